@@ -15,16 +15,30 @@
 #include "cpu_instructions/base/cleanup_instruction_set.h"
 
 #include <algorithm>
+#include <deque>
 #include <map>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 #include "strings/string.h"
 
+#include "cpu_instructions/util/fingerprint.h"
+#include "cpu_instructions/util/proto_fingerprint.h"
+#include "cpu_instructions/util/stage_profiler.h"
+#include "cpu_instructions/util/thread_pool.h"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 #include "src/google/protobuf/descriptor.h"
+#include "src/google/protobuf/field_mask.pb.h"
 #include "src/google/protobuf/io/zero_copy_stream_impl_lite.h"
 #include "src/google/protobuf/repeated_field.h"
+#include "src/google/protobuf/util/field_mask_util.h"
 #include "src/google/protobuf/util/message_differencer.h"
+#include "strings/str_cat.h"
+#include "strings/str_join.h"
+#include "strings/string_view.h"
 #include "util/gtl/map_util.h"
 #include "util/task/status.h"
 #include "util/task/status_macros.h"
@@ -36,22 +50,180 @@ DEFINE_bool(cpu_instructions_print_transform_names_to_log, true,
 DEFINE_bool(cpu_instructions_print_transform_diffs_to_log, false,
             "Print the names and the diffs of the instruction set before and "
             "after running each transform to the log.");
+DEFINE_int32(cpu_instructions_transform_num_threads, 1,
+             "The number of threads used to run the transforms of the default "
+             "pipeline that have the same rank and do not conflict, and to "
+             "process the instructions in per-instruction transforms.");
+DEFINE_bool(cpu_instructions_fuse_per_instruction_transforms, true,
+            "Run consecutive per-instruction transforms of the default "
+            "pipeline in a single pass over the instructions. Ignored when "
+            "--cpu_instructions_print_transform_diffs_to_log is set.");
 
 namespace cpu_instructions {
 
+using ::google::protobuf::Descriptor;
 using ::google::protobuf::FieldDescriptor;
+using ::google::protobuf::FieldMask;
 using ::google::protobuf::Message;
+using ::google::protobuf::Reflection;
+using ::google::protobuf::util::FieldMaskUtil;
 using ::google::protobuf::util::MessageDifferencer;
 using ::cpu_instructions::util::OkStatus;
 using ::cpu_instructions::util::Status;
 using ::cpu_instructions::util::StatusOr;
 
-using InstructionSetTransformOrder =
-    std::multimap<int, InstructionSetTransform>;
+InstructionSetTransformAccess& InstructionSetTransformAccess::Reads(
+    const std::vector<string>& fields) {
+  read_fields_.insert(read_fields_.end(), fields.begin(), fields.end());
+  return *this;
+}
+
+InstructionSetTransformAccess& InstructionSetTransformAccess::Writes(
+    const std::vector<string>& fields) {
+  written_fields_.insert(written_fields_.end(), fields.begin(), fields.end());
+  return *this;
+}
+
+InstructionSetTransformAccess& InstructionSetTransformAccess::OnlyMnemonics(
+    const std::vector<string>& mnemonics) {
+  mnemonics_.insert(mnemonics.begin(), mnemonics.end());
+  return *this;
+}
 
 namespace internal {
 namespace {
 
+// A path of fields starting at InstructionProto.
+using FieldPath = std::vector<const FieldDescriptor*>;
+
+// Parses a path of field names like "vendor_syntax.operands". Dies if the path
+// does not exist or if it goes through a repeated or non-message field.
+FieldPath ParseFieldPathOrDie(const string& path) {
+  FieldPath fields;
+  const Descriptor* descriptor = InstructionProto::descriptor();
+  size_t begin = 0;
+  while (true) {
+    CHECK(descriptor != nullptr)
+        << "Field path '" << path << "' goes through a non-message field";
+    const size_t end = std::min(path.find('.', begin), path.size());
+    const FieldDescriptor* const field =
+        descriptor->FindFieldByName(path.substr(begin, end - begin));
+    CHECK(field != nullptr) << "Unknown field path '" << path << "'";
+    fields.push_back(field);
+    if (end == path.size()) break;
+    CHECK(!field->is_repeated())
+        << "Field path '" << path << "' goes through a repeated field";
+    descriptor = field->message_type();
+    begin = end + 1;
+  }
+  return fields;
+}
+
+// Returns true if one of the paths is a prefix of the other one, i.e. if they
+// may refer to the same data.
+bool FieldPathsOverlap(const FieldPath& path_a, const FieldPath& path_b) {
+  const size_t length = std::min(path_a.size(), path_b.size());
+  return std::equal(path_a.begin(), path_a.begin() + length, path_b.begin());
+}
+
+bool AnyFieldPathsOverlap(const std::vector<FieldPath>& paths_a,
+                          const std::vector<FieldPath>& paths_b) {
+  for (const FieldPath& path_a : paths_a) {
+    for (const FieldPath& path_b : paths_b) {
+      if (FieldPathsOverlap(path_a, path_b)) return true;
+    }
+  }
+  return false;
+}
+
+// Returns true if the field at 'path' is set in 'message', i.e. if all the
+// messages on the path are present and the last field is set or not empty.
+bool HasFieldPath(const FieldPath& path, const Message& message) {
+  const Message* current = &message;
+  for (size_t i = 0; i + 1 < path.size(); ++i) {
+    const Reflection* const reflection = current->GetReflection();
+    if (!reflection->HasField(*current, path[i])) return false;
+    current = &reflection->GetMessage(*current, path[i]);
+  }
+  const Reflection* const reflection = current->GetReflection();
+  return path.back()->is_repeated()
+             ? reflection->FieldSize(*current, path.back()) > 0
+             : reflection->HasField(*current, path.back());
+}
+
+// Swaps the values of the field at 'path' between two instructions. Nothing is
+// done when the field is set in neither of them: creating the messages on the
+// path would change the instructions, e.g. switch the case of a oneof that
+// contains one of these messages.
+void SwapFieldPath(const FieldPath& path, Message* message_a,
+                   Message* message_b) {
+  if (!HasFieldPath(path, *message_a) && !HasFieldPath(path, *message_b)) {
+    return;
+  }
+  for (size_t i = 0; i + 1 < path.size(); ++i) {
+    const Reflection* const reflection = message_a->GetReflection();
+    message_a = reflection->MutableMessage(message_a, path[i]);
+    message_b = reflection->MutableMessage(message_b, path[i]);
+  }
+  message_a->GetReflection()->SwapFields(message_a, message_b, {path.back()});
+}
+
+constexpr char kMnemonicField[] = "vendor_syntax.mnemonic";
+
+const FieldPath& GetMnemonicFieldPath() {
+  static const FieldPath* const kMnemonicPath =
+      new FieldPath(ParseFieldPathOrDie(kMnemonicField));
+  return *kMnemonicPath;
+}
+
+// A transform registered for the default pipeline, with its parsed access
+// declaration.
+struct RegisteredTransform {
+  string name;
+  InstructionSetTransform transform;
+  // The raw transform, if it was registered as a per-instruction transform.
+  PerInstructionTransform per_instruction_transform;
+  // False if the transform was registered without an access declaration.
+  bool has_access = false;
+  // All the fields read or written by the transform.
+  std::vector<FieldPath> accessed_fields;
+  std::vector<FieldPath> written_fields;
+  // Empty if the transform may access all instructions.
+  std::unordered_set<string> mnemonics;
+  // The fields copied from the instructions accessed by the transform when it
+  // runs on a copy of the instruction set.
+  FieldMask copied_fields;
+};
+
+// Returns true if the result of running 'transform_a' and 'transform_b' might
+// depend on their order.
+bool TransformsConflict(const RegisteredTransform& transform_a,
+                        const RegisteredTransform& transform_b) {
+  if (!transform_a.has_access || !transform_b.has_access) return true;
+  // All transforms may read the mnemonics of all instructions.
+  const std::vector<FieldPath> mnemonic_path = {GetMnemonicFieldPath()};
+  if (AnyFieldPathsOverlap(mnemonic_path, transform_a.written_fields) ||
+      AnyFieldPathsOverlap(mnemonic_path, transform_b.written_fields)) {
+    return true;
+  }
+  if (!transform_a.mnemonics.empty() && !transform_b.mnemonics.empty()) {
+    bool have_common_mnemonic = false;
+    for (const string& mnemonic : transform_a.mnemonics) {
+      if (ContainsKey(transform_b.mnemonics, mnemonic)) {
+        have_common_mnemonic = true;
+        break;
+      }
+    }
+    if (!have_common_mnemonic) return false;
+  }
+  return AnyFieldPathsOverlap(transform_a.written_fields,
+                              transform_b.accessed_fields) ||
+         AnyFieldPathsOverlap(transform_b.written_fields,
+                              transform_a.accessed_fields);
+}
+
+using InstructionSetTransformOrder = std::multimap<int, RegisteredTransform>;
+
 InstructionSetTransformsByName* GetMutableTransformsByName() {
   static InstructionSetTransformsByName* const transforms_by_name =
       new InstructionSetTransformsByName();
@@ -64,9 +236,21 @@ InstructionSetTransformOrder* GetMutableDefaultTransformOrder() {
   return transforms_order;
 }
 
+std::unordered_map<string, InstructionSetTransformAccess>*
+GetMutableTransformAccesses() {
+  static auto* const accesses =
+      new std::unordered_map<string, InstructionSetTransformAccess>();
+  return accesses;
+}
+
+std::unordered_map<string, int>* GetMutableTransformVersions() {
+  static auto* const versions = new std::unordered_map<string, int>();
+  return versions;
+}
+
 Status RunSingleTransform(
     const string& transform_name,
-    InstructionSetTransformRawFunction* transform_function,
+    const InstructionSetTransform& transform_function,
     InstructionSetProto* instruction_set) {
   CHECK(transform_function != nullptr);
   CHECK(instruction_set != nullptr);
@@ -74,6 +258,7 @@ Status RunSingleTransform(
       FLAGS_cpu_instructions_print_transform_diffs_to_log) {
     LOG(INFO) << "Running: " << transform_name;
   }
+  ScopedStageTimer timer(transform_name);
   Status transform_status = OkStatus();
   if (FLAGS_cpu_instructions_print_transform_diffs_to_log) {
     const StatusOr<string> diff_or_status =
@@ -95,14 +280,208 @@ Status RunSingleTransform(
     const char* const status = transform_status.ok() ? "Success: " : "Failed: ";
     LOG(INFO) << status << transform_name;
   }
+  timer.AddItems("instructions", instruction_set->instructions_size());
   return transform_status;
 }
 
-}  // namespace
+#ifndef NDEBUG
+// Clears the field at 'path' in 'message', and then the messages on the path
+// that became empty.
+void ClearFieldPath(const FieldPath& path, Message* message) {
+  if (!HasFieldPath(path, *message)) return;
+  std::vector<Message*> messages = {message};
+  for (size_t i = 0; i + 1 < path.size(); ++i) {
+    messages.push_back(messages.back()->GetReflection()->MutableMessage(
+        messages.back(), path[i]));
+  }
+  for (size_t i = path.size(); i-- > 0;) {
+    Message* const parent = messages[i];
+    if (i + 1 < path.size() && messages[i + 1]->ByteSizeLong() > 0) break;
+    parent->GetReflection()->ClearField(parent, path[i]);
+  }
+}
 
-RegisterInstructionSetTransform::RegisterInstructionSetTransform(
-    const string& transform_name, int rank_in_default_pipeline,
-    InstructionSetTransformRawFunction transform) {
+// CHECK-fails if 'transform' changed 'copy' outside of the fields it declares
+// as written, or outside of the instructions it may access. 'scope' is the
+// list of the indices of the instructions it may access, in increasing order.
+// The fields swapped back into the instruction set are only those declared as
+// written, so other changes would be silently lost.
+void CheckOnlyWrittenFieldsChanged(const RegisteredTransform& transform,
+                                   const std::vector<int>& scope,
+                                   const InstructionSetProto& original_copy,
+                                   const InstructionSetProto& copy) {
+  auto next_in_scope = scope.begin();
+  for (int i = 0; i < copy.instructions_size(); ++i) {
+    InstructionProto original = original_copy.instructions(i);
+    InstructionProto transformed = copy.instructions(i);
+    if (next_in_scope != scope.end() && *next_in_scope == i) {
+      ++next_in_scope;
+      for (const FieldPath& path : transform.written_fields) {
+        ClearFieldPath(path, &original);
+        ClearFieldPath(path, &transformed);
+      }
+    }
+    string differences;
+    MessageDifferencer differencer;
+    differencer.ReportDifferencesToString(&differences);
+    CHECK(differencer.Compare(original, transformed))
+        << "Transform " << transform.name
+        << " changed fields it does not declare as written in instruction "
+        << i << ":\n"
+        << differences;
+  }
+}
+#endif  // NDEBUG
+
+// Runs a group of transforms that do not conflict with each other. One
+// transform that may access all instructions (or the first one if there is no
+// such transform) runs directly on 'instruction_set', the others run on copies
+// that hold only the instructions they access, and the fields they write are
+// then swapped into 'instruction_set'.
+Status RunNonConflictingTransforms(
+    int num_threads, const std::vector<const RegisteredTransform*>& group,
+    InstructionSetProto* instruction_set) {
+  if (group.size() == 1) return group[0]->transform(instruction_set);
+  size_t in_place = 0;
+  for (size_t i = 0; i < group.size(); ++i) {
+    if (group[i]->mnemonics.empty()) {
+      in_place = i;
+      break;
+    }
+  }
+  const int num_instructions = instruction_set->instructions_size();
+  FieldMask mnemonic_field;
+  mnemonic_field.add_paths(kMnemonicField);
+  const FieldMaskUtil::MergeOptions merge_options;
+  // The copies and the indices of the instructions accessed by each transform
+  // are computed before any of the transforms runs. The copies contain only
+  // the fields the transforms may access, so that a transform reading a field
+  // it does not declare gets different results than in the serial pipeline.
+  std::vector<std::vector<int>> scopes(group.size());
+  std::vector<InstructionSetProto> copies(group.size());
+  for (size_t i = 0; i < group.size(); ++i) {
+    if (i == in_place) continue;
+    const RegisteredTransform& transform = *group[i];
+    InstructionSetProto& copy = copies[i];
+    copy.mutable_instructions()->Reserve(num_instructions);
+    for (int j = 0; j < num_instructions; ++j) {
+      const InstructionProto& instruction = instruction_set->instructions(j);
+      InstructionProto* const instruction_copy = copy.add_instructions();
+      if (transform.mnemonics.empty() ||
+          ContainsKey(transform.mnemonics,
+                      instruction.vendor_syntax().mnemonic())) {
+        FieldMaskUtil::MergeMessageTo(instruction, transform.copied_fields,
+                                      merge_options, instruction_copy);
+        scopes[i].push_back(j);
+      } else {
+        FieldMaskUtil::MergeMessageTo(instruction, mnemonic_field,
+                                      merge_options, instruction_copy);
+      }
+    }
+  }
+#ifndef NDEBUG
+  const std::vector<InstructionSetProto> original_copies = copies;
+#endif  // NDEBUG
+  std::vector<Status> statuses(group.size());
+  ParallelFor(num_threads, group.size(), [&](size_t i) {
+    statuses[i] =
+        group[i]->transform(i == in_place ? instruction_set : &copies[i]);
+  });
+  for (const Status& status : statuses) RETURN_IF_ERROR(status);
+  CHECK_EQ(instruction_set->instructions_size(), num_instructions)
+      << "Transform " << group[in_place]->name
+      << " changed the list of instructions";
+  for (size_t i = 0; i < group.size(); ++i) {
+    if (i == in_place) continue;
+    CHECK_EQ(copies[i].instructions_size(), num_instructions)
+        << "Transform " << group[i]->name
+        << " changed the list of instructions";
+#ifndef NDEBUG
+    CheckOnlyWrittenFieldsChanged(*group[i], scopes[i], original_copies[i],
+                                  copies[i]);
+#endif  // NDEBUG
+    for (const int index : scopes[i]) {
+      for (const FieldPath& path : group[i]->written_fields) {
+        SwapFieldPath(path, instruction_set->mutable_instructions(index),
+                      copies[i].mutable_instructions(index));
+      }
+    }
+  }
+  return OkStatus();
+}
+
+// Runs 'transforms' with the same result as running them one by one in the
+// given order. Each transform runs after all the transforms before it that it
+// conflicts with; transforms without an access declaration run alone.
+Status RunTransformsInParallel(
+    int num_threads, const std::vector<const RegisteredTransform*>& transforms,
+    InstructionSetProto* instruction_set) {
+  size_t begin = 0;
+  while (begin < transforms.size()) {
+    if (!transforms[begin]->has_access) {
+      RETURN_IF_ERROR(transforms[begin]->transform(instruction_set));
+      ++begin;
+      continue;
+    }
+    size_t end = begin;
+    while (end < transforms.size() && transforms[end]->has_access) ++end;
+    // Assigns each transform to the first group after all the groups of the
+    // transforms it conflicts with.
+    std::vector<std::vector<const RegisteredTransform*>> groups;
+    std::vector<size_t> group_indices(end - begin, 0);
+    for (size_t i = begin; i < end; ++i) {
+      size_t& group_index = group_indices[i - begin];
+      for (size_t j = begin; j < i; ++j) {
+        if (TransformsConflict(*transforms[i], *transforms[j])) {
+          group_index = std::max(group_index, group_indices[j - begin] + 1);
+        }
+      }
+      if (group_index == groups.size()) groups.emplace_back();
+      groups[group_index].push_back(transforms[i]);
+    }
+    for (const auto& group : groups) {
+      RETURN_IF_ERROR(
+          RunNonConflictingTransforms(num_threads, group, instruction_set));
+    }
+    begin = end;
+  }
+  return OkStatus();
+}
+
+// Returns the name of a pipeline step that runs all transforms from 'run'.
+string GetStepName(const std::vector<const RegisteredTransform*>& run) {
+  std::vector<string> names;
+  for (const RegisteredTransform* const transform : run) {
+    names.push_back(transform->name);
+  }
+  return strings::Join(names, kStepNameSeparator);
+}
+
+// Fuses a run of consecutive per-instruction transforms into a single transform
+// that applies all of them to each instruction before moving to the next one.
+InstructionSetTransform FusePerInstructionTransforms(
+    const std::vector<const RegisteredTransform*>& run) {
+  std::vector<PerInstructionTransform> per_instruction_transforms;
+  for (const RegisteredTransform* const transform : run) {
+    CHECK(transform->per_instruction_transform != nullptr);
+    per_instruction_transforms.push_back(transform->per_instruction_transform);
+  }
+  const string fused_name = GetStepName(run);
+  const InstructionSetTransform fused_transform =
+      [per_instruction_transforms](InstructionSetProto* instruction_set) {
+        return RunPerInstructionTransforms(per_instruction_transforms,
+                                           instruction_set);
+      };
+  return [fused_name, fused_transform](InstructionSetProto* instruction_set) {
+    return RunSingleTransform(fused_name, fused_transform, instruction_set);
+  };
+}
+
+void RegisterTransform(const string& transform_name,
+                       int rank_in_default_pipeline,
+                       const InstructionSetTransform& transform,
+                       const PerInstructionTransform& per_instruction_transform,
+                       const InstructionSetTransformAccess* access) {
   InstructionSetTransformsByName& transforms_by_name =
       *GetMutableTransformsByName();
   CHECK(!ContainsKey(transforms_by_name, transform_name))
@@ -112,25 +491,156 @@ RegisterInstructionSetTransform::RegisterInstructionSetTransform(
         return RunSingleTransform(transform_name, transform, instruction_set);
       };
   transforms_by_name[transform_name] = transform_wrapper;
+  RegisteredTransform registered_transform;
+  registered_transform.name = transform_name;
+  registered_transform.transform = transform_wrapper;
+  registered_transform.per_instruction_transform = per_instruction_transform;
+  if (access != nullptr) {
+    (*GetMutableTransformAccesses())[transform_name] = *access;
+    registered_transform.has_access = true;
+    for (const string& field : access->read_fields()) {
+      registered_transform.accessed_fields.push_back(
+          ParseFieldPathOrDie(field));
+    }
+    for (const string& field : access->written_fields()) {
+      registered_transform.accessed_fields.push_back(
+          ParseFieldPathOrDie(field));
+      registered_transform.written_fields.push_back(ParseFieldPathOrDie(field));
+    }
+    FieldMask& copied_fields = registered_transform.copied_fields;
+    copied_fields.add_paths(kMnemonicField);
+    for (const string& field : access->read_fields()) {
+      copied_fields.add_paths(field);
+    }
+    for (const string& field : access->written_fields()) {
+      copied_fields.add_paths(field);
+    }
+    registered_transform.mnemonics = access->mnemonics();
+  }
   if (rank_in_default_pipeline != kNotInDefaultPipeline) {
     GetMutableDefaultTransformOrder()->emplace(rank_in_default_pipeline,
-                                               transform_wrapper);
+                                               registered_transform);
   }
 }
 
+}  // namespace
+
+RegisterInstructionSetTransform::RegisterInstructionSetTransform(
+    const string& transform_name, int rank_in_default_pipeline,
+    InstructionSetTransformRawFunction transform) {
+  RegisterTransform(transform_name, rank_in_default_pipeline, transform,
+                    nullptr, nullptr);
+}
+
+RegisterInstructionSetTransform::RegisterInstructionSetTransform(
+    const string& transform_name, int rank_in_default_pipeline,
+    InstructionSetTransformRawFunction transform,
+    const InstructionSetTransformAccess& access) {
+  RegisterTransform(transform_name, rank_in_default_pipeline, transform,
+                    nullptr, &access);
+}
+
+RegisterInstructionSetTransform::RegisterInstructionSetTransform(
+    const string& transform_name, int rank_in_default_pipeline,
+    PerInstructionTransformRawFunction transform) {
+  RegisterTransform(transform_name, rank_in_default_pipeline,
+                    [transform](InstructionSetProto* instruction_set) {
+                      return RunPerInstructionTransform(transform,
+                                                        instruction_set);
+                    },
+                    transform, nullptr);
+}
+
+RegisterInstructionSetTransform::RegisterInstructionSetTransform(
+    const string& transform_name, int rank_in_default_pipeline,
+    PerInstructionTransformRawFunction transform,
+    const InstructionSetTransformAccess& access) {
+  RegisterTransform(transform_name, rank_in_default_pipeline,
+                    [transform](InstructionSetProto* instruction_set) {
+                      return RunPerInstructionTransform(transform,
+                                                        instruction_set);
+                    },
+                    transform, &access);
+}
+
+RegisterInstructionSetTransformVersion::RegisterInstructionSetTransformVersion(
+    const string& transform_name, int version) {
+  CHECK_GE(version, 0);
+  CHECK(InsertIfNotPresent(GetMutableTransformVersions(), transform_name,
+                           version))
+      << "The version of transform '" << transform_name
+      << "' is already registered!";
+}
+
 }  // namespace internal
 
 const InstructionSetTransformsByName& GetTransformsByName() {
   return *internal::GetMutableTransformsByName();
 }
 
+const InstructionSetTransformAccess* GetTransformAccessOrNull(
+    const string& transform_name) {
+  return FindOrNull(*internal::GetMutableTransformAccesses(), transform_name);
+}
+
+int GetTransformVersion(const string& transform_name) {
+  return FindWithDefault(*internal::GetMutableTransformVersions(),
+                         transform_name, 0);
+}
+
+std::vector<NamedInstructionSetTransform> GetDefaultNamedTransformPipeline() {
+  const internal::InstructionSetTransformOrder&
+      default_pipeline_transforms_order =
+          *internal::GetMutableDefaultTransformOrder();
+  const int num_threads = FLAGS_cpu_instructions_transform_num_threads;
+  // Fusing the transforms would also merge their diffs.
+  const bool fuse_transforms =
+      FLAGS_cpu_instructions_fuse_per_instruction_transforms &&
+      !FLAGS_cpu_instructions_print_transform_diffs_to_log;
+  const auto is_fusable = [fuse_transforms](
+      const internal::RegisteredTransform& transform) {
+    return fuse_transforms && transform.per_instruction_transform != nullptr;
+  };
+  std::vector<NamedInstructionSetTransform> transforms;
+  transforms.reserve(default_pipeline_transforms_order.size());
+  for (auto it = default_pipeline_transforms_order.begin();
+       it != default_pipeline_transforms_order.end();) {
+    // Collects either a run of consecutive fusable transforms, possibly with
+    // different ranks, or a run of other transforms with the same rank.
+    const int rank = it->first;
+    const bool fusable = is_fusable(it->second);
+    std::vector<const internal::RegisteredTransform*> run;
+    for (; it != default_pipeline_transforms_order.end() &&
+           is_fusable(it->second) == fusable && (fusable || it->first == rank);
+         ++it) {
+      run.push_back(&it->second);
+    }
+    if (run.size() == 1) {
+      transforms.push_back({run.front()->name, run.front()->transform});
+    } else if (fusable) {
+      transforms.push_back({internal::GetStepName(run),
+                            internal::FusePerInstructionTransforms(run)});
+    } else if (num_threads <= 1) {
+      for (const internal::RegisteredTransform* transform : run) {
+        transforms.push_back({transform->name, transform->transform});
+      }
+    } else {
+      transforms.push_back(
+          {internal::GetStepName(run),
+           [num_threads, run](InstructionSetProto* instruction_set) {
+             return internal::RunTransformsInParallel(num_threads, run,
+                                                      instruction_set);
+           }});
+    }
+  }
+  return transforms;
+}
+
 std::vector<InstructionSetTransform> GetDefaultTransformPipeline() {
-  const InstructionSetTransformOrder& default_pipeline_transforms_order =
-      *internal::GetMutableDefaultTransformOrder();
   std::vector<InstructionSetTransform> transforms;
-  transforms.reserve(default_pipeline_transforms_order.size());
-  for (const auto& element : default_pipeline_transforms_order) {
-    transforms.push_back(element.second);
+  for (const NamedInstructionSetTransform& step :
+       GetDefaultNamedTransformPipeline()) {
+    transforms.push_back(step.transform);
   }
   return transforms;
 }
@@ -146,61 +656,281 @@ Status RunTransformPipeline(
   return OkStatus();
 }
 
+Status RunPerInstructionTransform(const PerInstructionTransform& transform,
+                                  InstructionSetProto* instruction_set) {
+  return RunPerInstructionTransforms({transform}, instruction_set);
+}
+
+Status RunPerInstructionTransforms(
+    const std::vector<PerInstructionTransform>& transforms,
+    InstructionSetProto* instruction_set) {
+  CHECK(instruction_set != nullptr);
+  for (const PerInstructionTransform& transform : transforms) {
+    CHECK(transform != nullptr);
+  }
+  ::google::protobuf::RepeatedPtrField<InstructionProto>* const instructions =
+      instruction_set->mutable_instructions();
+  // For each instruction, the index of the first transform that failed on it
+  // and its error. Keeping them per instruction makes the returned error
+  // independent of the order in which the threads process the instructions.
+  std::vector<std::pair<size_t, Status>> failures(
+      instructions->size(), std::make_pair(transforms.size(), OkStatus()));
+  ParallelFor(FLAGS_cpu_instructions_transform_num_threads,
+              instructions->size(), [&](size_t i) {
+                InstructionProto* const instruction = instructions->Mutable(i);
+                for (size_t j = 0; j < transforms.size(); ++j) {
+                  Status status = transforms[j](instruction);
+                  if (!status.ok()) {
+                    failures[i] = std::make_pair(j, std::move(status));
+                    return;
+                  }
+                }
+              });
+  // Running the transforms one by one would stop after the first transform
+  // that failed, and return its error on the first instruction.
+  const std::pair<size_t, Status>* first_failure = nullptr;
+  for (const auto& failure : failures) {
+    if (failure.first < transforms.size() &&
+        (first_failure == nullptr || failure.first < first_failure->first)) {
+      first_failure = &failure;
+    }
+  }
+  return first_failure == nullptr ? OkStatus() : first_failure->second;
+}
+
+namespace {
+
 // A message difference reporter that reports the differences to a string, and
-// ignores all matched & moved items.
+// ignores all matched & moved items. When 'path_prefix' is not empty, it is
+// prepended to the paths of all reported fields; this is used to report the
+// differences between two instructions as differences in the instruction set.
 class ConciseDifferenceReporter : public MessageDifferencer::Reporter {
  public:
-  explicit ConciseDifferenceReporter(string* output_string)
-      : stream_(output_string), base_reporter_(&stream_) {}
+  ConciseDifferenceReporter(
+      string* output_string,
+      std::vector<MessageDifferencer::SpecificField> path_prefix)
+      : stream_(output_string),
+        base_reporter_(&stream_),
+        path_prefix_(std::move(path_prefix)) {}
 
   void ReportAdded(const Message& message1, const Message& message2,
                    const std::vector<MessageDifferencer::SpecificField>&
                        field_path) override {
-    base_reporter_.ReportAdded(message1, message2, field_path);
+    base_reporter_.ReportAdded(message1, message2, WithPrefix(field_path));
   }
   void ReportDeleted(const Message& message1, const Message& message2,
                      const std::vector<MessageDifferencer::SpecificField>&
                          field_path) override {
-    base_reporter_.ReportDeleted(message1, message2, field_path);
+    base_reporter_.ReportDeleted(message1, message2, WithPrefix(field_path));
   }
   void ReportModified(const Message& message1, const Message& message2,
                       const std::vector<MessageDifferencer::SpecificField>&
                           field_path) override {
-    base_reporter_.ReportModified(message1, message2, field_path);
+    base_reporter_.ReportModified(message1, message2, WithPrefix(field_path));
   }
 
  private:
+  std::vector<MessageDifferencer::SpecificField> WithPrefix(
+      const std::vector<MessageDifferencer::SpecificField>& field_path) const {
+    std::vector<MessageDifferencer::SpecificField> full_path = path_prefix_;
+    full_path.insert(full_path.end(), field_path.begin(), field_path.end());
+    return full_path;
+  }
+
   ::google::protobuf::io::StringOutputStream stream_;
   MessageDifferencer::StreamReporter base_reporter_;
+  const std::vector<MessageDifferencer::SpecificField> path_prefix_;
+};
+
+// Compares 'message1' and 'message2', and appends the differences to 'output'.
+void AppendDifferences(
+    const Message& message1, const Message& message2,
+    const std::vector<MessageDifferencer::SpecificField>& path_prefix,
+    string* output) {
+  // NOTE(ondrasej): The reporter flushes the remaining changes to 'output' in
+  // its destructor, so it must be destroyed before 'output' is used again.
+  MessageDifferencer differencer;
+  ConciseDifferenceReporter reporter(output, path_prefix);
+  differencer.ReportDifferencesTo(&reporter);
+  // NOTE(ondrasej): We are only interested in the string diff; we can safely
+  // ignore the return value saying whether the two are equivalent or not.
+  differencer.Compare(message1, message2);
+}
+
+// Appends a report of an instruction that was added or deleted as a whole, in
+// the format used by MessageDifferencer::StreamReporter.
+void AppendInstructionReport(const char* change, int index,
+                             const InstructionProto& instruction,
+                             string* output) {
+  const string text = instruction.ShortDebugString();
+  StrAppend(output, StrCat(change, ": instructions[", index, "]: ",
+                           text.empty() ? "{ }" : StrCat("{ ", text, " }"),
+                           "\n"));
+}
+
+// The deterministic serializations of the instructions of an instruction set,
+// stored in a single buffer, and their fingerprints. This is much cheaper than
+// a copy of the instruction set, and it is enough to find the instructions
+// changed by a transform and to restore their original versions.
+class SerializedInstructions {
+ public:
+  explicit SerializedInstructions(const InstructionSetProto& instruction_set) {
+    const int num_instructions = instruction_set.instructions_size();
+    offsets_.reserve(num_instructions + 1);
+    fingerprints_.reserve(num_instructions);
+    offsets_.push_back(0);
+    for (const InstructionProto& instruction : instruction_set.instructions()) {
+      AppendDeterministicSerialization(instruction, &buffer_);
+      offsets_.push_back(buffer_.size());
+      fingerprints_.push_back(Fingerprint(bytes(fingerprints_.size())));
+    }
+  }
+
+  int size() const { return fingerprints_.size(); }
+  uint64_t fingerprint(int index) const { return fingerprints_[index]; }
+  StringPiece bytes(int index) const {
+    return StringPiece(buffer_.data() + offsets_[index],
+                       offsets_[index + 1] - offsets_[index]);
+  }
+  InstructionProto ParseInstruction(int index) const {
+    InstructionProto instruction;
+    const StringPiece serialized = bytes(index);
+    CHECK(instruction.ParseFromArray(serialized.data(), serialized.size()));
+    return instruction;
+  }
+
+ private:
+  string buffer_;
+  // The serialization of the i-th instruction is between offsets_[i] and
+  // offsets_[i + 1] in buffer_.
+  std::vector<size_t> offsets_;
+  std::vector<uint64_t> fingerprints_;
 };
 
+// Swaps the instructions of 'instruction_set' with 'instructions'. Used to
+// copy or compare the other fields of the instruction set without touching the
+// instructions.
+void SwapInstructions(
+    InstructionSetProto* instruction_set,
+    ::google::protobuf::RepeatedPtrField<InstructionProto>* instructions) {
+  instruction_set->mutable_instructions()->Swap(instructions);
+}
+
+}  // namespace
+
 StatusOr<string> RunTransformWithDiff(const InstructionSetTransform& transform,
                                       InstructionSetProto* instruction_set) {
   CHECK(instruction_set != nullptr);
-  InstructionSetProto original_instruction_set = *instruction_set;
+  ::google::protobuf::RepeatedPtrField<InstructionProto> instructions;
+  // Only the fields other than the instructions are copied; the instructions
+  // are compared through their fingerprints.
+  InstructionSetProto original_header;
+  SwapInstructions(instruction_set, &instructions);
+  original_header = *instruction_set;
+  SwapInstructions(instruction_set, &instructions);
+  const SerializedInstructions original_instructions(*instruction_set);
 
   RETURN_IF_ERROR(transform(instruction_set));
 
+  const SerializedInstructions new_instructions(*instruction_set);
   string differences;
-  {
-    // NOTE(ondrasej): The block here is necessary because the differencer and
-    // the reporter must be destroyed before the return value is constructed.
-    // Otherwise, the compiler would use move semantics and move the contents of
-    // 'differences' of it before the reporter flushes the remaining changes in
-    // the destructor. The only way to force this flush is to force the
-    // destruction of the objects before the return value is constructed.
-    MessageDifferencer differencer;
-    ConciseDifferenceReporter reporter(&differences);
-    differencer.ReportDifferencesTo(&reporter);
+  SwapInstructions(instruction_set, &instructions);
+  AppendDifferences(original_header, *instruction_set, {}, &differences);
+  SwapInstructions(instruction_set, &instructions);
+
+  // The instructions are compared as a multiset: an instruction is unchanged
+  // if it has an identical counterpart, regardless of its position.
+  std::unordered_multimap<uint64_t, int> original_by_fingerprint;
+  for (int i = 0; i < original_instructions.size(); ++i) {
+    original_by_fingerprint.emplace(original_instructions.fingerprint(i), i);
+  }
+  std::vector<bool> original_matched(original_instructions.size(), false);
+  std::vector<bool> new_matched(new_instructions.size(), false);
+  for (int i = 0; i < new_instructions.size(); ++i) {
+    auto range =
+        original_by_fingerprint.equal_range(new_instructions.fingerprint(i));
+    for (auto it = range.first; it != range.second; ++it) {
+      if (original_instructions.bytes(it->second) ==
+          new_instructions.bytes(i)) {
+        original_matched[it->second] = true;
+        new_matched[i] = true;
+        original_by_fingerprint.erase(it);
+        break;
+      }
+    }
+  }
 
-    const FieldDescriptor* const instructions_field =
-        instruction_set->GetDescriptor()->FindFieldByName("instructions");
-    CHECK(instructions_field != nullptr);
-    differencer.TreatAsSet(instructions_field);
+  // The unmatched instructions were modified, deleted or added. An original
+  // instruction and a new instruction are paired as a modification if they
+  // have the same mnemonic and encoding specification; instructions with the
+  // same key are paired in order. If the transform changed the keys, but not
+  // the number of the instructions, the remaining instructions are paired in
+  // order. Everything else is reported as deleted or added.
+  const auto get_key = [](const InstructionProto& instruction) {
+    return StrCat(instruction.vendor_syntax().mnemonic(), "\t",
+                  instruction.raw_encoding_specification());
+  };
+  std::vector<int> unmatched_originals;
+  std::vector<InstructionProto> unmatched_original_protos;
+  std::unordered_map<string, std::deque<int>> unpaired_originals_by_key;
+  for (int i = 0; i < original_instructions.size(); ++i) {
+    if (original_matched[i]) continue;
+    InstructionProto original = original_instructions.ParseInstruction(i);
+    unpaired_originals_by_key[get_key(original)].push_back(
+        unmatched_originals.size());
+    unmatched_originals.push_back(i);
+    unmatched_original_protos.push_back(std::move(original));
+  }
+  // paired_new[k] is the index of the new instruction paired with
+  // unmatched_originals[k], or -1 if the original instruction was deleted.
+  std::vector<int> paired_new(unmatched_originals.size(), -1);
+  std::vector<int> unpaired_news;
+  for (int i = 0; i < new_instructions.size(); ++i) {
+    if (new_matched[i]) continue;
+    std::deque<int>* const originals =
+        FindOrNull(unpaired_originals_by_key,
+                   get_key(instruction_set->instructions(i)));
+    if (originals == nullptr || originals->empty()) {
+      unpaired_news.push_back(i);
+      continue;
+    }
+    paired_new[originals->front()] = i;
+    originals->pop_front();
+  }
+  std::vector<int> unpaired_originals;
+  for (size_t k = 0; k < unmatched_originals.size(); ++k) {
+    if (paired_new[k] < 0) unpaired_originals.push_back(k);
+  }
+  if (unpaired_originals.size() == unpaired_news.size()) {
+    for (size_t k = 0; k < unpaired_originals.size(); ++k) {
+      paired_new[unpaired_originals[k]] = unpaired_news[k];
+    }
+    unpaired_news.clear();
+  }
 
-    // NOTE(ondrasej): We are only interested in the string diff; we can safely
-    // ignore the return value saying whether the two are equivalent or not.
-    differencer.Compare(original_instruction_set, *instruction_set);
+  const FieldDescriptor* const instructions_field =
+      instruction_set->GetDescriptor()->FindFieldByName("instructions");
+  CHECK(instructions_field != nullptr);
+  for (size_t k = 0; k < unmatched_originals.size(); ++k) {
+    const int original_index = unmatched_originals[k];
+    const int new_index = paired_new[k];
+    if (new_index < 0) {
+      AppendInstructionReport("deleted", original_index,
+                              unmatched_original_protos[k], &differences);
+      continue;
+    }
+    MessageDifferencer::SpecificField instruction_field;
+    instruction_field.field = instructions_field;
+    instruction_field.index = original_index;
+    instruction_field.new_index = new_index;
+    AppendDifferences(unmatched_original_protos[k],
+                      instruction_set->instructions(new_index),
+                      {instruction_field}, &differences);
+  }
+  for (const int new_index : unpaired_news) {
+    AppendInstructionReport("added", new_index,
+                            instruction_set->instructions(new_index),
+                            &differences);
   }
 
   return differences;
@@ -21,6 +21,7 @@
 #include <functional>
 #include <limits>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include "strings/string.h"
 
@@ -40,6 +41,13 @@ using ::cpu_instructions::util::StatusOr;
 using InstructionSetTransformRawFunction = Status(InstructionSetProto*);
 using InstructionSetTransform = std::function<Status(InstructionSetProto*)>;
 
+// The type of the transforms that process each instruction independently of
+// the other instructions. Such transforms may modify only the instruction they
+// are given, and they may not add or remove instructions; they are registered
+// using REGISTER_PER_INSTRUCTION_TRANSFORM.
+using PerInstructionTransformRawFunction = Status(InstructionProto*);
+using PerInstructionTransform = std::function<Status(InstructionProto*)>;
+
 // The list of instruction database transforms indexed by their names.
 using InstructionSetTransformsByName =
     std::unordered_map<string, InstructionSetTransform>;
@@ -47,6 +55,60 @@ using InstructionSetTransformsByName =
 // Returns the list of all available transforms, indexed by their names.
 const InstructionSetTransformsByName& GetTransformsByName();
 
+// A step of a transform pipeline with its name. A step may run several
+// transforms (see GetDefaultTransformPipeline); its name is then the names of
+// these transforms in the order in which they would run one by one, joined by
+// kStepNameSeparator.
+struct NamedInstructionSetTransform {
+  string name;
+  InstructionSetTransform transform;
+};
+constexpr char kStepNameSeparator[] = "+";
+
+// Describes the parts of the instruction set that a transform accesses. Fields
+// are given as paths of field names relative to InstructionProto, e.g.
+// "raw_encoding_specification" or "vendor_syntax.operands"; all fields on the
+// path except the last one must be singular message fields. A transform with
+// an access declaration may read the vendor syntax mnemonic of all
+// instructions, and read and write the fields it declares in the instructions
+// whose mnemonic is in the declared set (or in all instructions when no set is
+// given). It must not add, remove or reorder instructions, or touch any other
+// data.
+//
+// Usage:
+//   InstructionSetTransformAccess()
+//       .Reads({"vendor_syntax.operands"})
+//       .Writes({"raw_encoding_specification"})
+//       .OnlyMnemonics({"XBEGIN"})
+class InstructionSetTransformAccess {
+ public:
+  InstructionSetTransformAccess& Reads(const std::vector<string>& fields);
+  InstructionSetTransformAccess& Writes(const std::vector<string>& fields);
+  InstructionSetTransformAccess& OnlyMnemonics(
+      const std::vector<string>& mnemonics);
+
+  const std::vector<string>& read_fields() const { return read_fields_; }
+  const std::vector<string>& written_fields() const { return written_fields_; }
+  // The mnemonics of the instructions accessed by the transform. When empty,
+  // the transform may access all instructions.
+  const std::unordered_set<string>& mnemonics() const { return mnemonics_; }
+
+ private:
+  std::vector<string> read_fields_;
+  std::vector<string> written_fields_;
+  std::unordered_set<string> mnemonics_;
+};
+
+// Returns the version of the transform 'transform_name' declared with
+// REGISTER_INSTRUCTION_SET_TRANSFORM_VERSION, or 0 if it has no declared
+// version.
+int GetTransformVersion(const string& transform_name);
+
+// Returns the access declaration of the transform 'transform_name', or nullptr
+// if the transform was registered without one.
+const InstructionSetTransformAccess* GetTransformAccessOrNull(
+    const string& transform_name);
+
 // Returns the default sequence of transforms that need to be applied to the
 // data from the Intel manual to clean them up and transform them into a format
 // suitable for machine processing. The values in the vector are pointers to
@@ -55,12 +117,33 @@ const InstructionSetTransformsByName& GetTransformsByName();
 // Note that some of the transforms expect that another transform was already
 // executed, and they might not function correctly if this assumption is
 // violated. The vector contains the transforms in the correct order.
+//
+// When --cpu_instructions_transform_num_threads is greater than one, the
+// transforms with the same rank are replaced by a single transform that runs
+// those that do not conflict in parallel, based on their access declarations.
+// Transforms that conflict keep their relative order, and transforms without
+// a declaration run alone, so the result is the same as with a single thread.
+//
+// When --cpu_instructions_fuse_per_instruction_transforms is true, consecutive
+// per-instruction transforms are replaced by a single transform that runs all
+// of them on each instruction before moving to the next one (see
+// RunPerInstructionTransforms). Such transforms do not take part in the
+// parallel scheduling above; they are already parallelized by instructions.
 std::vector<InstructionSetTransform> GetDefaultTransformPipeline();
 
+// Same as GetDefaultTransformPipeline, but also returns the names of the steps.
+std::vector<NamedInstructionSetTransform> GetDefaultNamedTransformPipeline();
+
 // Runs the given transform on the given instruction set proto, and computes a
 // diff of the changes made by the transform. The changes are returned as a
 // human-readable string; the returned string is empty if and only if the
-// transform did not make any changes to the proto.
+// transform did not make any changes to the proto. The instructions are
+// compared as a multiset using their fingerprints, so that moving instructions
+// is not reported. A changed instruction is reported field by field when it
+// can be paired with an original instruction with the same mnemonic and
+// encoding specification, or when the transform did not change the number of
+// changed instructions; the other changed instructions are reported as deleted
+// or added.
 StatusOr<string> RunTransformWithDiff(const InstructionSetTransform& transform,
                                       InstructionSetProto* instruction_set);
 
@@ -72,6 +155,27 @@ Status RunTransformPipeline(
     const std::vector<InstructionSetTransform>& pipeline,
     InstructionSetProto* instruction_set);
 
+// Runs 'transform' on all instructions of 'instruction_set'. The instructions
+// are distributed among --cpu_instructions_transform_num_threads threads. The
+// transform is applied to all instructions even if it fails on some of them;
+// the returned status is the error of the instruction with the lowest index,
+// or OK if the transform succeeded on all of them. The result thus does not
+// depend on the number of threads.
+Status RunPerInstructionTransform(const PerInstructionTransform& transform,
+                                  InstructionSetProto* instruction_set);
+
+// Runs all 'transforms' on each instruction of 'instruction_set' in a single
+// pass: each instruction goes through the transforms in the given order before
+// the next instruction is processed. When all transforms succeed, the result is
+// the same as when running them one by one with RunPerInstructionTransform.
+// The returned status is also the same: it is the error of the first failing
+// transform on the instruction with the lowest index. The instruction set after
+// an error is not: the remaining transforms are not applied to the failing
+// instruction, but they are applied to all the other instructions.
+Status RunPerInstructionTransforms(
+    const std::vector<PerInstructionTransform>& transforms,
+    InstructionSetProto* instruction_set);
+
 // Sorts the instructions by their vendor syntax. The sorting criteria are:
 // 1. The mnemonic (lexicographical order),
 // 2. The number of operands (instructions with less operands come first),
@@ -95,6 +199,43 @@ Status SortByVendorSyntax(InstructionSetProto* instruction_set);
       register_transform_##transform(#transform, rank_in_default_pipeline, \
                                      transform)
 
+// Same as REGISTER_INSTRUCTION_SET_TRANSFORM, but also declares the parts of
+// the instruction set accessed by the transform. 'access' is an
+// InstructionSetTransformAccess. Transforms registered without a declaration
+// never run in parallel with other transforms.
+#define REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(                    \
+    transform, rank_in_default_pipeline, access)                           \
+  ::cpu_instructions::internal::RegisterInstructionSetTransform            \
+      register_transform_##transform(#transform, rank_in_default_pipeline, \
+                                     transform, access)
+
+// Registers a PerInstructionTransformRawFunction. The transform is added to
+// the lists as an InstructionSetTransform that calls RunPerInstructionTransform.
+#define REGISTER_PER_INSTRUCTION_TRANSFORM(transform,                      \
+                                           rank_in_default_pipeline)       \
+  ::cpu_instructions::internal::RegisterInstructionSetTransform            \
+      register_transform_##transform(#transform, rank_in_default_pipeline, \
+                                     transform)
+
+// Same as REGISTER_PER_INSTRUCTION_TRANSFORM, but also declares the parts of
+// the instruction set accessed by the transform, as in
+// REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS.
+#define REGISTER_PER_INSTRUCTION_TRANSFORM_WITH_ACCESS(                    \
+    transform, rank_in_default_pipeline, access)                           \
+  ::cpu_instructions::internal::RegisterInstructionSetTransform            \
+      register_transform_##transform(#transform, rank_in_default_pipeline, \
+                                     transform, access)
+
+// Declares the version of a registered transform. The version must be
+// incremented whenever a change of the code changes the output of the
+// transform: it is a part of the keys of the checkpoints of the transform
+// pipeline (see transform_checkpoints.h), and the checkpoints taken after an
+// older version of the transform are not reused. Transforms without a declared
+// version have version 0.
+#define REGISTER_INSTRUCTION_SET_TRANSFORM_VERSION(transform, version) \
+  ::cpu_instructions::internal::RegisterInstructionSetTransformVersion  \
+      register_transform_version_##transform(#transform, version)
+
 // A special value passed to REGISTER_INSTRUCTION_SET_TRANSFORM for transforms
 // that are not included in the default pipeline.
 constexpr int kNotInDefaultPipeline = std::numeric_limits<int>::max();
@@ -108,6 +249,25 @@ class RegisterInstructionSetTransform {
   RegisterInstructionSetTransform(const string& transform_name,
                                   int rank_in_default_pipeline,
                                   InstructionSetTransformRawFunction transform);
+  RegisterInstructionSetTransform(const string& transform_name,
+                                  int rank_in_default_pipeline,
+                                  InstructionSetTransformRawFunction transform,
+                                  const InstructionSetTransformAccess& access);
+  RegisterInstructionSetTransform(const string& transform_name,
+                                  int rank_in_default_pipeline,
+                                  PerInstructionTransformRawFunction transform);
+  RegisterInstructionSetTransform(const string& transform_name,
+                                  int rank_in_default_pipeline,
+                                  PerInstructionTransformRawFunction transform,
+                                  const InstructionSetTransformAccess& access);
+};
+
+// A helper class used for the implementation of
+// REGISTER_INSTRUCTION_SET_TRANSFORM_VERSION.
+class RegisterInstructionSetTransformVersion {
+ public:
+  RegisterInstructionSetTransformVersion(const string& transform_name,
+                                         int version);
 };
 
 }  // namespace internal
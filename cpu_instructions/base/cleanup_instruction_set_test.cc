@@ -17,12 +17,18 @@
 #include <functional>
 
 #include "cpu_instructions/base/cleanup_instruction_set_test_utils.h"
+#include "cpu_instructions/testing/test_util.h"
+#include "gflags/gflags.h"
 #include "glog/logging.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "src/google/protobuf/text_format.h"
+#include "strings/str_cat.h"
 #include "util/task/canonical_errors.h"
 #include "util/task/status.h"
+#include "util/task/status_macros.h"
+
+DECLARE_int32(cpu_instructions_transform_num_threads);
 
 namespace cpu_instructions {
 namespace {
@@ -31,6 +37,7 @@ using ::cpu_instructions::InstructionFormat;
 using ::cpu_instructions::InstructionOperand;
 using ::cpu_instructions::InstructionProto;
 using ::cpu_instructions::InstructionSetProto;
+using ::cpu_instructions::testing::EqualsProto;
 using ::google::protobuf::RepeatedPtrField;
 using ::google::protobuf::TextFormat;
 using ::cpu_instructions::util::InvalidArgumentError;
@@ -49,6 +56,179 @@ TEST(GetDefaultTransformPipelineTest, ReturnedVectorIsNotEmpty) {
   EXPECT_GT(transforms.size(), 0);
 }
 
+// Transforms used to test the parallel scheduling of the default pipeline. They
+// all have the same rank, and the result depends on the order of those that
+// conflict.
+Status AppendToFeatureName(InstructionSetProto* instruction_set) {
+  for (InstructionProto& instruction :
+       *instruction_set->mutable_instructions()) {
+    instruction.set_feature_name(instruction.feature_name() + "+");
+  }
+  return OkStatus();
+}
+REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(
+    AppendToFeatureName, 1,
+    InstructionSetTransformAccess().Writes({"feature_name"}));
+
+// Conflicts with AppendToFeatureName.
+Status AddFeatureNameOperandToMov(InstructionSetProto* instruction_set) {
+  for (InstructionProto& instruction :
+       *instruction_set->mutable_instructions()) {
+    if (instruction.vendor_syntax().mnemonic() != "MOV") continue;
+    instruction.mutable_vendor_syntax()->add_operands()->set_name(
+        instruction.feature_name());
+  }
+  return OkStatus();
+}
+REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(
+    AddFeatureNameOperandToMov, 1, InstructionSetTransformAccess()
+                                       .Reads({"feature_name"})
+                                       .Writes({"vendor_syntax.operands"})
+                                       .OnlyMnemonics({"MOV"}));
+
+// Does not conflict with any of the transforms above.
+Status AddOperandToAdd(InstructionSetProto* instruction_set) {
+  for (InstructionProto& instruction :
+       *instruction_set->mutable_instructions()) {
+    if (instruction.vendor_syntax().mnemonic() != "ADD") continue;
+    instruction.mutable_vendor_syntax()->add_operands()->set_name("r32");
+  }
+  return OkStatus();
+}
+REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(
+    AddOperandToAdd, 1, InstructionSetTransformAccess()
+                            .Writes({"vendor_syntax.operands"})
+                            .OnlyMnemonics({"ADD"}));
+
+Status SetEncodingScheme(InstructionSetProto* instruction_set) {
+  for (InstructionProto& instruction :
+       *instruction_set->mutable_instructions()) {
+    instruction.set_encoding_scheme("RM");
+  }
+  return OkStatus();
+}
+REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(
+    SetEncodingScheme, 1,
+    InstructionSetTransformAccess().Writes({"encoding_scheme"}));
+
+// Registered without an access declaration, so it runs alone.
+Status RenameSubToSbb(InstructionSetProto* instruction_set) {
+  for (InstructionProto& instruction :
+       *instruction_set->mutable_instructions()) {
+    if (instruction.vendor_syntax().mnemonic() == "SUB") {
+      instruction.mutable_vendor_syntax()->set_mnemonic("SBB");
+    }
+  }
+  return OkStatus();
+}
+REGISTER_INSTRUCTION_SET_TRANSFORM(RenameSubToSbb, 1);
+
+Status AddOperandToSbb(InstructionSetProto* instruction_set) {
+  for (InstructionProto& instruction :
+       *instruction_set->mutable_instructions()) {
+    if (instruction.vendor_syntax().mnemonic() != "SBB") continue;
+    instruction.mutable_vendor_syntax()->add_operands()->set_name("r64");
+  }
+  return OkStatus();
+}
+REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(
+    AddOperandToSbb, 1, InstructionSetTransformAccess()
+                            .Writes({"vendor_syntax.operands"})
+                            .OnlyMnemonics({"SBB"}));
+
+// Transforms used to test that the parallel scheduling detects undeclared
+// writes. They only change instructions whose mnemonic is 'UNDECLARED'.
+Status SetFeatureNameOfUndeclared(InstructionSetProto* instruction_set) {
+  for (InstructionProto& instruction :
+       *instruction_set->mutable_instructions()) {
+    if (instruction.vendor_syntax().mnemonic() != "UNDECLARED") continue;
+    instruction.set_feature_name("UNDECLARED");
+  }
+  return OkStatus();
+}
+REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(
+    SetFeatureNameOfUndeclared, 2,
+    InstructionSetTransformAccess().Writes({"feature_name"}));
+
+// Declares that it writes the encoding scheme, but also writes the
+// description.
+Status SetDescriptionOfUndeclared(InstructionSetProto* instruction_set) {
+  for (InstructionProto& instruction :
+       *instruction_set->mutable_instructions()) {
+    if (instruction.vendor_syntax().mnemonic() != "UNDECLARED") continue;
+    instruction.set_encoding_scheme("RM");
+    instruction.set_description("Not declared");
+  }
+  return OkStatus();
+}
+REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(
+    SetDescriptionOfUndeclared, 2, InstructionSetTransformAccess()
+                                       .Writes({"encoding_scheme"})
+                                       .OnlyMnemonics({"UNDECLARED"}));
+
+TEST(GetTransformAccessOrNullTest, DeclaredAccess) {
+  const InstructionSetTransformAccess* const access =
+      GetTransformAccessOrNull("AddFeatureNameOperandToMov");
+  ASSERT_NE(access, nullptr);
+  EXPECT_THAT(access->read_fields(), ::testing::ElementsAre("feature_name"));
+  EXPECT_THAT(access->written_fields(),
+              ::testing::ElementsAre("vendor_syntax.operands"));
+  EXPECT_THAT(access->mnemonics(), ::testing::ElementsAre("MOV"));
+  EXPECT_EQ(GetTransformAccessOrNull("RenameSubToSbb"), nullptr);
+  EXPECT_EQ(GetTransformAccessOrNull("NoSuchTransform"), nullptr);
+}
+
+TEST(GetDefaultTransformPipelineTest, ParallelPipelineMatchesSerial) {
+  constexpr char kInstructionSetProto[] = R"(
+      source_infos { source_name: 'test' }
+      instructions { vendor_syntax { mnemonic: 'MOV' } feature_name: 'A' }
+      instructions { vendor_syntax { mnemonic: 'ADD' } feature_name: 'B' }
+      instructions { vendor_syntax { mnemonic: 'SUB' } }
+      instructions { feature_name: 'C' })";
+  constexpr char kExpectedInstructionSetProto[] = R"(
+      source_infos { source_name: 'test' }
+      instructions { feature_name: 'C+' encoding_scheme: 'RM' }
+      instructions {
+        vendor_syntax { mnemonic: 'ADD' operands { name: 'r32' }}
+        feature_name: 'B+' encoding_scheme: 'RM' }
+      instructions {
+        vendor_syntax { mnemonic: 'MOV' operands { name: 'A+' }}
+        feature_name: 'A+' encoding_scheme: 'RM' }
+      instructions {
+        vendor_syntax { mnemonic: 'SBB' operands { name: 'r64' }}
+        feature_name: '+' encoding_scheme: 'RM' })";
+  ::gflags::FlagSaver flag_saver;
+  for (const int num_threads : {1, 4}) {
+    FLAGS_cpu_instructions_transform_num_threads = num_threads;
+    InstructionSetProto instruction_set;
+    ASSERT_TRUE(
+        TextFormat::ParseFromString(kInstructionSetProto, &instruction_set));
+    EXPECT_TRUE(
+        RunTransformPipeline(GetDefaultTransformPipeline(), &instruction_set)
+            .ok());
+    EXPECT_THAT(instruction_set, EqualsProto(kExpectedInstructionSetProto))
+        << "num_threads = " << num_threads;
+  }
+}
+
+#ifndef NDEBUG
+// The undeclared writes are only detected in debug builds.
+TEST(GetDefaultTransformPipelineDeathTest, UndeclaredWriteInParallel) {
+  ::gflags::FlagSaver flag_saver;
+  FLAGS_cpu_instructions_transform_num_threads = 2;
+  InstructionSetProto instruction_set;
+  instruction_set.add_instructions()->mutable_vendor_syntax()->set_mnemonic(
+      "UNDECLARED");
+  EXPECT_DEATH(
+      {
+        const Status status = RunTransformPipeline(
+            GetDefaultTransformPipeline(), &instruction_set);
+      },
+      "SetDescriptionOfUndeclared changed fields it does not declare as "
+      "written");
+}
+#endif  // NDEBUG
+
 TEST(RunTransformWithDiffTest, NoDifference) {
   constexpr char kInstructionSetProto[] = R"(
       instructions {
@@ -105,6 +285,75 @@ TEST(RunTransformWithDiffTest, WithDifference) {
   EXPECT_EQ(diff_or_status.ValueOrDie(), kExpectedDiff);
 }
 
+// A dummy transform that renames the feature of the second instruction, and
+// returns Status::OK. Used for testing the diff.
+Status RenameFeatureOfSecondInstruction(InstructionSetProto* instruction_set) {
+  CHECK(instruction_set != nullptr);
+  instruction_set->mutable_instructions(1)->set_feature_name("SSE");
+  return OkStatus();
+}
+
+TEST(RunTransformWithDiffTest, WithModification) {
+  constexpr char kInstructionSetProto[] = R"(
+      instructions {
+        vendor_syntax { mnemonic: 'SCAS' operands { name: 'm8' }}
+        encoding_scheme: 'NP'
+        raw_encoding_specification: 'AE' }
+      instructions {
+        vendor_syntax { mnemonic: 'INS' operands { name: 'm8' }
+                        operands { name: 'DX' }}
+        feature_name: 'X87'
+        encoding_scheme: 'NP' raw_encoding_specification: '6C' })";
+  constexpr char kExpectedDiff[] =
+      "modified: instructions[1].feature_name: \"X87\" -> \"SSE\"\n";
+  InstructionSetProto instruction_set;
+  ASSERT_TRUE(
+      TextFormat::ParseFromString(kInstructionSetProto, &instruction_set));
+  const StatusOr<string> diff_or_status =
+      RunTransformWithDiff(RenameFeatureOfSecondInstruction, &instruction_set);
+  ASSERT_OK(diff_or_status.status());
+  EXPECT_EQ(diff_or_status.ValueOrDie(), kExpectedDiff);
+}
+
+// A dummy transform that deletes the second instruction and renames the feature
+// of the instruction that follows it, and returns Status::OK. Used for testing
+// the diff when the modified instruction changes its position.
+Status DeleteSecondInstructionAndRenameFeatureOfThird(
+    InstructionSetProto* instruction_set) {
+  RETURN_IF_ERROR(DeleteSecondInstruction(instruction_set));
+  return RenameFeatureOfSecondInstruction(instruction_set);
+}
+
+TEST(RunTransformWithDiffTest, WithDeletionAndModification) {
+  constexpr char kInstructionSetProto[] = R"(
+      instructions {
+        vendor_syntax { mnemonic: 'SCAS' operands { name: 'm8' }}
+        encoding_scheme: 'NP'
+        raw_encoding_specification: 'AE' }
+      instructions {
+        vendor_syntax { mnemonic: 'INS' operands { name: 'm8' }
+                        operands { name: 'DX' }}
+        encoding_scheme: 'NP' raw_encoding_specification: '6C' }
+      instructions {
+        vendor_syntax { mnemonic: 'INS' operands { name: 'm16' }
+                        operands { name: 'DX' }}
+        feature_name: 'X87'
+        encoding_scheme: 'NP' raw_encoding_specification: '6D' })";
+  constexpr char kExpectedDiff[] =
+      "deleted: instructions[1]: { vendor_syntax { mnemonic: \"INS\" operands "
+      "{ name: \"m8\" } operands { name: \"DX\" } } encoding_scheme: \"NP\" "
+      "raw_encoding_specification: \"6C\" }\n"
+      "modified: instructions[2].feature_name -> "
+      "instructions[1].feature_name: \"X87\" -> \"SSE\"\n";
+  InstructionSetProto instruction_set;
+  ASSERT_TRUE(
+      TextFormat::ParseFromString(kInstructionSetProto, &instruction_set));
+  const StatusOr<string> diff_or_status = RunTransformWithDiff(
+      DeleteSecondInstructionAndRenameFeatureOfThird, &instruction_set);
+  ASSERT_OK(diff_or_status.status());
+  EXPECT_EQ(diff_or_status.ValueOrDie(), kExpectedDiff);
+}
+
 // A dummy transform that immediately returns an error.
 Status ReturnErrorInsteadOfTransforming(InstructionSetProto* instruction_set) {
   return InvalidArgumentError("I do not transform!");
@@ -127,6 +376,81 @@ TEST(RunTransformWithDiffTest, WithError) {
   EXPECT_EQ(diff_or_status.status().error_message(), "I do not transform!");
 }
 
+// A per-instruction transform that appends the index from the feature name to
+// the mnemonic, and fails on instructions with an odd index.
+Status AppendIndexToMnemonic(InstructionProto* instruction) {
+  const string& index = instruction->feature_name();
+  instruction->mutable_vendor_syntax()->set_mnemonic(
+      instruction->vendor_syntax().mnemonic() + index);
+  if ((index.back() - '0') % 2 == 1) {
+    return InvalidArgumentError(StrCat("Odd index: ", index));
+  }
+  return OkStatus();
+}
+
+TEST(RunPerInstructionTransformTest, ProcessesAllInstructions) {
+  constexpr int kNumInstructions = 100;
+  ::gflags::FlagSaver flag_saver;
+  for (const int num_threads : {1, 4}) {
+    FLAGS_cpu_instructions_transform_num_threads = num_threads;
+    InstructionSetProto instruction_set;
+    for (int i = 0; i < kNumInstructions; ++i) {
+      InstructionProto* const instruction = instruction_set.add_instructions();
+      instruction->mutable_vendor_syntax()->set_mnemonic("ADD");
+      instruction->set_feature_name(StrCat(i));
+    }
+    const Status status =
+        RunPerInstructionTransform(AppendIndexToMnemonic, &instruction_set);
+    // The transform fails on instructions 1, 3, 5, ...; the error of the first
+    // one is returned regardless of the number of threads.
+    EXPECT_EQ(status.error_code(), INVALID_ARGUMENT);
+    EXPECT_EQ(status.error_message(), "Odd index: 1");
+    ASSERT_EQ(instruction_set.instructions_size(), kNumInstructions);
+    for (int i = 0; i < kNumInstructions; ++i) {
+      EXPECT_EQ(instruction_set.instructions(i).vendor_syntax().mnemonic(),
+                StrCat("ADD", i));
+    }
+  }
+}
+
+// A per-instruction transform that appends "-" to the mnemonic, and fails on
+// instructions whose index from the feature name is divisible by three.
+Status AppendDashToMnemonic(InstructionProto* instruction) {
+  instruction->mutable_vendor_syntax()->set_mnemonic(
+      instruction->vendor_syntax().mnemonic() + "-");
+  if ((instruction->feature_name().back() - '0') % 3 == 0) {
+    return InvalidArgumentError(
+        StrCat("Divisible by three: ", instruction->feature_name()));
+  }
+  return OkStatus();
+}
+
+TEST(RunPerInstructionTransformsTest, MatchesUnfusedTransforms) {
+  constexpr int kNumInstructions = 10;
+  ::gflags::FlagSaver flag_saver;
+  for (const int num_threads : {1, 4}) {
+    FLAGS_cpu_instructions_transform_num_threads = num_threads;
+    InstructionSetProto instruction_set;
+    for (int i = 1; i <= kNumInstructions; ++i) {
+      InstructionProto* const instruction = instruction_set.add_instructions();
+      instruction->set_feature_name(StrCat(i));
+    }
+    // AppendIndexToMnemonic fails already on the first instruction, but when
+    // the transforms run one by one, AppendDashToMnemonic fails before it.
+    const Status status = RunPerInstructionTransforms(
+        {AppendDashToMnemonic, AppendIndexToMnemonic}, &instruction_set);
+    EXPECT_EQ(status.error_message(), "Divisible by three: 3");
+    // The second transform is not applied to instructions where the first one
+    // failed.
+    EXPECT_EQ(instruction_set.instructions(0).vendor_syntax().mnemonic(),
+              "-1");
+    EXPECT_EQ(instruction_set.instructions(1).vendor_syntax().mnemonic(),
+              "-2");
+    EXPECT_EQ(instruction_set.instructions(2).vendor_syntax().mnemonic(),
+              "-");
+  }
+}
+
 TEST(SortByVendorSyntaxTest, Sort) {
   constexpr char kInstructionSetProto[] =
       R"(instructions {
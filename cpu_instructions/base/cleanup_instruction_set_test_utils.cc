@@ -33,4 +33,13 @@ void TestTransform(const InstructionSetTransform& transform,
   EXPECT_THAT(instruction_set, EqualsProto(expected_output));
 }
 
+void TestTransform(const PerInstructionTransform& transform,
+                   const string& input_proto, const string& expected_output) {
+  TestTransform(
+      [&transform](InstructionSetProto* instruction_set) {
+        return RunPerInstructionTransform(transform, instruction_set);
+      },
+      input_proto, expected_output);
+}
+
 }  // namespace cpu_instructions
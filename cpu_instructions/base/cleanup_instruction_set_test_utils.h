@@ -29,6 +29,12 @@ void TestTransform(const InstructionSetTransform& transform,
                    const string& input_proto,
                    const string& expected_output_proto);
 
+// Same as above, but for transforms that process each instruction separately.
+// The transform is run through RunPerInstructionTransform.
+void TestTransform(const PerInstructionTransform& transform,
+                   const string& input_proto,
+                   const string& expected_output_proto);
+
 }  // namespace cpu_instructions
 
 #endif  // CPU_INSTRUCTIONS_BASE_CLEANUP_INSTRUCTION_SET_TEST_UTILS_H_
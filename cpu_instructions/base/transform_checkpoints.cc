@@ -0,0 +1,189 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/base/transform_checkpoints.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <unordered_set>
+
+#include "cpu_instructions/util/fingerprint.h"
+#include "cpu_instructions/util/proto_fingerprint.h"
+#include "glog/logging.h"
+#include "strings/str_cat.h"
+#include "strings/str_join.h"
+#include "strings/str_split.h"
+#include "util/gtl/map_util.h"
+#include "util/task/status.h"
+#include "util/task/status_macros.h"
+
+DEFINE_string(cpu_instructions_transform_checkpoint_directory, "",
+              "If not empty, the instruction set is stored in this directory "
+              "after each step of the transform pipeline, and later runs with "
+              "the same input resume from the deepest stored checkpoint. Each "
+              "run with a new input or new transform versions adds a full copy "
+              "of the instruction set per step, and the checkpoints are never "
+              "removed: use a dedicated directory and delete it when it is no "
+              "longer needed. The directory must exist.");
+DEFINE_string(cpu_instructions_transform_checkpoint_rerun_from, "",
+              "A comma-separated list of names of transforms whose code "
+              "changed since the checkpoints were stored, without a change of "
+              "their versions. The pipeline does not resume from the "
+              "checkpoints taken after these transforms or any later one.");
+
+namespace cpu_instructions {
+
+using ::cpu_instructions::util::OkStatus;
+using ::cpu_instructions::util::Status;
+
+namespace {
+
+// Must be incremented whenever the format of the checkpoints changes.
+constexpr const uint64_t kCheckpointVersion = 2;
+
+constexpr const char kCheckpointFileExtension[] = ".instruction_set.pb";
+
+// Returns the names of the transforms run by the pipeline step 'step_name'.
+std::vector<string> GetTransformNames(const string& step_name) {
+  return strings::Split(step_name, kStepNameSeparator,  // NOLINT
+                        strings::SkipEmpty());
+}
+
+}  // namespace
+
+TransformCheckpoints::TransformCheckpoints(const string& directory)
+    : directory_(directory) {
+  CHECK(!directory.empty());
+}
+
+string TransformCheckpoints::GetKey(
+    uint64_t input_fingerprint,
+    const std::vector<AppliedTransform>& transforms) {
+  uint64_t fingerprint = FingerprintCat(kCheckpointVersion, input_fingerprint);
+  for (const AppliedTransform& transform : transforms) {
+    fingerprint = FingerprintCat(fingerprint, Fingerprint(transform.name));
+    fingerprint = FingerprintCat(fingerprint, transform.version);
+  }
+  return FingerprintToString(fingerprint);
+}
+
+bool TransformCheckpoints::Lookup(const string& key,
+                                  InstructionSetProto* instruction_set) const {
+  CHECK(instruction_set != nullptr);
+  const string filename = GetFilename(key);
+  FILE* const input_file = fopen(filename.c_str(), "rb");
+  if (input_file == nullptr) return false;
+  InstructionSetProto checkpoint;
+  const bool parsed = checkpoint.ParseFromFileDescriptor(fileno(input_file));
+  fclose(input_file);
+  if (!parsed) {
+    LOG(WARNING) << "Ignoring corrupted checkpoint '" << filename << "'";
+    return false;
+  }
+  instruction_set->Swap(&checkpoint);
+  return true;
+}
+
+void TransformCheckpoints::InsertOrDie(
+    const string& key, const InstructionSetProto& instruction_set) const {
+  // The instruction set is written to a temporary file which is then renamed,
+  // so readers never see a partially written checkpoint.
+  string temp_filename = StrCat(directory_, "/.", key, ".XXXXXX");
+  const int fd = mkstemp(&temp_filename[0]);
+  CHECK_GE(fd, 0) << "Could not create '" << temp_filename << "'";
+  CHECK(instruction_set.SerializeToFileDescriptor(fd))
+      << "Could not write '" << temp_filename << "'";
+  CHECK_EQ(close(fd), 0) << "Could not close '" << temp_filename << "'";
+  const string filename = GetFilename(key);
+  CHECK_EQ(rename(temp_filename.c_str(), filename.c_str()), 0)
+      << "Could not rename '" << temp_filename << "' to '" << filename << "'";
+}
+
+string TransformCheckpoints::GetFilename(const string& key) const {
+  return StrCat(directory_, "/", key, kCheckpointFileExtension);
+}
+
+Status RunTransformPipelineWithCheckpoints(
+    const std::vector<NamedInstructionSetTransform>& pipeline,
+    InstructionSetProto* instruction_set) {
+  CHECK(instruction_set != nullptr);
+  if (FLAGS_cpu_instructions_transform_checkpoint_directory.empty()) {
+    std::vector<InstructionSetTransform> transforms;
+    for (const NamedInstructionSetTransform& step : pipeline) {
+      transforms.push_back(step.transform);
+    }
+    return RunTransformPipeline(transforms, instruction_set);
+  }
+  const TransformCheckpoints checkpoints(
+      FLAGS_cpu_instructions_transform_checkpoint_directory);
+  const std::vector<string> rerun_from =
+      strings::Split(FLAGS_cpu_instructions_transform_checkpoint_rerun_from,
+                     ",", strings::SkipEmpty());  // NOLINT
+  const std::unordered_set<string> rerun_from_set(rerun_from.begin(),
+                                                  rerun_from.end());
+
+  // The keys are computed from the names of the individual transforms rather
+  // than from the names of the steps, so that the checkpoints do not depend on
+  // how the transforms are grouped into steps.
+  const uint64_t input_fingerprint = FingerprintProto(*instruction_set);
+  std::vector<AppliedTransform> applied_transforms;
+  // keys[i] is the key of the checkpoint taken after pipeline[i].
+  std::vector<string> keys;
+  size_t first_rerun_step = pipeline.size();
+  std::unordered_set<string> rerun_from_found;
+  for (size_t i = 0; i < pipeline.size(); ++i) {
+    for (const string& name : GetTransformNames(pipeline[i].name)) {
+      if (ContainsKey(rerun_from_set, name)) {
+        first_rerun_step = std::min(first_rerun_step, i);
+        rerun_from_found.insert(name);
+      }
+      applied_transforms.push_back({name, GetTransformVersion(name)});
+    }
+    keys.push_back(
+        TransformCheckpoints::GetKey(input_fingerprint, applied_transforms));
+  }
+  for (const string& name : rerun_from) {
+    CHECK(ContainsKey(rerun_from_found, name))
+        << "Transform '" << name << "' is not in the pipeline";
+  }
+
+  // Resume from the deepest checkpoint taken before the first step that must be
+  // rerun.
+  size_t first_step = 0;
+  for (size_t i = first_rerun_step; i > 0; --i) {
+    if (checkpoints.Lookup(keys[i - 1], instruction_set)) {
+      std::vector<string> skipped_steps;
+      for (size_t j = 0; j < i; ++j) skipped_steps.push_back(pipeline[j].name);
+      LOG(WARNING) << "Resuming the transform pipeline from checkpoint '"
+                   << checkpoints.GetFilename(keys[i - 1]) << "', skipping "
+                   << i << " of " << pipeline.size() << " steps: "
+                   << strings::Join(skipped_steps, ", ")
+                   << ". If the code of any of these transforms changed, "
+                      "increment its version or list it in "
+                      "--cpu_instructions_transform_checkpoint_rerun_from.";
+      first_step = i;
+      break;
+    }
+  }
+  for (size_t i = first_step; i < pipeline.size(); ++i) {
+    CHECK(pipeline[i].transform != nullptr);
+    RETURN_IF_ERROR(pipeline[i].transform(instruction_set));
+    checkpoints.InsertOrDie(keys[i], *instruction_set);
+  }
+  return OkStatus();
+}
+
+}  // namespace cpu_instructions
@@ -0,0 +1,98 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// On-disk checkpoints of the instruction set after each step of a transform
+// pipeline.
+//
+// When working on a late transform, most of the time of a run is spent in the
+// transforms before it, whose output does not change from one run to the next.
+// A checkpoint is stored after each step of the pipeline, named after a
+// fingerprint of the input instruction set and of the names and the versions of
+// the transforms applied so far, and a later run with the same prefix resumes
+// from the deepest available checkpoint. The versions are declared with
+// REGISTER_INSTRUCTION_SET_TRANSFORM_VERSION, and they must be incremented
+// whenever the output of a transform changes.
+//
+// Checkpoints are never evicted: every run with a new input or with new
+// transform versions adds one full instruction set per step to the directory,
+// and stale checkpoints stay there until the directory is deleted by the user.
+
+#ifndef CPU_INSTRUCTIONS_BASE_TRANSFORM_CHECKPOINTS_H_
+#define CPU_INSTRUCTIONS_BASE_TRANSFORM_CHECKPOINTS_H_
+
+#include <cstdint>
+#include <vector>
+#include "strings/string.h"
+
+#include "cpu_instructions/base/cleanup_instruction_set.h"
+#include "cpu_instructions/proto/instructions.pb.h"
+#include "gflags/gflags.h"
+#include "util/task/status.h"
+
+DECLARE_string(cpu_instructions_transform_checkpoint_directory);
+DECLARE_string(cpu_instructions_transform_checkpoint_rerun_from);
+
+namespace cpu_instructions {
+
+// A transform applied to the instruction set, as identified in the keys of the
+// checkpoints.
+struct AppliedTransform {
+  string name;
+  int version;
+};
+
+// The checkpoints can be shared by several threads and processes: entries are
+// written atomically.
+class TransformCheckpoints {
+ public:
+  // 'directory' must exist.
+  explicit TransformCheckpoints(const string& directory);
+
+  // Returns the key of the checkpoint taken after applying 'transforms', in
+  // this order, to an instruction set whose fingerprint is 'input_fingerprint'.
+  static string GetKey(uint64_t input_fingerprint,
+                       const std::vector<AppliedTransform>& transforms);
+
+  // Reads the instruction set stored under 'key' into 'instruction_set' and
+  // returns true, or returns false and leaves 'instruction_set' unchanged if
+  // there is no such checkpoint.
+  bool Lookup(const string& key, InstructionSetProto* instruction_set) const;
+
+  // Stores 'instruction_set' under 'key'. Dies on I/O errors.
+  void InsertOrDie(const string& key,
+                   const InstructionSetProto& instruction_set) const;
+
+  // Returns the name of the file that stores the checkpoint 'key'.
+  string GetFilename(const string& key) const;
+
+ private:
+  const string directory_;
+};
+
+// Runs all transforms from 'pipeline' on the given instruction set proto, like
+// RunTransformPipeline. When --cpu_instructions_transform_checkpoint_directory
+// is not empty, the instruction set is stored in that directory after each
+// step, and the pipeline resumes from the deepest checkpoint matching the input
+// and the names and versions of the transforms of the steps; a warning is
+// logged when it does. The checkpoints taken after any of the transforms listed
+// in --cpu_instructions_transform_checkpoint_rerun_from and after all the
+// transforms that follow them are ignored and replaced, e.g. while working on a
+// transform before incrementing its version.
+Status RunTransformPipelineWithCheckpoints(
+    const std::vector<NamedInstructionSetTransform>& pipeline,
+    InstructionSetProto* instruction_set);
+
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_BASE_TRANSFORM_CHECKPOINTS_H_
@@ -0,0 +1,246 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/base/transform_checkpoints.h"
+
+#include <stdlib.h>
+#include <vector>
+#include "strings/string.h"
+
+#include "cpu_instructions/base/cleanup_instruction_set.h"
+#include "cpu_instructions/proto/instructions.pb.h"
+#include "cpu_instructions/testing/test_util.h"
+#include "cpu_instructions/util/proto_fingerprint.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "strings/str_cat.h"
+#include "util/task/status.h"
+#include "util/task/status_macros.h"
+
+namespace cpu_instructions {
+namespace {
+
+using ::cpu_instructions::testing::EqualsProto;
+using ::cpu_instructions::util::OkStatus;
+using ::cpu_instructions::util::Status;
+
+// Creates a new empty directory under TEST_TMPDIR, so that each test starts
+// without checkpoints, also when the tests are repeated.
+string MakeTempDirectory() {
+  string directory = StrCat(getenv("TEST_TMPDIR"), "/checkpoints.XXXXXX");
+  CHECK(mkdtemp(&directory[0]) != nullptr)
+      << "Could not create '" << directory << "'";
+  return directory;
+}
+
+TEST(TransformCheckpointsTest, LookupAfterInsert) {
+  const TransformCheckpoints checkpoints(MakeTempDirectory());
+  const InstructionSetProto instruction_set =
+      ParseProtoFromStringOrDie<InstructionSetProto>(R"(
+        instructions { vendor_syntax { mnemonic: 'LOOKUP' } })");
+  const string key = TransformCheckpoints::GetKey(
+      FingerprintProto(instruction_set), {{"AddOperandInfo", 0}});
+
+  InstructionSetProto checkpoint;
+  EXPECT_FALSE(checkpoints.Lookup(key, &checkpoint));
+  EXPECT_THAT(checkpoint, EqualsProto(InstructionSetProto()));
+  checkpoints.InsertOrDie(key, instruction_set);
+  EXPECT_TRUE(checkpoints.Lookup(key, &checkpoint));
+  EXPECT_THAT(checkpoint, EqualsProto(instruction_set));
+}
+
+TEST(TransformCheckpointsTest, KeyDependsOnAllInputs) {
+  const string key = TransformCheckpoints::GetKey(1, {{"A", 0}, {"B", 1}});
+  EXPECT_EQ(key, TransformCheckpoints::GetKey(1, {{"A", 0}, {"B", 1}}));
+
+  EXPECT_NE(key, TransformCheckpoints::GetKey(2, {{"A", 0}, {"B", 1}}));
+  EXPECT_NE(key, TransformCheckpoints::GetKey(1, {{"B", 1}, {"A", 0}}));
+  EXPECT_NE(key, TransformCheckpoints::GetKey(1, {{"A", 0}}));
+  EXPECT_NE(key,
+            TransformCheckpoints::GetKey(1, {{"A", 0}, {"B", 1}, {"C", 0}}));
+  EXPECT_NE(key, TransformCheckpoints::GetKey(1, {{"A", 1}, {"B", 1}}));
+  EXPECT_NE(key, TransformCheckpoints::GetKey(1, {{"A", 0}, {"B", 0}}));
+}
+
+int num_append_a_calls = 0;
+int num_append_b_calls = 0;
+
+// Appends a suffix to the mnemonics of all instructions, and counts the calls.
+Status AppendA(InstructionSetProto* instruction_set) {
+  ++num_append_a_calls;
+  for (InstructionProto& instruction :
+       *instruction_set->mutable_instructions()) {
+    instruction.mutable_vendor_syntax()->mutable_mnemonic()->append("A");
+  }
+  return OkStatus();
+}
+
+Status AppendB(InstructionSetProto* instruction_set) {
+  ++num_append_b_calls;
+  for (InstructionProto& instruction :
+       *instruction_set->mutable_instructions()) {
+    instruction.mutable_vendor_syntax()->mutable_mnemonic()->append("B");
+  }
+  return OkStatus();
+}
+
+// A transform with a declared version.
+Status AppendVersioned(InstructionSetProto* instruction_set) {
+  for (InstructionProto& instruction :
+       *instruction_set->mutable_instructions()) {
+    instruction.mutable_vendor_syntax()->mutable_mnemonic()->append("V");
+  }
+  return OkStatus();
+}
+REGISTER_INSTRUCTION_SET_TRANSFORM_VERSION(AppendVersioned, 3);
+
+TEST(GetTransformVersionTest, DeclaredAndDefault) {
+  EXPECT_EQ(GetTransformVersion("AppendVersioned"), 3);
+  EXPECT_EQ(GetTransformVersion("AppendA"), 0);
+}
+
+class RunTransformPipelineWithCheckpointsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    num_append_a_calls = 0;
+    num_append_b_calls = 0;
+    FLAGS_cpu_instructions_transform_checkpoint_directory =
+        MakeTempDirectory();
+    FLAGS_cpu_instructions_transform_checkpoint_rerun_from = "";
+  }
+
+  ::gflags::FlagSaver flag_saver_;
+
+  // Runs the pipeline on an instruction set with a single instruction whose
+  // mnemonic is 'mnemonic', and returns the mnemonic after the transforms.
+  string RunPipeline(const std::vector<NamedInstructionSetTransform>& pipeline,
+                     const string& mnemonic) {
+    InstructionSetProto instruction_set;
+    instruction_set.add_instructions()->mutable_vendor_syntax()->set_mnemonic(
+        mnemonic);
+    EXPECT_OK(RunTransformPipelineWithCheckpoints(pipeline, &instruction_set));
+    return instruction_set.instructions(0).vendor_syntax().mnemonic();
+  }
+};
+
+TEST_F(RunTransformPipelineWithCheckpointsTest, ResumesFromDeepestCheckpoint) {
+  const std::vector<NamedInstructionSetTransform> pipeline = {
+      {"AppendA", AppendA}, {"AppendB", AppendB}};
+  EXPECT_EQ(RunPipeline(pipeline, "RESUME"), "RESUMEAB");
+  EXPECT_EQ(num_append_a_calls, 1);
+  EXPECT_EQ(num_append_b_calls, 1);
+
+  // Both steps are read from the checkpoints.
+  EXPECT_EQ(RunPipeline(pipeline, "RESUME"), "RESUMEAB");
+  EXPECT_EQ(num_append_a_calls, 1);
+  EXPECT_EQ(num_append_b_calls, 1);
+
+  // A longer pipeline with the same prefix resumes after the prefix.
+  const std::vector<NamedInstructionSetTransform> longer_pipeline = {
+      {"AppendA", AppendA}, {"AppendB", AppendB}, {"AppendA", AppendA}};
+  EXPECT_EQ(RunPipeline(longer_pipeline, "RESUME"), "RESUMEABA");
+  EXPECT_EQ(num_append_a_calls, 2);
+  EXPECT_EQ(num_append_b_calls, 1);
+
+  // A different input does not use the checkpoints.
+  EXPECT_EQ(RunPipeline(pipeline, "OTHER"), "OTHERAB");
+  EXPECT_EQ(num_append_a_calls, 3);
+  EXPECT_EQ(num_append_b_calls, 2);
+}
+
+TEST_F(RunTransformPipelineWithCheckpointsTest, FusedStepsShareCheckpoints) {
+  const std::vector<NamedInstructionSetTransform> pipeline = {
+      {"AppendA", AppendA}, {"AppendB", AppendB}};
+  EXPECT_EQ(RunPipeline(pipeline, "FUSED"), "FUSEDAB");
+
+  const std::vector<NamedInstructionSetTransform> fused_pipeline = {
+      {StrCat("AppendA", kStepNameSeparator, "AppendB"),
+       [](InstructionSetProto* instruction_set) {
+         RETURN_IF_ERROR(AppendA(instruction_set));
+         return AppendB(instruction_set);
+       }}};
+  EXPECT_EQ(RunPipeline(fused_pipeline, "FUSED"), "FUSEDAB");
+  EXPECT_EQ(num_append_a_calls, 1);
+  EXPECT_EQ(num_append_b_calls, 1);
+}
+
+TEST_F(RunTransformPipelineWithCheckpointsTest, RerunsFromChangedTransform) {
+  const std::vector<NamedInstructionSetTransform> pipeline = {
+      {"AppendA", AppendA}, {"AppendB", AppendB}};
+  EXPECT_EQ(RunPipeline(pipeline, "RERUN"), "RERUNAB");
+  EXPECT_EQ(num_append_a_calls, 1);
+  EXPECT_EQ(num_append_b_calls, 1);
+
+  FLAGS_cpu_instructions_transform_checkpoint_rerun_from = "AppendB";
+  EXPECT_EQ(RunPipeline(pipeline, "RERUN"), "RERUNAB");
+  EXPECT_EQ(num_append_a_calls, 1);
+  EXPECT_EQ(num_append_b_calls, 2);
+
+  FLAGS_cpu_instructions_transform_checkpoint_rerun_from = "AppendA";
+  EXPECT_EQ(RunPipeline(pipeline, "RERUN"), "RERUNAB");
+  EXPECT_EQ(num_append_a_calls, 2);
+  EXPECT_EQ(num_append_b_calls, 3);
+}
+
+TEST_F(RunTransformPipelineWithCheckpointsTest, KeysUseTransformVersions) {
+  const std::vector<NamedInstructionSetTransform> pipeline = {
+      {"AppendA", AppendA}, {"AppendVersioned", AppendVersioned}};
+  EXPECT_EQ(RunPipeline(pipeline, "VERSION"), "VERSIONAV");
+
+  InstructionSetProto input;
+  input.add_instructions()->mutable_vendor_syntax()->set_mnemonic("VERSION");
+  const uint64_t input_fingerprint = FingerprintProto(input);
+  const TransformCheckpoints checkpoints(
+      FLAGS_cpu_instructions_transform_checkpoint_directory);
+  InstructionSetProto checkpoint;
+  EXPECT_TRUE(checkpoints.Lookup(
+      TransformCheckpoints::GetKey(input_fingerprint,
+                                   {{"AppendA", 0}, {"AppendVersioned", 3}}),
+      &checkpoint));
+  EXPECT_EQ(checkpoint.instructions(0).vendor_syntax().mnemonic(),
+            "VERSIONAV");
+  // The checkpoints of other versions of the transform were not created.
+  EXPECT_FALSE(checkpoints.Lookup(
+      TransformCheckpoints::GetKey(input_fingerprint,
+                                   {{"AppendA", 0}, {"AppendVersioned", 0}}),
+      &checkpoint));
+}
+
+TEST_F(RunTransformPipelineWithCheckpointsTest, RerunsFromEarliestListed) {
+  const std::vector<NamedInstructionSetTransform> pipeline = {
+      {"AppendA", AppendA}, {"AppendB", AppendB}, {"AppendA", AppendA}};
+  EXPECT_EQ(RunPipeline(pipeline, "LIST"), "LISTABA");
+  EXPECT_EQ(num_append_a_calls, 2);
+  EXPECT_EQ(num_append_b_calls, 1);
+
+  FLAGS_cpu_instructions_transform_checkpoint_rerun_from = "AppendB,AppendA";
+  EXPECT_EQ(RunPipeline(pipeline, "LIST"), "LISTABA");
+  EXPECT_EQ(num_append_a_calls, 4);
+  EXPECT_EQ(num_append_b_calls, 2);
+}
+
+TEST_F(RunTransformPipelineWithCheckpointsTest, NoDirectory) {
+  FLAGS_cpu_instructions_transform_checkpoint_directory = "";
+  const std::vector<NamedInstructionSetTransform> pipeline = {
+      {"AppendA", AppendA}};
+  EXPECT_EQ(RunPipeline(pipeline, "NODIR"), "NODIRA");
+  EXPECT_EQ(RunPipeline(pipeline, "NODIR"), "NODIRA");
+  EXPECT_EQ(num_append_a_calls, 2);
+}
+
+}  // namespace
+}  // namespace cpu_instructions
@@ -27,26 +27,36 @@ DEFINE_string(
 
 namespace cpu_instructions {
 
-std::vector<InstructionSetTransform> GetTransformsFromCommandLineFlags() {
+std::vector<NamedInstructionSetTransform>
+GetNamedTransformsFromCommandLineFlags() {
   static constexpr const char kDefaultSet[] = "default";
   const auto& transforms_by_name = GetTransformsByName();
-  std::vector<InstructionSetTransform> transforms;
+  std::vector<NamedInstructionSetTransform> transforms;
   const std::vector<string> transform_names =
       strings::Split(FLAGS_cpu_instructions_transforms, ",",  // NOLINT
                      strings::SkipEmpty());
   for (const string& transform_name : transform_names) {
     if (transform_name == kDefaultSet) {
-      const auto default_transforms = GetDefaultTransformPipeline();
+      const auto default_transforms = GetDefaultNamedTransformPipeline();
       transforms.insert(transforms.end(), default_transforms.begin(),
                         default_transforms.end());
     } else {
       auto* transform = FindOrNull(transforms_by_name, transform_name);
       CHECK(transform != nullptr)
           << "Transform was not found: " << transform_name;
-      transforms.push_back(*transform);
+      transforms.push_back({transform_name, *transform});
     }
   }
   return transforms;
 }
 
+std::vector<InstructionSetTransform> GetTransformsFromCommandLineFlags() {
+  std::vector<InstructionSetTransform> transforms;
+  for (const NamedInstructionSetTransform& transform :
+       GetNamedTransformsFromCommandLineFlags()) {
+    transforms.push_back(transform.transform);
+  }
+  return transforms;
+}
+
 }  // namespace cpu_instructions
@@ -30,6 +30,11 @@ namespace cpu_instructions {
 // --cpu_instructions_transforms.
 std::vector<InstructionSetTransform> GetTransformsFromCommandLineFlags();
 
+// Same as GetTransformsFromCommandLineFlags, but also returns the names of the
+// transforms, e.g. for RunTransformPipelineWithCheckpoints.
+std::vector<NamedInstructionSetTransform>
+GetNamedTransformsFromCommandLineFlags();
+
 }  // namespace cpu_instructions
 
 #endif  // CPU_INSTRUCTIONS_BASE_TRANSFORM_FACTORY_H_
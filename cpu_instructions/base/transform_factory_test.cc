@@ -40,6 +40,15 @@ TEST(TransformFactoryTest, GetTransformsFromCommandLineFlags) {
   EXPECT_EQ(GetTransformsFromCommandLineFlags().size(), 2);
 }
 
+TEST(TransformFactoryTest, GetNamedTransformsFromCommandLineFlags) {
+  FLAGS_cpu_instructions_transforms = "TestTransform2,TestTransform1";
+  const std::vector<NamedInstructionSetTransform> transforms =
+      GetNamedTransformsFromCommandLineFlags();
+  ASSERT_EQ(transforms.size(), 2);
+  EXPECT_EQ(transforms[0].name, "TestTransform2");
+  EXPECT_EQ(transforms[1].name, "TestTransform1");
+}
+
 TEST(TransformFactoryDeathTest, GetTransformsFromCommandLineFlagsDoesNotExist) {
   FLAGS_cpu_instructions_transforms = "DoesNotExist";
   EXPECT_DEATH(GetTransformsFromCommandLineFlags().size(), "");
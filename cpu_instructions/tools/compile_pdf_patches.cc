@@ -0,0 +1,66 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// This program validates a directory of patches and compiles it into a patch
+// bundle that can be passed to parse_sdm and pdf2proto instead of the
+// directory. All the errors found in the patches are reported.
+// Usage:
+// bazel run -c opt \
+// cpu_instructions/tools:compile_pdf_patches -- \
+// --cpu_instructions_patches_directory=/path/to/sdm_patches \
+// --cpu_instructions_patch_bundle_file=/path/to/sdm_patches.bundle
+
+#include "strings/string.h"
+
+#include "gflags/gflags.h"
+
+#include "cpu_instructions/proto/pdf/pdf_document.pb.h"
+#include "cpu_instructions/util/pdf/pdf_document_utils.h"
+#include "cpu_instructions/util/pdf/pdf_patch_bundle.h"
+#include "glog/logging.h"
+
+DEFINE_string(cpu_instructions_patches_directory,
+              "cpu_instructions/x86/pdf/sdm_patches/",
+              "A folder containing a set of patches to apply to original "
+              "documents.");
+DEFINE_string(cpu_instructions_patch_bundle_file, "",
+              "Where to write the compiled patches.");
+
+namespace cpu_instructions {
+namespace pdf {
+namespace {
+
+void Main() {
+  CHECK(!FLAGS_cpu_instructions_patch_bundle_file.empty())
+      << "missing --cpu_instructions_patch_bundle_file";
+  const PdfDocumentsChanges patch_sets =
+      LoadConfigurations(FLAGS_cpu_instructions_patches_directory);
+  CHECK_GT(patch_sets.documents_size(), 0)
+      << "No patches in '" << FLAGS_cpu_instructions_patches_directory << "'";
+  WritePdfPatchBundleOrDie(patch_sets,
+                           FLAGS_cpu_instructions_patch_bundle_file);
+  LOG(INFO) << "Compiled the patches of " << patch_sets.documents_size()
+            << " documents to '" << FLAGS_cpu_instructions_patch_bundle_file
+            << "'";
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace cpu_instructions
+
+int main(int argc, char** argv) {
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cpu_instructions::pdf::Main();
+  return 0;
+}
@@ -16,9 +16,11 @@
 
 #include "gflags/gflags.h"
 
+#include "cpu_instructions/base/transform_checkpoints.h"
 #include "cpu_instructions/base/transform_factory.h"
 #include "cpu_instructions/proto/instructions.pb.h"
 #include "cpu_instructions/util/proto_util.h"
+#include "cpu_instructions/util/stage_profiler.h"
 #include "cpu_instructions/x86/pdf/parse_sdm.h"
 #include "glog/logging.h"
 #include "strings/str_cat.h"
@@ -35,7 +37,8 @@ DEFINE_string(cpu_instructions_output_file_base, "",
               "Where to dump instructions");
 DEFINE_string(
     cpu_instructions_patches_directory, "cpu_instructions/x86/pdf/sdm_patches/",
-    "A folder containing a set of patches to apply to original documents");
+    "A folder containing a set of patches to apply to original documents, "
+    "or a bundle of patches compiled by compile_pdf_patches.");
 
 namespace cpu_instructions {
 namespace {
@@ -51,15 +54,26 @@ void Main() {
                               FLAGS_cpu_instructions_patches_directory,
                               FLAGS_cpu_instructions_output_file_base);
 
-  // Optionally apply transforms in --cpu_instructions_transforms.
-  CHECK_OK(RunTransformPipeline(GetTransformsFromCommandLineFlags(),
-                                &instruction_set));
+  // Optionally apply transforms in --cpu_instructions_transforms, resuming
+  // from the checkpoints in --cpu_instructions_transform_checkpoint_directory.
+  CHECK_OK(RunTransformPipelineWithCheckpoints(
+      GetNamedTransformsFromCommandLineFlags(), &instruction_set));
 
   // Write transformed intruction set.
   const string instructions_filename =
       StrCat(FLAGS_cpu_instructions_output_file_base, "_transformed.pbtxt");
   LOG(INFO) << "Saving instruction database as: " << instructions_filename;
-  WriteTextProtoOrDie(instructions_filename, instruction_set);
+  {
+    ScopedStageTimer timer("WriteTextProtoOrDie");
+    WriteTextProtoOrDie(instructions_filename, instruction_set);
+    timer.AddItems("instructions", instruction_set.instructions_size());
+  }
+
+  // Write the time and memory used by each stage of the parser.
+  const string profile_filename =
+      StrCat(FLAGS_cpu_instructions_output_file_base, ".profile.pbtxt");
+  LOG(INFO) << "Saving stage profile as: " << profile_filename;
+  WriteTextProtoOrDie(profile_filename, StageProfiler::Get()->GetReport());
 }
 
 }  // namespace
@@ -18,12 +18,18 @@
 // cpu_instructions/tools:pdf2proto -- \
 // --cpu_instructions_pdf_input_file=/path/to/file.pdf \
 // --cpu_instructions_pdf_output_file=/path/to/file.pdf.pb
+//
+// With --cpu_instructions_pdf_indexed_output, the output has a page index and
+// is not a binary PdfDocument proto; name it e.g. /path/to/file.pdf.pbidx. The
+// tools of this directory read both formats.
 
+#include <memory>
 #include "strings/string.h"
 
 #include "gflags/gflags.h"
 
 #include "cpu_instructions/proto/pdf/pdf_document.pb.h"
+#include "cpu_instructions/util/pdf/pdf_patch_bundle.h"
 #include "cpu_instructions/util/pdf/xpdf_util.h"
 #include "cpu_instructions/util/proto_util.h"
 #include "glog/logging.h"
@@ -37,7 +43,12 @@ DEFINE_string(cpu_instructions_pdf_input_file, "",
 DEFINE_string(cpu_instructions_pdf_output_file, "",
               "Where to dump instructions.");
 DEFINE_string(cpu_instructions_pdf_patch_sets_file, "",
-              "A set of patches to original documents.");
+              "A set of patches to original documents: a PdfDocumentsChanges "
+              "in text format, a directory of PdfDocumentChanges in text "
+              "format, or a bundle compiled by compile_pdf_patches.");
+DEFINE_bool(cpu_instructions_pdf_keep_characters, true,
+            "Whether to output the characters of the pages. They are needed "
+            "to inspect the segments but make the output much larger.");
 
 namespace cpu_instructions {
 namespace pdf {
@@ -49,14 +60,17 @@ void Main() {
   CHECK(!FLAGS_cpu_instructions_pdf_output_file.empty())
       << "missing --cpu_instructions_pdf_output_file";
 
-  PdfDocumentsChanges patch_sets;
-  if (!FLAGS_cpu_instructions_pdf_patch_sets_file.empty()) {
-    ReadTextProtoOrDie(FLAGS_cpu_instructions_pdf_patch_sets_file, &patch_sets);
-  }
-  const auto pdf_parse_request =
+  const std::unique_ptr<PdfPatchBundle> patch_sets =
+      FLAGS_cpu_instructions_pdf_patch_sets_file.empty()
+          ? PdfPatchBundle::FromChangesOrDie(PdfDocumentsChanges())
+          : PdfPatchBundle::LoadOrDie(
+                FLAGS_cpu_instructions_pdf_patch_sets_file);
+  auto pdf_parse_request =
       ParseRequestOrDie(FLAGS_cpu_instructions_pdf_input_file);
-  WriteBinaryProtoOrDie(FLAGS_cpu_instructions_pdf_output_file,
-                        ParseOrDie(pdf_parse_request, patch_sets));
+  pdf_parse_request.set_keep_characters(
+      FLAGS_cpu_instructions_pdf_keep_characters);
+  ParseToFileOrDie(pdf_parse_request, *patch_sets,
+                   FLAGS_cpu_instructions_pdf_output_file);
 }
 
 }  // namespace
@@ -20,9 +20,20 @@
 // --cpu_instructions_proto_input_file=/path/to/sdm.pdf.pb \
 // --cpu_instructions_match_expression='SAL/SAR/SHL/SHR' \
 // --cpu_instructions_page_numbers=662
+//
+// The input files are binary PdfDocument protos, or indexed documents written
+// by pdf2proto with --cpu_instructions_pdf_indexed_output.
+//
+// The text of the document is indexed the first time it is searched, see
+// cpu_instructions/util/pdf/pdf_text_index.h. With
+// --cpu_instructions_interactive, the regular expressions are read from the
+// standard input, one per line, and the document is only loaded once.
 
 #include <algorithm>
-#include <unordered_map>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
 #include <unordered_set>
 #include <vector>
 #include "strings/string.h"
@@ -30,11 +41,9 @@
 #include "gflags/gflags.h"
 
 #include "cpu_instructions/proto/pdf/pdf_document.pb.h"
-#include "cpu_instructions/util/pdf/xpdf_util.h"
-#include "cpu_instructions/util/proto_util.h"
+#include "cpu_instructions/util/pdf/pdf_text_index.h"
 #include "glog/logging.h"
 #include "re2/re2.h"
-#include "strings/str_split.h"
 #include "util/gtl/map_util.h"
 
 DEFINE_string(cpu_instructions_proto_input_file, "",
@@ -43,21 +52,22 @@ DEFINE_string(cpu_instructions_match_expression, "",
               "The regular expression to match cells to patch.");
 DEFINE_string(cpu_instructions_page_numbers, "",
               "A list of page numbers to process, all pages if not set.");
+DEFINE_string(cpu_instructions_text_index_file, "",
+              "Where the index of the text of the input file is stored. "
+              "Defaults to <cpu_instructions_proto_input_file>.text_index. "
+              "The index is rebuilt when the input file changes.");
+DEFINE_bool(cpu_instructions_interactive, false,
+            "Whether to read the regular expressions from the standard input, "
+            "one per line, instead of --cpu_instructions_match_expression.");
 
 namespace cpu_instructions {
 namespace pdf {
 namespace {
 
-bool ShouldProcessTextBlock(const PdfTextBlock& block) {
-  if (FLAGS_cpu_instructions_match_expression.empty()) return true;
-  return RE2::PartialMatch(block.text(),
-                           FLAGS_cpu_instructions_match_expression);
-}
-
 bool ShouldProcessPage(const std::unordered_set<size_t>& allowed_pages,
-                       const PdfPage& page) {
+                       int page_number) {
   if (allowed_pages.empty()) return true;
-  return ContainsKey(allowed_pages, page.number());
+  return ContainsKey(allowed_pages, page_number);
 }
 
 std::unordered_set<size_t> ParsePageNumbers() {
@@ -73,39 +83,25 @@ std::unordered_set<size_t> ParsePageNumbers() {
   return pages;
 }
 
-void Main() {
-  CHECK(!FLAGS_cpu_instructions_proto_input_file.empty())
-      << "missing --cpu_instructions_proto_input_file";
-  CHECK(!FLAGS_cpu_instructions_match_expression.empty())
-      << "missing --cpu_instructions_match_expression";
-
-  const auto pdf_document = ReadBinaryProtoOrDie<PdfDocument>(
-      FLAGS_cpu_instructions_proto_input_file);
-
-  // Prepare patches.
-  const auto pages = ParsePageNumbers();
+// Returns the patches replacing the cells of 'index' that match 'regexp' by
+// themselves, for the pages in 'pages'.
+PdfDocumentsChanges GetPatches(const PdfTextIndex& index, const RE2& regexp,
+                               const std::unordered_set<size_t>& pages) {
   std::map<size_t, std::vector<PdfPagePatch>> page_patches;
-  for (const auto& page : pdf_document.pages()) {
-    if (!ShouldProcessPage(pages, page)) continue;
-
-    for (const auto& row : page.rows()) {
-      for (const auto& block : row.blocks()) {
-        if (ShouldProcessTextBlock(block)) {
-          PdfPagePatch patch;
-          patch.set_row(block.row());
-          patch.set_col(block.col());
-          patch.set_expected(block.text());
-          patch.set_replacement(block.text());
-          page_patches[page.number()].push_back(patch);
-        }
-      }
-    }
+  for (const PdfTextIndex::Block* block : index.Search(regexp)) {
+    if (!ShouldProcessPage(pages, block->page_number())) continue;
+    PdfPagePatch patch;
+    patch.set_row(block->row());
+    patch.set_col(block->col());
+    patch.set_expected(block->text());
+    patch.set_replacement(block->text());
+    page_patches[block->page_number()].push_back(patch);
   }
 
   // Gather patches per page.
   PdfDocumentsChanges documents_changes;
   auto* document_changes = documents_changes.add_documents();
-  *document_changes->mutable_document_id() = pdf_document.document_id();
+  *document_changes->mutable_document_id() = index.index().document_id();
   for (const auto& page_patches_pair : page_patches) {
     auto* page_patches = document_changes->add_pages();
     page_patches->set_page_number(page_patches_pair.first);
@@ -114,9 +110,56 @@ void Main() {
               google::protobuf::RepeatedFieldBackInserter(
                   page_patches->mutable_patches()));
   }
+  return documents_changes;
+}
+
+// Reads regular expressions from the standard input until it is closed, and
+// displays the patches of each of them.
+void RunInteractive(const PdfTextIndex& index,
+                    const std::unordered_set<size_t>& pages) {
+  std::cout << "Indexed " << index.num_blocks()
+            << " cells. Enter a regular expression per line." << std::endl;
+  string line;
+  while (std::cout << "> " << std::flush, std::getline(std::cin, line)) {
+    if (line.empty()) continue;
+    const RE2 regexp(line, RE2::Quiet);
+    if (!regexp.ok()) {
+      std::cout << "Invalid regular expression: " << regexp.error()
+                << std::endl;
+      continue;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    const PdfDocumentsChanges changes = GetPatches(index, regexp, pages);
+    const std::chrono::duration<double, std::milli> duration =
+        std::chrono::steady_clock::now() - start;
+    int num_patches = 0;
+    for (const PdfPageChanges& page : changes.documents(0).pages()) {
+      num_patches += page.patches_size();
+    }
+    std::cout << changes.DebugString() << num_patches << " cells in "
+              << duration.count() << " ms" << std::endl;
+  }
+}
+
+void Main() {
+  CHECK(!FLAGS_cpu_instructions_proto_input_file.empty())
+      << "missing --cpu_instructions_proto_input_file";
+  CHECK(FLAGS_cpu_instructions_interactive ||
+        !FLAGS_cpu_instructions_match_expression.empty())
+      << "missing --cpu_instructions_match_expression";
+
+  const auto index =
+      PdfTextIndex::LoadOrBuildOrDie(FLAGS_cpu_instructions_proto_input_file,
+                                     FLAGS_cpu_instructions_text_index_file);
+  const auto pages = ParsePageNumbers();
+  if (FLAGS_cpu_instructions_interactive) {
+    RunInteractive(*index, pages);
+    return;
+  }
 
   // Display patches.
-  documents_changes.PrintDebugString();
+  GetPatches(*index, RE2(FLAGS_cpu_instructions_match_expression), pages)
+      .PrintDebugString();
 }
 
 }  // namespace
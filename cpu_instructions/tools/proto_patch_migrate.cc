@@ -20,6 +20,9 @@
 // --cpu_instructions_proto_input_file=/path/to/sdm.pdf.pb \
 // --cpu_instructions_match_expression='SAL/SAR/SHL/SHR' \
 // --cpu_instructions_page_numbers=662
+//
+// The input files are binary PdfDocument protos, or indexed documents written
+// by pdf2proto with --cpu_instructions_pdf_indexed_output.
 
 #include <algorithm>
 #include <unordered_map>
@@ -30,6 +33,7 @@
 #include "gflags/gflags.h"
 
 #include "cpu_instructions/proto/pdf/pdf_document.pb.h"
+#include "cpu_instructions/util/pdf/pdf_document_stream.h"
 #include "cpu_instructions/util/pdf/pdf_document_utils.h"
 #include "cpu_instructions/util/pdf/xpdf_util.h"
 #include "cpu_instructions/util/proto_util.h"
@@ -109,7 +113,7 @@ void Main() {
   LOG(INFO) << "Opening original document "
             << FLAGS_cpu_instructions_from_proto_file;
   const auto from_document =
-      ReadBinaryProtoOrDie<PdfDocument>(FLAGS_cpu_instructions_from_proto_file);
+      ReadPdfDocumentOrDie(FLAGS_cpu_instructions_from_proto_file);
   LOG(INFO) << "Opening patches from "
             << FLAGS_cpu_instructions_patches_directory;
   const auto patch_sets =
@@ -121,7 +125,7 @@ void Main() {
   LOG(INFO) << "Opening destination document "
             << FLAGS_cpu_instructions_to_proto_file;
   const auto to_document =
-      ReadBinaryProtoOrDie<PdfDocument>(FLAGS_cpu_instructions_to_proto_file);
+      ReadPdfDocumentOrDie(FLAGS_cpu_instructions_to_proto_file);
 
   PdfDocumentChanges successful_patches;
   PdfDocumentChanges failed_patches;
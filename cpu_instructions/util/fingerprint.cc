@@ -0,0 +1,55 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/fingerprint.h"
+
+#include "base/stringprintf.h"
+
+namespace cpu_instructions {
+
+namespace {
+
+// 64-bit FNV-1a, see http://www.isthe.com/chongo/tech/comp/fnv/.
+constexpr uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ULL;
+constexpr uint64_t kFnvPrime = 0x100000001b3ULL;
+
+uint64_t FnvAppend(uint64_t hash, const char* data, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= kFnvPrime;
+  }
+  return hash;
+}
+
+}  // namespace
+
+uint64_t Fingerprint(StringPiece data) {
+  return FnvAppend(kFnvOffsetBasis, data.data(), data.size());
+}
+
+uint64_t FingerprintCat(uint64_t a, uint64_t b) {
+  char buffer[2 * sizeof(uint64_t)];
+  for (int i = 0; i < 8; ++i) {
+    buffer[i] = static_cast<char>(a >> (8 * i));
+    buffer[8 + i] = static_cast<char>(b >> (8 * i));
+  }
+  return Fingerprint(StringPiece(buffer, sizeof(buffer)));
+}
+
+string FingerprintToString(uint64_t fingerprint) {
+  return StringPrintf(
+      "%016llx", static_cast<unsigned long long>(fingerprint));  // NOLINT
+}
+
+}  // namespace cpu_instructions
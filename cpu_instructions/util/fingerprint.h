@@ -0,0 +1,43 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Stable 64-bit fingerprints of strings.
+//
+// Unlike std::hash, the fingerprints do not depend on the platform, the
+// compiler or the run, and can be persisted (e.g. as cache keys). The
+// fingerprints of protos are in proto_fingerprint.h, which is kept separate so
+// that this library does not depend on the full protobuf library.
+
+#ifndef CPU_INSTRUCTIONS_UTIL_FINGERPRINT_H_
+#define CPU_INSTRUCTIONS_UTIL_FINGERPRINT_H_
+
+#include <cstdint>
+#include "strings/string.h"
+
+#include "strings/string_view.h"
+
+namespace cpu_instructions {
+
+// Returns the fingerprint of 'data'.
+uint64_t Fingerprint(StringPiece data);
+
+// Returns a fingerprint of the pair (a, b). The order of the arguments matters.
+uint64_t FingerprintCat(uint64_t a, uint64_t b);
+
+// Returns 'fingerprint' as a 16 character hexadecimal string.
+string FingerprintToString(uint64_t fingerprint);
+
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_UTIL_FINGERPRINT_H_
@@ -0,0 +1,38 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/fingerprint.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace cpu_instructions {
+namespace {
+
+TEST(FingerprintTest, IsStable) {
+  // These values must never change, fingerprints are persisted.
+  EXPECT_EQ(Fingerprint(""), 0xcbf29ce484222325ULL);
+  EXPECT_EQ(Fingerprint("a"), 0xaf63dc4c8601ec8cULL);
+  EXPECT_EQ(FingerprintToString(Fingerprint("foobar")), "85944171f73967e8");
+}
+
+TEST(FingerprintTest, FingerprintCatIsOrderDependent) {
+  const uint64_t a = Fingerprint("a");
+  const uint64_t b = Fingerprint("b");
+  EXPECT_EQ(FingerprintCat(a, b), FingerprintCat(a, b));
+  EXPECT_NE(FingerprintCat(a, b), FingerprintCat(b, a));
+}
+
+}  // namespace
+}  // namespace cpu_instructions
@@ -16,82 +16,109 @@
 
 #include <stddef.h>
 #include <algorithm>
-#include <vector>
 
 #include "cpu_instructions/proto/instructions.pb.h"
 #include "glog/logging.h"
 #include "strings/str_cat.h"
 #include "strings/string_view.h"
-#include "strings/strip.h"
 
 namespace cpu_instructions {
 
-namespace {
-bool ContainsPrefix(StringPiece s, const std::vector<StringPiece>& prefixes) {
-  for (const auto& prefix : prefixes) {
-    if (s.substr(0, prefix.size()) == prefix) {
-      return true;
+void InstructionSyntaxLexer::SkipWhitespace() { ConsumeWhile(IsWhitespace); }
+
+bool InstructionSyntaxLexer::ConsumeChar(char c) {
+  if (input_.empty() || input_[0] != c) return false;
+  input_.remove_prefix(1);
+  return true;
+}
+
+StringPiece InstructionSyntaxLexer::ConsumeUntil(StringPiece delimiters,
+                                                 bool skip_parentheses) {
+  int depth = 0;
+  size_t size = 0;
+  for (; size < input_.size(); ++size) {
+    const char c = input_[size];
+    if (skip_parentheses && c == '(') {
+      ++depth;
+    } else if (skip_parentheses && c == ')') {
+      if (depth > 0) --depth;
+    } else if (depth == 0 && delimiters.find(c) != StringPiece::npos) {
+      break;
     }
   }
-  return false;
+  const StringPiece token = input_.substr(0, size);
+  input_.remove_prefix(size);
+  return token;
 }
 
-std::vector<string> SeparateOperandsWithCommas(const string& s) {
-  std::vector<string> result;
-  bool in_parenthesis = false;
-  int start = 0;
-  for (int i = 0; i < s.size(); ++i) {
-    const char& c = s[i];
-    if (c == '(') {
-      in_parenthesis = true;
-    } else if (c == ')') {
-      in_parenthesis = false;
-    } else if (c == ',' && !in_parenthesis) {
-      result.push_back(s.substr(start, i - start));
-      start = i + 1;
-    }
+StringPiece InstructionSyntaxLexer::ConsumedSince(
+    const InstructionSyntaxLexer& checkpoint) const {
+  return StringPiece(checkpoint.input_.data(),
+                     input_.data() - checkpoint.input_.data());
+}
+
+StringPiece InstructionSyntaxLexer::StripWhitespace(StringPiece text) {
+  while (!text.empty() && IsWhitespace(text[0])) text.remove_prefix(1);
+  while (!text.empty() && IsWhitespace(text[text.size() - 1])) {
+    text.remove_suffix(1);
   }
-  result.push_back(s.substr(start, s.size() - start));
-  return result;
+  return text;
+}
+
+bool InstructionSyntaxLexer::IsWhitespace(char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
 }
+
+namespace {
+
+bool HasX86Prefix(StringPiece s) {
+  for (const char* const prefix : {"LOCK", "REP"}) {
+    if (s.starts_with(prefix)) return true;
+  }
+  return false;
+}
+
+// Copies 'text' to 'output', replacing tabs by spaces.
+void AssignWithSpaces(StringPiece text, string* output) {
+  output->assign(text.data(), text.size());
+  std::replace(output->begin(), output->end(), '\t', ' ');
+}
+
 }  // namespace
 
-InstructionFormat ParseAssemblyStringOrDie(const string& code) {
+InstructionFormat ParseAssemblyStringOrDie(StringPiece code) {
   // The syntax always has the format [prefix] mnemonic op1, op2[, op3].
-  // We parse it by first splitting the string by commas; this will separate the
-  // mnemonic and the first operand from the other operands. Then we split the
-  // mnemonic and the first operand by spaces.
+  // The input is split by the commas that are not between parentheses; this
+  // separates the mnemonic and the first operand from the other operands. Then
+  // the mnemonic and the first operand are split by spaces.
   InstructionFormat proto;
-  std::vector<string> parts = SeparateOperandsWithCommas(code);
-  CHECK(!parts.empty());
-  // Parse the mnemonic and the optional first operand.
-  string mnemonic_and_first_operand = parts[0];
-  StripWhitespace(&mnemonic_and_first_operand);
-  std::replace(mnemonic_and_first_operand.begin(),
-               mnemonic_and_first_operand.end(), '\t', ' ');
-
+  InstructionSyntaxLexer lexer(code);
+  const StringPiece mnemonic_and_first_operand =
+      InstructionSyntaxLexer::StripWhitespace(lexer.ConsumeUntil(",", true));
   CHECK(!mnemonic_and_first_operand.empty());
-  const std::vector<StringPiece> kX86Prefixes = {"LOCK", "REP"};
-  size_t delimiting_space = mnemonic_and_first_operand.find_first_of(' ');
-  if (delimiting_space != string::npos &&
-      ContainsPrefix(mnemonic_and_first_operand, kX86Prefixes)) {
+  constexpr char kSpaces[] = " \t";
+  size_t delimiting_space = mnemonic_and_first_operand.find_first_of(kSpaces);
+  if (delimiting_space != StringPiece::npos &&
+      HasX86Prefix(mnemonic_and_first_operand)) {
     delimiting_space =
-        mnemonic_and_first_operand.find_first_of(' ', delimiting_space + 1);
+        mnemonic_and_first_operand.find_first_of(kSpaces, delimiting_space + 1);
   }
-  if (delimiting_space == string::npos) {
-    proto.set_mnemonic(mnemonic_and_first_operand);
+  if (delimiting_space == StringPiece::npos) {
+    AssignWithSpaces(mnemonic_and_first_operand, proto.mutable_mnemonic());
   } else {
-    proto.set_mnemonic(mnemonic_and_first_operand.substr(0, delimiting_space));
-    proto.add_operands()->set_name(
-        mnemonic_and_first_operand.substr(delimiting_space + 1));
+    AssignWithSpaces(mnemonic_and_first_operand.substr(0, delimiting_space),
+                     proto.mutable_mnemonic());
+    AssignWithSpaces(mnemonic_and_first_operand.substr(delimiting_space + 1),
+                     proto.add_operands()->mutable_name());
   }
 
   // Copy the remaining operands.
-  for (int i = 1; i < parts.size(); ++i) {
-    string operand = parts[i];
-    StripWhitespace(&operand);
-    proto.add_operands()->set_name(operand);
+  while (lexer.ConsumeChar(',')) {
+    const StringPiece operand =
+        InstructionSyntaxLexer::StripWhitespace(lexer.ConsumeUntil(",", true));
+    proto.add_operands()->set_name(operand.data(), operand.size());
   }
+  CHECK(lexer.AtEnd());
   return proto;
 }
 
@@ -18,14 +18,68 @@
 #include "strings/string.h"
 
 #include "cpu_instructions/proto/instructions.pb.h"
+#include "strings/string_view.h"
 
 namespace cpu_instructions {
 
+// A hand-written lexer for the syntax of instructions, i.e.
+// "[prefix] mnemonic op1, op2[, op3]", shared by the parsers of the assembly
+// and vendor syntaxes. The tokens are views of the input, so lexing does not
+// allocate and the input must outlive the tokens. The lexer is copyable, which
+// is how parsers look ahead and backtrack.
+class InstructionSyntaxLexer {
+ public:
+  explicit InstructionSyntaxLexer(StringPiece input) : input_(input) {}
+
+  // Whether the whole input was consumed.
+  bool AtEnd() const { return input_.empty(); }
+
+  // The input that was not consumed yet.
+  StringPiece remaining() const { return input_; }
+
+  // Consumes the whitespace at the start of the remaining input.
+  void SkipWhitespace();
+
+  // Consumes 'c' if it is the next character. Returns whether it did.
+  bool ConsumeChar(char c);
+
+  // Consumes and returns the longest prefix of the remaining input whose
+  // characters satisfy 'predicate'.
+  template <typename Predicate>
+  StringPiece ConsumeWhile(const Predicate& predicate);
+
+  // Consumes and returns the text up to the next character in 'delimiters', or
+  // up to the end of the input. The delimiter is not consumed. When
+  // 'skip_parentheses' is true, the delimiters between parentheses are part of
+  // the text, e.g. "(%rsp,%ymm12,8)".
+  StringPiece ConsumeUntil(StringPiece delimiters, bool skip_parentheses);
+
+  // Returns the text consumed since 'checkpoint', a copy of this lexer.
+  StringPiece ConsumedSince(const InstructionSyntaxLexer& checkpoint) const;
+
+  // Returns 'text' without its leading and trailing whitespace.
+  static StringPiece StripWhitespace(StringPiece text);
+
+  static bool IsWhitespace(char c);
+
+ private:
+  StringPiece input_;
+};
+
+template <typename Predicate>
+StringPiece InstructionSyntaxLexer::ConsumeWhile(const Predicate& predicate) {
+  size_t size = 0;
+  while (size < input_.size() && predicate(input_[size])) ++size;
+  const StringPiece token = input_.substr(0, size);
+  input_.remove_prefix(size);
+  return token;
+}
+
 // Parses a code string in assembly format and returns a corresponding
 // InstructionFormat.
 // NOTE(bdb): This only handles x86 prefixes.
 // TODO(bdb): Make this x86-independent.
-InstructionFormat ParseAssemblyStringOrDie(const string& code);
+InstructionFormat ParseAssemblyStringOrDie(StringPiece code);
 
 // Returns an assembler-ready string corresponding to the InstructionFormat
 // passed as argument.
@@ -0,0 +1,166 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/pdf/character_distances.h"
+
+#include <cfloat>
+#include <cmath>
+
+#include "glog/logging.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace cpu_instructions {
+namespace pdf {
+
+CharacterDistances::CharacterDistances(const Glyphs& glyphs,
+                                       double max_distance_ratio)
+    : max_distance_ratio_(max_distance_ratio) {
+  const size_t size = glyphs.size();
+  for (auto* values : {&center_x_, &center_y_, &left_, &top_, &right_,
+                       &bottom_, &font_size_}) {
+    values->reserve(size);
+  }
+  orientation_.reserve(size);
+  for (size_t i = 0; i < size; ++i) {
+    const Glyph& glyph = glyphs.Get(i);
+    const Point center = GetCenter(glyph);
+    center_x_.push_back(center.x);
+    center_y_.push_back(center.y);
+    left_.push_back(glyph.left);
+    top_.push_back(glyph.top);
+    right_.push_back(glyph.right);
+    bottom_.push_back(glyph.bottom);
+    font_size_.push_back(glyph.font_size);
+    orientation_.push_back(glyph.orientation);
+  }
+}
+
+// The distance along a direction vector such as (-1, 0) is x * -1 + y * 0,
+// which is exactly -x. Likewise the span of a box along WEST is [-right, -left]
+// and intersects the span of another box along WEST iff their spans along EAST
+// intersect. This is why only the sign of the forward direction is kept.
+CharacterDistances::Query CharacterDistances::GetQuery(size_t index) const {
+  Query query;
+  query.orientation = orientation_[index];
+  switch (query.orientation) {
+    case NORTH:
+    case SOUTH:
+      query.centers = center_y_.data();
+      query.side_min = left_.data();
+      query.side_max = right_.data();
+      query.sign = query.orientation == NORTH ? -1.0f : 1.0f;
+      break;
+    case EAST:
+    case WEST:
+      query.centers = center_x_.data();
+      query.side_min = top_.data();
+      query.side_max = bottom_.data();
+      query.sign = query.orientation == WEST ? -1.0f : 1.0f;
+      break;
+    default:
+      LOG(FATAL) << "Invalid orientation " << query.orientation;
+  }
+  query.center = query.centers[index];
+  query.min = query.side_min[index];
+  query.max = query.side_max[index];
+  // The maximal distance is computed in double precision and the comparison
+  // must be strict: 'distance < limit' is the same as 'distance <= max' where
+  // max is the largest float strictly smaller than limit.
+  const double limit = max_distance_ratio_ * font_size_[index];
+  query.max_distance = static_cast<float>(limit);
+  if (query.max_distance >= limit) {
+    query.max_distance = std::nextafter(query.max_distance, -INFINITY);
+  }
+  return query;
+}
+
+void CharacterDistances::Compute(size_t index, const Indices& candidates,
+                                 std::vector<float>* distances) const {
+  CHECK(distances != nullptr);
+  distances->resize(candidates.size());
+  const Query query = GetQuery(index);
+  size_t i = 0;
+#if defined(__SSE2__)
+  // Candidates are scattered in the packed arrays, so they are loaded into
+  // vectors one lane at a time. The rest of the computation is branch free.
+  const __m128 sign = _mm_set1_ps(query.sign);
+  const __m128 center = _mm_set1_ps(query.center);
+  const __m128 min = _mm_set1_ps(query.min);
+  const __m128 max = _mm_set1_ps(query.max);
+  const __m128i orientation = _mm_set1_epi32(query.orientation);
+  const __m128 max_distance = _mm_set1_ps(query.max_distance);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 flt_max = _mm_set1_ps(FLT_MAX);
+  for (; i + 4 <= candidates.size(); i += 4) {
+    const size_t a = candidates[i];
+    const size_t b = candidates[i + 1];
+    const size_t c = candidates[i + 2];
+    const size_t d = candidates[i + 3];
+    const __m128 other_center =
+        _mm_setr_ps(query.centers[a], query.centers[b], query.centers[c],
+                    query.centers[d]);
+    const __m128 other_min =
+        _mm_setr_ps(query.side_min[a], query.side_min[b], query.side_min[c],
+                    query.side_min[d]);
+    const __m128 other_max =
+        _mm_setr_ps(query.side_max[a], query.side_max[b], query.side_max[c],
+                    query.side_max[d]);
+    const __m128i other_orientation =
+        _mm_setr_epi32(orientation_[a], orientation_[b], orientation_[c],
+                       orientation_[d]);
+    const __m128 distance = _mm_mul_ps(_mm_sub_ps(other_center, center), sign);
+    const __m128 same_line =
+        _mm_and_ps(_mm_cmpge_ps(max, other_min), _mm_cmple_ps(min, other_max));
+    const __m128 same_orientation =
+        _mm_castsi128_ps(_mm_cmpeq_epi32(orientation, other_orientation));
+    const __m128 within_distance = _mm_and_ps(
+        _mm_cmpgt_ps(distance, zero), _mm_cmple_ps(distance, max_distance));
+    const __m128 valid = _mm_and_ps(_mm_and_ps(same_line, same_orientation),
+                                    within_distance);
+    _mm_storeu_ps(distances->data() + i,
+                  _mm_or_ps(_mm_and_ps(valid, distance),
+                            _mm_andnot_ps(valid, flt_max)));
+  }
+#endif
+  ComputeScalar(query, candidates, i, distances->data());
+}
+
+void CharacterDistances::ComputeScalar(size_t index, const Indices& candidates,
+                                       std::vector<float>* distances) const {
+  CHECK(distances != nullptr);
+  distances->resize(candidates.size());
+  ComputeScalar(GetQuery(index), candidates, 0, distances->data());
+}
+
+void CharacterDistances::ComputeScalar(const Query& query,
+                                       const Indices& candidates, size_t begin,
+                                       float* distances) const {
+  for (size_t i = begin; i < candidates.size(); ++i) {
+    const size_t other = candidates[i];
+    const float distance = (query.centers[other] - query.center) * query.sign;
+    const bool same_line = query.max >= query.side_min[other] &&
+                           query.min <= query.side_max[other];
+    const bool same_orientation = query.orientation == orientation_[other];
+    const bool within_distance =
+        distance > 0 && distance <= query.max_distance;
+    distances[i] =
+        same_line && same_orientation && within_distance ? distance : FLT_MAX;
+  }
+}
+
+}  // namespace pdf
+}  // namespace cpu_instructions
@@ -0,0 +1,96 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A batched kernel computing the distances used to link characters into
+// segments.
+
+#ifndef CPU_INSTRUCTIONS_UTIL_PDF_CHARACTER_DISTANCES_H_
+#define CPU_INSTRUCTIONS_UTIL_PDF_CHARACTER_DISTANCES_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "cpu_instructions/util/pdf/geometry.h"
+#include "cpu_instructions/util/pdf/glyphs.h"
+
+namespace cpu_instructions {
+namespace pdf {
+
+// Computes the forward distance between a character and a batch of candidate
+// characters.
+//
+// The distance from a to b is the projection of the vector between their
+// centers on the forward direction of a. It is FLT_MAX when b does not have the
+// same orientation as a, when the sideways spans of a and b do not intersect
+// (they are not on the same line), when b is not strictly forward of a, or when
+// b is not closer than 'max_distance_ratio' times the font size of a.
+//
+// The characters are copied to packed float arrays once so that a batch can be
+// evaluated with SIMD instructions. The results are bit for bit the same as
+// those of the scalar computation with Span and Vec2F.
+class CharacterDistances {
+ public:
+  CharacterDistances(const Glyphs& glyphs, double max_distance_ratio);
+
+  // Sets distances[i] to the distance from characters[index] to
+  // characters[candidates[i]]. 'distances' is resized to candidates.size().
+  void Compute(size_t index, const Indices& candidates,
+               std::vector<float>* distances) const;
+
+  // Same as Compute but does not use SIMD instructions. Exposed for testing.
+  void ComputeScalar(size_t index, const Indices& candidates,
+                     std::vector<float>* distances) const;
+
+ private:
+  // The data needed to compute distances from one character. The forward axis
+  // is x for EAST and WEST characters and y for NORTH and SOUTH characters,
+  // the sideways axis is the other one.
+  struct Query {
+    // The packed coordinates of all the characters: centers along the forward
+    // axis, and bounds along the sideways axis.
+    const float* centers = nullptr;
+    const float* side_min = nullptr;
+    const float* side_max = nullptr;
+    // -1 when the forward direction goes toward decreasing coordinates.
+    float sign = 1.0f;
+    // The same values for the queried character.
+    float center = 0.0f;
+    float min = 0.0f;
+    float max = 0.0f;
+    int32_t orientation = 0;
+    // The largest float strictly smaller than the maximal distance.
+    float max_distance = 0.0f;
+  };
+
+  Query GetQuery(size_t index) const;
+
+  // Handles candidates [begin, candidates.size()).
+  void ComputeScalar(const Query& query, const Indices& candidates,
+                     size_t begin, float* distances) const;
+
+  const double max_distance_ratio_;
+  std::vector<float> center_x_;
+  std::vector<float> center_y_;
+  std::vector<float> left_;
+  std::vector<float> top_;
+  std::vector<float> right_;
+  std::vector<float> bottom_;
+  std::vector<float> font_size_;
+  std::vector<int32_t> orientation_;
+};
+
+}  // namespace pdf
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_UTIL_PDF_CHARACTER_DISTANCES_H_
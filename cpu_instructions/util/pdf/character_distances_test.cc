@@ -0,0 +1,137 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/pdf/character_distances.h"
+
+#include <cfloat>
+#include <random>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace cpu_instructions {
+namespace pdf {
+namespace {
+
+using ::testing::ElementsAre;
+
+constexpr double kMaxDistanceRatio = 0.9;
+
+void AddCharacter(float left, float top, float right, float bottom,
+                  float font_size, Orientation orientation,
+                  Glyphs* glyphs) {
+  Glyph glyph;
+  glyph.left = left;
+  glyph.top = top;
+  glyph.right = right;
+  glyph.bottom = bottom;
+  glyph.font_size = font_size;
+  glyph.orientation = orientation;
+  glyphs->Add(glyph, "a");
+}
+
+// The distance as computed by ClusterCharacters before the kernel existed.
+float GetReferenceDistance(const Glyph& a, const Glyph& b) {
+  const Orientation sideways = RotateClockwise90(a.orientation);
+  const Span v_span_a = GetSpan(GetBoundingBox(a), sideways);
+  const Span v_span_b = GetSpan(GetBoundingBox(b), sideways);
+  const bool same_line = v_span_a.Intersects(v_span_b);
+  const bool same_orientation = a.orientation == b.orientation;
+  const Vec2F forward = GetDirectionVector(a.orientation);
+  const float distance = (GetCenter(b) - GetCenter(a)).dot_product(forward);
+  const bool within_distance =
+      distance > 0 && distance < kMaxDistanceRatio * a.font_size;
+  if (same_line && same_orientation && within_distance) {
+    return distance;
+  }
+  return FLT_MAX;
+}
+
+Indices GetAllIndices(const Glyphs& characters) {
+  Indices indices;
+  for (size_t i = 0; i < characters.size(); ++i) indices.push_back(i);
+  return indices;
+}
+
+TEST(CharacterDistancesTest, Simple) {
+  Glyphs characters;
+  AddCharacter(0.0f, 0.0f, 5.0f, 10.0f, 10.0f, EAST, &characters);
+  // Forward on the same line.
+  AddCharacter(5.0f, 0.0f, 10.0f, 10.0f, 10.0f, EAST, &characters);
+  // Backward.
+  AddCharacter(-5.0f, 0.0f, 0.0f, 10.0f, 10.0f, EAST, &characters);
+  // On the next line.
+  AddCharacter(5.0f, 11.0f, 10.0f, 21.0f, 10.0f, EAST, &characters);
+  // Too far.
+  AddCharacter(10.0f, 0.0f, 15.0f, 10.0f, 10.0f, EAST, &characters);
+  // Another orientation.
+  AddCharacter(5.0f, 0.0f, 10.0f, 10.0f, 10.0f, SOUTH, &characters);
+  const CharacterDistances distances(characters, kMaxDistanceRatio);
+  std::vector<float> output;
+  distances.Compute(0, GetAllIndices(characters), &output);
+  EXPECT_THAT(output,
+              ElementsAre(FLT_MAX, 5.0f, FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX));
+  distances.ComputeScalar(0, GetAllIndices(characters), &output);
+  EXPECT_THAT(output,
+              ElementsAre(FLT_MAX, 5.0f, FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX));
+  distances.Compute(0, {}, &output);
+  EXPECT_THAT(output, ElementsAre());
+}
+
+TEST(CharacterDistancesTest, MaxDistanceIsExclusive) {
+  Glyphs characters;
+  // kMaxDistanceRatio * 10 is 9 in double precision.
+  AddCharacter(0.0f, 0.0f, 2.0f, 10.0f, 10.0f, EAST, &characters);
+  AddCharacter(9.0f, 0.0f, 11.0f, 10.0f, 10.0f, EAST, &characters);
+  AddCharacter(8.0f, 0.0f, 10.0f, 10.0f, 10.0f, EAST, &characters);
+  const CharacterDistances distances(characters, kMaxDistanceRatio);
+  std::vector<float> output;
+  distances.Compute(0, {1, 2, 1, 2, 1}, &output);
+  EXPECT_THAT(output, ElementsAre(FLT_MAX, 8.0f, FLT_MAX, 8.0f, FLT_MAX));
+}
+
+TEST(CharacterDistancesTest, SameAsReference) {
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<float> coordinate(0.0f, 100.0f);
+  std::uniform_real_distribution<float> size(0.5f, 12.0f);
+  std::uniform_int_distribution<int> orientation(NORTH, WEST);
+  Glyphs characters;
+  for (int i = 0; i < 500; ++i) {
+    const float left = coordinate(generator);
+    const float top = coordinate(generator);
+    const Orientation character_orientation =
+        static_cast<Orientation>(orientation(generator));
+    AddCharacter(left, top, left + size(generator), top + size(generator),
+                 size(generator), character_orientation, &characters);
+  }
+  const CharacterDistances distances(characters, kMaxDistanceRatio);
+  const Indices candidates = GetAllIndices(characters);
+  std::vector<float> output;
+  std::vector<float> scalar_output;
+  for (size_t i = 0; i < characters.size(); ++i) {
+    distances.Compute(i, candidates, &output);
+    distances.ComputeScalar(i, candidates, &scalar_output);
+    for (size_t j = 0; j < characters.size(); ++j) {
+      const float expected =
+          GetReferenceDistance(characters.Get(i), characters.Get(j));
+      ASSERT_EQ(output[j], expected) << i << " " << j;
+      ASSERT_EQ(scalar_output[j], expected) << i << " " << j;
+    }
+  }
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace cpu_instructions
@@ -14,7 +14,10 @@
 
 #include "cpu_instructions/util/pdf/geometry.h"
 
+#include <algorithm>
 #include <cfloat>
+#include <cmath>
+#include <numeric>
 
 #include "glog/logging.h"
 
@@ -119,6 +122,90 @@ void QuadTree::Subdivide() {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+constexpr const int UniformGrid::kMaxCellsPerAxis;
+
+UniformGrid::UniformGrid(const BoundingBox& bounding_box, float cell_size,
+                         const std::vector<Point>& points)
+    : bounding_box_(bounding_box) {
+  CHECK_GT(cell_size, 0);
+  const auto GetNumCells = [cell_size](float length) {
+    const float num_cells = std::ceil(length / cell_size);
+    return std::max(1, std::min(kMaxCellsPerAxis, static_cast<int>(num_cells)));
+  };
+  num_columns_ = GetNumCells(GetWidth(bounding_box));
+  num_rows_ = GetNumCells(GetHeight(bounding_box));
+  const float width = GetWidth(bounding_box);
+  const float height = GetHeight(bounding_box);
+  inverse_cell_width_ = width > 0 ? num_columns_ / width : 0.0f;
+  inverse_cell_height_ = height > 0 ? num_rows_ / height : 0.0f;
+
+  // Counting sort of the points by cell, which keeps the points of a cell in
+  // increasing index order.
+  const size_t num_cells = num_columns_ * num_rows_;
+  std::vector<int> point_cells(points.size(), -1);
+  cell_begin_.assign(num_cells + 1, 0);
+  for (size_t i = 0; i < points.size(); ++i) {
+    const Point& point = points[i];
+    if (!Contains(bounding_box, point)) continue;
+    point_cells[i] = GetRow(point.y) * num_columns_ + GetColumn(point.x);
+    ++cell_begin_[point_cells[i] + 1];
+  }
+  for (size_t cell = 0; cell < num_cells; ++cell) {
+    cell_begin_[cell + 1] += cell_begin_[cell];
+  }
+  const size_t num_points = cell_begin_[num_cells];
+  xs_.resize(num_points);
+  ys_.resize(num_points);
+  indices_.resize(num_points);
+  std::vector<size_t> cell_end(cell_begin_.begin(), cell_begin_.end() - 1);
+  for (size_t i = 0; i < points.size(); ++i) {
+    if (point_cells[i] < 0) continue;
+    const size_t position = cell_end[point_cells[i]]++;
+    xs_[position] = points[i].x;
+    ys_[position] = points[i].y;
+    indices_[position] = i;
+  }
+}
+
+int UniformGrid::GetColumn(float x) const {
+  const int column =
+      static_cast<int>((x - bounding_box_.left()) * inverse_cell_width_);
+  return std::max(0, std::min(num_columns_ - 1, column));
+}
+
+int UniformGrid::GetRow(float y) const {
+  const int row =
+      static_cast<int>((y - bounding_box_.top()) * inverse_cell_height_);
+  return std::max(0, std::min(num_rows_ - 1, row));
+}
+
+void UniformGrid::QueryRange(const BoundingBox& range, Indices* output) const {
+  if (!Intersects(bounding_box_, range)) return;
+  const int first_column = GetColumn(range.left());
+  const int last_column = GetColumn(range.right());
+  const int first_row = GetRow(range.top());
+  const int last_row = GetRow(range.bottom());
+  const float left = range.left();
+  const float right = range.right();
+  const float top = range.top();
+  const float bottom = range.bottom();
+  for (int row = first_row; row <= last_row; ++row) {
+    const size_t row_cell = row * num_columns_;
+    const size_t begin = cell_begin_[row_cell + first_column];
+    const size_t end = cell_begin_[row_cell + last_column + 1];
+    // The cells of a row are contiguous.
+    for (size_t i = begin; i < end; ++i) {
+      const float x = xs_[i];
+      const float y = ys_[i];
+      if (x >= left && x <= right && y >= top && y <= bottom) {
+        output->push_back(indices_[i]);
+      }
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 Span::Span(float min, float max) : min(min), max(max) { CHECK_LE(min, max); }
 
 bool Span::Contains(const Span& other) const {
@@ -129,6 +216,43 @@ bool Span::Intersects(const Span& other) const {
   return max >= other.min && min <= other.max;
 }
 
+std::vector<Indices> ClusterIntersectingSpans(const std::vector<Span>& spans) {
+  Indices sorted(spans.size());
+  std::iota(sorted.begin(), sorted.end(), 0);
+  std::sort(sorted.begin(), sorted.end(), [&spans](size_t a, size_t b) {
+    return spans[a].min < spans[b].min ||
+           (spans[a].min == spans[b].min && a < b);
+  });
+  // Once sorted, a span intersects one of the previous spans iff its min is not
+  // greater than the max of all the previous spans. Groups are then contiguous
+  // runs of 'sorted'.
+  std::vector<int> group_of_span(spans.size(), -1);
+  int num_groups = 0;
+  float group_max = 0.0f;
+  for (const size_t index : sorted) {
+    const Span& span = spans[index];
+    if (num_groups == 0 || span.min > group_max) {
+      ++num_groups;
+      group_max = span.max;
+    } else {
+      group_max = std::max(group_max, span.max);
+    }
+    group_of_span[index] = num_groups - 1;
+  }
+  // Renumbers the groups by their first index.
+  std::vector<int> output_group(num_groups, -1);
+  std::vector<Indices> output;
+  for (size_t index = 0; index < spans.size(); ++index) {
+    int& group = output_group[group_of_span[index]];
+    if (group < 0) {
+      group = output.size();
+      output.emplace_back();
+    }
+    output[group].push_back(index);
+  }
+  return output;
+}
+
 Span GetSpan(const BoundingBox& box, const Orientation orientation) {
   const Vec2F direction = GetDirectionVector(orientation);
   CHECK_EQ(direction.norm_square(), 1);
@@ -114,6 +114,46 @@ class QuadTree {
   std::vector<PointData> points_;          // points stored in this node.
 };
 
+////////////////////////////////////////////////////////////////////////////////
+// A uniform grid to accelerate range queries over a fixed set of points.
+//
+// Points are bucketed by cell and stored as a structure of arrays, so a query
+// scans a few contiguous ranges of memory and does not allocate (besides
+// growing 'output').
+class UniformGrid {
+ public:
+  // Indexes 'points', the index of a point being its position in the vector.
+  // As with QuadTree, points outside 'bounding_box' are ignored. 'cell_size'
+  // should be close to the size of the queried ranges.
+  UniformGrid(const BoundingBox& bounding_box, float cell_size,
+              const std::vector<Point>& points);
+
+  // Gathers points in the range bounding box into output. Within a cell,
+  // points are output by increasing index.
+  void QueryRange(const BoundingBox& range, Indices* output) const;
+
+  // The maximum number of cells along an axis, this bounds the memory used by
+  // the grid when cell_size is small compared to bounding_box.
+  static constexpr const int kMaxCellsPerAxis = 256;
+
+ private:
+  int GetColumn(float x) const;
+  int GetRow(float y) const;
+
+  const BoundingBox bounding_box_;
+  int num_columns_ = 1;
+  int num_rows_ = 1;
+  float inverse_cell_width_ = 0.0f;
+  float inverse_cell_height_ = 0.0f;
+  // The points of cell (row, column) are at positions [cell_begin_[c],
+  // cell_begin_[c + 1]) of xs_, ys_ and indices_ where c = row * num_columns_ +
+  // column.
+  std::vector<size_t> cell_begin_;
+  std::vector<float> xs_;
+  std::vector<float> ys_;
+  std::vector<size_t> indices_;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // An interval between min and max (inclusive) and associated set logic.
 //
@@ -136,6 +176,13 @@ struct Span {
   float max = 0.0f;
 };
 
+// Groups spans which intersect directly or through other spans. Returns the
+// indices of the spans in each group; the indices are sorted, and the groups
+// are sorted by their first index. This is the same as adding an edge between
+// all pairs of intersecting spans to a DenseConnectedComponentsFinder, but runs
+// in O(n log n): spans are swept by increasing min.
+std::vector<Indices> ClusterIntersectingSpans(const std::vector<Span>& spans);
+
 // Returns the Span of a BoundingBox along a specific orientation.
 // +  +-----+  +
 // |  |     |  |
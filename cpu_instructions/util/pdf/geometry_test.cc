@@ -14,6 +14,10 @@
 
 #include "cpu_instructions/util/pdf/geometry.h"
 
+#include <algorithm>
+#include <random>
+
+#include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
 namespace cpu_instructions {
@@ -204,6 +208,53 @@ TEST(GeometryTest, QuadTreeQuadrant) {
   }
 }
 
+TEST(GeometryTest, UniformGrid) {
+  const BoundingBox area = CreateBox(1.0f, 1.0f, 10.0f, 10.0f);
+  // Point 1 is outside of area and is ignored.
+  const UniformGrid grid(area, 2.0f,
+                         {Point(5.0f, 5.0f), Point(11.0f, 11.0f),
+                          Point(1.0f, 1.0f), Point(10.0f, 10.0f)});
+  Indices indices;
+  grid.QueryRange(area, &indices);
+  EXPECT_THAT(indices, ::testing::UnorderedElementsAre(0, 2, 3));
+  // Querying an area with no points.
+  indices.clear();
+  grid.QueryRange(CreateBox(1.5f, 1.5f, 2.0f, 2.0f), &indices);
+  EXPECT_TRUE(indices.empty());
+  // Querying an area outside the grid.
+  grid.QueryRange(CreateBox(20.0f, 20.0f, 30.0f, 30.0f), &indices);
+  EXPECT_TRUE(indices.empty());
+  // Edges are inclusive.
+  grid.QueryRange(CreateBox(5.0f, 5.0f, 10.0f, 10.0f), &indices);
+  EXPECT_THAT(indices, ::testing::ElementsAre(0, 3));
+}
+
+TEST(GeometryTest, UniformGridIsSameAsQuadTree) {
+  const BoundingBox area = CreateBox(0.0f, 0.0f, 612.0f, 792.0f);
+  std::mt19937 generator(42);
+  std::uniform_real_distribution<float> coordinate(-10.0f, 800.0f);
+  std::vector<Point> points;
+  QuadTree tree(area);
+  for (size_t i = 0; i < 2000; ++i) {
+    points.emplace_back(coordinate(generator), coordinate(generator));
+    tree.Insert(i, points.back());
+  }
+  for (const float cell_size : {1.0f, 10.0f, 1000.0f}) {
+    const UniformGrid grid(area, cell_size, points);
+    for (size_t i = 0; i < 200; ++i) {
+      const float size = 20.0f;
+      const BoundingBox range = CreateBox(points[i], size, size);
+      Indices expected;
+      tree.QueryRange(range, &expected);
+      Indices indices;
+      grid.QueryRange(range, &indices);
+      std::sort(expected.begin(), expected.end());
+      std::sort(indices.begin(), indices.end());
+      EXPECT_EQ(indices, expected) << "cell_size " << cell_size;
+    }
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Span
 
@@ -229,6 +280,26 @@ TEST(GeometryTest, SpanIntersects) {
   EXPECT_FALSE(Span(1.0f, 5.0f).Intersects(Span(6.0f, 7.0f)));
 }
 
+TEST(GeometryTest, ClusterIntersectingSpans) {
+  using ::testing::ElementsAre;
+  EXPECT_THAT(ClusterIntersectingSpans({}), ElementsAre());
+  EXPECT_THAT(ClusterIntersectingSpans({Span(1.0f, 2.0f)}),
+              ElementsAre(ElementsAre(0)));
+  // Spans touching at their ends intersect.
+  EXPECT_THAT(ClusterIntersectingSpans({Span(1.0f, 2.0f), Span(2.0f, 3.0f)}),
+              ElementsAre(ElementsAre(0, 1)));
+  // 0 and 3 are connected through 2, which is contained in 1.
+  EXPECT_THAT(
+      ClusterIntersectingSpans({Span(8.0f, 9.0f), Span(0.0f, 10.0f),
+                                Span(5.0f, 6.0f), Span(3.0f, 4.0f),
+                                Span(20.0f, 21.0f), Span(11.0f, 12.0f)}),
+      ElementsAre(ElementsAre(0, 1, 2, 3), ElementsAre(4), ElementsAre(5)));
+  // Groups are ordered by their first index, not by position.
+  EXPECT_THAT(ClusterIntersectingSpans({Span(5.0f, 6.0f), Span(1.0f, 2.0f),
+                                        Span(5.5f, 7.0f)}),
+              ElementsAre(ElementsAre(0, 2), ElementsAre(1)));
+}
+
 TEST(GeometryTest, GetSpan) {
   const BoundingBox box = CreateBox(1.0f, 2.0f, 3.0f, 4.0f);
   const Span span_h = GetSpan(box, Orientation::EAST);
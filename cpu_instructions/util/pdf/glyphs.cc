@@ -0,0 +1,83 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/pdf/glyphs.h"
+
+#include <limits>
+
+#include "glog/logging.h"
+
+namespace cpu_instructions {
+namespace pdf {
+
+BoundingBox GetBoundingBox(const Glyph& glyph) {
+  BoundingBox box;
+  box.set_left(glyph.left);
+  box.set_top(glyph.top);
+  box.set_right(glyph.right);
+  box.set_bottom(glyph.bottom);
+  return box;
+}
+
+Glyphs::Glyphs(
+    const google::protobuf::RepeatedPtrField<PdfCharacter>& characters) {
+  glyphs_.reserve(characters.size());
+  for (const PdfCharacter& character : characters) {
+    Glyph glyph;
+    glyph.codepoint = character.codepoint();
+    glyph.fill_color_hash = character.fill_color_hash();
+    glyph.font_size = character.font_size();
+    glyph.orientation = character.orientation();
+    const BoundingBox& box = character.bounding_box();
+    glyph.left = box.left();
+    glyph.top = box.top();
+    glyph.right = box.right();
+    glyph.bottom = box.bottom();
+    Add(glyph, character.utf8());
+  }
+}
+
+void Glyphs::Add(const Glyph& glyph, StringPiece utf8) {
+  CHECK_LE(utf8_.size() + utf8.size(), std::numeric_limits<uint32_t>::max());
+  glyphs_.push_back(glyph);
+  Glyph& added = glyphs_.back();
+  added.utf8_begin = utf8_.size();
+  added.utf8_size = utf8.size();
+  utf8_.append(utf8.data(), utf8.size());
+}
+
+void Glyphs::AppendToCharacters(
+    google::protobuf::RepeatedPtrField<PdfCharacter>* characters) const {
+  CHECK(characters != nullptr);
+  characters->Reserve(characters->size() + glyphs_.size());
+  for (size_t i = 0; i < glyphs_.size(); ++i) {
+    const Glyph& glyph = glyphs_[i];
+    PdfCharacter* const character = characters->Add();
+    character->set_codepoint(glyph.codepoint);
+    const StringPiece utf8 = GetUtf8(i);
+    character->set_utf8(utf8.data(), utf8.size());
+    character->set_font_size(glyph.font_size);
+    character->set_orientation(glyph.orientation);
+    *character->mutable_bounding_box() = GetBoundingBox(glyph);
+    character->set_fill_color_hash(glyph.fill_color_hash);
+  }
+}
+
+void Glyphs::Clear() {
+  glyphs_.clear();
+  utf8_.clear();
+}
+
+}  // namespace pdf
+}  // namespace cpu_instructions
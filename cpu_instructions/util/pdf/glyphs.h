@@ -0,0 +1,103 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A compact representation of the characters of a page.
+//
+// A page of a large document has thousands of characters, and a PdfCharacter
+// proto (plus its utf8 string) costs a few allocations each. Glyphs stores the
+// same data as plain structs in a vector, and the UTF-8 encodings of all the
+// characters in a single string. Clearing Glyphs keeps the memory for the next
+// page.
+
+#ifndef CPU_INSTRUCTIONS_UTIL_PDF_GLYPHS_H_
+#define CPU_INSTRUCTIONS_UTIL_PDF_GLYPHS_H_
+
+#include <cstdint>
+#include <vector>
+#include "strings/string.h"
+
+#include "cpu_instructions/proto/pdf/pdf_document.pb.h"
+#include "cpu_instructions/util/pdf/geometry.h"
+#include "strings/string_view.h"
+
+namespace cpu_instructions {
+namespace pdf {
+
+// The fields of a PdfCharacter, without the UTF-8 encoding which is stored in
+// the Glyphs holding the glyph.
+struct Glyph {
+  uint32_t codepoint = 0;
+  uint32_t fill_color_hash = 0;
+  float font_size = 0.0f;
+  Orientation orientation = NORTH;
+  // The bounding box.
+  float left = 0.0f;
+  float top = 0.0f;
+  float right = 0.0f;
+  float bottom = 0.0f;
+  // The position of the UTF-8 encoding in Glyphs::utf8_.
+  uint32_t utf8_begin = 0;
+  uint32_t utf8_size = 0;
+};
+
+// Returns the bounding box of 'glyph'.
+BoundingBox GetBoundingBox(const Glyph& glyph);
+
+// Returns the center of the bounding box of 'glyph'.
+inline Point GetCenter(const Glyph& glyph) {
+  return {(glyph.left + glyph.right) / 2.0f,
+          (glyph.top + glyph.bottom) / 2.0f};
+}
+
+// The characters of a page, in stream order.
+class Glyphs {
+ public:
+  Glyphs() = default;
+
+  // Copies 'characters'.
+  explicit Glyphs(
+      const google::protobuf::RepeatedPtrField<PdfCharacter>& characters);
+
+  size_t size() const { return glyphs_.size(); }
+  bool empty() const { return glyphs_.empty(); }
+
+  const Glyph& Get(size_t index) const { return glyphs_[index]; }
+
+  // Returns the UTF-8 encoding of the glyph at 'index'. The StringPiece is
+  // invalidated by Add().
+  StringPiece GetUtf8(size_t index) const {
+    const Glyph& glyph = glyphs_[index];
+    return StringPiece(utf8_.data() + glyph.utf8_begin, glyph.utf8_size);
+  }
+
+  // Appends 'glyph' with the UTF-8 encoding 'utf8'. The utf8_begin and
+  // utf8_size fields of 'glyph' are ignored.
+  void Add(const Glyph& glyph, StringPiece utf8);
+
+  // Appends the glyphs as PdfCharacter protos to 'characters'.
+  void AppendToCharacters(
+      google::protobuf::RepeatedPtrField<PdfCharacter>* characters) const;
+
+  // Removes all the glyphs, but keeps the allocated memory.
+  void Clear();
+
+ private:
+  std::vector<Glyph> glyphs_;
+  string utf8_;
+};
+
+}  // namespace pdf
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_UTIL_PDF_GLYPHS_H_
@@ -0,0 +1,93 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/pdf/glyphs.h"
+
+#include "cpu_instructions/testing/test_util.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace cpu_instructions {
+namespace pdf {
+namespace {
+
+using ::cpu_instructions::testing::EqualsProto;
+
+constexpr const char kPage[] = R"(
+  characters {
+    codepoint: 0x41
+    utf8: "A"
+    font_size: 7.98
+    orientation: EAST
+    bounding_box { left: 1 top: 2 right: 3 bottom: 4 }
+    fill_color_hash: 0x48674bc7
+  }
+  characters {
+    codepoint: 0x2014
+    utf8: "-"
+    font_size: 10
+    orientation: NORTH
+    bounding_box { left: 5 top: 6 right: 7 bottom: 8 }
+  }
+  characters {
+    codepoint: 0xe9
+    utf8: "\303\251"
+    font_size: 12
+    orientation: SOUTH
+    bounding_box { left: 9 top: 10 right: 11 bottom: 12 }
+    fill_color_hash: 1
+  })";
+
+TEST(GlyphsTest, FromCharacters) {
+  const PdfPage page = ParseProtoFromStringOrDie<PdfPage>(kPage);
+  const Glyphs glyphs(page.characters());
+  ASSERT_EQ(glyphs.size(), 3);
+  EXPECT_EQ(glyphs.Get(0).codepoint, 0x41);
+  EXPECT_EQ(glyphs.Get(0).fill_color_hash, 0x48674bc7);
+  EXPECT_EQ(glyphs.Get(0).font_size, 7.98f);
+  EXPECT_EQ(glyphs.Get(0).orientation, EAST);
+  EXPECT_EQ(glyphs.GetUtf8(0), "A");
+  EXPECT_EQ(glyphs.GetUtf8(1), "-");
+  EXPECT_EQ(glyphs.GetUtf8(2), "\303\251");
+  EXPECT_THAT(GetBoundingBox(glyphs.Get(2)),
+              EqualsProto("left: 9 top: 10 right: 11 bottom: 12"));
+  EXPECT_EQ(GetCenter(glyphs.Get(2)).x, 10.0f);
+  EXPECT_EQ(GetCenter(glyphs.Get(2)).y, 11.0f);
+}
+
+TEST(GlyphsTest, AppendToCharacters) {
+  const PdfPage page = ParseProtoFromStringOrDie<PdfPage>(kPage);
+  const Glyphs glyphs(page.characters());
+  PdfPage output;
+  glyphs.AppendToCharacters(output.mutable_characters());
+  EXPECT_THAT(output, EqualsProto(page));
+}
+
+TEST(GlyphsTest, Clear) {
+  Glyphs glyphs;
+  EXPECT_TRUE(glyphs.empty());
+  glyphs.Add(Glyph(), "abc");
+  glyphs.Add(Glyph(), "d");
+  EXPECT_EQ(glyphs.size(), 2);
+  EXPECT_EQ(glyphs.GetUtf8(1), "d");
+  glyphs.Clear();
+  EXPECT_TRUE(glyphs.empty());
+  glyphs.Add(Glyph(), "e");
+  EXPECT_EQ(glyphs.GetUtf8(0), "e");
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace cpu_instructions
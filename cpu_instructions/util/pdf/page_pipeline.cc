@@ -0,0 +1,89 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/pdf/page_pipeline.h"
+
+#include "glog/logging.h"
+#include "util/gtl/ptr_util.h"
+
+namespace cpu_instructions {
+namespace pdf {
+
+constexpr const int PagePipeline::kPagesInFlightPerThread;
+
+PagePipeline::PagePipeline(int num_threads, OutputCallback output_callback)
+    : output_callback_(std::move(output_callback)),
+      max_pages_in_flight_(num_threads * kPagesInFlightPerThread) {
+  CHECK_GE(num_threads, 0);
+  if (num_threads > 0) {
+    pool_ = gtl::MakeUnique<ThreadPool>(num_threads);
+    pool_->StartWorkers();
+  }
+}
+
+PagePipeline::~PagePipeline() {
+  // Each worker outputs the pages it can after processing a page, so all the
+  // pages are output once the workers are done.
+  pool_.reset();
+  CHECK(pending_.empty());
+}
+
+void PagePipeline::Add(ProcessFunction process) {
+  CHECK(process != nullptr);
+  if (pool_ == nullptr) {
+    PdfPage page;
+    process(&page);
+    output_callback_(&page);
+    return;
+  }
+  PendingPage* pending_page = nullptr;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    page_output_.wait(
+        lock, [this]() { return pending_.size() < max_pages_in_flight_; });
+    pending_.push_back(gtl::MakeUnique<PendingPage>());
+    pending_page = pending_.back().get();
+  }
+  pool_->Schedule([this, pending_page, process]() {
+    process(&pending_page->page);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_page->done = true;
+    }
+    OutputDonePages();
+  });
+}
+
+void PagePipeline::OutputDonePages() {
+  std::lock_guard<std::mutex> output_lock(output_mutex_);
+  while (true) {
+    PendingPage* page = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (pending_.empty() || !pending_.front()->done) return;
+      page = pending_.front().get();
+    }
+    // The page stays in pending_ while it is output so that it counts toward
+    // max_pages_in_flight_. Only this thread can remove it, Add() only appends.
+    output_callback_(&page->page);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_.pop_front();
+    }
+    page_output_.notify_one();
+  }
+}
+
+}  // namespace pdf
+}  // namespace cpu_instructions
@@ -0,0 +1,98 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Processes PDF pages on a pool of threads and outputs them in order.
+
+#ifndef CPU_INSTRUCTIONS_UTIL_PDF_PAGE_PIPELINE_H_
+#define CPU_INSTRUCTIONS_UTIL_PDF_PAGE_PIPELINE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "cpu_instructions/proto/pdf/pdf_document.pb.h"
+#include "cpu_instructions/util/thread_pool.h"
+
+namespace cpu_instructions {
+namespace pdf {
+
+// The second stage of the PDF extraction: while xpdf renders a page on the
+// calling thread, the previous pages are clustered and patched on worker
+// threads. Pages are then passed to the output callback in the order in which
+// they were added.
+//
+// The number of pages being processed or waiting for output is bounded, Add()
+// blocks when the workers fall behind so that memory does not grow with the
+// size of the document.
+//
+// Usage:
+//   PagePipeline pipeline(num_threads, output_callback);
+//   for (...) pipeline.Add([...](PdfPage* page) { ... });
+//   // All pages are output when 'pipeline' goes out of scope.
+class PagePipeline {
+ public:
+  // Called with each page once processed. The callee may take the contents of
+  // the page. Calls are serialized, but may happen on any thread.
+  using OutputCallback = std::function<void(PdfPage* page)>;
+
+  // Computes a page. The page is empty when the function is called.
+  using ProcessFunction = std::function<void(PdfPage* page)>;
+
+  // When num_threads is 0, pages are processed and output synchronously by
+  // Add().
+  PagePipeline(int num_threads, OutputCallback output_callback);
+
+  PagePipeline(const PagePipeline&) = delete;
+  PagePipeline& operator=(const PagePipeline&) = delete;
+
+  // Blocks until all the pages are output.
+  ~PagePipeline();
+
+  // Schedules 'process' and the output of the resulting page.
+  void Add(ProcessFunction process);
+
+  // The maximal number of pages in flight per thread.
+  static constexpr const int kPagesInFlightPerThread = 2;
+
+ private:
+  struct PendingPage {
+    PdfPage page;
+    bool done = false;
+  };
+
+  // Outputs the pages at the front of pending_ which are done.
+  void OutputDonePages();
+
+  const OutputCallback output_callback_;
+  const size_t max_pages_in_flight_;
+
+  // Held while pages are output, so that they are output in order.
+  std::mutex output_mutex_;
+  std::mutex mutex_;
+  std::condition_variable page_output_;
+  // The pages being processed or waiting to be output, in the order in which
+  // they were added. Guarded by mutex_.
+  std::deque<std::unique_ptr<PendingPage>> pending_;
+
+  // Declared last so that the workers are joined before the other members are
+  // destroyed.
+  std::unique_ptr<ThreadPool> pool_;
+};
+
+}  // namespace pdf
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_UTIL_PDF_PAGE_PIPELINE_H_
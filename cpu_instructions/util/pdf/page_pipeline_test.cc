@@ -0,0 +1,91 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/pdf/page_pipeline.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace cpu_instructions {
+namespace pdf {
+namespace {
+
+using ::testing::ElementsAreArray;
+
+constexpr int kNumPages = 100;
+
+std::vector<int> GetExpectedPageNumbers() {
+  std::vector<int> numbers;
+  for (int i = 0; i < kNumPages; ++i) numbers.push_back(i);
+  return numbers;
+}
+
+TEST(PagePipelineTest, OutputsPagesInOrder) {
+  for (const int num_threads : {0, 1, 4}) {
+    std::vector<int> output_numbers;
+    {
+      PagePipeline pipeline(num_threads, [&output_numbers](PdfPage* page) {
+        output_numbers.push_back(page->number());
+      });
+      for (int i = 0; i < kNumPages; ++i) {
+        pipeline.Add([i](PdfPage* page) {
+          // Makes later pages finish before earlier ones.
+          std::this_thread::sleep_for(std::chrono::microseconds((i % 7) * 50));
+          page->set_number(i);
+        });
+      }
+    }
+    EXPECT_THAT(output_numbers, ElementsAreArray(GetExpectedPageNumbers()))
+        << "num_threads = " << num_threads;
+  }
+}
+
+TEST(PagePipelineTest, SynchronousWithoutThreads) {
+  int num_output_pages = 0;
+  PagePipeline pipeline(0, [&num_output_pages](PdfPage* page) {
+    ++num_output_pages;
+  });
+  pipeline.Add([](PdfPage* page) { page->set_number(1); });
+  EXPECT_EQ(num_output_pages, 1);
+}
+
+TEST(PagePipelineTest, BoundsPagesInFlight) {
+  constexpr int kNumThreads = 2;
+  std::atomic<int> num_in_flight(0);
+  std::atomic<int> max_in_flight(0);
+  {
+    PagePipeline pipeline(kNumThreads,
+                          [&num_in_flight](PdfPage* page) { --num_in_flight; });
+    for (int i = 0; i < kNumPages; ++i) {
+      const int in_flight = ++num_in_flight;
+      if (in_flight > max_in_flight) max_in_flight = in_flight;
+      pipeline.Add([](PdfPage* page) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      });
+    }
+  }
+  EXPECT_EQ(num_in_flight, 0);
+  // The page being added is counted before Add() blocks.
+  EXPECT_LE(max_in_flight,
+            kNumThreads * PagePipeline::kPagesInFlightPerThread + 1);
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace cpu_instructions
@@ -17,23 +17,32 @@
 #include <algorithm>
 #include <cfloat>
 #include <map>
+#include <memory>
 #include <unordered_map>
 #include <vector>
 #include "strings/string.h"
 
+#include "cpu_instructions/util/pdf/character_distances.h"
 #include "cpu_instructions/util/pdf/geometry.h"
+#include "cpu_instructions/util/stage_profiler.h"
 #include "gflags/gflags.h"
 #include "strings/str_cat.h"
 #include "strings/str_join.h"
 #include "strings/string_view.h"
 #include "util/graph/connected_components.h"
 #include "util/gtl/map_util.h"
+#include "util/gtl/ptr_util.h"
 
 DEFINE_double(cpu_instructions_pdf_max_character_distance, 0.9,
               "The maximal distance of two characters to be considered part of "
               "the same cell. The value is a multiplier; the real distance is "
               "obtained by multiplying the font size with this coefficient.");
 
+DEFINE_bool(cpu_instructions_pdf_use_quad_tree, false,
+            "Whether to use a QuadTree instead of a UniformGrid to find the "
+            "neighbors of characters. Both yield the same clusters, the grid "
+            "is faster.");
+
 namespace cpu_instructions {
 namespace pdf {
 
@@ -70,42 +79,75 @@ Vec2F GetVector(const T& a, const T& b) {
   return GetCenter(b.bounding_box()) - GetCenter(a.bounding_box());
 }
 
+// Returns the average font size of 'glyphs', or 1 if there are none.
+float GetAverageFontSize(const Glyphs& glyphs) {
+  if (glyphs.empty()) return 1.0f;
+  double sum = 0;
+  for (size_t i = 0; i < glyphs.size(); ++i) sum += glyphs.Get(i).font_size;
+  return std::max(1.0, sum / glyphs.size());
+}
+
 // Helper class providing indexed access to characters.
 // Indexed access is needed to use ConnectedComponent.
 class Characters {
  public:
-  Characters(const PdfCharacters* characters, const BoundingBox& page)
-      : characters_(characters), tree_(page) {
+  Characters(const Glyphs* characters, const BoundingBox& page)
+      : characters_(characters),
+        distances_(*characters,
+                   FLAGS_cpu_instructions_pdf_max_character_distance) {
     centers_.reserve(characters_->size());
-    size_t i = 0;
-    for (const auto& character : *characters_) {
-      const auto& center = GetCenter(character.bounding_box());
-      centers_.push_back(center);
-      tree_.Insert(i++, center);
+    for (size_t i = 0; i < characters_->size(); ++i) {
+      centers_.push_back(GetCenter(characters_->Get(i)));
+    }
+    if (FLAGS_cpu_instructions_pdf_use_quad_tree) {
+      tree_ = gtl::MakeUnique<QuadTree>(page);
+      for (size_t i = 0; i < centers_.size(); ++i) {
+        tree_->Insert(i, centers_[i]);
+      }
+    } else {
+      // Candidates are searched in a square of twice the font size, see
+      // GetCandidates.
+      grid_ = gtl::MakeUnique<UniformGrid>(
+          page, 2.0f * GetAverageFontSize(*characters_), centers_);
     }
   }
 
   size_t size() const { return characters_->size(); }
 
-  const PdfCharacter& Get(size_t index) const {
-    return characters_->Get(index);
+  const Glyph& Get(size_t index) const { return characters_->Get(index); }
+
+  StringPiece GetUtf8(size_t index) const {
+    return characters_->GetUtf8(index);
   }
 
   // Gathers characters close to the one pointed to by 'index' to prune the
-  // O(N^2) search.
-  const Indices GetCandidates(size_t index) const {
-    const auto character = Get(index);
-    const auto center = GetCenter(character.bounding_box());
-    const float size = character.font_size() * 2.0f;
-    Indices indices;
-    tree_.QueryRange(CreateBox(center, size, size), &indices);
-    return indices;
+  // O(N^2) search. 'candidates' is cleared first, reusing it across calls
+  // avoids allocations.
+  void GetCandidates(size_t index, Indices* candidates) const {
+    candidates->clear();
+    const float size = Get(index).font_size * 2.0f;
+    const BoundingBox range = CreateBox(centers_[index], size, size);
+    if (tree_) {
+      tree_->QueryRange(range, candidates);
+    } else {
+      grid_->QueryRange(range, candidates);
+    }
+  }
+
+  // Computes the distances from the character pointed to by 'index' to each of
+  // 'candidates', see CharacterDistances.
+  void GetDistances(size_t index, const Indices& candidates,
+                    std::vector<float>* distances) const {
+    distances_.Compute(index, candidates, distances);
   }
 
  private:
-  const PdfCharacters* const characters_;
+  const Glyphs* const characters_;
+  const CharacterDistances distances_;
   std::vector<Point> centers_;
-  QuadTree tree_;
+  // Exactly one of tree_ and grid_ is set.
+  std::unique_ptr<QuadTree> tree_;
+  std::unique_ptr<UniformGrid> grid_;
 };
 
 std::vector<Indices> GetClusters(DenseConnectedComponentsFinder* finder) {
@@ -124,39 +166,26 @@ std::vector<Indices> GetClusters(DenseConnectedComponentsFinder* finder) {
 // Actually clusters the characters by retaining the closest character in the
 // forward direction and linking them together in PdfTextSegments.
 void ClusterCharacters(const Characters& all, PdfTextSegments* segments) {
-  // Returns FLT_MAX if characters[b] is not on the same line, backward or too
-  // far away from characters[a].
-  const auto GetCharacterDistance = [&all](size_t index_a,
-                                           size_t index_b) -> float {
-    const auto& a = all.Get(index_a);
-    const auto& b = all.Get(index_b);
-    const Orientation sideways = RotateClockwise90(a.orientation());
-    const Span v_span_a = GetSpan(a.bounding_box(), sideways);
-    const Span v_span_b = GetSpan(b.bounding_box(), sideways);
-    const bool same_line = v_span_a.Intersects(v_span_b);
-    const bool same_orientation = a.orientation() == b.orientation();
-    const Vec2F forward = GetForwardDirection(a);
-    const float distance = GetVector(a, b).dot_product(forward);
-    const bool within_distance =
-        distance > 0 &&
-        distance <
-            FLAGS_cpu_instructions_pdf_max_character_distance * a.font_size();
-    if (same_line && same_orientation && within_distance) {
-      return distance;
-    }
-    return FLT_MAX;
-  };
-
   DenseConnectedComponentsFinder components;
   components.SetNumberOfNodes(all.size());
 
-  // For each character, adds an edge between it and the closest one.
+  // For each character, adds an edge between it and the closest one. Ties are
+  // broken by index so that the result does not depend on the order in which
+  // the spatial index returns the candidates. The distance is FLT_MAX for
+  // characters which are not on the same line, backward or too far away.
+  Indices candidates;
+  std::vector<float> distances;
   for (size_t i = 0; i < all.size(); ++i) {
     float min_distance = FLT_MAX;
     size_t candidate_index = 0;
-    for (size_t j : all.GetCandidates(i)) {
-      const float distance = GetCharacterDistance(i, j);
-      if (distance < min_distance) {
+    all.GetCandidates(i, &candidates);
+    all.GetDistances(i, candidates, &distances);
+    for (size_t k = 0; k < candidates.size(); ++k) {
+      const size_t j = candidates[k];
+      const float distance = distances[k];
+      if (distance < min_distance ||
+          (distance == min_distance && distance < FLT_MAX &&
+           j < candidate_index)) {
         candidate_index = j;
         min_distance = distance;
       }
@@ -170,27 +199,29 @@ void ClusterCharacters(const Characters& all, PdfTextSegments* segments) {
   for (auto& indices : GetClusters(&components)) {
     // Returns whether characters[a] is before characters[b].
     const auto reading_order_cmp = [&all](size_t index_a, size_t index_b) {
-      const auto& a = all.Get(index_a);
-      const auto& b = all.Get(index_b);
-      const Vec2F forward = GetForwardDirection(a);
-      return GetVector(a, b).dot_product(forward) > 0;
+      const Glyph& a = all.Get(index_a);
+      const Glyph& b = all.Get(index_b);
+      const Vec2F forward = GetDirectionVector(a.orientation);
+      return (GetCenter(b) - GetCenter(a)).dot_product(forward) > 0;
     };
     std::sort(indices.begin(), indices.end(), reading_order_cmp);
     PdfTextSegment segment;
     BoundingBox* bounding_box = segment.mutable_bounding_box();
     bool first = true;
     for (const size_t index : indices) {
-      const auto& character = all.Get(index);
+      const Glyph& character = all.Get(index);
+      const BoundingBox character_box = GetBoundingBox(character);
       if (first) {
-        segment.set_font_size(character.font_size());
-        segment.set_orientation(RotateClockwise90(character.orientation()));
-        segment.set_fill_color_hash(character.fill_color_hash());
-        *bounding_box = character.bounding_box();
+        segment.set_font_size(character.font_size);
+        segment.set_orientation(RotateClockwise90(character.orientation));
+        segment.set_fill_color_hash(character.fill_color_hash);
+        *bounding_box = character_box;
         first = false;
       }
       segment.add_character_indices(index);
-      segment.mutable_text()->append(character.utf8());
-      Union(character.bounding_box(), bounding_box);
+      const StringPiece utf8 = all.GetUtf8(index);
+      segment.mutable_text()->append(utf8.data(), utf8.size());
+      Union(character_box, bounding_box);
     }
     if (!segment.text().empty()) {
       segment.Swap(segments->Add());
@@ -362,6 +393,16 @@ class Blocks {
 
   const PdfTextBlock& Get(size_t index) const { return *blocks_.at(index); }
 
+  // Returns the spans of the blocks along 'orientation'.
+  std::vector<Span> GetSpans(Orientation orientation) const {
+    std::vector<Span> spans;
+    spans.reserve(blocks_.size());
+    for (const PdfTextBlock* block : blocks_) {
+      spans.push_back(GetSpan(block->bounding_box(), orientation));
+    }
+    return spans;
+  }
+
   Blocks Keep(Indices indices) const {
     std::vector<const PdfTextBlock*> subset;
     for (const size_t index : indices) subset.push_back(blocks_.at(index));
@@ -381,26 +422,9 @@ class Blocks {
 // |  D  |          |        |    +-+
 // +-----+          +--------+
 void ClusterColumns(const Blocks& row_blocks, PdfTextBlocks* output) {
-  const auto is_same_column = [](const PdfTextBlock& a, const PdfTextBlock& b) {
-    const Orientation horizontal = Orientation::EAST;
-    const Span h_span_a = GetSpan(a.bounding_box(), horizontal);
-    const Span h_span_b = GetSpan(b.bounding_box(), horizontal);
-    return h_span_a.Intersects(h_span_b);
-  };
-
-  const size_t blocks_size = row_blocks.size();
-  DenseConnectedComponentsFinder connected_columns;
-  connected_columns.SetNumberOfNodes(blocks_size);
-
-  for (size_t i = 0; i < blocks_size; ++i) {
-    for (size_t j = i + 1; j < blocks_size; ++j) {
-      if (is_same_column(row_blocks.Get(i), row_blocks.Get(j))) {
-        connected_columns.AddEdge(i, j);
-      }
-    }
-  }
-
-  for (auto& col_indices : GetClusters(&connected_columns)) {
+  // Blocks are on the same column if their horizontal spans intersect.
+  for (auto& col_indices : ClusterIntersectingSpans(
+           row_blocks.GetSpans(Orientation::EAST))) {
     const auto top_down_cmp = [&row_blocks](size_t a_index, size_t b_index) {
       const auto& a = row_blocks.Get(a_index).bounding_box();
       const auto& b = row_blocks.Get(b_index).bounding_box();
@@ -440,27 +464,9 @@ void ClusterColumns(const Blocks& row_blocks, PdfTextBlocks* output) {
 // |  D  |          |        |    +-+
 // +-----+          +--------+
 void ClusterRows(const Blocks& page_blocks, PdfTextTableRows* rows) {
-  const auto SameRow = [](const PdfTextBlock& a, const PdfTextBlock& b) {
-    const Orientation vertical = Orientation::SOUTH;
-    const Span v_span_a = GetSpan(a.bounding_box(), vertical);
-    const Span v_span_b = GetSpan(b.bounding_box(), vertical);
-    return v_span_a.Intersects(v_span_b);
-  };
-
-  const size_t blocks_size = page_blocks.size();
-  DenseConnectedComponentsFinder connected_rows;
-  connected_rows.SetNumberOfNodes(blocks_size);
-
-  // O(N^2) algorithm with low N to find row aligned blocks.
-  for (size_t i = 0; i < blocks_size; ++i) {
-    for (size_t j = i + 1; j < blocks_size; ++j) {
-      if (SameRow(page_blocks.Get(i), page_blocks.Get(j))) {
-        connected_rows.AddEdge(i, j);
-      }
-    }
-  }
-
-  for (auto& row_indices : GetClusters(&connected_rows)) {
+  // Blocks are on the same row if their vertical spans intersect.
+  for (auto& row_indices : ClusterIntersectingSpans(
+           page_blocks.GetSpans(Orientation::SOUTH))) {
     const Blocks row_blocks = page_blocks.Keep(row_indices);
 
     PdfTextTableRow row;
@@ -488,25 +494,42 @@ void ClusterRows(const Blocks& page_blocks, PdfTextTableRows* rows) {
 
 void Cluster(PdfPage* page,
              const PdfPagePreventSegmentBindings& prevent_segment_bindings) {
+  Cluster(Glyphs(page->characters()), page, prevent_segment_bindings);
+}
+
+void Cluster(const Glyphs& glyphs, PdfPage* page,
+             const PdfPagePreventSegmentBindings& prevent_segment_bindings) {
   // First cluster characters into segments.
-  const PdfCharacters& page_characters = page->characters();
   const BoundingBox page_bbox = CreateBox(0, 0, page->width(), page->height());
-  Characters characters(&page_characters, page_bbox);
+  Characters characters(&glyphs, page_bbox);
   PdfTextSegments* page_segments = page->mutable_segments();
   page_segments->Clear();
-  ClusterCharacters(characters, page_segments);
+  {
+    ScopedStageTimer timer("ClusterCharacters");
+    ClusterCharacters(characters, page_segments);
+    timer.AddItems("glyphs", glyphs.size());
+    timer.AddItems("segments", page_segments->size());
+  }
 
   // Then cluster segments in blocks.
   Segments segments(prevent_segment_bindings, page_segments);
   PdfTextBlocks* page_blocks = page->mutable_blocks();
   page_blocks->Clear();
-  ClusterSegments(&segments, page_blocks);
+  {
+    ScopedStageTimer timer("ClusterSegments");
+    ClusterSegments(&segments, page_blocks);
+    timer.AddItems("blocks", page_blocks->size());
+  }
 
   // Last cluster blocks in rows.
   const Blocks blocks(page_blocks);
   PdfTextTableRows* page_rows = page->mutable_rows();
   page_rows->Clear();
-  ClusterRows(blocks, page_rows);
+  {
+    ScopedStageTimer timer("ClusterRows");
+    ClusterRows(blocks, page_rows);
+    timer.AddItems("rows", page_rows->size());
+  }
 
   // Sort rows from top to bottom.
   std::sort(page_rows->begin(), page_rows->end(),
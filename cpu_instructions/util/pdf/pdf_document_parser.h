@@ -16,6 +16,7 @@
 #define CPU_INSTRUCTIONS_UTIL_PDF_PDF_DOCUMENT_PARSER_H_
 
 #include "cpu_instructions/proto/pdf/pdf_document.pb.h"
+#include "cpu_instructions/util/pdf/glyphs.h"
 
 namespace cpu_instructions {
 namespace pdf {
@@ -44,6 +45,14 @@ void Cluster(PdfPage* page,
              const PdfPagePreventSegmentBindings& prevent_segment_bindings =
                  PdfPagePreventSegmentBindings());
 
+// Same as above, but clusters 'glyphs' instead of the characters of 'page',
+// which are left untouched. The character indices of the segments refer to
+// 'glyphs'. This avoids materializing a PdfCharacter for each glyph when they
+// are not needed in the output.
+void Cluster(const Glyphs& glyphs, PdfPage* page,
+             const PdfPagePreventSegmentBindings& prevent_segment_bindings =
+                 PdfPagePreventSegmentBindings());
+
 }  // namespace pdf
 }  // namespace cpu_instructions
 
@@ -0,0 +1,137 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks the clustering of real SDM pages.
+// Usage:
+// bazel run -c opt \
+// cpu_instructions/util/pdf:pdf_document_parser_benchmark -- \
+// --cpu_instructions_pdf_benchmark_document=/path/to/document.pbtxt
+//
+// By default, the benchmark runs on the two SDM pages of the x86 test data. To
+// run it on a full SDM, first dump its pages with their characters:
+// bazel run -c opt \
+// cpu_instructions/tools:pdf2proto -- \
+// --cpu_instructions_pdf_input_file=/path/to/325462-sdm-vol-1-2abcd-3abcd.pdf \
+// --cpu_instructions_pdf_output_file=/tmp/sdm.pdf.pb
+// and then pass --cpu_instructions_pdf_benchmark_document=/tmp/sdm.pdf.pb to
+// the benchmark; it overrides the default document. A page range such as
+// 'file.pdf:1200-1400' in --cpu_instructions_pdf_input_file gives a shorter
+// run.
+
+#include <vector>
+#include "strings/string.h"
+
+#include "benchmark/benchmark.h"
+#include "cpu_instructions/proto/pdf/pdf_document.pb.h"
+#include "cpu_instructions/util/pdf/pdf_document_parser.h"
+#include "cpu_instructions/util/pdf/pdf_document_stream.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "src/google/protobuf/util/message_differencer.h"
+#include "strings/string_view.h"
+
+DEFINE_string(cpu_instructions_pdf_benchmark_document, "",
+              "A PdfDocument whose pages are clustered by the benchmarks: a "
+              "text proto if the name ends with '.pbtxt', otherwise a binary "
+              "or indexed file as written by pdf2proto. The pages must have "
+              "their characters.");
+
+DECLARE_bool(cpu_instructions_pdf_use_quad_tree);
+
+namespace cpu_instructions {
+namespace pdf {
+namespace {
+
+// Checks that both spatial indices yield the same clusters on all pages.
+void CheckSameClusters(const std::vector<PdfPage>& pages) {
+  for (const PdfPage& page : pages) {
+    PdfPage with_grid = page;
+    FLAGS_cpu_instructions_pdf_use_quad_tree = false;
+    Cluster(&with_grid);
+    PdfPage with_quad_tree = page;
+    FLAGS_cpu_instructions_pdf_use_quad_tree = true;
+    Cluster(&with_quad_tree);
+    CHECK(google::protobuf::util::MessageDifferencer::Equals(with_grid,
+                                                             with_quad_tree))
+        << "Different clusters for page " << page.number();
+  }
+  FLAGS_cpu_instructions_pdf_use_quad_tree = false;
+}
+
+int GetNumCharacters(const std::vector<PdfPage>& pages) {
+  int num_characters = 0;
+  for (const PdfPage& page : pages) num_characters += page.characters_size();
+  return num_characters;
+}
+
+// Returns the pages of the benchmark document, with only their characters.
+const std::vector<PdfPage>& GetPages() {
+  static const std::vector<PdfPage>* const pages = []() {
+    const string& filename = FLAGS_cpu_instructions_pdf_benchmark_document;
+    CHECK(!filename.empty())
+        << "missing --cpu_instructions_pdf_benchmark_document";
+    auto* const result = new std::vector<PdfPage>();
+    const auto add_page = [result](const PdfPage& page) {
+      result->emplace_back();
+      PdfPage* const characters_only = &result->back();
+      characters_only->set_number(page.number());
+      characters_only->set_width(page.width());
+      characters_only->set_height(page.height());
+      *characters_only->mutable_characters() = page.characters();
+    };
+    if (StringPiece(filename).ends_with(".pbtxt")) {
+      const auto document = ReadTextProtoOrDie<PdfDocument>(filename);
+      for (const PdfPage& page : document.pages()) add_page(page);
+    } else {
+      // Full documents are read one page at a time, so that only the
+      // characters of the pages are held in memory.
+      PdfDocumentReader reader(filename);
+      PdfPage page;
+      while (reader.ReadNextPage(&page)) add_page(page);
+    }
+    LOG(INFO) << "Read " << result->size() << " pages with "
+              << GetNumCharacters(*result) << " characters from " << filename;
+    CheckSameClusters(*result);
+    return result;
+  }();
+  return *pages;
+}
+
+// Clusters all the pages of the benchmark document. The argument is the value
+// of --cpu_instructions_pdf_use_quad_tree.
+void BM_Cluster(benchmark::State& state) {
+  const std::vector<PdfPage>& pages = GetPages();
+  FLAGS_cpu_instructions_pdf_use_quad_tree = state.range(0);
+  std::vector<PdfPage> pages_copy;
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    pages_copy = pages;
+    state.ResumeTiming();
+    for (PdfPage& page : pages_copy) Cluster(&page);
+  }
+  state.SetItemsProcessed(state.iterations() * GetNumCharacters(pages));
+}
+BENCHMARK(BM_Cluster)->Arg(0)->Arg(1);
+
+}  // namespace
+}  // namespace pdf
+}  // namespace cpu_instructions
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
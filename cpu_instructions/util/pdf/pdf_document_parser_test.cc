@@ -14,12 +14,20 @@
 
 #include "cpu_instructions/util/pdf/pdf_document_parser.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
 #include <iterator>
+#include <map>
+#include <vector>
 
+#include "cpu_instructions/util/pdf/geometry.h"
 #include "cpu_instructions/util/proto_util.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "src/google/protobuf/text_format.h"
+#include "strings/str_cat.h"
+#include "util/graph/connected_components.h"
 
 using ::testing::ElementsAreArray;
 
@@ -180,6 +188,184 @@ TEST(ExtractLine, do_not_connect) {
   EXPECT_EQ(page.rows(0).blocks(1).text(), "n");
 }
 
+// The pairwise implementation that ClusterIntersectingSpans replaced.
+std::vector<Indices> PairwiseClusterIntersectingSpans(
+    const std::vector<Span>& spans) {
+  DenseConnectedComponentsFinder components;
+  components.SetNumberOfNodes(spans.size());
+  for (size_t i = 0; i < spans.size(); ++i) {
+    for (size_t j = i + 1; j < spans.size(); ++j) {
+      if (spans[i].Intersects(spans[j])) components.AddEdge(i, j);
+    }
+  }
+  std::map<int, Indices> clusters;
+  const std::vector<int> ids = components.GetComponentIds();
+  for (size_t i = 0; i < ids.size(); ++i) clusters[ids[i]].push_back(i);
+  std::vector<Indices> output;
+  for (auto& id_indices : clusters) output.push_back(id_indices.second);
+  return output;
+}
+
+std::vector<Span> GetSpans(const std::vector<const PdfTextBlock*>& blocks,
+                           Orientation orientation) {
+  std::vector<Span> spans;
+  for (const PdfTextBlock* block : blocks) {
+    spans.push_back(GetSpan(block->bounding_box(), orientation));
+  }
+  return spans;
+}
+
+std::vector<const PdfTextBlock*> Keep(
+    const std::vector<const PdfTextBlock*>& blocks, const Indices& indices) {
+  std::vector<const PdfTextBlock*> subset;
+  for (const size_t index : indices) subset.push_back(blocks.at(index));
+  return subset;
+}
+
+// The rows and columns of 'page' as computed by Cluster() before
+// ClusterIntersectingSpans: the blocks of the page are grouped into rows, and
+// the blocks of each row into columns, with PairwiseClusterIntersectingSpans.
+PdfTextTableRows PairwiseClusterRows(const PdfPage& page) {
+  const auto union_into = [](const BoundingBox& a, BoundingBox* b) {
+    *b = Union(a, *b);
+  };
+  std::vector<const PdfTextBlock*> page_blocks;
+  for (const PdfTextBlock& block : page.blocks()) page_blocks.push_back(&block);
+  PdfTextTableRows rows;
+  for (const Indices& row_indices : PairwiseClusterIntersectingSpans(
+           GetSpans(page_blocks, Orientation::SOUTH))) {
+    const std::vector<const PdfTextBlock*> row_blocks =
+        Keep(page_blocks, row_indices);
+    PdfTextTableRow row;
+    auto* text_blocks = row.mutable_blocks();
+    for (Indices& col_indices : PairwiseClusterIntersectingSpans(
+             GetSpans(row_blocks, Orientation::EAST))) {
+      std::sort(col_indices.begin(), col_indices.end(),
+                [&row_blocks](size_t a_index, size_t b_index) {
+                  return row_blocks[a_index]->bounding_box().top() <
+                         row_blocks[b_index]->bounding_box().top();
+                });
+      PdfTextBlock output_block;
+      BoundingBox* bounding_box = output_block.mutable_bounding_box();
+      string* text = output_block.mutable_text();
+      bool first = true;
+      for (const size_t index : col_indices) {
+        const PdfTextBlock& block = *row_blocks[index];
+        if (first) {
+          *bounding_box = block.bounding_box();
+          output_block.set_font_size(block.font_size());
+          first = false;
+        }
+        union_into(block.bounding_box(), bounding_box);
+        if (!text->empty()) text->push_back('\n');
+        text->append(block.text());
+      }
+      while (!text->empty() && std::isspace(text->back())) text->pop_back();
+      output_block.Swap(text_blocks->Add());
+    }
+    std::sort(text_blocks->begin(), text_blocks->end(),
+              [](const PdfTextBlock& a, const PdfTextBlock& b) {
+                return a.bounding_box().left() < b.bounding_box().left();
+              });
+    BoundingBox* bounding_box = row.mutable_bounding_box();
+    bool first = true;
+    for (const PdfTextBlock& block : *text_blocks) {
+      if (first) {
+        *bounding_box = block.bounding_box();
+        first = false;
+      }
+      union_into(block.bounding_box(), bounding_box);
+    }
+    row.Swap(rows.Add());
+  }
+  std::sort(rows.begin(), rows.end(),
+            [](const PdfTextTableRow& a, const PdfTextTableRow& b) {
+              return a.bounding_box().top() < b.bounding_box().top();
+            });
+  for (size_t row_index = 0; row_index < rows.size(); ++row_index) {
+    auto* row = rows.Mutable(row_index);
+    for (size_t col_index = 0; col_index < row->blocks_size(); ++col_index) {
+      auto* block = row->mutable_blocks(col_index);
+      block->set_row(row_index);
+      block->set_col(col_index);
+    }
+  }
+  return rows;
+}
+
+// Returns the number of groups of 'clusters' with more than one element.
+int CountMultiElementGroups(const std::vector<Indices>& clusters) {
+  return std::count_if(
+      clusters.begin(), clusters.end(),
+      [](const Indices& indices) { return indices.size() > 1; });
+}
+
+TEST(ClusterIntersectingSpans, SameAsPairwiseOnTestData) {
+  PdfDocument document = ReadTextProtoOrDie<PdfDocument>(
+      StrCat(getenv("TEST_SRCDIR"),
+             "/__main__/cpu_instructions/x86/pdf/testdata/"
+             "253666_p170_p171_pdfdoc.pbtxt"));
+  int num_multi_block_rows = 0;
+  int num_multi_block_columns = 0;
+  for (PdfPage& page : *document.mutable_pages()) {
+    // page.blocks() are the blocks given to ClusterRows, and the blocks of each
+    // row are the ones given to ClusterColumns.
+    Cluster(&page);
+    std::vector<const PdfTextBlock*> page_blocks;
+    for (const PdfTextBlock& block : page.blocks()) {
+      page_blocks.push_back(&block);
+    }
+    ASSERT_FALSE(page_blocks.empty());
+    const std::vector<Span> rows_spans =
+        GetSpans(page_blocks, Orientation::SOUTH);
+    const std::vector<Indices> rows = ClusterIntersectingSpans(rows_spans);
+    EXPECT_EQ(rows, PairwiseClusterIntersectingSpans(rows_spans))
+        << "page " << page.number();
+    num_multi_block_rows += CountMultiElementGroups(rows);
+    for (const Indices& row_indices : rows) {
+      const std::vector<Span> columns_spans =
+          GetSpans(Keep(page_blocks, row_indices), Orientation::EAST);
+      const std::vector<Indices> columns =
+          ClusterIntersectingSpans(columns_spans);
+      EXPECT_EQ(columns, PairwiseClusterIntersectingSpans(columns_spans))
+          << "page " << page.number();
+      num_multi_block_columns += CountMultiElementGroups(columns);
+    }
+
+    // The rows computed by Cluster() are the same as with the pairwise
+    // implementation.
+    const PdfTextTableRows expected_rows = PairwiseClusterRows(page);
+    ASSERT_EQ(page.rows_size(), expected_rows.size())
+        << "page " << page.number();
+    for (int i = 0; i < expected_rows.size(); ++i) {
+      EXPECT_EQ(page.rows(i).SerializeAsString(),
+                expected_rows.Get(i).SerializeAsString())
+          << "page " << page.number() << ", row " << i;
+    }
+  }
+  // Make sure that the test data actually has blocks that are merged.
+  EXPECT_GT(num_multi_block_rows, 0);
+  EXPECT_GT(num_multi_block_columns, 0);
+}
+
+TEST(Cluster, SameWithGlyphs) {
+  const PdfDocument document = ReadTextProtoOrDie<PdfDocument>(
+      StrCat(getenv("TEST_SRCDIR"),
+             "/__main__/cpu_instructions/x86/pdf/testdata/"
+             "253666_p170_p171_pdfdoc.pbtxt"));
+  for (const PdfPage& page : document.pages()) {
+    PdfPage expected = page;
+    Cluster(&expected);
+    expected.clear_characters();
+    PdfPage page_without_characters = page;
+    page_without_characters.clear_characters();
+    Cluster(Glyphs(page.characters()), &page_without_characters);
+    EXPECT_EQ(page_without_characters.SerializeAsString(),
+              expected.SerializeAsString())
+        << "page " << page.number();
+  }
+}
+
 }  // namespace
 
 }  // namespace pdf
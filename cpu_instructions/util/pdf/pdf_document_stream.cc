@@ -0,0 +1,286 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/pdf/pdf_document_stream.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "glog/logging.h"
+#include "src/google/protobuf/io/coded_stream.h"
+#include "src/google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "src/google/protobuf/wire_format_lite.h"
+
+namespace cpu_instructions {
+namespace pdf {
+
+namespace {
+
+using ::google::protobuf::io::CodedInputStream;
+using ::google::protobuf::io::CodedOutputStream;
+using ::google::protobuf::io::FileOutputStream;
+using ::google::protobuf::io::StringOutputStream;
+using ::google::protobuf::internal::WireFormatLite;
+
+// The tag preceding each page in a serialized PdfDocument.
+const uint32_t kPagesTag =
+    WireFormatLite::MakeTag(PdfDocument::kPagesFieldNumber,
+                            WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+
+// The tag of the number of a serialized PdfPage.
+const uint32_t kPageNumberTag = WireFormatLite::MakeTag(
+    PdfPage::kNumberFieldNumber, WireFormatLite::WIRETYPE_VARINT);
+
+// The first and last bytes of kIndexed files. A serialized proto can't start
+// with a zero byte, which would be a tag with field number 0.
+constexpr char kIndexedMagic[8] = {'\0', 'P', 'D', 'F', 'I', 'D', 'X', '1'};
+
+// The offset of the index followed by the magic number.
+constexpr size_t kIndexedTrailerSize = sizeof(uint64_t) + sizeof(kIndexedMagic);
+
+// The largest buffer a CodedInputStream can read from.
+constexpr size_t kMaxCodedInputSize = std::numeric_limits<int>::max();
+
+bool HasIndexedMagic(const uint8_t* data) {
+  return memcmp(data, kIndexedMagic, sizeof(kIndexedMagic)) == 0;
+}
+
+// Returns PdfPage.number for a serialized page without decoding the page. The
+// fields are serialized in order, so the number is usually the first field.
+int ReadPageNumber(const uint8_t* data, size_t size) {
+  CodedInputStream input(data, std::min(size, kMaxCodedInputSize));
+  for (uint32_t tag = input.ReadTag(); tag != 0; tag = input.ReadTag()) {
+    if (tag == kPageNumberTag) {
+      uint32_t number = 0;
+      if (!input.ReadVarint32(&number)) break;
+      return static_cast<int32_t>(number);
+    }
+    if (!WireFormatLite::SkipField(&input, tag)) break;
+  }
+  // Corrupted pages are reported when they are decoded.
+  return 0;
+}
+
+}  // namespace
+
+PdfDocumentWriter::PdfDocumentWriter(const string& filename,
+                                     PdfDocumentFormat format)
+    : filename_(filename), format_(format) {
+  CHECK(!filename.empty());
+  file_ = fopen(filename.c_str(), "wb");
+  CHECK(file_) << "Could not open '" << filename << "'";
+  output_stream_.reset(new FileOutputStream(fileno(file_)));
+  if (format_ == PdfDocumentFormat::kIndexed) {
+    CodedOutputStream output(output_stream_.get());
+    output.WriteRaw(kIndexedMagic, sizeof(kIndexedMagic));
+    offset_ += output.ByteCount();
+  }
+}
+
+PdfDocumentWriter::~PdfDocumentWriter() {
+  if (file_ != nullptr) Close();
+}
+
+void PdfDocumentWriter::WriteHeader(const PdfDocument& header) {
+  CHECK(output_stream_) << "'" << filename_ << "' is closed";
+  CHECK_EQ(header.pages_size(), 0);
+  if (format_ == PdfDocumentFormat::kIndexed) {
+    index_.mutable_header()->MergeFrom(header);
+    return;
+  }
+  CodedOutputStream output(output_stream_.get());
+  CHECK(header.SerializeToCodedStream(&output))
+      << "Could not write to '" << filename_ << "'";
+  offset_ += output.ByteCount();
+}
+
+void PdfDocumentWriter::WritePage(const PdfPage& page) {
+  CHECK(output_stream_) << "'" << filename_ << "' is closed";
+  const size_t size = page.ByteSizeLong();
+  CodedOutputStream output(output_stream_.get());
+  if (format_ == PdfDocumentFormat::kIndexed) {
+    PdfDocumentIndex::Page* const location = index_.add_pages();
+    location->set_number(page.number());
+    location->set_offset(offset_);
+    location->set_size(size);
+  } else {
+    output.WriteTag(kPagesTag);
+    output.WriteVarint32(static_cast<uint32_t>(size));
+  }
+  page.SerializeWithCachedSizes(&output);
+  CHECK(!output.HadError()) << "Could not write to '" << filename_ << "'";
+  offset_ += output.ByteCount();
+}
+
+void PdfDocumentWriter::Close() {
+  CHECK(output_stream_) << "'" << filename_ << "' is already closed";
+  if (format_ == PdfDocumentFormat::kIndexed) {
+    CodedOutputStream output(output_stream_.get());
+    CHECK(index_.SerializeToCodedStream(&output))
+        << "Could not write to '" << filename_ << "'";
+    output.WriteLittleEndian64(offset_);
+    output.WriteRaw(kIndexedMagic, sizeof(kIndexedMagic));
+    CHECK(!output.HadError()) << "Could not write to '" << filename_ << "'";
+    offset_ += output.ByteCount();
+  }
+  CHECK(output_stream_->Flush()) << "Could not write to '" << filename_ << "'";
+  output_stream_.reset();
+  CHECK_EQ(fclose(file_), 0) << "Could not close '" << filename_ << "'";
+  file_ = nullptr;
+}
+
+PdfDocumentReader::PdfDocumentReader(const string& filename)
+    : filename_(filename) {
+  CHECK(!filename.empty());
+  fd_ = open(filename.c_str(), O_RDONLY);
+  CHECK_GE(fd_, 0) << "Could not open '" << filename << "'";
+  struct stat file_stat;
+  CHECK_EQ(fstat(fd_, &file_stat), 0) << "Could not stat '" << filename << "'";
+  size_ = file_stat.st_size;
+  // mmap() fails on empty files, which are empty kProto documents.
+  if (size_ > 0) {
+    void* const data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    CHECK(data != MAP_FAILED) << "Could not map '" << filename << "'";
+    data_ = static_cast<const uint8_t*>(data);
+  }
+  if (size_ >= sizeof(kIndexedMagic) && HasIndexedMagic(data_)) {
+    format_ = PdfDocumentFormat::kIndexed;
+    ReadIndex();
+  } else {
+    ScanFields();
+  }
+}
+
+PdfDocumentReader::~PdfDocumentReader() {
+  if (data_ != nullptr) munmap(const_cast<uint8_t*>(data_), size_);
+  close(fd_);
+}
+
+void PdfDocumentReader::ReadIndex() {
+  CHECK_GE(size_, sizeof(kIndexedMagic) + kIndexedTrailerSize)
+      << "Truncated file '" << filename_ << "'";
+  CHECK(HasIndexedMagic(data_ + size_ - sizeof(kIndexedMagic)))
+      << "Truncated file '" << filename_ << "'";
+  const size_t index_end = size_ - kIndexedTrailerSize;
+  uint64_t index_offset = 0;
+  for (int i = sizeof(uint64_t) - 1; i >= 0; --i) {
+    index_offset = (index_offset << 8) | data_[index_end + i];
+  }
+  CHECK_GE(index_offset, sizeof(kIndexedMagic))
+      << "Corrupted file '" << filename_ << "'";
+  CHECK_LE(index_offset, index_end) << "Corrupted file '" << filename_ << "'";
+  CHECK_LE(index_end - index_offset, kMaxCodedInputSize);
+  PdfDocumentIndex index;
+  CHECK(index.ParseFromArray(data_ + index_offset, index_end - index_offset))
+      << "Corrupted index in '" << filename_ << "'";
+  header_.Swap(index.mutable_header());
+  pages_.reserve(index.pages_size());
+  for (const PdfDocumentIndex::Page& page : index.pages()) {
+    CHECK_GE(page.offset(), sizeof(kIndexedMagic))
+        << "Corrupted index in '" << filename_ << "'";
+    CHECK_LE(page.offset(), index_offset)
+        << "Corrupted index in '" << filename_ << "'";
+    CHECK_LE(page.size(), index_offset - page.offset())
+        << "Corrupted index in '" << filename_ << "'";
+    pages_.emplace_back();
+    PageLocation& location = pages_.back();
+    location.number = page.number();
+    location.offset = page.offset();
+    location.size = page.size();
+  }
+}
+
+void PdfDocumentReader::ScanFields() {
+  string header_fields;
+  {
+    StringOutputStream header_stream(&header_fields);
+    CodedOutputStream header_output(&header_stream);
+    size_t position = 0;
+    while (position < size_) {
+      // A new CodedInputStream is created for each field so that files larger
+      // than what a CodedInputStream can read are supported.
+      CodedInputStream input(data_ + position,
+                             std::min(size_ - position, kMaxCodedInputSize));
+      const uint32_t tag = input.ReadTag();
+      CHECK_NE(tag, 0) << "Corrupted file '" << filename_ << "'";
+      if (tag == kPagesTag) {
+        uint32_t page_size = 0;
+        CHECK(input.ReadVarint32(&page_size))
+            << "Corrupted file '" << filename_ << "'";
+        PageLocation location;
+        location.offset = position + input.CurrentPosition();
+        location.size = page_size;
+        CHECK_LE(location.size, size_ - location.offset)
+            << "Truncated file '" << filename_ << "'";
+        location.number = ReadPageNumber(data_ + location.offset, page_size);
+        pages_.push_back(location);
+        position = location.offset + location.size;
+      } else {
+        CHECK(WireFormatLite::SkipField(&input, tag, &header_output))
+            << "Corrupted file '" << filename_ << "'";
+        position += input.CurrentPosition();
+      }
+    }
+  }
+  if (!header_fields.empty()) {
+    CHECK(header_.ParseFromString(header_fields))
+        << "Corrupted file '" << filename_ << "'";
+  }
+}
+
+bool PdfDocumentReader::ReadNextPage(PdfPage* page) {
+  CHECK(page != nullptr);
+  if (next_page_index_ >= num_pages()) return false;
+  ReadPage(next_page_index_, page);
+  ++next_page_index_;
+  return true;
+}
+
+void PdfDocumentReader::ReadPage(int index, PdfPage* page) const {
+  CHECK(page != nullptr);
+  CHECK_GE(index, 0);
+  CHECK_LT(index, num_pages());
+  const PageLocation& location = pages_[index];
+  CHECK_LE(location.size, kMaxCodedInputSize);
+  CHECK(page->ParseFromArray(data_ + location.offset, location.size))
+      << "Corrupted page in '" << filename_ << "'";
+}
+
+bool PdfDocumentReader::ReadPageWithNumber(int page_number,
+                                           PdfPage* page) const {
+  for (int index = 0; index < num_pages(); ++index) {
+    if (pages_[index].number == page_number) {
+      ReadPage(index, page);
+      return true;
+    }
+  }
+  return false;
+}
+
+PdfDocument ReadPdfDocumentOrDie(const string& filename) {
+  PdfDocumentReader reader(filename);
+  PdfDocument document = reader.header();
+  for (int index = 0; index < reader.num_pages(); ++index) {
+    reader.ReadPage(index, document.add_pages());
+  }
+  return document;
+}
+
+}  // namespace pdf
+}  // namespace cpu_instructions
@@ -0,0 +1,164 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Reads and writes PdfDocument files one page at a time.
+//
+// Two formats are supported:
+// - kProto: a regular binary PdfDocument proto, where each page is a length
+//   delimited 'pages' field. Files written by PdfDocumentWriter can be read
+//   with ReadBinaryProtoOrDie<PdfDocument>, and files written by
+//   WriteBinaryProtoOrDie can be read by PdfDocumentReader.
+// - kIndexed: a magic number, the serialized pages, a PdfDocumentIndex holding
+//   the header and the offset of each page, the offset of the index as a
+//   little-endian uint64, and the magic number again. The index can be read
+//   without going through the pages, so that a single page can be decoded
+//   without reading the rest of the document.
+// Only one page needs to be in memory at any time.
+
+#ifndef CPU_INSTRUCTIONS_UTIL_PDF_PDF_DOCUMENT_STREAM_H_
+#define CPU_INSTRUCTIONS_UTIL_PDF_PDF_DOCUMENT_STREAM_H_
+
+#include <stdio.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "strings/string.h"
+
+#include "cpu_instructions/proto/pdf/pdf_document.pb.h"
+#include "src/google/protobuf/io/zero_copy_stream_impl.h"
+
+namespace cpu_instructions {
+namespace pdf {
+
+enum class PdfDocumentFormat { kProto, kIndexed };
+
+// Writes a PdfDocument to a file, page by page.
+//
+// Usage:
+//   PdfDocumentWriter writer(filename, format);
+//   writer.WriteHeader(header);  // document_id and metadata.
+//   for (...) writer.WritePage(page);
+//   writer.Close();
+class PdfDocumentWriter {
+ public:
+  // Dies if the file can't be opened for writing.
+  explicit PdfDocumentWriter(
+      const string& filename,
+      PdfDocumentFormat format = PdfDocumentFormat::kProto);
+
+  PdfDocumentWriter(const PdfDocumentWriter&) = delete;
+  PdfDocumentWriter& operator=(const PdfDocumentWriter&) = delete;
+
+  // Closes the file if Close() was not called.
+  ~PdfDocumentWriter();
+
+  // Writes all the fields of 'header' but the pages, which must be empty.
+  // Should be called before the first WritePage() with kProto, and before
+  // Close() with kIndexed.
+  void WriteHeader(const PdfDocument& header);
+
+  // Appends 'page' to the pages of the document.
+  void WritePage(const PdfPage& page);
+
+  // Flushes and closes the file. Dies on error.
+  void Close();
+
+ private:
+  const string filename_;
+  const PdfDocumentFormat format_;
+  FILE* file_ = nullptr;
+  std::unique_ptr<google::protobuf::io::FileOutputStream> output_stream_;
+  // The number of bytes written so far.
+  uint64_t offset_ = 0;
+  // The index of the document, only used with kIndexed.
+  PdfDocumentIndex index_;
+};
+
+// Reads a PdfDocument from a file written in either format, page by page or
+// by random access. The file is memory-mapped, and pages are only decoded when
+// they are read. With kIndexed files, the constructor only reads the index.
+// With kProto files, it goes through the fields of the document to find the
+// pages, but does not decode them.
+//
+// Usage:
+//   PdfDocumentReader reader(filename);
+//   PdfPage page;
+//   while (reader.ReadNextPage(&page)) { ... }
+// or:
+//   if (reader.ReadPageWithNumber(page_number, &page)) { ... }
+class PdfDocumentReader {
+ public:
+  // Dies if the file can't be opened for reading, or if it is corrupted.
+  explicit PdfDocumentReader(const string& filename);
+
+  PdfDocumentReader(const PdfDocumentReader&) = delete;
+  PdfDocumentReader& operator=(const PdfDocumentReader&) = delete;
+
+  ~PdfDocumentReader();
+
+  // Reads the next page into 'page' and returns true, or returns false if there
+  // are no more pages. Dies if the page is corrupted.
+  bool ReadNextPage(PdfPage* page);
+
+  // The number of pages in the document.
+  int num_pages() const { return pages_.size(); }
+
+  // The number of the page at 'index' in [0, num_pages()), i.e.
+  // PdfPage.number.
+  int GetPageNumber(int index) const { return pages_[index].number; }
+
+  // Reads the page at 'index' in [0, num_pages()) into 'page'. Dies if the page
+  // is corrupted.
+  void ReadPage(int index, PdfPage* page) const;
+
+  // Reads the first page whose number is 'page_number' into 'page' and returns
+  // true, or returns false if there is no such page.
+  bool ReadPageWithNumber(int page_number, PdfPage* page) const;
+
+  // All the fields of the document but the pages.
+  const PdfDocument& header() const { return header_; }
+
+  PdfDocumentFormat format() const { return format_; }
+
+ private:
+  struct PageLocation {
+    int number = 0;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+  };
+
+  // Fills header_ and pages_ from the index at the end of the file.
+  void ReadIndex();
+
+  // Fills header_ and pages_ by going through the fields of the document.
+  void ScanFields();
+
+  const string filename_;
+  PdfDocumentFormat format_ = PdfDocumentFormat::kProto;
+  int fd_ = -1;
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  PdfDocument header_;
+  std::vector<PageLocation> pages_;
+  int next_page_index_ = 0;
+};
+
+// Reads a whole PdfDocument written in either format.
+PdfDocument ReadPdfDocumentOrDie(const string& filename);
+
+}  // namespace pdf
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_UTIL_PDF_PDF_DOCUMENT_STREAM_H_
@@ -0,0 +1,177 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/pdf/pdf_document_stream.h"
+
+#include <cstdlib>
+#include "strings/string.h"
+
+#include "cpu_instructions/testing/test_util.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "strings/str_cat.h"
+
+namespace cpu_instructions {
+namespace pdf {
+namespace {
+
+using ::cpu_instructions::testing::EqualsProto;
+
+constexpr const char kDocument[] = R"(
+  document_id { title: "title" creation_date: "date" }
+  pages {
+    number: 1
+    width: 612
+    height: 792
+    characters { codepoint: 68 utf8: "a" font_size: 11 }
+  }
+  pages { number: 2 }
+  pages {
+    number: 3
+    rows { blocks { text: "some text" } }
+  }
+  metadata { key: "Title" value: "title" }
+)";
+
+string GetTestFilename(const string& basename) {
+  return StrCat(getenv("TEST_TMPDIR"), "/", basename);
+}
+
+// Writes 'document' with a PdfDocumentWriter.
+void WriteDocument(const PdfDocument& document, const string& filename,
+                   PdfDocumentFormat format = PdfDocumentFormat::kProto) {
+  PdfDocument header = document;
+  header.clear_pages();
+  PdfDocumentWriter writer(filename, format);
+  writer.WriteHeader(header);
+  for (const PdfPage& page : document.pages()) writer.WritePage(page);
+  writer.Close();
+}
+
+// Reads back a whole document with a PdfDocumentReader.
+PdfDocument ReadDocument(const string& filename) {
+  PdfDocumentReader reader(filename);
+  PdfDocument document;
+  PdfPage page;
+  while (reader.ReadNextPage(&page)) page.Swap(document.add_pages());
+  document.MergeFrom(reader.header());
+  return document;
+}
+
+TEST(PdfDocumentStreamTest, WrittenFileIsAPdfDocument) {
+  const PdfDocument document =
+      ParseProtoFromStringOrDie<PdfDocument>(kDocument);
+  const string filename = GetTestFilename("written.pdf.pb");
+  WriteDocument(document, filename);
+  EXPECT_THAT(ReadBinaryProtoOrDie<PdfDocument>(filename),
+              EqualsProto(document));
+}
+
+TEST(PdfDocumentStreamTest, ReadsPagesOneByOne) {
+  const PdfDocument document =
+      ParseProtoFromStringOrDie<PdfDocument>(kDocument);
+  const string filename = GetTestFilename("pages.pdf.pb");
+  WriteDocument(document, filename);
+
+  PdfDocumentReader reader(filename);
+  // The header is available before the first page is read.
+  EXPECT_THAT(reader.header(), EqualsProto(R"(
+    document_id { title: "title" creation_date: "date" }
+    metadata { key: "Title" value: "title" })"));
+  PdfPage page;
+  for (const PdfPage& expected_page : document.pages()) {
+    ASSERT_TRUE(reader.ReadNextPage(&page));
+    EXPECT_THAT(page, EqualsProto(expected_page));
+  }
+  EXPECT_FALSE(reader.ReadNextPage(&page));
+  EXPECT_FALSE(reader.ReadNextPage(&page));
+}
+
+TEST(PdfDocumentStreamTest, ReadsFilesWrittenInOneGo) {
+  const PdfDocument document =
+      ParseProtoFromStringOrDie<PdfDocument>(kDocument);
+  const string filename = GetTestFilename("one_go.pdf.pb");
+  WriteBinaryProtoOrDie(filename, document);
+  EXPECT_THAT(ReadDocument(filename), EqualsProto(document));
+}
+
+TEST(PdfDocumentStreamTest, EmptyDocument) {
+  const string filename = GetTestFilename("empty.pdf.pb");
+  WriteDocument(PdfDocument(), filename);
+  PdfDocumentReader reader(filename);
+  PdfPage page;
+  EXPECT_FALSE(reader.ReadNextPage(&page));
+  EXPECT_THAT(reader.header(), EqualsProto(""));
+}
+
+TEST(PdfDocumentStreamTest, ReadsIndexedFiles) {
+  const PdfDocument document =
+      ParseProtoFromStringOrDie<PdfDocument>(kDocument);
+  const string filename = GetTestFilename("indexed.pdf.pb");
+  WriteDocument(document, filename, PdfDocumentFormat::kIndexed);
+  EXPECT_EQ(PdfDocumentReader(filename).format(), PdfDocumentFormat::kIndexed);
+  EXPECT_THAT(ReadDocument(filename), EqualsProto(document));
+  EXPECT_THAT(ReadPdfDocumentOrDie(filename), EqualsProto(document));
+}
+
+TEST(PdfDocumentStreamTest, IndexedHeaderCanBeWrittenAfterPages) {
+  const string filename = GetTestFilename("late_header.pdf.pb");
+  PdfDocumentWriter writer(filename, PdfDocumentFormat::kIndexed);
+  PdfPage page;
+  page.set_number(5);
+  writer.WritePage(page);
+  PdfDocument header;
+  header.mutable_document_id()->set_title("title");
+  writer.WriteHeader(header);
+  writer.Close();
+  EXPECT_THAT(ReadPdfDocumentOrDie(filename), EqualsProto(R"(
+    document_id { title: "title" }
+    pages { number: 5 })"));
+}
+
+TEST(PdfDocumentStreamTest, RandomAccess) {
+  const PdfDocument document =
+      ParseProtoFromStringOrDie<PdfDocument>(kDocument);
+  for (const PdfDocumentFormat format :
+       {PdfDocumentFormat::kProto, PdfDocumentFormat::kIndexed}) {
+    const string filename = GetTestFilename("random_access.pdf.pb");
+    WriteDocument(document, filename, format);
+    PdfDocumentReader reader(filename);
+    EXPECT_EQ(reader.format(), format);
+    ASSERT_EQ(reader.num_pages(), 3);
+    EXPECT_EQ(reader.GetPageNumber(0), 1);
+    EXPECT_EQ(reader.GetPageNumber(2), 3);
+    PdfPage page;
+    reader.ReadPage(1, &page);
+    EXPECT_THAT(page, EqualsProto(document.pages(1)));
+    ASSERT_TRUE(reader.ReadPageWithNumber(3, &page));
+    EXPECT_THAT(page, EqualsProto(document.pages(2)));
+    EXPECT_FALSE(reader.ReadPageWithNumber(4, &page));
+  }
+}
+
+TEST(PdfDocumentStreamTest, EmptyIndexedDocument) {
+  const string filename = GetTestFilename("empty_indexed.pdf.pb");
+  WriteDocument(PdfDocument(), filename, PdfDocumentFormat::kIndexed);
+  PdfDocumentReader reader(filename);
+  EXPECT_EQ(reader.num_pages(), 0);
+  PdfPage page;
+  EXPECT_FALSE(reader.ReadNextPage(&page));
+  EXPECT_THAT(reader.header(), EqualsProto(""));
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace cpu_instructions
@@ -15,20 +15,27 @@
 #include "cpu_instructions/util/pdf/pdf_document_utils.h"
 
 #include <dirent.h>
+#include <sys/stat.h>
 #include <algorithm>
 #include <map>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "cpu_instructions/util/proto_util.h"
+#include "cpu_instructions/util/thread_pool.h"
 #include "glog/logging.h"
 #include "strings/str_cat.h"
 #include "strings/str_join.h"
 #include "util/gtl/map_util.h"
+#include "util/gtl/ptr_util.h"
 
 namespace cpu_instructions {
 namespace pdf {
 
+using internal::EqualRangeReference;
+
 namespace {
 
 // Positive, in bound is simply itselt
@@ -45,20 +52,6 @@ int GetIndex(int size, int index) {
 }
 
 typedef std::vector<size_t> Hashes;
-typedef Hashes::const_iterator HashesItr;
-
-// Stores a mapping between a_index and b_index of length match_length.
-struct EqualRangeReference {
-  EqualRangeReference() = default;
-  EqualRangeReference(size_t a_index, size_t b_index, size_t match_length)
-      : a_index(a_index), b_index(b_index), match_length(match_length) {}
-
-  size_t last_a_index() const { return a_index + match_length - 1; }
-
-  size_t a_index;
-  size_t b_index;
-  size_t match_length;
-};
 
 // The value used to separate the two concatenated buffers used by the suffix
 // array. It must be a small value not present in the original buffers.
@@ -67,102 +60,164 @@ struct EqualRangeReference {
 // More information here:  https://cs.stackexchange.com/a/9619
 constexpr const size_t kSentinel = 0;
 
-// A convenient structure holding the concatenation of a, kSentinel and b.
-// 'a' and 'b' are the hashes of the blocks in the 'from' and 'to' documents
-// respectively.
-struct ConcatHashes {
-  static Hashes ConcatenateHashes(const Hashes& a, const Hashes& b) {
-    Hashes buffer;
-    CHECK_GT(a.size(), 1);
-    CHECK_GT(b.size(), 1);
-    buffer.reserve(a.size() + b.size() + 1);
-    buffer.insert(std::end(buffer), std::begin(a), std::end(a));
-    buffer.push_back(kSentinel);
-    buffer.insert(std::end(buffer), std::begin(b), std::end(b));
-    return buffer;
+// Returns the concatenation of a, kSentinel and b, where each hash is replaced
+// by its rank among the distinct hashes, starting at 1. 'a' and 'b' are the
+// hashes of the blocks in the 'from' and 'to' documents respectively.
+Hashes ConcatenateRanks(const Hashes& a, const Hashes& b) {
+  Hashes buffer;
+  buffer.reserve(a.size() + b.size() + 1);
+  buffer.insert(std::end(buffer), std::begin(a), std::end(a));
+  buffer.push_back(kSentinel);
+  buffer.insert(std::end(buffer), std::begin(b), std::end(b));
+  CHECK_EQ(std::count(std::begin(buffer), std::end(buffer), kSentinel), 1);
+  Hashes sorted = buffer;
+  std::sort(std::begin(sorted), std::end(sorted));
+  sorted.erase(std::unique(std::begin(sorted), std::end(sorted)),
+               std::end(sorted));
+  for (size_t& value : buffer) {
+    value = 1 + std::distance(std::begin(sorted),
+                              std::lower_bound(std::begin(sorted),
+                                               std::end(sorted), value));
   }
+  return buffer;
+}
 
-  ConcatHashes(const Hashes& a, const Hashes& b)
-      : array(ConcatenateHashes(a, b)),
-        begin(std::begin(array)),
-        end_a(begin + a.size()),
-        begin_b(end_a + 1),
-        end(std::end(array)) {
-    CHECK_EQ(std::count(begin, end, kSentinel), 1);
+// Returns the suffix array of 'text', i.e. the start positions of its suffixes
+// in lexicographic order, a suffix being smaller than the suffixes it is a
+// prefix of. The values of 'text' must be in [1, alphabet_size).
+//
+// The suffixes of 'text' are sorted as the cyclic shifts of 'text' followed by
+// a 0 terminator, by doubling the length of the sorted prefixes at each step.
+// Each step is two counting sorts, so the complexity is O(n log n) regardless
+// of how repetitive 'text' is.
+std::vector<size_t> GetSuffixArray(const Hashes& text, size_t alphabet_size) {
+  const size_t n = text.size() + 1;
+  std::vector<size_t> counts(std::max(alphabet_size, n), 0);
+  // suffixes[i] is the i-th shift in sorted order, classes[j] is the rank of
+  // the prefix of shift j among the distinct sorted prefixes.
+  std::vector<size_t> suffixes(n);
+  std::vector<size_t> classes(n);
+  for (size_t i = 0; i < n; ++i) {
+    classes[i] = i < text.size() ? text[i] : 0;
+    CHECK_LT(classes[i], alphabet_size);
+    ++counts[classes[i]];
   }
-
-  // Returns the size of the concatenated buffer.
-  size_t size() const { return array.size(); }
-
-  // Returns whether the iterator points in the a buffer or not.
-  bool IsInA(const HashesItr& i) const { return i < end_a; }
-
-  // Takes two iterators and compares then lexicographically.
-  bool LexicographicCompare(const HashesItr& a, const HashesItr& b) const {
-    return std::lexicographical_compare(a, end, b, end);
+  for (size_t c = 1; c < counts.size(); ++c) counts[c] += counts[c - 1];
+  for (size_t i = n; i-- > 0;) suffixes[--counts[classes[i]]] = i;
+  // Renumbers the classes from 0 so that they can be counted in [0, n).
+  std::vector<size_t> new_classes(n);
+  size_t num_classes = 1;
+  new_classes[suffixes[0]] = 0;
+  for (size_t i = 1; i < n; ++i) {
+    if (classes[suffixes[i]] != classes[suffixes[i - 1]]) ++num_classes;
+    new_classes[suffixes[i]] = num_classes - 1;
   }
+  classes.swap(new_classes);
+
+  std::vector<size_t> by_second_half(n);
+  for (size_t length = 1; num_classes < n; length *= 2) {
+    // The shifts sorted by their second half are the shifts starting 'length'
+    // positions before the already sorted ones.
+    for (size_t i = 0; i < n; ++i) {
+      by_second_half[i] = (suffixes[i] + n - length % n) % n;
+    }
+    // Stable counting sort by the class of the first half.
+    std::fill(std::begin(counts), std::begin(counts) + num_classes, 0);
+    for (size_t i = 0; i < n; ++i) ++counts[classes[by_second_half[i]]];
+    for (size_t c = 1; c < num_classes; ++c) counts[c] += counts[c - 1];
+    for (size_t i = n; i-- > 0;) {
+      suffixes[--counts[classes[by_second_half[i]]]] = by_second_half[i];
+    }
+    num_classes = 1;
+    new_classes[suffixes[0]] = 0;
+    for (size_t i = 1; i < n; ++i) {
+      const size_t current = suffixes[i];
+      const size_t previous = suffixes[i - 1];
+      if (classes[current] != classes[previous] ||
+          classes[(current + length) % n] != classes[(previous + length) % n]) {
+        ++num_classes;
+      }
+      new_classes[current] = num_classes - 1;
+    }
+    classes.swap(new_classes);
+  }
+  // The shift starting at the terminator is always first.
+  CHECK_EQ(suffixes[0], text.size());
+  suffixes.erase(std::begin(suffixes));
+  return suffixes;
+}
 
-  // Returns the index of itr within the original a or b buffer.
-  size_t Index(const HashesItr& itr) const {
-    CHECK(itr != end_a);
-    return IsInA(itr) ? std::distance(begin, itr) : std::distance(begin_b, itr);
+// Returns the LCP array of 'text' (Kasai et al.): the i-th value is the length
+// of the longest common prefix of the suffixes at suffix_array[i - 1] and
+// suffix_array[i]. The first value is 0. Runs in O(n).
+std::vector<size_t> GetLongestCommonPrefixes(
+    const Hashes& text, const std::vector<size_t>& suffix_array) {
+  const size_t n = text.size();
+  std::vector<size_t> ranks(n);
+  for (size_t i = 0; i < n; ++i) ranks[suffix_array[i]] = i;
+  std::vector<size_t> prefixes(n, 0);
+  size_t length = 0;
+  for (size_t position = 0; position < n; ++position) {
+    if (ranks[position] == 0) {
+      length = 0;
+      continue;
+    }
+    const size_t previous = suffix_array[ranks[position] - 1];
+    while (position + length < n && previous + length < n &&
+           text[position + length] == text[previous + length]) {
+      ++length;
+    }
+    prefixes[ranks[position]] = length;
+    if (length > 0) --length;
   }
+  return prefixes;
+}
 
-  const Hashes array;
-  const HashesItr begin;    // points to begin of array (it's also begin of a).
-  const HashesItr end_a;    // points to end of a within array.
-  const HashesItr begin_b;  // points to begin of b within array.
-  const HashesItr end;      // points to end of array (it's also end of b).
-};
+}  // namespace
+
+namespace internal {
 
 // Finds all the matching subsequences between a and b. The algorithm is
 // described here: https://cs.stackexchange.com/a/9619 and uses lcp array and
 // suffix array.
 std::vector<EqualRangeReference> GetMatchingRanges(const Hashes& a,
                                                    const Hashes& b) {
+  if (a.empty() || b.empty()) return {};
   // The concatenation of a, kSentinel and b.
-  const ConcatHashes hashes(a, b);
-
-  // Initialize suffix array pointers.
-  std::vector<HashesItr> pointers;
-  pointers.reserve(hashes.size());
-  for (auto itr = hashes.begin; itr != hashes.end; ++itr) {
-    pointers.push_back(itr);
-  }
-  // Get common suffixes.
-  std::sort(std::begin(pointers), std::end(pointers),
-            [&hashes](const HashesItr a, const HashesItr b) {
-              return hashes.LexicographicCompare(a, b);
-            });
-
-  std::vector<EqualRangeReference> ranges;
+  const Hashes text = ConcatenateRanks(a, b);
+  const size_t alphabet_size =
+      *std::max_element(std::begin(text), std::end(text)) + 1;
+  const std::vector<size_t> suffix_array = GetSuffixArray(text, alphabet_size);
+  const std::vector<size_t> prefixes =
+      GetLongestCommonPrefixes(text, suffix_array);
+
+  // Returns the index of a position of 'text' within the original a or b.
+  const auto get_index = [&a](size_t position) {
+    CHECK_NE(position, a.size());
+    return position < a.size() ? position : position - a.size() - 1;
+  };
 
   // We now traverse the suffix array and extract common prefixes for adjacent
-  // pointers. See https://en.wikipedia.org/wiki/LCP_array.
+  // suffixes. See https://en.wikipedia.org/wiki/LCP_array.
   // LCP array would also find matching subsequences within a and within b, we
   // want only matching subsequences between a and b so we have to check that
-  // iterators don't belong to the same set of hashes.
-  bool is_first_iteration = true;
-  HashesItr previous_itr;
-  bool previous_is_in_a;
-  for (const auto& itr : pointers) {
-    const bool is_in_a = hashes.IsInA(itr);
-    if (!is_first_iteration) {
-      const auto pair = std::mismatch(previous_itr, hashes.end, itr);
-      const auto match_length = std::distance(previous_itr, pair.first);
-      if (match_length > 0 && is_in_a != previous_is_in_a) {
-        const auto current_index = hashes.Index(itr);
-        const auto previous_index = hashes.Index(previous_itr);
-        if (is_in_a) {
-          ranges.emplace_back(current_index, previous_index, match_length);
-        } else {
-          ranges.emplace_back(previous_index, current_index, match_length);
-        }
+  // suffixes don't belong to the same set of hashes.
+  std::vector<EqualRangeReference> ranges;
+  for (size_t i = 1; i < suffix_array.size(); ++i) {
+    const size_t match_length = prefixes[i];
+    const size_t current = suffix_array[i];
+    const size_t previous = suffix_array[i - 1];
+    const bool is_in_a = current < a.size();
+    const bool previous_is_in_a = previous < a.size();
+    if (match_length > 0 && is_in_a != previous_is_in_a) {
+      const size_t current_index = get_index(current);
+      const size_t previous_index = get_index(previous);
+      if (is_in_a) {
+        ranges.emplace_back(current_index, previous_index, match_length);
+      } else {
+        ranges.emplace_back(previous_index, current_index, match_length);
       }
     }
-    previous_itr = itr;
-    previous_is_in_a = is_in_a;
-    is_first_iteration = false;
   }
   return ranges;
 }
@@ -193,6 +248,10 @@ std::unordered_map<size_t, size_t> GetBlockMapping(const Hashes& a,
   return block_mapping;
 }
 
+}  // namespace internal
+
+namespace {
+
 // A simple tuple to serve as a key in a map.
 struct BlockPosition {
   BlockPosition() = default;
@@ -232,7 +291,7 @@ struct BlockIndex {
           blocks.push_back(&block);
           const BlockPosition position(page.number(), block.row(), block.col());
           InsertOrDieNoPrint(&position_to_index, position, index);
-          InsertOrDieNoPrint(&index_to_position, index, position);
+          index_to_position.push_back(position);
         }
       }
     }
@@ -243,13 +302,14 @@ struct BlockIndex {
   }
 
   BlockPosition GetPosition(size_t index) const {
-    return FindOrDie(index_to_position, index);
+    CHECK_LT(index, index_to_position.size());
+    return index_to_position[index];
   }
 
   Hashes hashes;
   std::vector<const PdfTextBlock*> blocks;
   std::map<BlockPosition, size_t> position_to_index;
-  std::map<size_t, BlockPosition> index_to_position;
+  std::vector<BlockPosition> index_to_position;
 };
 
 // Takes a mapping from blocks to blocks and tries to rewrite the input patch
@@ -357,17 +417,30 @@ std::vector<const PdfTextTableRow*> GetPageBodyRows(const PdfPage& page,
 }
 
 PdfDocumentsChanges LoadConfigurations(const string& directory) {
-  PdfDocumentsChanges patch_sets;
+  // Files are read in name order so that the result does not depend on the
+  // order of the directory entries. Sub-directories, including "." and "..",
+  // are skipped.
+  std::vector<string> filenames;
   DIR* dir = nullptr;
   struct dirent* ent = nullptr;
   if ((dir = opendir(directory.c_str())) != nullptr) {
     while ((ent = readdir(dir)) != nullptr) {
       const string full_path = StrCat(directory, "/", ent->d_name);
-      LOG(INFO) << "Reading configuration file " << full_path;
-      ReadTextProtoOrDie(full_path, patch_sets.add_documents());
+      struct stat file_stat;
+      if (stat(full_path.c_str(), &file_stat) != 0 ||
+          !S_ISREG(file_stat.st_mode)) {
+        continue;
+      }
+      filenames.push_back(full_path);
     }
     closedir(dir);
   }
+  std::sort(filenames.begin(), filenames.end());
+  PdfDocumentsChanges patch_sets;
+  for (const string& filename : filenames) {
+    LOG(INFO) << "Reading configuration file " << filename;
+    ReadTextProtoOrDie(filename, patch_sets.add_documents());
+  }
   return patch_sets;
 }
 
@@ -388,12 +461,17 @@ void TransferPatches(const PdfDocumentChanges& changes, const PdfDocument& from,
                      const PdfDocument& to,
                      PdfDocumentChanges* successful_patches,
                      PdfDocumentChanges* failed_patches) {
-  LOG(INFO) << "Building index for original document";
-  const BlockIndex index_in(from);
-  LOG(INFO) << "Building index for destination document";
-  const BlockIndex index_out(to);
+  LOG(INFO) << "Building indices for original and destination documents";
+  // The two indices are independent, they are built in parallel.
+  std::unique_ptr<BlockIndex> indices[2];
+  ParallelFor(2, 2, [&from, &to, &indices](size_t i) {
+    indices[i] = gtl::MakeUnique<BlockIndex>(i == 0 ? from : to);
+  });
+  const BlockIndex& index_in = *indices[0];
+  const BlockIndex& index_out = *indices[1];
   LOG(INFO) << "Finding text block matches";
-  const auto block_mapping = GetBlockMapping(index_in.hashes, index_out.hashes);
+  const auto block_mapping =
+      internal::GetBlockMapping(index_in.hashes, index_out.hashes);
   LOG(INFO) << "Processing patches";
   std::map<size_t, std::vector<PdfPagePatch>> successful_page_patches;
   std::map<size_t, std::vector<PdfPagePatch>> failed_page_patches;
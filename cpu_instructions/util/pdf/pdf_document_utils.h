@@ -16,6 +16,9 @@
 #ifndef CPU_INSTRUCTIONS_UTIL_PDF_PDF_DOCUMENT_UTILS_H_
 #define CPU_INSTRUCTIONS_UTIL_PDF_PDF_DOCUMENT_UTILS_H_
 
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
 #include "strings/string.h"
 
 #include "cpu_instructions/proto/pdf/pdf_document.pb.h"
@@ -53,7 +56,8 @@ bool CheckPatch(const PdfPagePatch& patch, const PdfPage& page);
 std::vector<const PdfTextTableRow*> GetPageBodyRows(const PdfPage& page,
                                                     float margin);
 
-// Loads all files in directory and returns the merged PdfDocumentsChanges.
+// Loads all files in directory and returns the merged PdfDocumentsChanges. The
+// documents are in the order of the file names.
 PdfDocumentsChanges LoadConfigurations(const string& directory);
 
 // Returns the changes corresponding to the given document id, or nullptr if not
@@ -80,6 +84,39 @@ void TransferPatches(const PdfDocumentChanges& changes,
                      const PdfDocument& to_document,
                      PdfDocumentChanges* successful_patches,
                      PdfDocumentChanges* failed_patches);
+
+namespace internal {
+
+// A range of 'match_length' equal hashes starting at 'a_index' in the 'from'
+// document and at 'b_index' in the 'to' document.
+struct EqualRangeReference {
+  EqualRangeReference() = default;
+  EqualRangeReference(size_t a_index, size_t b_index, size_t match_length)
+      : a_index(a_index), b_index(b_index), match_length(match_length) {}
+
+  size_t last_a_index() const { return a_index + match_length - 1; }
+
+  size_t a_index;
+  size_t b_index;
+  size_t match_length;
+};
+
+// Returns the ranges of equal hashes between 'a' and 'b' found by
+// TransferPatches: for each pair of suffixes of 'a' and 'b' that are adjacent
+// in the suffix array of the concatenation of 'a' and 'b', their longest common
+// prefix, if it is not empty. The ranges are in suffix array order. The hashes
+// must not be 0.
+std::vector<EqualRangeReference> GetMatchingRanges(const std::vector<size_t>& a,
+                                                   const std::vector<size_t>& b);
+
+// Returns the mapping from the indices in 'a' to the indices in 'b' used by
+// TransferPatches: the ranges returned by GetMatchingRanges are taken from the
+// longest to the shortest, and a range is skipped when its first or last index
+// in 'a' is already mapped.
+std::unordered_map<size_t, size_t> GetBlockMapping(
+    const std::vector<size_t>& a, const std::vector<size_t>& b);
+
+}  // namespace internal
 }  // namespace pdf
 }  // namespace cpu_instructions
 
@@ -15,7 +15,10 @@
 #include "cpu_instructions/util/pdf/pdf_document_utils.h"
 
 #include <algorithm>
+#include <map>
 #include <numeric>
+#include <tuple>
+#include <vector>
 
 #include "cpu_instructions/testing/test_util.h"
 #include "cpu_instructions/util/proto_util.h"
@@ -23,6 +26,7 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "src/google/protobuf/text_format.h"
+#include "strings/str_cat.h"
 
 namespace cpu_instructions {
 namespace pdf {
@@ -309,6 +313,168 @@ TEST(PdfDocumentExtractorTest, TransferPatches) {
   EXPECT_THAT(failed_patches, EqualsProto(kExpectedFailed));
 }
 
+// The expected values in the tests below are the output of the original
+// implementation of the alignment, which sorted the suffixes with std::sort.
+// The split between successful and failed patches depends on the exact ranges
+// and on their order, so they must not change.
+
+using RangeTuple = std::tuple<size_t, size_t, size_t>;
+
+std::vector<RangeTuple> GetMatchingRangeTuples(const std::vector<size_t>& a,
+                                               const std::vector<size_t>& b) {
+  std::vector<RangeTuple> ranges;
+  for (const auto& range : internal::GetMatchingRanges(a, b)) {
+    ranges.emplace_back(range.a_index, range.b_index, range.match_length);
+  }
+  return ranges;
+}
+
+std::map<size_t, size_t> GetSortedBlockMapping(const std::vector<size_t>& a,
+                                               const std::vector<size_t>& b) {
+  const auto mapping = internal::GetBlockMapping(a, b);
+  return std::map<size_t, size_t>(mapping.begin(), mapping.end());
+}
+
+TEST(GetMatchingRangesTest, IdenticalHalves) {
+  const std::vector<size_t> hashes = {1, 2, 3, 1, 2, 3};
+  const std::vector<RangeTuple> kExpectedRanges = {
+      RangeTuple{3, 3, 3}, RangeTuple{3, 0, 3}, RangeTuple{0, 0, 6},
+      RangeTuple{4, 4, 2}, RangeTuple{4, 1, 2}, RangeTuple{1, 1, 5},
+      RangeTuple{5, 5, 1}, RangeTuple{5, 2, 1}, RangeTuple{2, 2, 4}};
+  EXPECT_EQ(GetMatchingRangeTuples(hashes, hashes), kExpectedRanges);
+  const std::map<size_t, size_t> kExpectedMapping = {
+      {0, 0}, {1, 1}, {2, 2}, {3, 3}, {4, 4}, {5, 5}};
+  EXPECT_EQ(GetSortedBlockMapping(hashes, hashes), kExpectedMapping);
+}
+
+TEST(GetMatchingRangesTest, RunOfOneHash) {
+  const std::vector<size_t> a = {7, 7, 7, 7};
+  const std::vector<size_t> b = {7, 7, 7};
+  const std::vector<RangeTuple> kExpectedRanges = {
+      RangeTuple{3, 2, 1}, RangeTuple{3, 1, 1}, RangeTuple{2, 1, 2},
+      RangeTuple{2, 0, 2}, RangeTuple{1, 0, 3}};
+  EXPECT_EQ(GetMatchingRangeTuples(a, b), kExpectedRanges);
+  const std::map<size_t, size_t> kExpectedMapping = {{1, 0}, {2, 1}, {3, 2}};
+  EXPECT_EQ(GetSortedBlockMapping(a, b), kExpectedMapping);
+}
+
+TEST(GetMatchingRangesTest, RepetitiveWithEdit) {
+  const std::vector<size_t> a = {4, 5, 4, 5, 4, 5, 9};
+  const std::vector<size_t> b = {9, 4, 5, 4, 6, 4, 5};
+  const std::vector<RangeTuple> kExpectedRanges = {
+      RangeTuple{0, 5, 2}, RangeTuple{2, 1, 3}, RangeTuple{4, 1, 2},
+      RangeTuple{4, 3, 1}, RangeTuple{1, 6, 1}, RangeTuple{3, 2, 2},
+      RangeTuple{5, 2, 1}, RangeTuple{6, 0, 1}};
+  EXPECT_EQ(GetMatchingRangeTuples(a, b), kExpectedRanges);
+  const std::map<size_t, size_t> kExpectedMapping = {
+      {0, 5}, {1, 6}, {2, 1}, {3, 2}, {4, 3}, {5, 2}, {6, 0}};
+  EXPECT_EQ(GetSortedBlockMapping(a, b), kExpectedMapping);
+}
+
+TEST(GetMatchingRangesTest, EmptySide) {
+  EXPECT_THAT(GetMatchingRangeTuples({}, {1, 2}), ::testing::IsEmpty());
+  EXPECT_THAT(GetMatchingRangeTuples({1, 2}, {}), ::testing::IsEmpty());
+  EXPECT_THAT(GetSortedBlockMapping({}, {1, 2}), ::testing::IsEmpty());
+  EXPECT_THAT(GetSortedBlockMapping({1, 2}, {}), ::testing::IsEmpty());
+}
+
+TEST(GetMatchingRangesTest, SingleBlock) {
+  const std::vector<RangeTuple> kExpectedRanges = {RangeTuple{0, 2, 1},
+                                                   RangeTuple{0, 1, 1}};
+  EXPECT_EQ(GetMatchingRangeTuples({3}, {1, 3, 3}), kExpectedRanges);
+  const std::map<size_t, size_t> kExpectedMapping = {{0, 2}};
+  EXPECT_EQ(GetSortedBlockMapping({3}, {1, 3, 3}), kExpectedMapping);
+
+  const std::vector<RangeTuple> kExpectedSingleRange = {RangeTuple{0, 0, 1}};
+  EXPECT_EQ(GetMatchingRangeTuples({3}, {3}), kExpectedSingleRange);
+}
+
+// Returns a page with a header and a footer that are the same on all pages,
+// and one row per element of 'cells' in the body.
+PdfPage MakeRepetitivePage(int number, const std::vector<string>& cells) {
+  PdfPage page;
+  page.set_number(number);
+  page.set_width(100);
+  page.set_height(100);
+  std::vector<string> rows = {"Vol. 2A"};
+  rows.insert(rows.end(), cells.begin(), cells.end());
+  rows.push_back("Instruction Set Reference");
+  for (size_t row = 0; row < rows.size(); ++row) {
+    PdfTextTableRow* const table_row = page.add_rows();
+    PdfTextBlock* const block = table_row->add_blocks();
+    block->set_row(row);
+    block->set_col(0);
+    block->set_text(rows[row]);
+  }
+  return page;
+}
+
+TEST(PdfDocumentExtractorTest, TransferPatchesRepetitiveDocuments) {
+  PdfDocument from_pdf;
+  from_pdf.mutable_document_id()->set_title("doc 1");
+  *from_pdf.add_pages() = MakeRepetitivePage(1, {"ADD", "r/m32", "r/m32"});
+  *from_pdf.add_pages() = MakeRepetitivePage(2, {"SUB", "r/m32", "r/m32"});
+  *from_pdf.add_pages() = MakeRepetitivePage(3, {"XOR", "r/m32", "r/m32"});
+
+  // The second edition inserts a page and changes a cell of the last page.
+  PdfDocument to_pdf;
+  to_pdf.mutable_document_id()->set_title("doc 2");
+  *to_pdf.add_pages() = MakeRepetitivePage(1, {"ADD", "r/m32", "r/m32"});
+  *to_pdf.add_pages() = MakeRepetitivePage(2, {"AND", "r/m32", "r/m32"});
+  *to_pdf.add_pages() = MakeRepetitivePage(3, {"SUB", "r/m32", "r/m32"});
+  *to_pdf.add_pages() = MakeRepetitivePage(4, {"XOR", "r/m64", "r/m32"});
+
+  PdfDocumentChanges patches;
+  patches.mutable_document_id()->set_title("doc 1");
+  for (int page_number = 1; page_number <= 3; ++page_number) {
+    PdfPageChanges* const page_changes = patches.add_pages();
+    page_changes->set_page_number(page_number);
+    for (int row = 1; row <= 3; ++row) {
+      PdfPagePatch* const patch = page_changes->add_patches();
+      patch->set_row(row);
+      patch->set_col(0);
+      patch->set_expected(
+          from_pdf.pages(page_number - 1).rows(row).blocks(0).text());
+      patch->set_replacement(StrCat("patched ", page_number, ",", row));
+    }
+  }
+
+  PdfDocumentChanges successful_patches;
+  PdfDocumentChanges failed_patches;
+  TransferPatches(patches, from_pdf, to_pdf, &successful_patches,
+                  &failed_patches);
+  constexpr char kExpectedSuccessful[] = R"(
+      document_id { title: "doc 2" }
+      pages {
+        page_number: 2
+        patches { row: 2 expected: "r/m32" replacement: "patched 1,2" }
+        patches { row: 3 expected: "r/m32" replacement: "patched 1,3" }
+      }
+      pages {
+        page_number: 3
+        patches { row: 1 expected: "SUB" replacement: "patched 2,1" }
+        patches { row: 2 expected: "r/m32" replacement: "patched 2,2" }
+        patches { row: 3 expected: "r/m32" replacement: "patched 2,3" }
+        patches { row: 2 expected: "r/m32" replacement: "patched 3,2" }
+        patches { row: 3 expected: "r/m32" replacement: "patched 3,3" }
+      }
+      pages {
+        page_number: 4
+        patches { row: 1 expected: "XOR" replacement: "patched 3,1" }
+      }
+    )";
+  EXPECT_THAT(successful_patches, EqualsProto(kExpectedSuccessful));
+
+  constexpr char kExpectedFailed[] = R"(
+      document_id { title: "doc 1" }
+      pages {
+        page_number: 1
+        patches { row: 1 expected: "ADD" replacement: "patched 1,1" }
+      }
+    )";
+  EXPECT_THAT(failed_patches, EqualsProto(kExpectedFailed));
+}
+
 }  // namespace
 }  // namespace pdf
 }  // namespace cpu_instructions
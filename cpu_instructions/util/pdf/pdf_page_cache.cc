@@ -0,0 +1,102 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/pdf/pdf_page_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+
+#include "cpu_instructions/util/fingerprint.h"
+#include "cpu_instructions/util/proto_fingerprint.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "strings/str_cat.h"
+
+DECLARE_double(cpu_instructions_pdf_max_character_distance);
+
+namespace cpu_instructions {
+namespace pdf {
+
+namespace {
+
+// Must be incremented whenever the rendering or the clustering code changes in
+// a way that modifies the parsed pages.
+constexpr const uint64_t kCacheVersion = 3;
+
+constexpr const char kCacheFileExtension[] = ".pdf_page.pb";
+
+uint64_t FingerprintDouble(double value) {
+  uint64_t bits = 0;
+  static_assert(sizeof(bits) == sizeof(value), "Unexpected double size");
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+}  // namespace
+
+PdfPageCache::PdfPageCache(const string& directory) : directory_(directory) {
+  CHECK(!directory.empty());
+}
+
+string PdfPageCache::GetKey(const PdfDocumentId& document_id, int page_number,
+                            const PdfPageChanges& page_changes,
+                            bool keep_characters) {
+  uint64_t fingerprint = kCacheVersion;
+  fingerprint = FingerprintCat(fingerprint, FingerprintProto(document_id));
+  fingerprint = FingerprintCat(fingerprint, page_number);
+  fingerprint = FingerprintCat(fingerprint, FingerprintProto(page_changes));
+  fingerprint = FingerprintCat(fingerprint, keep_characters);
+  fingerprint = FingerprintCat(
+      fingerprint,
+      FingerprintDouble(FLAGS_cpu_instructions_pdf_max_character_distance));
+  return FingerprintToString(fingerprint);
+}
+
+bool PdfPageCache::Lookup(const string& key, PdfPage* page) const {
+  CHECK(page != nullptr);
+  const string filename = GetFilename(key);
+  FILE* const input_file = fopen(filename.c_str(), "rb");
+  if (input_file == nullptr) return false;
+  const bool parsed = page->ParseFromFileDescriptor(fileno(input_file));
+  fclose(input_file);
+  if (!parsed) {
+    LOG(WARNING) << "Ignoring corrupted cache entry '" << filename << "'";
+    page->Clear();
+  }
+  return parsed;
+}
+
+void PdfPageCache::InsertOrDie(const string& key, const PdfPage& page) const {
+  // The page is written to a temporary file which is then renamed, so readers
+  // never see a partially written entry.
+  string temp_filename = StrCat(directory_, "/.", key, ".XXXXXX");
+  const int fd = mkstemp(&temp_filename[0]);
+  CHECK_GE(fd, 0) << "Could not create '" << temp_filename << "'";
+  CHECK(page.SerializeToFileDescriptor(fd))
+      << "Could not write '" << temp_filename << "'";
+  CHECK_EQ(close(fd), 0) << "Could not close '" << temp_filename << "'";
+  const string filename = GetFilename(key);
+  CHECK_EQ(rename(temp_filename.c_str(), filename.c_str()), 0)
+      << "Could not rename '" << temp_filename << "' to '" << filename << "'";
+}
+
+string PdfPageCache::GetFilename(const string& key) const {
+  return StrCat(directory_, "/", key, kCacheFileExtension);
+}
+
+}  // namespace pdf
+}  // namespace cpu_instructions
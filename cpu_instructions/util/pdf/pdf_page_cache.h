@@ -0,0 +1,62 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// An on-disk cache of parsed PDF pages.
+//
+// Rendering and clustering a page is expensive, and most pages do not change
+// from one run to the next: only the pages whose patches or clustering
+// parameters changed need to be parsed again. Pages are stored one per file,
+// named after a fingerprint of everything that influences the parsed page.
+
+#ifndef CPU_INSTRUCTIONS_UTIL_PDF_PDF_PAGE_CACHE_H_
+#define CPU_INSTRUCTIONS_UTIL_PDF_PDF_PAGE_CACHE_H_
+
+#include "strings/string.h"
+
+#include "cpu_instructions/proto/pdf/pdf_document.pb.h"
+
+namespace cpu_instructions {
+namespace pdf {
+
+// The cache can be shared by several threads and processes: entries are written
+// atomically.
+class PdfPageCache {
+ public:
+  // 'directory' must exist.
+  explicit PdfPageCache(const string& directory);
+
+  // Returns the cache key for page 'page_number' of document 'document_id'
+  // parsed with 'page_changes' and the current clustering flags.
+  // 'keep_characters' is PdfParseRequest.keep_characters.
+  static string GetKey(const PdfDocumentId& document_id, int page_number,
+                       const PdfPageChanges& page_changes,
+                       bool keep_characters);
+
+  // Reads the page stored under 'key' into 'page' and returns true, or returns
+  // false if there is no such page.
+  bool Lookup(const string& key, PdfPage* page) const;
+
+  // Stores 'page' under 'key'. Dies on I/O errors.
+  void InsertOrDie(const string& key, const PdfPage& page) const;
+
+ private:
+  string GetFilename(const string& key) const;
+
+  const string directory_;
+};
+
+}  // namespace pdf
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_UTIL_PDF_PDF_PAGE_CACHE_H_
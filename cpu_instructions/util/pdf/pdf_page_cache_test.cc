@@ -0,0 +1,71 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/pdf/pdf_page_cache.h"
+
+#include <cstdlib>
+#include "strings/string.h"
+
+#include "cpu_instructions/testing/test_util.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "gflags/gflags.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+DECLARE_double(cpu_instructions_pdf_max_character_distance);
+
+namespace cpu_instructions {
+namespace pdf {
+namespace {
+
+using ::cpu_instructions::testing::EqualsProto;
+
+TEST(PdfPageCacheTest, LookupAfterInsert) {
+  const PdfPageCache cache(getenv("TEST_TMPDIR"));
+  const PdfPage page = ParseProtoFromStringOrDie<PdfPage>(R"(
+    number: 12
+    characters { codepoint: 68 utf8: "a" font_size: 11 })");
+  const string key = PdfPageCache::GetKey(PdfDocumentId(), 12, {}, true);
+
+  PdfPage cached_page;
+  EXPECT_FALSE(cache.Lookup(key, &cached_page));
+  cache.InsertOrDie(key, page);
+  EXPECT_TRUE(cache.Lookup(key, &cached_page));
+  EXPECT_THAT(cached_page, EqualsProto(page));
+}
+
+TEST(PdfPageCacheTest, KeyDependsOnAllInputs) {
+  const auto document_id =
+      ParseProtoFromStringOrDie<PdfDocumentId>("title: 'SDM'");
+  const auto page_changes = ParseProtoFromStringOrDie<PdfPageChanges>(
+      "page_number: 3 prevent_segment_bindings { first: 'a' second: 'b' }");
+  const string key = PdfPageCache::GetKey(document_id, 3, page_changes, true);
+  EXPECT_EQ(key, PdfPageCache::GetKey(document_id, 3, page_changes, true));
+
+  EXPECT_NE(key,
+            PdfPageCache::GetKey(PdfDocumentId(), 3, page_changes, true));
+  EXPECT_NE(key, PdfPageCache::GetKey(document_id, 4, page_changes, true));
+  EXPECT_NE(key,
+            PdfPageCache::GetKey(document_id, 3, PdfPageChanges(), true));
+  EXPECT_NE(key, PdfPageCache::GetKey(document_id, 3, page_changes, false));
+
+  const double old_distance = FLAGS_cpu_instructions_pdf_max_character_distance;
+  FLAGS_cpu_instructions_pdf_max_character_distance = old_distance + 0.1;
+  EXPECT_NE(key, PdfPageCache::GetKey(document_id, 3, page_changes, true));
+  FLAGS_cpu_instructions_pdf_max_character_distance = old_distance;
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace cpu_instructions
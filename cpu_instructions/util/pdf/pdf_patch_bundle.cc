@@ -0,0 +1,268 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/pdf/pdf_patch_bundle.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <set>
+#include <utility>
+
+#include "cpu_instructions/util/pdf/pdf_document_utils.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "glog/logging.h"
+#include "strings/str_cat.h"
+
+namespace cpu_instructions {
+namespace pdf {
+
+namespace {
+
+// The first and last bytes of bundle files. A serialized proto can't start with
+// a zero byte, which would be a tag with field number 0.
+constexpr char kBundleMagic[8] = {'\0', 'P', 'D', 'F', 'P', 'T', 'C', '1'};
+
+// The offset of the index followed by the magic number.
+constexpr size_t kBundleTrailerSize = sizeof(uint64_t) + sizeof(kBundleMagic);
+
+bool HasBundleMagic(const uint8_t* data) {
+  return memcmp(data, kBundleMagic, sizeof(kBundleMagic)) == 0;
+}
+
+// Returns a string that uniquely identifies 'document_id'.
+string GetDocumentKey(const PdfDocumentId& document_id) {
+  string key = document_id.title();
+  key.push_back('\0');
+  key.append(document_id.creation_date());
+  key.push_back('\0');
+  key.append(document_id.modification_date());
+  return key;
+}
+
+void ValidatePatch(const string& context, const PdfPagePatch& patch,
+                   std::vector<string>* errors) {
+  if (patch.row() < 0 || patch.col() < 0) {
+    errors->push_back(StrCat(context, ": invalid cell for patch ",
+                             patch.ShortDebugString()));
+  }
+  switch (patch.action_case()) {
+    case PdfPagePatch::ACTION_NOT_SET:
+      errors->push_back(
+          StrCat(context, ": action must be one of replacement or remove_cell "
+                          "for patch ",
+                 patch.ShortDebugString()));
+      break;
+    case PdfPagePatch::kReplacement:
+      break;
+    case PdfPagePatch::kRemoveCell:
+      if (!patch.remove_cell()) {
+        errors->push_back(StrCat(context, ": remove_cell must be true if set "
+                                          "for patch ",
+                                 patch.ShortDebugString()));
+      }
+      break;
+  }
+}
+
+}  // namespace
+
+std::vector<string> ValidatePdfDocumentsChanges(
+    const PdfDocumentsChanges& changes) {
+  std::vector<string> errors;
+  std::set<string> document_keys;
+  for (const PdfDocumentChanges& document : changes.documents()) {
+    const string document_context =
+        StrCat("Document {", document.document_id().ShortDebugString(), "}");
+    if (!document_keys.insert(GetDocumentKey(document.document_id())).second) {
+      errors.push_back(StrCat(document_context, ": duplicate document id"));
+    }
+    for (const PdfPageChanges& page : document.pages()) {
+      const string page_context =
+          StrCat(document_context, " page ", page.page_number());
+      if (page.page_number() <= 0) {
+        errors.push_back(StrCat(page_context, ": invalid page number"));
+      }
+      for (const PdfPagePatch& patch : page.patches()) {
+        ValidatePatch(page_context, patch, &errors);
+      }
+      for (const auto& binding : page.prevent_segment_bindings()) {
+        if (binding.first().empty() || binding.second().empty()) {
+          errors.push_back(StrCat(page_context,
+                                  ": incomplete prevent_segment_bindings ",
+                                  binding.ShortDebugString()));
+        }
+      }
+    }
+  }
+  return errors;
+}
+
+string CompilePdfPatchBundleOrDie(const PdfDocumentsChanges& changes) {
+  const std::vector<string> errors = ValidatePdfDocumentsChanges(changes);
+  for (const string& error : errors) LOG(ERROR) << error;
+  CHECK(errors.empty()) << errors.size() << " errors in the patches";
+
+  string contents(kBundleMagic, sizeof(kBundleMagic));
+  PdfPatchBundleIndex index;
+  for (const PdfDocumentChanges& document : changes.documents()) {
+    // Merges the changes of each page, in the order in which they appear.
+    std::map<int, PdfPageChanges> pages;
+    for (const PdfPageChanges& page : document.pages()) {
+      pages[page.page_number()].MergeFrom(page);
+    }
+    PdfPatchBundleIndex::Document* const document_index =
+        index.add_documents();
+    *document_index->mutable_document_id() = document.document_id();
+    for (const auto& number_changes_pair : pages) {
+      PdfPatchBundleIndex::Page* const location = document_index->add_pages();
+      location->set_number(number_changes_pair.first);
+      location->set_offset(contents.size());
+      CHECK(number_changes_pair.second.AppendToString(&contents));
+      location->set_size(contents.size() - location->offset());
+    }
+  }
+  const uint64_t index_offset = contents.size();
+  CHECK(index.AppendToString(&contents));
+  for (size_t i = 0; i < sizeof(uint64_t); ++i) {
+    contents.push_back(static_cast<char>((index_offset >> (8 * i)) & 0xff));
+  }
+  contents.append(kBundleMagic, sizeof(kBundleMagic));
+  return contents;
+}
+
+void WritePdfPatchBundleOrDie(const PdfDocumentsChanges& changes,
+                              const string& filename) {
+  const string contents = CompilePdfPatchBundleOrDie(changes);
+  FILE* const file = fopen(filename.c_str(), "wb");
+  CHECK(file) << "Could not open '" << filename << "'";
+  CHECK_EQ(fwrite(contents.data(), 1, contents.size(), file), contents.size())
+      << "Could not write to '" << filename << "'";
+  CHECK_EQ(fclose(file), 0) << "Could not close '" << filename << "'";
+}
+
+PdfPageChanges PdfPatchBundle::Document::GetPageChanges(int page_number) const {
+  PdfPageChanges changes;
+  const auto it = pages_.find(page_number);
+  if (it == pages_.end()) return changes;
+  const Location& location = it->second;
+  CHECK(changes.ParseFromArray(bundle_->data_ + location.offset,
+                               location.size))
+      << "Corrupted changes for page " << page_number << " in '"
+      << bundle_->name_ << "'";
+  return changes;
+}
+
+PdfPatchBundle::PdfPatchBundle(const string& name) : name_(name) {}
+
+PdfPatchBundle::~PdfPatchBundle() {
+  if (fd_ >= 0) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+    close(fd_);
+  }
+}
+
+std::unique_ptr<PdfPatchBundle> PdfPatchBundle::OpenOrDie(
+    const string& filename) {
+  CHECK(!filename.empty());
+  std::unique_ptr<PdfPatchBundle> bundle(new PdfPatchBundle(filename));
+  bundle->fd_ = open(filename.c_str(), O_RDONLY);
+  CHECK_GE(bundle->fd_, 0) << "Could not open '" << filename << "'";
+  struct stat file_stat;
+  CHECK_EQ(fstat(bundle->fd_, &file_stat), 0)
+      << "Could not stat '" << filename << "'";
+  bundle->size_ = file_stat.st_size;
+  CHECK_GE(bundle->size_, sizeof(kBundleMagic) + kBundleTrailerSize)
+      << "Truncated file '" << filename << "'";
+  void* const data =
+      mmap(nullptr, bundle->size_, PROT_READ, MAP_PRIVATE, bundle->fd_, 0);
+  CHECK(data != MAP_FAILED) << "Could not map '" << filename << "'";
+  bundle->data_ = static_cast<const uint8_t*>(data);
+  bundle->ReadIndex();
+  return bundle;
+}
+
+std::unique_ptr<PdfPatchBundle> PdfPatchBundle::FromChangesOrDie(
+    const PdfDocumentsChanges& changes) {
+  std::unique_ptr<PdfPatchBundle> bundle(new PdfPatchBundle("<memory>"));
+  bundle->contents_ = CompilePdfPatchBundleOrDie(changes);
+  bundle->data_ = reinterpret_cast<const uint8_t*>(bundle->contents_.data());
+  bundle->size_ = bundle->contents_.size();
+  bundle->ReadIndex();
+  return bundle;
+}
+
+std::unique_ptr<PdfPatchBundle> PdfPatchBundle::LoadOrDie(const string& path) {
+  CHECK(!path.empty());
+  struct stat path_stat;
+  CHECK_EQ(stat(path.c_str(), &path_stat), 0)
+      << "Could not stat '" << path << "'";
+  if (S_ISDIR(path_stat.st_mode)) {
+    return FromChangesOrDie(LoadConfigurations(path));
+  }
+  uint8_t magic[sizeof(kBundleMagic)] = {};
+  FILE* const file = fopen(path.c_str(), "rb");
+  CHECK(file) << "Could not open '" << path << "'";
+  const size_t magic_size = fread(magic, 1, sizeof(magic), file);
+  CHECK_EQ(fclose(file), 0) << "Could not close '" << path << "'";
+  if (magic_size == sizeof(magic) && HasBundleMagic(magic)) {
+    return OpenOrDie(path);
+  }
+  return FromChangesOrDie(ReadTextProtoOrDie<PdfDocumentsChanges>(path));
+}
+
+void PdfPatchBundle::ReadIndex() {
+  CHECK(HasBundleMagic(data_)) << "Not a patch bundle: '" << name_ << "'";
+  CHECK(HasBundleMagic(data_ + size_ - sizeof(kBundleMagic)))
+      << "Truncated file '" << name_ << "'";
+  const size_t index_end = size_ - kBundleTrailerSize;
+  uint64_t index_offset = 0;
+  for (int i = sizeof(uint64_t) - 1; i >= 0; --i) {
+    index_offset = (index_offset << 8) | data_[index_end + i];
+  }
+  CHECK_GE(index_offset, sizeof(kBundleMagic))
+      << "Corrupted file '" << name_ << "'";
+  CHECK_LE(index_offset, index_end) << "Corrupted file '" << name_ << "'";
+  PdfPatchBundleIndex index;
+  CHECK(index.ParseFromArray(data_ + index_offset, index_end - index_offset))
+      << "Corrupted index in '" << name_ << "'";
+  for (const PdfPatchBundleIndex::Document& document : index.documents()) {
+    Document& entry = documents_[GetDocumentKey(document.document_id())];
+    entry.bundle_ = this;
+    entry.document_id_ = document.document_id();
+    for (const PdfPatchBundleIndex::Page& page : document.pages()) {
+      CHECK_GE(page.offset(), sizeof(kBundleMagic))
+          << "Corrupted index in '" << name_ << "'";
+      CHECK_LE(page.offset(), index_offset)
+          << "Corrupted index in '" << name_ << "'";
+      CHECK_LE(page.size(), index_offset - page.offset())
+          << "Corrupted index in '" << name_ << "'";
+      Document::Location& location = entry.pages_[page.number()];
+      location.offset = page.offset();
+      location.size = page.size();
+    }
+  }
+}
+
+const PdfPatchBundle::Document* PdfPatchBundle::GetDocumentOrNull(
+    const PdfDocumentId& document_id) const {
+  const auto it = documents_.find(GetDocumentKey(document_id));
+  return it == documents_.end() ? nullptr : &it->second;
+}
+
+}  // namespace pdf
+}  // namespace cpu_instructions
@@ -0,0 +1,137 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A compiled form of PdfDocumentsChanges, indexed by document id and by page
+// number.
+//
+// A bundle file contains a magic number, the serialized PdfPageChanges of each
+// patched page, a PdfPatchBundleIndex holding the document ids and the offset
+// of the changes of each page, the offset of the index as a little-endian
+// uint64, and the magic number again (the same layout as the kIndexed format
+// of pdf_document_stream.h). All the changes of a given page are merged into a
+// single PdfPageChanges when the bundle is compiled.
+//
+// The changes are validated when the bundle is compiled, so that errors in the
+// patch files are reported before any page is rendered.
+
+#ifndef CPU_INSTRUCTIONS_UTIL_PDF_PDF_PATCH_BUNDLE_H_
+#define CPU_INSTRUCTIONS_UTIL_PDF_PDF_PATCH_BUNDLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "strings/string.h"
+
+#include "cpu_instructions/proto/pdf/pdf_document.pb.h"
+
+namespace cpu_instructions {
+namespace pdf {
+
+// Returns the errors found in 'changes': duplicate document ids, invalid page
+// numbers and malformed patches. Errors that depend on the contents of the
+// pages (e.g. the expected text of a patch) are still reported when the patch
+// is applied.
+std::vector<string> ValidatePdfDocumentsChanges(
+    const PdfDocumentsChanges& changes);
+
+// Compiles 'changes' into a bundle. Dies if 'changes' are not valid.
+string CompilePdfPatchBundleOrDie(const PdfDocumentsChanges& changes);
+
+// Compiles 'changes' into a bundle and writes it to 'filename'.
+void WritePdfPatchBundleOrDie(const PdfDocumentsChanges& changes,
+                              const string& filename);
+
+// Provides random access to the changes of a compiled bundle. Page changes are
+// only decoded when they are requested. The class is thread-safe.
+//
+// Usage:
+//   const auto bundle = PdfPatchBundle::LoadOrDie(path);
+//   const PdfPatchBundle::Document* const patches =
+//       bundle->GetDocumentOrNull(document_id);
+//   if (patches) changes = patches->GetPageChanges(page_number);
+class PdfPatchBundle {
+ public:
+  // The changes of a single document.
+  class Document {
+   public:
+    const PdfDocumentId& document_id() const { return document_id_; }
+
+    // Returns the merged changes of page 'page_number', or an empty
+    // PdfPageChanges if the page has no changes.
+    PdfPageChanges GetPageChanges(int page_number) const;
+
+   private:
+    friend class PdfPatchBundle;
+
+    struct Location {
+      uint64_t offset = 0;
+      uint64_t size = 0;
+    };
+
+    const PdfPatchBundle* bundle_ = nullptr;
+    PdfDocumentId document_id_;
+    std::unordered_map<int, Location> pages_;
+  };
+
+  // Memory-maps the bundle written to 'filename'. Dies if the file can't be
+  // read or is corrupted.
+  static std::unique_ptr<PdfPatchBundle> OpenOrDie(const string& filename);
+
+  // Compiles 'changes' into an in-memory bundle. Dies if they are not valid.
+  static std::unique_ptr<PdfPatchBundle> FromChangesOrDie(
+      const PdfDocumentsChanges& changes);
+
+  // Loads the changes at 'path', which can be a bundle file, a directory of
+  // PdfDocumentChanges in text format (see LoadConfigurations), or a
+  // PdfDocumentsChanges in text format.
+  static std::unique_ptr<PdfPatchBundle> LoadOrDie(const string& path);
+
+  PdfPatchBundle(const PdfPatchBundle&) = delete;
+  PdfPatchBundle& operator=(const PdfPatchBundle&) = delete;
+
+  ~PdfPatchBundle();
+
+  // Whether the bundle has no documents.
+  bool empty() const { return documents_.empty(); }
+
+  int num_documents() const { return documents_.size(); }
+
+  // Returns the changes of the document with 'document_id', or nullptr if the
+  // bundle has no changes for this document.
+  const Document* GetDocumentOrNull(const PdfDocumentId& document_id) const;
+
+ private:
+  explicit PdfPatchBundle(const string& name);
+
+  // Reads the index of the bundle in [data_, data_ + size_).
+  void ReadIndex();
+
+  // Used in error messages.
+  const string name_;
+  // The contents of in-memory bundles.
+  string contents_;
+  // The file descriptor of memory-mapped bundles, -1 otherwise.
+  int fd_ = -1;
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  std::map<string, Document> documents_;
+};
+
+}  // namespace pdf
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_UTIL_PDF_PDF_PATCH_BUNDLE_H_
@@ -0,0 +1,191 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/pdf/pdf_patch_bundle.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cpu_instructions/testing/test_util.h"
+#include "cpu_instructions/util/pdf/pdf_document_utils.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "strings/str_cat.h"
+
+namespace cpu_instructions {
+namespace pdf {
+namespace {
+
+using ::cpu_instructions::testing::EqualsProto;
+using ::testing::ElementsAre;
+using ::testing::HasSubstr;
+using ::testing::IsEmpty;
+
+constexpr const char kChanges[] = R"(
+  documents {
+    document_id { title: "first" creation_date: "1" modification_date: "2" }
+    pages {
+      page_number: 3
+      patches { row: 1 col: 2 expected: "a" replacement: "b" }
+    }
+    pages {
+      page_number: 5
+      prevent_segment_bindings { first: "c" second: "d" }
+    }
+    pages {
+      page_number: 3
+      patches { row: 3 col: 0 expected: "e" remove_cell: true }
+    }
+  }
+  documents {
+    document_id { title: "second" creation_date: "1" modification_date: "2" }
+    pages {
+      page_number: 1
+      patches { row: 0 col: 0 expected: "f" replacement: "g" }
+    }
+  })";
+
+constexpr const char kFirstDocumentId[] =
+    R"(title: "first" creation_date: "1" modification_date: "2")";
+
+string GetTestFilename(const string& basename) {
+  return StrCat(getenv("TEST_TMPDIR"), "/", basename);
+}
+
+void CheckBundle(const PdfPatchBundle& bundle) {
+  EXPECT_EQ(bundle.num_documents(), 2);
+  const PdfPatchBundle::Document* const first = bundle.GetDocumentOrNull(
+      ParseProtoFromStringOrDie<PdfDocumentId>(kFirstDocumentId));
+  ASSERT_NE(first, nullptr);
+  EXPECT_THAT(first->document_id(), EqualsProto(kFirstDocumentId));
+  // The changes of page 3 are merged.
+  EXPECT_THAT(first->GetPageChanges(3), EqualsProto(R"(
+                page_number: 3
+                patches { row: 1 col: 2 expected: "a" replacement: "b" }
+                patches { row: 3 col: 0 expected: "e" remove_cell: true })"));
+  EXPECT_THAT(first->GetPageChanges(5), EqualsProto(R"(
+                page_number: 5
+                prevent_segment_bindings { first: "c" second: "d" })"));
+  EXPECT_THAT(first->GetPageChanges(4), EqualsProto(""));
+  EXPECT_EQ(bundle.GetDocumentOrNull(ParseProtoFromStringOrDie<PdfDocumentId>(
+                R"(title: "first" creation_date: "1")")),
+            nullptr);
+}
+
+TEST(PdfPatchBundleTest, FromChanges) {
+  const auto bundle = PdfPatchBundle::FromChangesOrDie(
+      ParseProtoFromStringOrDie<PdfDocumentsChanges>(kChanges));
+  CheckBundle(*bundle);
+}
+
+TEST(PdfPatchBundleTest, Empty) {
+  const auto bundle = PdfPatchBundle::FromChangesOrDie(PdfDocumentsChanges());
+  EXPECT_TRUE(bundle->empty());
+  EXPECT_EQ(bundle->GetDocumentOrNull(PdfDocumentId()), nullptr);
+}
+
+TEST(PdfPatchBundleTest, WriteAndOpen) {
+  const string filename = GetTestFilename("changes.bundle");
+  WritePdfPatchBundleOrDie(
+      ParseProtoFromStringOrDie<PdfDocumentsChanges>(kChanges), filename);
+  CheckBundle(*PdfPatchBundle::OpenOrDie(filename));
+  CheckBundle(*PdfPatchBundle::LoadOrDie(filename));
+}
+
+TEST(PdfPatchBundleTest, LoadTextProto) {
+  const string filename = GetTestFilename("changes.pbtxt");
+  WriteTextProtoOrDie(filename,
+                      ParseProtoFromStringOrDie<PdfDocumentsChanges>(kChanges));
+  CheckBundle(*PdfPatchBundle::LoadOrDie(filename));
+}
+
+TEST(PdfPatchBundleTest, LoadDirectory) {
+  const string directory = GetTestFilename("patches");
+  mkdir(directory.c_str(), 0755);
+  const auto changes = ParseProtoFromStringOrDie<PdfDocumentsChanges>(kChanges);
+  WriteTextProtoOrDie(StrCat(directory, "/first.pbtxt"), changes.documents(0));
+  WriteTextProtoOrDie(StrCat(directory, "/second.pbtxt"),
+                      changes.documents(1));
+  CheckBundle(*PdfPatchBundle::LoadOrDie(directory));
+}
+
+TEST(PdfPatchBundleTest, CorruptedFile) {
+  const string filename = GetTestFilename("corrupted.bundle");
+  WritePdfPatchBundleOrDie(
+      ParseProtoFromStringOrDie<PdfDocumentsChanges>(kChanges), filename);
+  ASSERT_EQ(truncate(filename.c_str(), 20), 0);
+  EXPECT_DEATH(PdfPatchBundle::OpenOrDie(filename), "");
+}
+
+TEST(PdfPatchBundleTest, ValidatePdfDocumentsChanges) {
+  EXPECT_THAT(ValidatePdfDocumentsChanges(
+                  ParseProtoFromStringOrDie<PdfDocumentsChanges>(kChanges)),
+              IsEmpty());
+  const auto invalid = ParseProtoFromStringOrDie<PdfDocumentsChanges>(R"(
+    documents {
+      document_id { title: "first" }
+      pages {
+        page_number: 0
+        patches { row: -1 col: 0 expected: "a" replacement: "b" }
+      }
+      pages {
+        page_number: 2
+        patches { row: 1 col: 1 expected: "a" }
+        patches { row: 1 col: 1 expected: "a" remove_cell: false }
+        prevent_segment_bindings { first: "c" }
+      }
+    }
+    documents { document_id { title: "first" } })");
+  EXPECT_THAT(
+      ValidatePdfDocumentsChanges(invalid),
+      ElementsAre(HasSubstr("page 0: invalid page number"),
+                  HasSubstr("page 0: invalid cell"),
+                  HasSubstr("page 2: action must be one of"),
+                  HasSubstr("page 2: remove_cell must be true"),
+                  HasSubstr("page 2: incomplete prevent_segment_bindings"),
+                  HasSubstr("duplicate document id")));
+  EXPECT_DEATH(PdfPatchBundle::FromChangesOrDie(invalid), "errors");
+}
+
+// The patches of the SDM are valid, and the bundle yields the same changes as
+// scanning the pages of the documents.
+TEST(PdfPatchBundleTest, SdmPatches) {
+  const string directory =
+      StrCat(getenv("TEST_SRCDIR"), "/__main__/cpu_instructions/x86/pdf/",
+             "sdm_patches");
+  const PdfDocumentsChanges changes = LoadConfigurations(directory);
+  ASSERT_GT(changes.documents_size(), 0);
+  const auto bundle = PdfPatchBundle::LoadOrDie(directory);
+  EXPECT_EQ(bundle->num_documents(), changes.documents_size());
+  for (const PdfDocumentChanges& document : changes.documents()) {
+    const PdfPatchBundle::Document* const compiled =
+        bundle->GetDocumentOrNull(document.document_id());
+    ASSERT_NE(compiled, nullptr);
+    for (const PdfPageChanges& page : document.pages()) {
+      PdfPageChanges expected;
+      for (const PdfPageChanges& other_page : document.pages()) {
+        if (other_page.page_number() == page.page_number()) {
+          expected.MergeFrom(other_page);
+        }
+      }
+      EXPECT_THAT(compiled->GetPageChanges(page.page_number()),
+                  EqualsProto(expected));
+    }
+  }
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace cpu_instructions
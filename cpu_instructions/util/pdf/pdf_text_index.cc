@@ -0,0 +1,243 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/pdf/pdf_text_index.h"
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <utility>
+
+#include "cpu_instructions/util/proto_util.h"
+#include "glog/logging.h"
+#include "re2/filtered_re2.h"
+#include "strings/str_cat.h"
+#include "util/gtl/ptr_util.h"
+
+namespace cpu_instructions {
+namespace pdf {
+
+namespace {
+
+constexpr const size_t kTrigramSize = 3;
+
+constexpr const char kIndexFileSuffix[] = ".text_index";
+
+bool IsAscii(const string& text) {
+  return std::all_of(text.begin(), text.end(),
+                     [](char c) { return (c & 0x80) == 0; });
+}
+
+char ToLowerAscii(char c) { return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c; }
+
+uint32_t GetTrigram(const char* data) {
+  return (static_cast<uint32_t>(static_cast<uint8_t>(data[0])) << 16) |
+         (static_cast<uint32_t>(static_cast<uint8_t>(data[1])) << 8) |
+         static_cast<uint32_t>(static_cast<uint8_t>(data[2]));
+}
+
+// Returns the distinct trigrams of 'text' lowercased, in increasing order.
+std::vector<uint32_t> GetTrigrams(const string& text) {
+  std::vector<uint32_t> trigrams;
+  if (text.size() < kTrigramSize) return trigrams;
+  string lowercased(text);
+  std::transform(lowercased.begin(), lowercased.end(), lowercased.begin(),
+                 ToLowerAscii);
+  for (size_t i = 0; i + kTrigramSize <= lowercased.size(); ++i) {
+    trigrams.push_back(GetTrigram(lowercased.data() + i));
+  }
+  std::sort(trigrams.begin(), trigrams.end());
+  trigrams.erase(std::unique(trigrams.begin(), trigrams.end()),
+                 trigrams.end());
+  return trigrams;
+}
+
+void AddBlockIdDeltas(const std::vector<uint32_t>& block_ids,
+                      google::protobuf::RepeatedField<uint32_t>* deltas) {
+  uint32_t previous_id = 0;
+  for (const uint32_t block_id : block_ids) {
+    deltas->Add(block_id - previous_id);
+    previous_id = block_id;
+  }
+}
+
+std::vector<uint32_t> GetBlockIds(
+    const google::protobuf::RepeatedField<uint32_t>& deltas) {
+  std::vector<uint32_t> block_ids;
+  block_ids.reserve(deltas.size());
+  uint32_t block_id = 0;
+  for (const uint32_t delta : deltas) {
+    block_id += delta;
+    block_ids.push_back(block_id);
+  }
+  return block_ids;
+}
+
+// Sets the source fields of 'index' to the size and modification time of
+// 'filename'.
+void SetSourceOrDie(const string& filename, PdfBlockTextIndex* index) {
+  struct stat file_stat;
+  CHECK_EQ(stat(filename.c_str(), &file_stat), 0)
+      << "Could not stat '" << filename << "'";
+  index->set_source_size(file_stat.st_size);
+  index->set_source_modification_time_ns(
+      static_cast<int64_t>(file_stat.st_mtim.tv_sec) * 1000000000 +
+      file_stat.st_mtim.tv_nsec);
+}
+
+}  // namespace
+
+PdfBlockTextIndex BuildPdfBlockTextIndex(PdfDocumentReader* reader) {
+  CHECK(reader != nullptr);
+  PdfBlockTextIndex index;
+  *index.mutable_document_id() = reader->header().document_id();
+  std::map<uint32_t, std::vector<uint32_t>> postings;
+  std::vector<uint32_t> non_ascii_block_ids;
+  PdfPage page;
+  while (reader->ReadNextPage(&page)) {
+    for (const PdfTextTableRow& row : page.rows()) {
+      for (const PdfTextBlock& block : row.blocks()) {
+        const uint32_t block_id = index.blocks_size();
+        PdfBlockTextIndex::Block* const entry = index.add_blocks();
+        entry->set_page_number(page.number());
+        entry->set_row(block.row());
+        entry->set_col(block.col());
+        entry->set_text(block.text());
+        for (const uint32_t trigram : GetTrigrams(block.text())) {
+          postings[trigram].push_back(block_id);
+        }
+        if (!IsAscii(block.text())) non_ascii_block_ids.push_back(block_id);
+      }
+    }
+  }
+  for (const auto& trigram_block_ids_pair : postings) {
+    PdfBlockTextIndex::Posting* const posting = index.add_postings();
+    posting->set_trigram(trigram_block_ids_pair.first);
+    AddBlockIdDeltas(trigram_block_ids_pair.second,
+                     posting->mutable_block_id_deltas());
+  }
+  AddBlockIdDeltas(non_ascii_block_ids,
+                   index.mutable_non_ascii_block_id_deltas());
+  return index;
+}
+
+PdfTextIndex::PdfTextIndex(PdfBlockTextIndex index) : index_(std::move(index)) {
+  for (int i = 0; i < index_.postings_size(); ++i) {
+    posting_indices_[index_.postings(i).trigram()] = i;
+  }
+}
+
+std::unique_ptr<PdfTextIndex> PdfTextIndex::LoadOrBuildOrDie(
+    const string& pdf_filename, const string& index_filename) {
+  const string filename = index_filename.empty()
+                              ? StrCat(pdf_filename, kIndexFileSuffix)
+                              : index_filename;
+  PdfBlockTextIndex source;
+  SetSourceOrDie(pdf_filename, &source);
+  struct stat index_stat;
+  if (stat(filename.c_str(), &index_stat) == 0) {
+    PdfBlockTextIndex index = ReadBinaryProtoOrDie<PdfBlockTextIndex>(filename);
+    if (index.source_size() == source.source_size() &&
+        index.source_modification_time_ns() ==
+            source.source_modification_time_ns()) {
+      return gtl::MakeUnique<PdfTextIndex>(std::move(index));
+    }
+    LOG(INFO) << "'" << filename << "' is out of date";
+  }
+  LOG(INFO) << "Indexing '" << pdf_filename << "' into '" << filename << "'";
+  PdfDocumentReader reader(pdf_filename);
+  PdfBlockTextIndex index = BuildPdfBlockTextIndex(&reader);
+  index.set_source_size(source.source_size());
+  index.set_source_modification_time_ns(source.source_modification_time_ns());
+  WriteBinaryProtoOrDie(filename, index);
+  return gtl::MakeUnique<PdfTextIndex>(std::move(index));
+}
+
+std::vector<const PdfTextIndex::Block*> PdfTextIndex::Search(
+    const RE2& regexp) const {
+  CHECK(regexp.ok()) << "Invalid regular expression '" << regexp.pattern()
+                     << "': " << regexp.error();
+  // The atoms are lowercased strings such that any match contains at least one
+  // of them, ignoring case. There are none if the expression can match without
+  // a string of at least kTrigramSize characters.
+  re2::FilteredRE2 filter(kTrigramSize);
+  int regexp_id = 0;
+  CHECK_EQ(filter.Add(regexp.pattern(), regexp.options(), &regexp_id),
+           RE2::NoError);
+  std::vector<string> atoms;
+  filter.Compile(&atoms);
+  bool match_all_blocks = atoms.empty();
+  std::vector<uint32_t> candidates;
+  for (const string& atom : atoms) {
+    // Only ASCII letters are lowercased in the index, see
+    // PdfBlockTextIndex.non_ascii_block_id_deltas.
+    if (atom.size() < kTrigramSize || !IsAscii(atom)) {
+      match_all_blocks = true;
+      break;
+    }
+    AddCandidates(atom, &candidates);
+  }
+
+  std::vector<const Block*> blocks;
+  if (match_all_blocks) {
+    for (const Block& block : index_.blocks()) {
+      if (RE2::PartialMatch(block.text(), regexp)) blocks.push_back(&block);
+    }
+    return blocks;
+  }
+  const std::vector<uint32_t> non_ascii_block_ids =
+      GetBlockIds(index_.non_ascii_block_id_deltas());
+  candidates.insert(candidates.end(), non_ascii_block_ids.begin(),
+                    non_ascii_block_ids.end());
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                   candidates.end());
+  for (const uint32_t block_id : candidates) {
+    const Block& block = index_.blocks(block_id);
+    if (RE2::PartialMatch(block.text(), regexp)) blocks.push_back(&block);
+  }
+  return blocks;
+}
+
+void PdfTextIndex::AddCandidates(const string& atom,
+                                 std::vector<uint32_t>* block_ids) const {
+  std::vector<uint32_t> trigrams;
+  for (size_t i = 0; i + kTrigramSize <= atom.size(); ++i) {
+    trigrams.push_back(GetTrigram(atom.data() + i));
+  }
+  std::sort(trigrams.begin(), trigrams.end());
+  trigrams.erase(std::unique(trigrams.begin(), trigrams.end()),
+                 trigrams.end());
+  // The blocks containing the atom contain all its trigrams.
+  std::vector<uint32_t> candidates = GetPosting(trigrams.front());
+  for (size_t i = 1; i < trigrams.size() && !candidates.empty(); ++i) {
+    const std::vector<uint32_t> posting = GetPosting(trigrams[i]);
+    std::vector<uint32_t> intersection;
+    std::set_intersection(candidates.begin(), candidates.end(),
+                          posting.begin(), posting.end(),
+                          std::back_inserter(intersection));
+    candidates = std::move(intersection);
+  }
+  block_ids->insert(block_ids->end(), candidates.begin(), candidates.end());
+}
+
+std::vector<uint32_t> PdfTextIndex::GetPosting(uint32_t trigram) const {
+  const auto it = posting_indices_.find(trigram);
+  if (it == posting_indices_.end()) return {};
+  return GetBlockIds(index_.postings(it->second).block_id_deltas());
+}
+
+}  // namespace pdf
+}  // namespace cpu_instructions
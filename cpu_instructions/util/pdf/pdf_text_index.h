@@ -0,0 +1,95 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// An inverted index of the text of the blocks of a parsed PDF file, to find the
+// cells matching a regular expression without reading the whole document.
+//
+// The index maps each trigram of the lowercased text of the blocks to the
+// blocks containing it. To search for a regular expression, the literal
+// strings that any match must contain are extracted from the expression (see
+// re2::FilteredRE2), the blocks containing one of them are found from the
+// trigrams, and the expression is matched against these blocks only. Regular
+// expressions without such strings, e.g. "^.$", are matched against all the
+// blocks.
+//
+// The index is stored next to the .pdf.pb file it was built from, and is
+// rebuilt when this file changes.
+
+#ifndef CPU_INSTRUCTIONS_UTIL_PDF_PDF_TEXT_INDEX_H_
+#define CPU_INSTRUCTIONS_UTIL_PDF_PDF_TEXT_INDEX_H_
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "strings/string.h"
+
+#include "cpu_instructions/proto/pdf/pdf_document.pb.h"
+#include "cpu_instructions/util/pdf/pdf_document_stream.h"
+#include "re2/re2.h"
+
+namespace cpu_instructions {
+namespace pdf {
+
+// Returns the index of the blocks of the pages read from 'reader'. The source
+// fields of the index are not set.
+PdfBlockTextIndex BuildPdfBlockTextIndex(PdfDocumentReader* reader);
+
+// Searches the blocks of a PdfBlockTextIndex. The class is thread-safe.
+//
+// Usage:
+//   const auto index = PdfTextIndex::LoadOrBuildOrDie(pdf_filename);
+//   for (const auto* block : index->Search(RE2("SAL/SAR"))) { ... }
+class PdfTextIndex {
+ public:
+  using Block = PdfBlockTextIndex::Block;
+
+  explicit PdfTextIndex(PdfBlockTextIndex index);
+
+  PdfTextIndex(const PdfTextIndex&) = delete;
+  PdfTextIndex& operator=(const PdfTextIndex&) = delete;
+
+  // Returns the index of the .pdf.pb file 'pdf_filename'. The index is read
+  // from 'index_filename' if it is up to date, otherwise it is built and
+  // written to 'index_filename'. When 'index_filename' is empty, the index is
+  // stored in <pdf_filename>.text_index.
+  static std::unique_ptr<PdfTextIndex> LoadOrBuildOrDie(
+      const string& pdf_filename, const string& index_filename = "");
+
+  // Returns the blocks whose text partially matches 'regexp', in page, row and
+  // column order. Dies if 'regexp' is not valid.
+  std::vector<const Block*> Search(const RE2& regexp) const;
+
+  int num_blocks() const { return index_.blocks_size(); }
+
+  const PdfBlockTextIndex& index() const { return index_; }
+
+ private:
+  // Adds the ids of the blocks whose lowercased text may contain 'atom' to
+  // 'block_ids'. 'atom' is lowercased and has at least three characters.
+  void AddCandidates(const string& atom,
+                     std::vector<uint32_t>* block_ids) const;
+
+  // Returns the ids of the blocks containing 'trigram'.
+  std::vector<uint32_t> GetPosting(uint32_t trigram) const;
+
+  const PdfBlockTextIndex index_;
+  // The index of each trigram in index_.postings().
+  std::unordered_map<uint32_t, int> posting_indices_;
+};
+
+}  // namespace pdf
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_UTIL_PDF_PDF_TEXT_INDEX_H_
@@ -0,0 +1,166 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/pdf/pdf_text_index.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <vector>
+#include "strings/string.h"
+
+#include "cpu_instructions/util/pdf/pdf_document_parser.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "strings/str_cat.h"
+
+namespace cpu_instructions {
+namespace pdf {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+constexpr const char kDocument[] = R"(
+  pages {
+    number: 3
+    rows {
+      blocks { row: 0 col: 0 text: "SAL/SAR/SHL/SHR—Shift" }
+      blocks { row: 0 col: 1 text: "Opcode" }
+    }
+    rows { blocks { row: 1 col: 0 text: "sal r/m8, 1" } }
+  }
+  pages {
+    number: 4
+    rows {
+      blocks { row: 0 col: 0 text: "D0 /4" }
+      blocks { row: 0 col: 1 text: "Shift Arithmetic Left" }
+    }
+  }
+)";
+
+string GetTestFilename(const string& basename) {
+  return StrCat(getenv("TEST_TMPDIR"), "/", basename);
+}
+
+// Writes 'document' to 'filename' with a PdfDocumentWriter.
+void WriteDocument(const PdfDocument& document, const string& filename) {
+  PdfDocumentWriter writer(filename, PdfDocumentFormat::kIndexed);
+  writer.WriteHeader(PdfDocument());
+  for (const PdfPage& page : document.pages()) writer.WritePage(page);
+  writer.Close();
+}
+
+PdfTextIndex BuildIndex(const PdfDocument& document, const string& basename) {
+  const string filename = GetTestFilename(basename);
+  WriteDocument(document, filename);
+  PdfDocumentReader reader(filename);
+  return PdfTextIndex(BuildPdfBlockTextIndex(&reader));
+}
+
+// Returns the blocks of 'index' matching 'pattern' as "page:row:col".
+std::vector<string> Search(const PdfTextIndex& index, const string& pattern) {
+  std::vector<string> cells;
+  for (const auto* block : index.Search(RE2(pattern))) {
+    cells.push_back(
+        StrCat(block->page_number(), ":", block->row(), ":", block->col()));
+  }
+  return cells;
+}
+
+TEST(PdfTextIndexTest, Search) {
+  const PdfTextIndex index = BuildIndex(
+      ParseProtoFromStringOrDie<PdfDocument>(kDocument), "search.pdf.pb");
+  EXPECT_EQ(index.num_blocks(), 5);
+  EXPECT_THAT(Search(index, "SAL/SAR"), ElementsAre("3:0:0"));
+  EXPECT_THAT(Search(index, "Shift"), ElementsAre("3:0:0", "4:0:1"));
+  EXPECT_THAT(Search(index, "(?i)sal"), ElementsAre("3:0:0", "3:1:0"));
+  EXPECT_THAT(Search(index, "sal"), ElementsAre("3:1:0"));
+  EXPECT_THAT(Search(index, "Opcode|Arithmetic"),
+              ElementsAre("3:0:1", "4:0:1"));
+  EXPECT_THAT(Search(index, "r/m(8|16)"), ElementsAre("3:1:0"));
+  EXPECT_THAT(Search(index, "R—S"), ElementsAre("3:0:0"));
+  EXPECT_THAT(Search(index, "Missing"), IsEmpty());
+  // Expressions without a literal of three characters or more.
+  EXPECT_THAT(Search(index, "/4"), ElementsAre("4:0:0"));
+  EXPECT_THAT(Search(index, "^[A-Z0-9]{2} "), ElementsAre("4:0:0"));
+  EXPECT_THAT(Search(index, ""), ElementsAre("3:0:0", "3:0:1", "3:1:0",
+                                             "4:0:0", "4:0:1"));
+}
+
+TEST(PdfTextIndexTest, InvalidExpression) {
+  const PdfTextIndex index = BuildIndex(
+      ParseProtoFromStringOrDie<PdfDocument>(kDocument), "invalid.pdf.pb");
+  EXPECT_DEATH(index.Search(RE2("(", RE2::Quiet)), "Invalid regular");
+}
+
+TEST(PdfTextIndexTest, LoadOrBuild) {
+  const string pdf_filename = GetTestFilename("load.pdf.pb");
+  const string index_filename = StrCat(pdf_filename, ".text_index");
+  unlink(index_filename.c_str());
+  PdfDocument document = ParseProtoFromStringOrDie<PdfDocument>(kDocument);
+  WriteDocument(document, pdf_filename);
+  EXPECT_THAT(Search(*PdfTextIndex::LoadOrBuildOrDie(pdf_filename), "Opcode"),
+              ElementsAre("3:0:1"));
+  struct stat index_stat;
+  ASSERT_EQ(stat(index_filename.c_str(), &index_stat), 0);
+
+  // The index is read back from the file.
+  const auto loaded = PdfTextIndex::LoadOrBuildOrDie(pdf_filename);
+  EXPECT_GT(loaded->index().source_size(), 0);
+  EXPECT_THAT(Search(*loaded, "Opcode"), ElementsAre("3:0:1"));
+
+  // The index is rebuilt when the document changes.
+  document.mutable_pages(0)->mutable_rows(0)->mutable_blocks(1)->set_text(
+      "Opcode*");
+  document.mutable_pages(1)->mutable_rows(0)->mutable_blocks(0)->set_text(
+      "Opcode");
+  WriteDocument(document, pdf_filename);
+  EXPECT_THAT(Search(*PdfTextIndex::LoadOrBuildOrDie(pdf_filename), "Opcode"),
+              ElementsAre("3:0:1", "4:0:0"));
+
+  // The index can be stored in another file.
+  const string other_filename = GetTestFilename("other.text_index");
+  EXPECT_THAT(
+      Search(*PdfTextIndex::LoadOrBuildOrDie(pdf_filename, other_filename),
+             "Opcode"),
+      ElementsAre("3:0:1", "4:0:0"));
+  EXPECT_EQ(stat(other_filename.c_str(), &index_stat), 0);
+}
+
+// The index finds the same blocks as matching all of them.
+TEST(PdfTextIndexTest, SameAsScanOnTestData) {
+  PdfDocument document = ReadTextProtoOrDie<PdfDocument>(
+      StrCat(getenv("TEST_SRCDIR"),
+             "/__main__/cpu_instructions/x86/pdf/testdata/"
+             "253666_p170_p171_pdfdoc.pbtxt"));
+  for (PdfPage& page : *document.mutable_pages()) Cluster(&page);
+  const PdfTextIndex index = BuildIndex(document, "testdata.pdf.pb");
+  ASSERT_GT(index.num_blocks(), 0);
+  for (const char* const pattern :
+       {"ADD", "(?i)add", "ADD|SUB", "r/m(8|16|32)", "imm8", "^ADD$", "REX",
+        "Op/En", "[A-Z]{3,}", "Valid", "\\bAL\\b", "—", ".", "^$",
+        "Not Encodable", "(?i)IMM\\d+", "xyzzy"}) {
+    std::vector<const PdfTextIndex::Block*> expected;
+    for (const auto& block : index.index().blocks()) {
+      if (RE2::PartialMatch(block.text(), pattern)) expected.push_back(&block);
+    }
+    EXPECT_EQ(index.Search(RE2(pattern)), expected) << pattern;
+  }
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace cpu_instructions
@@ -14,30 +14,70 @@
 
 #include "cpu_instructions/util/pdf/xpdf_util.h"
 
+#include <algorithm>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <tuple>
 #include <unordered_map>
 #include <vector>
 
 #include "cpu_instructions/proto/pdf/pdf_document.pb.h"
+#include "cpu_instructions/util/fingerprint.h"
 #include "cpu_instructions/util/pdf/geometry.h"
+#include "cpu_instructions/util/pdf/glyphs.h"
+#include "cpu_instructions/util/pdf/page_pipeline.h"
 #include "cpu_instructions/util/pdf/pdf_document_parser.h"
+#include "cpu_instructions/util/pdf/pdf_document_stream.h"
 #include "cpu_instructions/util/pdf/pdf_document_utils.h"
+#include "cpu_instructions/util/pdf/pdf_page_cache.h"
+#include "cpu_instructions/util/stage_profiler.h"
+#include "cpu_instructions/util/thread_pool.h"
+#include "gflags/gflags.h"
 #include "glog/logging.h"
 #include "libutf/utf.h"
 #include "re2/re2.h"
+#include "strings/string_view.h"
 #include "strings/string_view_utils.h"
 #include "util/gtl/map_util.h"
 #include "util/gtl/ptr_util.h"
+#include "xpdf-3.04/goo/GList.h"
 #include "xpdf-3.04/xpdf/GfxState.h"
 #include "xpdf-3.04/xpdf/GlobalParams.h"
+#include "xpdf-3.04/xpdf/Link.h"
+#include "xpdf-3.04/xpdf/Outline.h"
 #include "xpdf-3.04/xpdf/OutputDev.h"
 #include "xpdf-3.04/xpdf/PDFDoc.h"
 #include "xpdf-3.04/xpdf/PDFDocEncoding.h"
+#include "xpdf-3.04/xpdf/Page.h"
 #include "xpdf-3.04/xpdf/UnicodeMap.h"
 
+DEFINE_int32(cpu_instructions_pdf_num_threads, 1,
+             "The number of threads used to render and cluster the pages of a "
+             "PDF file. The page range is split into contiguous chunks that "
+             "are processed independently and merged back in page order, so "
+             "the output does not depend on this value.");
+
+DEFINE_int32(cpu_instructions_pdf_num_clustering_threads, 1,
+             "The number of threads clustering and patching the pages rendered "
+             "by each xpdf thread. When positive, pages are clustered while "
+             "the next pages are rendered. When 0, pages are clustered on the "
+             "rendering thread.");
+
+DEFINE_string(cpu_instructions_pdf_page_cache_directory, "",
+              "If set, parsed pages are cached in this directory and only the "
+              "pages whose patches or clustering flags changed since the last "
+              "run are rendered again. The directory must exist.");
+
+DEFINE_bool(cpu_instructions_pdf_indexed_output, false,
+            "Whether documents written page by page have a page index, so "
+            "that single pages can be read without decoding the others. "
+            "Indexed documents can only be read with PdfDocumentReader, not "
+            "as a PdfDocument proto (e.g. with protoc --decode); use a "
+            "distinct extension such as .pdf.pbidx for them. Documents "
+            "without an index are regular binary PdfDocument protos.");
+
 namespace cpu_instructions {
 namespace pdf {
 
@@ -47,6 +87,11 @@ namespace {
 constexpr const int kHorizontalDPI = 72;
 constexpr const int kVerticalDPI = 72;
 
+// The number of page chunks per thread when parsing in parallel. Pages have
+// very different costs (e.g. dense tables vs. blank pages), having more chunks
+// than threads balances the load.
+constexpr const int kChunksPerThread = 4;
+
 constexpr const char kMetadataAuthor[] = "Author";
 constexpr const char kMetadataCreationDate[] = "CreationDate";
 constexpr const char kMetadataKeywords[] = "Keywords";
@@ -137,21 +182,101 @@ std::unique_ptr<PDFDoc> OpenOrDie(const string& filename) {
   return doc;
 }
 
+// Returns the page an outline item points to, or 0 if it does not point to a
+// page of the document.
+int GetOutlineItemPageNumber(PDFDoc* doc, OutlineItem* item) {
+  LinkAction* const action = item->getAction();
+  if (action == nullptr || action->getKind() != actionGoTo) return 0;
+  LinkGoTo* const go_to = static_cast<LinkGoTo*>(action);
+  LinkDest* destination = go_to->getDest();
+  // Named destinations are looked up in the catalog; the result is owned by
+  // the caller.
+  std::unique_ptr<LinkDest> named_destination;
+  if (destination == nullptr && go_to->getNamedDest() != nullptr) {
+    named_destination.reset(doc->findDest(go_to->getNamedDest()));
+    destination = named_destination.get();
+  }
+  if (destination == nullptr || !destination->isOk()) return 0;
+  if (!destination->isPageRef()) return destination->getPageNum();
+  const Ref page_ref = destination->getPageRef();
+  return doc->findPage(page_ref.num, page_ref.gen);
+}
+
+// Appends 'items' and their descendants to 'outline', depth first. The titles
+// are converted to UTF-8 with 'unicode_map'.
+void ReadOutlineItems(PDFDoc* doc, UnicodeMap* unicode_map, GList* items,
+                      int level, std::vector<PdfOutlineEntry>* outline) {
+  if (items == nullptr) return;
+  for (int i = 0; i < items->getLength(); ++i) {
+    OutlineItem* const item = static_cast<OutlineItem*>(items->get(i));
+    outline->emplace_back();
+    PdfOutlineEntry* const entry = &outline->back();
+    entry->set_level(level);
+    entry->set_page_number(GetOutlineItemPageNumber(doc, item));
+    char utf8_buffer[UTFmax];
+    for (int j = 0; j < item->getTitleLength(); ++j) {
+      const int num_utf8_bytes = unicode_map->mapUnicode(
+          item->getTitle()[j], utf8_buffer, sizeof(utf8_buffer));
+      entry->mutable_title()->append(utf8_buffer, num_utf8_bytes);
+    }
+    // The children are only loaded when the item is opened.
+    item->open();
+    ReadOutlineItems(doc, unicode_map, item->getKids(), level + 1, outline);
+    item->close();
+  }
+}
+
 }  // namespace
 
+std::vector<PdfOutlineEntry> ReadOutlineOrDie(const string& filename) {
+  const std::unique_ptr<PDFDoc> pdf_doc = OpenOrDie(filename);
+  std::vector<PdfOutlineEntry> outline;
+  Outline* const pdf_outline = pdf_doc->getOutline();
+  if (pdf_outline != nullptr) {
+    // getTextEncoding() returns a new reference to the map.
+    UnicodeMap* const unicode_map = GetXpdfGlobalParams()->getTextEncoding();
+    ReadOutlineItems(pdf_doc.get(), unicode_map, pdf_outline->getItems(), 0,
+                     &outline);
+    unicode_map->decRefCnt();
+  }
+  return outline;
+}
+
 namespace {
 
-// An XPDF device which outputs the stream of characters as a PdfDocument
-// protobuf.
+// Called with each page once it is clustered and patched. The callee may take
+// the contents of the page.
+using PageCallback = std::function<void(PdfPage* page)>;
+
+// A page rendered by xpdf, waiting to be clustered and patched.
+struct RenderedPage {
+  PdfPage page;  // Only the number and the size of the page are set.
+  Glyphs glyphs;
+  PdfPageChanges changes;
+  string cache_key;  // Only set when there is a page cache.
+};
+
+// An XPDF device which outputs the stream of characters as PdfPage protobufs.
 class ProtobufOutputDevice : public OutputDev {
  public:
-  // PdfDocumentChanges is used to change the way the document is parsed, it is
-  // also responsible for patching the document afterwards.
-  // ProtobufOutputDevice does not acquire ownership of pdf_document.
-  // pdf_document should outlive this instance.
-  ProtobufOutputDevice(const PdfDocumentChanges& document_changes,
-                       PdfDocument* pdf_document)
-      : document_changes_(&document_changes), pdf_document_(pdf_document) {}
+  // The changes of the document in 'patches' are used to change the way the
+  // document is parsed, and to patch the pages afterwards. 'patches' may be
+  // null if the document has no changes.
+  // Characters are only added to the pages if keep_characters is true.
+  // Rendered pages are clustered and patched on 'pipeline', which outputs them
+  // in order.
+  // If page_cache is not null, pages found in the cache are not rendered and
+  // rendered pages are added to the cache. ProtobufOutputDevice does not
+  // acquire ownership of page_cache nor pipeline.
+  ProtobufOutputDevice(const PdfDocumentId& document_id,
+                       const PdfPatchBundle::Document* patches,
+                       bool keep_characters, const PdfPageCache* page_cache,
+                       PagePipeline* pipeline)
+      : document_id_(document_id),
+        patches_(patches),
+        keep_characters_(keep_characters),
+        page_cache_(page_cache),
+        pipeline_(CHECK_NOTNULL(pipeline)) {}
 
   ProtobufOutputDevice(const ProtobufOutputDevice&) = delete;
 
@@ -163,15 +288,27 @@ class ProtobufOutputDevice : public OutputDev {
   GBool interpretType3Chars() override { return gFalse; }
   GBool needNonText() override { return gFalse; }
 
+  GBool checkPageSlice(Page* page, double hDPI, double vDPI, int rotate,
+                       GBool useMediaBox, GBool crop, int sliceX, int sliceY,
+                       int sliceW, int sliceH, GBool printing,
+                       GBool (*abortCheckCbk)(void* data),
+                       void* abortCheckCbkData) override;
   void startPage(int pageNum, GfxState* state) override;
   void endPage() override;
   void drawChar(GfxState* state, double x, double y, double dx, double dy,
                 double originX, double originY, CharCode c, int nBytes,
                 Unicode* u, int uLen) override;
 
-  const PdfDocumentChanges* const document_changes_;
-  PdfDocument* const pdf_document_ = nullptr;
-  PdfPage current_page_;
+  const PdfDocumentId document_id_;
+  const PdfPatchBundle::Document* const patches_;
+  const bool keep_characters_;
+  const PdfPageCache* const page_cache_;
+  PagePipeline* const pipeline_;
+  // The page being rendered. Its characters are clustered directly, and copied
+  // to the page only if keep_characters_ is true.
+  std::shared_ptr<RenderedPage> current_page_;
+  // Measures the rendering of current_page_.
+  std::unique_ptr<ScopedStageTimer> render_timer_;
 };
 
 constexpr const int kMinFontSize = 4;
@@ -205,49 +342,102 @@ BoundingBox GetBoundingBox(const float x, const float y, const float dx,
   }
 }
 
-// Converts the unicode data from xpdf into a string.
-string GetUtf8String(Unicode* u, int uLen) {
+// Converts the unicode data from xpdf into UTF-8. 'buffer' must have at least
+// UTFmax bytes, the returned StringPiece points to it or to a literal.
+StringPiece GetUtf8String(Unicode* u, int uLen, char* buffer) {
   CHECK_EQ(uLen, 1);
-  char buffer[UTFmax];
   const int length = runetochar(buffer, reinterpret_cast<Rune*>(u));
-  const string output(buffer, length);
+  const StringPiece output(buffer, length);
   // TODO(gchatelet): Moves this in the parser configuration.
   if (output == "—") return "-";
   if (output == "–") return "-";
   return output;
 }
 
-PdfPageChanges GetPageChanges(const PdfDocumentChanges& document_changes,
-                              int page_number) {
-  PdfPageChanges result;
-  for (const auto& page_changes : document_changes.pages()) {
-    if (page_changes.page_number() == page_number) {
-      result.MergeFrom(page_changes);
+// Clusters and patches 'rendered', and adds it to 'page_cache' if not null.
+// Characters are added to the page if 'keep_characters' is true; otherwise the
+// segments have no character indices.
+void ProcessPage(bool keep_characters, const PdfPageCache* page_cache,
+                 RenderedPage* rendered) {
+  PdfPage* const page = &rendered->page;
+  const PdfPageChanges& page_changes = rendered->changes;
+  Cluster(rendered->glyphs, page, page_changes.prevent_segment_bindings());
+  if (keep_characters) {
+    rendered->glyphs.AppendToCharacters(page->mutable_characters());
+  } else {
+    // The segments would otherwise refer to characters that are not in the
+    // page.
+    for (PdfTextSegment& segment : *page->mutable_segments()) {
+      segment.clear_character_indices();
     }
   }
-  return result;
+  if (!page_changes.patches().empty()) {
+    LOG(INFO) << "Patching page " << page->number();
+    ScopedStageTimer timer("ApplyPatches");
+    for (const auto& patch : page_changes.patches()) {
+      ApplyPatchOrDie(patch, page);
+    }
+    timer.AddItems("patches", page_changes.patches_size());
+  }
+  if (page_cache != nullptr) {
+    page_cache->InsertOrDie(rendered->cache_key, *page);
+  }
+}
+
+// Called by xpdf before rendering a page, the page is skipped if it returns
+// false.
+GBool ProtobufOutputDevice::checkPageSlice(
+    Page* page, double hDPI, double vDPI, int rotate, GBool useMediaBox,
+    GBool crop, int sliceX, int sliceY, int sliceW, int sliceH, GBool printing,
+    GBool (*abortCheckCbk)(void* data), void* abortCheckCbkData) {
+  const int page_number = page->getNum();
+  current_page_ = std::make_shared<RenderedPage>();
+  if (patches_ != nullptr) {
+    current_page_->changes = patches_->GetPageChanges(page_number);
+  }
+  if (page_cache_ == nullptr) return gTrue;
+  current_page_->cache_key =
+      PdfPageCache::GetKey(document_id_, page_number,
+                           current_page_->changes, keep_characters_);
+  auto cached_page = std::make_shared<PdfPage>();
+  if (!page_cache_->Lookup(current_page_->cache_key, cached_page.get())) {
+    return gTrue;
+  }
+  VLOG(1) << "Page " << page_number << " found in cache";
+  // Goes through the pipeline to be output in order with the rendered pages.
+  pipeline_->Add(
+      [cached_page](PdfPage* page) { page->Swap(cached_page.get()); });
+  current_page_.reset();
+  return gFalse;
 }
 
 void ProtobufOutputDevice::startPage(int pageNum, GfxState* state) {
-  current_page_.set_number(pageNum);
+  CHECK(current_page_ != nullptr);
+  render_timer_ = gtl::MakeUnique<ScopedStageTimer>("RenderPage");
+  PdfPage* const page = &current_page_->page;
+  page->set_number(pageNum);
   if (state) {
-    current_page_.set_width(state->getPageWidth());
-    current_page_.set_height(state->getPageHeight());
+    page->set_width(state->getPageWidth());
+    page->set_height(state->getPageHeight());
   }
   LOG_EVERY_N(INFO, 100) << "Processing page " << pageNum;
 }
 
 void ProtobufOutputDevice::endPage() {
-  const auto page_number = current_page_.number();
-  const auto& page_changes = GetPageChanges(*document_changes_, page_number);
-  Cluster(&current_page_, page_changes.prevent_segment_bindings());
-  if (!page_changes.patches().empty()) {
-    LOG(INFO) << "Patching page " << page_number;
-    for (const auto& patch : page_changes.patches()) {
-      ApplyPatchOrDie(patch, &current_page_);
-    }
-  }
-  current_page_.Swap(pdf_document_->add_pages());
+  const std::shared_ptr<RenderedPage> rendered = std::move(current_page_);
+  CHECK(rendered != nullptr);
+  // The clustering is measured separately, and may run on this thread.
+  render_timer_->AddItems("pages", 1);
+  render_timer_->AddItems("glyphs", rendered->glyphs.size());
+  render_timer_.reset();
+  // The closure does not refer to the device, which may be destroyed before
+  // the page is processed.
+  const bool keep_characters = keep_characters_;
+  const PdfPageCache* const page_cache = page_cache_;
+  pipeline_->Add([keep_characters, page_cache, rendered](PdfPage* page) {
+    ProcessPage(keep_characters, page_cache, rendered.get());
+    page->Swap(&rendered->page);
+  });
 }
 
 void ProtobufOutputDevice::drawChar(GfxState* state, double x, double y,
@@ -270,20 +460,48 @@ void ProtobufOutputDevice::drawChar(GfxState* state, double x, double y,
   // Dropping characters smaller than kMinFontSize.
   if (font_size < kMinFontSize) return;
 
-  auto* pdf_char = current_page_.add_characters();
-  pdf_char->set_codepoint(c);
-  pdf_char->set_utf8(GetUtf8String(u, uLen));
-  pdf_char->set_font_size(font_size);
-  pdf_char->set_orientation(orientation);
+  Glyph glyph;
+  glyph.codepoint = c;
+  glyph.font_size = font_size;
+  glyph.orientation = orientation;
   const char* color_buffer =
       reinterpret_cast<const char*>(CHECK_NOTNULL(state->getFillColor()->c));
   const int color_buffer_size =
       CHECK_NOTNULL(state->getFillColorSpace())->getNComps() *
       sizeof(GfxColorComp);
-  pdf_char->set_fill_color_hash(
-      std::hash<string>()(string(color_buffer, color_buffer_size)));
-  *pdf_char->mutable_bounding_box() =
+  glyph.fill_color_hash = static_cast<uint32_t>(
+      Fingerprint(StringPiece(color_buffer, color_buffer_size)));
+  const BoundingBox box =
       GetBoundingBox(x1, y1, width, height, font_size, orientation);
+  glyph.left = box.left();
+  glyph.top = box.top();
+  glyph.right = box.right();
+  glyph.bottom = box.bottom();
+  char utf8_buffer[UTFmax];
+  current_page_->glyphs.Add(glyph, GetUtf8String(u, uLen, utf8_buffer));
+}
+
+// Renders pages [first_page, last_page] (1-based, inclusive) of 'pdf_doc' and
+// calls 'page_callback' with each of them once clustered and patched, in page
+// order. Pages found in 'page_cache' (if not null) are not rendered.
+void RenderPagesOrDie(PDFDoc* pdf_doc, const PdfDocumentId& document_id,
+                      const PdfPatchBundle::Document* patches,
+                      int first_page, int last_page, bool keep_characters,
+                      const PdfPageCache* page_cache,
+                      const PageCallback& page_callback) {
+  CHECK(pdf_doc != nullptr);
+  // Outputs the pages which are still being processed when it goes out of
+  // scope, after output_device.
+  PagePipeline pipeline(FLAGS_cpu_instructions_pdf_num_clustering_threads,
+                        page_callback);
+  ProtobufOutputDevice output_device(document_id, patches, keep_characters,
+                                     page_cache, &pipeline);
+  pdf_doc->displayPages(&output_device,                //
+                        first_page, last_page,         //
+                        kHorizontalDPI, kVerticalDPI,  //
+                        /* rotate= */ 0,
+                        /* useMediaBox= */ gTrue, /* crop= */ gTrue,
+                        /* printing= */ gTrue);
 }
 
 }  // namespace
@@ -301,30 +519,211 @@ PdfParseRequest ParseRequestOrDie(const string& spec) {
   return request;
 }
 
-PdfDocument ParseOrDie(const PdfParseRequest& request,
-                       const PdfDocumentsChanges& all_patches) {
-  const std::unique_ptr<PDFDoc> pdf_doc = OpenOrDie(request.filename());
-  PdfDocument document;
-  ReadMetadata(pdf_doc.get(), &document);
-  CreateDocumentId(&document);
-  const auto* const patches =
-      GetConfigOrNull(all_patches, document.document_id());
-  CHECK(all_patches.documents().empty() || patches != nullptr)
-      << "Unable to find document_id '" << document.document_id().DebugString()
-      << "' in '" << request.filename() << "'";
-  const PdfDocumentChanges no_patch;
-  ProtobufOutputDevice output_device(patches ? *patches : no_patch, &document);
-  const int num_pages = pdf_doc->getNumPages();
+namespace {
+
+// A range of pages, 1-based and inclusive.
+using PageRange = std::pair<int, int>;
+
+// Returns the ranges of pages to parse for 'request', in page order and
+// without overlaps.
+std::vector<PageRange> GetPageRangesOrDie(const PdfParseRequest& request,
+                                          int num_pages) {
   const int first_page = request.first_page() == 0 ? 1 : request.first_page();
   const int last_page =
       request.last_page() == 0 ? num_pages : request.last_page();
-  pdf_doc->displayPages(&output_device,                //
-                        first_page, last_page,         //
-                        kHorizontalDPI, kVerticalDPI,  //
-                        /* rotate= */ 0,
-                        /* useMediaBox= */ gTrue, /* crop= */ gTrue,
-                        /* printing= */ gTrue);
+  CHECK_LE(first_page, last_page) << "Invalid page range in '"
+                                  << request.filename() << "'";
+  if (request.page_ranges().empty()) return {{first_page, last_page}};
+  std::vector<PageRange> ranges;
+  for (const PdfPageRange& range : request.page_ranges()) {
+    const int range_first_page =
+        std::max<int>(first_page, range.first_page());
+    const int range_last_page = std::min<int>(
+        last_page, range.last_page() == 0 ? num_pages : range.last_page());
+    if (range_first_page <= range_last_page) {
+      ranges.emplace_back(range_first_page, range_last_page);
+    }
+  }
+  std::sort(ranges.begin(), ranges.end());
+  std::vector<PageRange> merged;
+  for (const PageRange& range : ranges) {
+    if (!merged.empty() && range.first <= merged.back().second + 1) {
+      merged.back().second = std::max(merged.back().second, range.second);
+    } else {
+      merged.push_back(range);
+    }
+  }
+  return merged;
+}
+
+int GetNumPages(const std::vector<PageRange>& ranges) {
+  int num_pages = 0;
+  for (const PageRange& range : ranges) {
+    num_pages += range.second - range.first + 1;
+  }
+  return num_pages;
+}
+
+// Splits 'ranges' into 'num_chunks' lists of ranges with the same number of
+// pages (give or take one), in page order.
+std::vector<std::vector<PageRange>> SplitPageRanges(
+    const std::vector<PageRange>& ranges, int num_chunks) {
+  const int num_pages = GetNumPages(ranges);
+  std::vector<std::vector<PageRange>> chunks(num_chunks);
+  // Index of the first page of 'range' among the pages of 'ranges'.
+  int range_begin = 0;
+  size_t range_index = 0;
+  for (int chunk = 0; chunk < num_chunks; ++chunk) {
+    const int chunk_begin = num_pages * chunk / num_chunks;
+    const int chunk_end = num_pages * (chunk + 1) / num_chunks;
+    for (int begin = chunk_begin; begin < chunk_end;) {
+      const PageRange& range = ranges[range_index];
+      const int range_end = range_begin + range.second - range.first + 1;
+      const int end = std::min(chunk_end, range_end);
+      chunks[chunk].emplace_back(range.first + begin - range_begin,
+                                 range.first + end - range_begin - 1);
+      begin = end;
+      if (end == range_end) {
+        range_begin = range_end;
+        ++range_index;
+      }
+    }
+  }
+  return chunks;
+}
+
+// Parses the PDF file described by 'request'. Fills 'header' with the fields of
+// the document but the pages, then calls 'page_callback' with each page, in
+// page order.
+void ParsePagesOrDie(const PdfParseRequest& request,
+                     const PdfPatchBundle& all_patches, PdfDocument* header,
+                     const PageCallback& page_callback) {
+  CHECK(header != nullptr);
+  // Includes the rendering, the clustering and the patching of the pages, as
+  // well as page_callback.
+  ScopedStageTimer timer("ParsePdf");
+  const std::unique_ptr<PDFDoc> pdf_doc = OpenOrDie(request.filename());
+  ReadMetadata(pdf_doc.get(), header);
+  CreateDocumentId(header);
+  // The cache keys use the id of the parsed document even when there are no
+  // patches.
+  const PdfDocumentId document_id = header->document_id();
+  const PdfPatchBundle::Document* const patches =
+      all_patches.GetDocumentOrNull(document_id);
+  CHECK(all_patches.empty() || patches != nullptr)
+      << "Unable to find document_id '" << document_id.DebugString()
+      << "' in '" << request.filename() << "'";
+  std::unique_ptr<PdfPageCache> page_cache;
+  if (!FLAGS_cpu_instructions_pdf_page_cache_directory.empty()) {
+    page_cache = gtl::MakeUnique<PdfPageCache>(
+        FLAGS_cpu_instructions_pdf_page_cache_directory);
+  }
+  const std::vector<PageRange> page_ranges =
+      GetPageRangesOrDie(request, pdf_doc->getNumPages());
+  const int num_requested_pages = GetNumPages(page_ranges);
+  if (num_requested_pages == 0) {
+    LOG(WARNING) << "No pages to parse in '" << request.filename() << "'";
+    return;
+  }
+  timer.AddItems("pages", num_requested_pages);
+
+  const int num_threads = FLAGS_cpu_instructions_pdf_num_threads;
+  if (num_threads <= 1) {
+    for (const PageRange& range : page_ranges) {
+      RenderPagesOrDie(pdf_doc.get(), document_id, patches, range.first,
+                       range.second, request.keep_characters(),
+                       page_cache.get(), page_callback);
+    }
+    return;
+  }
+
+  // Each chunk is rendered with its own PDFDoc and output device: xpdf objects
+  // are not meant to be shared between threads. The pages of a chunk are
+  // buffered until all the previous chunks have been handed to page_callback.
+  const int num_chunks =
+      std::min(num_requested_pages, num_threads * kChunksPerThread);
+  const std::vector<std::vector<PageRange>> chunk_ranges =
+      SplitPageRanges(page_ranges, num_chunks);
+  std::vector<PdfDocument> chunks(num_chunks);
+  std::vector<bool> chunk_done(num_chunks, false);
+  int next_chunk_to_output = 0;
+  std::mutex output_mutex;
+  LOG(INFO) << "Parsing " << num_requested_pages << " pages in " << num_chunks
+            << " chunks on " << num_threads << " threads";
+  ParallelFor(num_threads, num_chunks, [&](size_t chunk) {
+    const std::unique_ptr<PDFDoc> chunk_pdf_doc =
+        OpenOrDie(request.filename());
+    PdfDocument* const chunk_document = &chunks[chunk];
+    for (const PageRange& range : chunk_ranges[chunk]) {
+      RenderPagesOrDie(chunk_pdf_doc.get(), document_id, patches, range.first,
+                       range.second, request.keep_characters(),
+                       page_cache.get(), [chunk_document](PdfPage* page) {
+                         page->Swap(chunk_document->add_pages());
+                       });
+    }
+
+    // Chunks are contiguous, outputting them in order yields the pages in the
+    // same order as the serial path.
+    std::lock_guard<std::mutex> lock(output_mutex);
+    chunk_done[chunk] = true;
+    for (; next_chunk_to_output < num_chunks &&
+           chunk_done[next_chunk_to_output];
+         ++next_chunk_to_output) {
+      PdfDocument* const done = &chunks[next_chunk_to_output];
+      for (PdfPage& page : *done->mutable_pages()) page_callback(&page);
+      done->Clear();
+    }
+  });
+  CHECK_EQ(next_chunk_to_output, num_chunks);
+}
+
+}  // namespace
+
+PdfDocument ParseOrDie(const PdfParseRequest& request,
+                       const PdfDocumentsChanges& documents_patches) {
+  return ParseOrDie(request,
+                    *PdfPatchBundle::FromChangesOrDie(documents_patches));
+}
+
+PdfDocument ParseOrDie(const PdfParseRequest& request,
+                       const PdfPatchBundle& documents_patches) {
+  PdfDocument document;
+  ParsePagesOrDie(
+      request, documents_patches, &document,
+      [&document](PdfPage* page) { page->Swap(document.add_pages()); });
   return document;
 }
+
+PdfDocument ParseToFileOrDie(const PdfParseRequest& request,
+                             const PdfDocumentsChanges& documents_patches,
+                             const string& output_filename) {
+  return ParseToFileOrDie(request,
+                          *PdfPatchBundle::FromChangesOrDie(documents_patches),
+                          output_filename);
+}
+
+PdfDocument ParseToFileOrDie(const PdfParseRequest& request,
+                             const PdfPatchBundle& documents_patches,
+                             const string& output_filename) {
+  PdfDocumentWriter writer(output_filename,
+                           FLAGS_cpu_instructions_pdf_indexed_output
+                               ? PdfDocumentFormat::kIndexed
+                               : PdfDocumentFormat::kProto);
+  PdfDocument header;
+  bool header_written = false;
+  const auto write_header_once = [&writer, &header, &header_written]() {
+    if (header_written) return;
+    writer.WriteHeader(header);
+    header_written = true;
+  };
+  ParsePagesOrDie(request, documents_patches, &header, [&](PdfPage* page) {
+    write_header_once();
+    writer.WritePage(*page);
+  });
+  write_header_once();
+  writer.Close();
+  return header;
+}
+
 }  // namespace pdf
 }  // namespace cpu_instructions
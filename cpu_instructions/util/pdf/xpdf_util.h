@@ -19,9 +19,11 @@
 
 #include <map>
 #include <memory>
+#include <vector>
 #include "strings/string.h"
 
 #include "cpu_instructions/proto/pdf/pdf_document.pb.h"
+#include "cpu_instructions/util/pdf/pdf_patch_bundle.h"
 
 namespace cpu_instructions {
 namespace pdf {
@@ -31,6 +33,11 @@ namespace pdf {
 // e.g. "/path/to/file.pdf:12-25"
 PdfParseRequest ParseRequestOrDie(const string& spec);
 
+// Reads the outline (a.k.a. bookmarks) of a PDF file, in depth-first order.
+// This does not render any page, so it is much faster than parsing the file.
+// Returns an empty vector if the file has no outline.
+std::vector<PdfOutlineEntry> ReadOutlineOrDie(const string& filename);
+
 // Parses a PDF file described by a PdfParseEntry.
 //
 // The function will:
@@ -41,12 +48,32 @@ PdfParseRequest ParseRequestOrDie(const string& spec);
 // - parse the pdf and apply the changes,
 // - return the corresponding PdfDocument.
 //
+// The pages contain their characters only if request.keep_characters() is
+// true.
+//
 // Please note that documents_patches have to contains an entry for the pdf's
 // document id or the function will die. Leave documents_patches empty for
 // tests.
 PdfDocument ParseOrDie(const PdfParseRequest& request,
                        const PdfDocumentsChanges& documents_patches);
 
+// Same as above, with patches compiled into a PdfPatchBundle. The changes of
+// each page are looked up in the index of the bundle.
+PdfDocument ParseOrDie(const PdfParseRequest& request,
+                       const PdfPatchBundle& documents_patches);
+
+// Same as ParseOrDie, but each page is written to 'output_filename' as soon as
+// it is processed instead of being kept in memory. The file is an indexed or
+// binary PdfDocument depending on --cpu_instructions_pdf_indexed_output; it can
+// be read page by page with PdfDocumentReader. Returns the document without its
+// pages.
+PdfDocument ParseToFileOrDie(const PdfParseRequest& request,
+                             const PdfDocumentsChanges& documents_patches,
+                             const string& output_filename);
+PdfDocument ParseToFileOrDie(const PdfParseRequest& request,
+                             const PdfPatchBundle& documents_patches,
+                             const string& output_filename);
+
 }  // namespace pdf
 }  // namespace cpu_instructions
 
@@ -14,13 +14,22 @@
 
 #include "cpu_instructions/util/pdf/xpdf_util.h"
 
+#include <vector>
+
 #include "cpu_instructions/testing/test_util.h"
+#include "cpu_instructions/util/pdf/page_pipeline.h"
+#include "cpu_instructions/util/proto_fingerprint.h"
+#include "gflags/gflags.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "src/google/protobuf/text_format.h"
 #include "strings/str_cat.h"
 #include "util/gtl/ptr_util.h"
 
+DECLARE_int32(cpu_instructions_pdf_num_threads);
+DECLARE_int32(cpu_instructions_pdf_num_clustering_threads);
+DECLARE_string(cpu_instructions_pdf_page_cache_directory);
+
 namespace cpu_instructions {
 namespace pdf {
 namespace {
@@ -33,6 +42,7 @@ TEST(ProtobufOutputDeviceTest, TestSimplePdfOutput) {
   PdfParseRequest request;
   request.set_filename(
       StrCat(getenv("TEST_SRCDIR"), kTestDataPath, "simple.pdf"));
+  request.set_keep_characters(true);
 
   PdfDocument pdf_document = ParseOrDie(request, PdfDocumentsChanges());
 
@@ -497,6 +507,177 @@ TEST(ProtobufOutputDeviceTest, TestSimplePdfOutput) {
   EXPECT_THAT(pdf_document, EqualsProto(kExpected));
 }
 
+TEST(ProtobufOutputDeviceTest, TestOutputWithoutCharacters) {
+  PdfParseRequest request;
+  request.set_filename(
+      StrCat(getenv("TEST_SRCDIR"), kTestDataPath, "simple.pdf"));
+  request.set_keep_characters(true);
+  const PdfDocument with_characters =
+      ParseOrDie(request, PdfDocumentsChanges());
+  request.set_keep_characters(false);
+  const PdfDocument without_characters =
+      ParseOrDie(request, PdfDocumentsChanges());
+
+  // The pages are the same, except that there are no characters and no
+  // references to them.
+  PdfDocument expected = with_characters;
+  for (PdfPage& page : *expected.mutable_pages()) {
+    EXPECT_GT(page.characters_size(), 0);
+    page.clear_characters();
+    for (PdfTextSegment& segment : *page.mutable_segments()) {
+      segment.clear_character_indices();
+    }
+  }
+  EXPECT_THAT(without_characters, EqualsProto(expected));
+}
+
+// Returns the deterministic serialization of 'document'; the metadata is a map.
+string Serialize(const PdfDocument& document) {
+  string serialized;
+  AppendDeterministicSerialization(document, &serialized);
+  return serialized;
+}
+
+// multipage.pdf has 20 pages with different amounts of text, i.e. more pages
+// than the chunks of a parallel parse.
+constexpr const int kMultipagePdfNumPages = 20;
+
+TEST(ProtobufOutputDeviceTest, TestParallelOutputIsSameAsSerial) {
+  ::gflags::FlagSaver flag_saver;
+  PdfParseRequest request;
+  request.set_filename(
+      StrCat(getenv("TEST_SRCDIR"), kTestDataPath, "multipage.pdf"));
+
+  FLAGS_cpu_instructions_pdf_num_threads = 1;
+  const PdfDocument serial = ParseOrDie(request, PdfDocumentsChanges());
+  ASSERT_EQ(serial.pages_size(), kMultipagePdfNumPages);
+  for (int i = 0; i < serial.pages_size(); ++i) {
+    EXPECT_EQ(serial.pages(i).number(), i + 1);
+  }
+  // With 2 threads, each chunk has several pages. With 8 threads, there are
+  // more chunks than pages.
+  for (const int num_threads : {2, 3, 4, 8}) {
+    SCOPED_TRACE(StrCat("num_threads = ", num_threads));
+    FLAGS_cpu_instructions_pdf_num_threads = num_threads;
+    const PdfDocument parallel = ParseOrDie(request, PdfDocumentsChanges());
+    EXPECT_EQ(Serialize(parallel), Serialize(serial));
+    EXPECT_THAT(parallel, EqualsProto(serial));
+  }
+}
+
+TEST(ProtobufOutputDeviceTest, TestParallelOutputWithPageRanges) {
+  ::gflags::FlagSaver flag_saver;
+  PdfParseRequest request;
+  request.set_filename(
+      StrCat(getenv("TEST_SRCDIR"), kTestDataPath, "multipage.pdf"));
+  // The chunks are split across the ranges.
+  PdfPageRange* const first_range = request.add_page_ranges();
+  first_range->set_first_page(3);
+  first_range->set_last_page(7);
+  PdfPageRange* const second_range = request.add_page_ranges();
+  second_range->set_first_page(12);
+  second_range->set_last_page(18);
+
+  FLAGS_cpu_instructions_pdf_num_threads = 1;
+  const PdfDocument serial = ParseOrDie(request, PdfDocumentsChanges());
+  ASSERT_EQ(serial.pages_size(), 12);
+  EXPECT_EQ(serial.pages(0).number(), 3);
+  EXPECT_EQ(serial.pages(5).number(), 12);
+  FLAGS_cpu_instructions_pdf_num_threads = 3;
+  const PdfDocument parallel = ParseOrDie(request, PdfDocumentsChanges());
+  EXPECT_EQ(Serialize(parallel), Serialize(serial));
+}
+
+TEST(ProtobufOutputDeviceTest, TestPipelinedOutputIsSameAsSerial) {
+  ::gflags::FlagSaver flag_saver;
+  PdfParseRequest request;
+  request.set_filename(
+      StrCat(getenv("TEST_SRCDIR"), kTestDataPath, "multipage.pdf"));
+  request.set_keep_characters(true);
+
+  FLAGS_cpu_instructions_pdf_num_clustering_threads = 0;
+  const PdfDocument serial = ParseOrDie(request, PdfDocumentsChanges());
+  ASSERT_EQ(serial.pages_size(), kMultipagePdfNumPages);
+  // The pages have different amounts of text, so they are clustered in
+  // different times and finish out of order. The document has more pages than
+  // PagePipeline keeps in flight, so Add() also blocks on a full pipeline.
+  for (const int num_threads : {1, 2, 4}) {
+    SCOPED_TRACE(StrCat("num_clustering_threads = ", num_threads));
+    ASSERT_GT(kMultipagePdfNumPages,
+              num_threads * PagePipeline::kPagesInFlightPerThread);
+    FLAGS_cpu_instructions_pdf_num_clustering_threads = num_threads;
+    const PdfDocument pipelined = ParseOrDie(request, PdfDocumentsChanges());
+    EXPECT_EQ(Serialize(pipelined), Serialize(serial));
+  }
+
+  // Pipelined clustering within parallel chunks.
+  FLAGS_cpu_instructions_pdf_num_threads = 2;
+  FLAGS_cpu_instructions_pdf_num_clustering_threads = 2;
+  EXPECT_EQ(Serialize(ParseOrDie(request, PdfDocumentsChanges())),
+            Serialize(serial));
+}
+
+TEST(ProtobufOutputDeviceTest, TestCachedOutputIsSameAsUncached) {
+  PdfParseRequest request;
+  request.set_filename(
+      StrCat(getenv("TEST_SRCDIR"), kTestDataPath, "simple.pdf"));
+
+  const PdfDocument uncached = ParseOrDie(request, PdfDocumentsChanges());
+  FLAGS_cpu_instructions_pdf_page_cache_directory = getenv("TEST_TMPDIR");
+  // The first run fills the cache, the second one reads from it.
+  const PdfDocument first_run = ParseOrDie(request, PdfDocumentsChanges());
+  const PdfDocument second_run = ParseOrDie(request, PdfDocumentsChanges());
+  FLAGS_cpu_instructions_pdf_page_cache_directory = "";
+
+  EXPECT_THAT(first_run, EqualsProto(uncached));
+  EXPECT_THAT(second_run, EqualsProto(uncached));
+}
+
+TEST(ProtobufOutputDeviceTest, TestPageRanges) {
+  PdfParseRequest request;
+  request.set_filename(
+      StrCat(getenv("TEST_SRCDIR"), kTestDataPath, "simple.pdf"));
+  const PdfDocument all_pages = ParseOrDie(request, PdfDocumentsChanges());
+
+  PdfPageRange* const range = request.add_page_ranges();
+  range->set_first_page(1);
+  range->set_last_page(1);
+  EXPECT_THAT(ParseOrDie(request, PdfDocumentsChanges()),
+              EqualsProto(all_pages));
+
+  // simple.pdf has a single page.
+  range->set_first_page(2);
+  range->set_last_page(0);
+  EXPECT_EQ(ParseOrDie(request, PdfDocumentsChanges()).pages_size(), 0);
+}
+
+TEST(ProtobufOutputDeviceTest, TestReadOutlineOrDie) {
+  // simple.pdf has no outline.
+  EXPECT_TRUE(
+      ReadOutlineOrDie(
+          StrCat(getenv("TEST_SRCDIR"), kTestDataPath, "simple.pdf"))
+          .empty());
+}
+
+TEST(ProtobufOutputDeviceTest, TestReadNestedOutlineOrDie) {
+  // The entries of multipage.pdf point to their pages either with /Dest or
+  // with a /GoTo action, and one of the titles is in UTF-16.
+  const std::vector<PdfOutlineEntry> outline = ReadOutlineOrDie(
+      StrCat(getenv("TEST_SRCDIR"), kTestDataPath, "multipage.pdf"));
+  const std::vector<const char*> kExpected = {
+      R"(title: "Chapter 1" level: 0 page_number: 1)",
+      R"(title: "Section 1.1" level: 1 page_number: 2)",
+      R"(title: "Section 1.2" level: 1 page_number: 5)",
+      R"(title: "Chapter 2" level: 0 page_number: 11)",
+      R"(title: "\303\234berblick" level: 1 page_number: 12)",
+      R"(title: "Details" level: 2 page_number: 13)",
+      R"(title: "Index" level: 0 page_number: 20)"};
+  ASSERT_EQ(outline.size(), kExpected.size());
+  for (size_t i = 0; i < outline.size(); ++i) {
+    EXPECT_THAT(outline[i], EqualsProto(kExpected[i]));
+  }
+}
+
 TEST(ProtobufOutputDeviceTest, TestParseRequestOrDie) {
   constexpr const char kExpected1[] = R"(
         filename: "/path/to/file.pdf"
@@ -0,0 +1,39 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/proto_fingerprint.h"
+
+#include "cpu_instructions/util/fingerprint.h"
+#include "src/google/protobuf/io/coded_stream.h"
+#include "src/google/protobuf/io/zero_copy_stream_impl_lite.h"
+
+namespace cpu_instructions {
+
+void AppendDeterministicSerialization(const google::protobuf::Message& message,
+                                      string* output) {
+  message.ByteSizeLong();  // Computes the cached sizes.
+  google::protobuf::io::StringOutputStream string_stream(output);
+  google::protobuf::io::CodedOutputStream coded_output(&string_stream);
+  // Map fields are serialized in a random order otherwise.
+  coded_output.SetSerializationDeterministic(true);
+  message.SerializeWithCachedSizes(&coded_output);
+}
+
+uint64_t FingerprintProto(const google::protobuf::Message& message) {
+  string serialized;
+  AppendDeterministicSerialization(message, &serialized);
+  return Fingerprint(serialized);
+}
+
+}  // namespace cpu_instructions
@@ -0,0 +1,39 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Stable 64-bit fingerprints of protos, see fingerprint.h.
+
+#ifndef CPU_INSTRUCTIONS_UTIL_PROTO_FINGERPRINT_H_
+#define CPU_INSTRUCTIONS_UTIL_PROTO_FINGERPRINT_H_
+
+#include <cstdint>
+#include "strings/string.h"
+
+#include "src/google/protobuf/message.h"
+
+namespace cpu_instructions {
+
+// Appends the deterministic serialization of 'message' to 'output'. Unlike
+// Message::SerializeToString, two equal messages always have the same
+// serialization, even when they contain map fields.
+void AppendDeterministicSerialization(const google::protobuf::Message& message,
+                                      string* output);
+
+// Returns the fingerprint of the deterministic serialization of 'message'. Two
+// equal messages have the same fingerprint.
+uint64_t FingerprintProto(const google::protobuf::Message& message);
+
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_UTIL_PROTO_FINGERPRINT_H_
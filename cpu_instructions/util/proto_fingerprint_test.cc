@@ -0,0 +1,51 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/proto_fingerprint.h"
+
+#include "strings/string.h"
+
+#include "cpu_instructions/proto/instructions.pb.h"
+#include "cpu_instructions/util/fingerprint.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace cpu_instructions {
+namespace {
+
+TEST(ProtoFingerprintTest, FingerprintProto) {
+  const auto proto = ParseProtoFromStringOrDie<InstructionProto>(
+      "llvm_mnemonic: 'ADD32mr' raw_encoding_specification: '01 /r'");
+  EXPECT_EQ(FingerprintProto(proto), FingerprintProto(proto));
+  InstructionProto other = proto;
+  other.set_llvm_mnemonic("ADD32rr");
+  EXPECT_NE(FingerprintProto(proto), FingerprintProto(other));
+  EXPECT_EQ(FingerprintProto(InstructionProto()), Fingerprint(""));
+}
+
+TEST(ProtoFingerprintTest, AppendDeterministicSerialization) {
+  const auto proto = ParseProtoFromStringOrDie<InstructionProto>(
+      "llvm_mnemonic: 'ADD32mr' raw_encoding_specification: '01 /r'");
+  string serialized = "prefix";
+  AppendDeterministicSerialization(proto, &serialized);
+  InstructionProto parsed;
+  ASSERT_TRUE(parsed.ParseFromString(serialized.substr(6)));
+  EXPECT_EQ(parsed.llvm_mnemonic(), "ADD32mr");
+  EXPECT_EQ(serialized.substr(0, 6), "prefix");
+  EXPECT_EQ(FingerprintProto(proto), Fingerprint(serialized.substr(6)));
+}
+
+}  // namespace
+}  // namespace cpu_instructions
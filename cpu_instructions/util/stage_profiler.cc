@@ -0,0 +1,126 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/stage_profiler.h"
+
+#include <sys/resource.h>
+#include <time.h>
+
+#include "glog/logging.h"
+
+namespace cpu_instructions {
+
+StageProfiler* StageProfiler::Get() {
+  static StageProfiler* const profiler = new StageProfiler();
+  return profiler;
+}
+
+void StageProfiler::AddRun(const StageProfile& run) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto inserted =
+      stage_indices_.emplace(run.name(), report_.stages_size());
+  if (inserted.second) {
+    *report_.add_stages() = run;
+    return;
+  }
+  StageProfile* const stage = report_.mutable_stages(inserted.first->second);
+  stage->set_num_runs(stage->num_runs() + run.num_runs());
+  stage->set_wall_time_seconds(stage->wall_time_seconds() +
+                               run.wall_time_seconds());
+  stage->set_cpu_time_seconds(stage->cpu_time_seconds() +
+                              run.cpu_time_seconds());
+  stage->set_peak_rss_delta_kb(stage->peak_rss_delta_kb() +
+                               run.peak_rss_delta_kb());
+  // Stages count few kinds of items, a linear search is enough.
+  for (const StageProfile::ItemCount& run_count : run.item_counts()) {
+    StageProfile::ItemCount* count = nullptr;
+    for (StageProfile::ItemCount& stage_count : *stage->mutable_item_counts()) {
+      if (stage_count.name() == run_count.name()) {
+        count = &stage_count;
+        break;
+      }
+    }
+    if (count == nullptr) {
+      *stage->add_item_counts() = run_count;
+    } else {
+      count->set_count(count->count() + run_count.count());
+    }
+  }
+}
+
+StageProfileReport StageProfiler::GetReport() const {
+  StageProfileReport report;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    report = report_;
+  }
+  report.set_peak_rss_kb(GetPeakRssKb());
+  return report;
+}
+
+void StageProfiler::Reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  report_.Clear();
+  stage_indices_.clear();
+}
+
+ScopedStageTimer::ScopedStageTimer(const string& name)
+    : name_(name),
+      start_wall_time_(std::chrono::steady_clock::now()),
+      start_cpu_time_seconds_(GetThreadCpuTimeSeconds()),
+      start_peak_rss_kb_(GetPeakRssKb()) {}
+
+ScopedStageTimer::~ScopedStageTimer() {
+  StageProfile run;
+  run.set_name(name_);
+  run.set_num_runs(1);
+  run.set_wall_time_seconds(std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() -
+                                start_wall_time_)
+                                .count());
+  run.set_cpu_time_seconds(GetThreadCpuTimeSeconds() -
+                           start_cpu_time_seconds_);
+  run.set_peak_rss_delta_kb(GetPeakRssKb() - start_peak_rss_kb_);
+  for (const auto& item_count : item_counts_) {
+    StageProfile::ItemCount* const count = run.add_item_counts();
+    count->set_name(item_count.first);
+    count->set_count(item_count.second);
+  }
+  StageProfiler::Get()->AddRun(run);
+}
+
+void ScopedStageTimer::AddItems(const string& item, int64_t count) {
+  for (auto& item_count : item_counts_) {
+    if (item_count.first == item) {
+      item_count.second += count;
+      return;
+    }
+  }
+  item_counts_.emplace_back(item, count);
+}
+
+double GetThreadCpuTimeSeconds() {
+  struct timespec time;
+  CHECK_EQ(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time), 0);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+int64_t GetPeakRssKb() {
+  struct rusage usage;
+  CHECK_EQ(getrusage(RUSAGE_SELF, &usage), 0);
+  // ru_maxrss is in kilobytes on Linux.
+  return usage.ru_maxrss;
+}
+
+}  // namespace cpu_instructions
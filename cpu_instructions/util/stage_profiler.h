@@ -0,0 +1,103 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A lightweight profiler measuring the wall time, CPU time and memory growth of
+// the stages of a program, e.g. the rendering, clustering and patching of the
+// pages of a PDF file.
+//
+// Usage:
+//   void ClusterRows(...) {
+//     ScopedStageTimer timer("ClusterRows");
+//     ...
+//     timer.AddItems("rows", rows->size());
+//   }
+//   ...
+//   WriteTextProtoOrDie(filename, StageProfiler::Get()->GetReport());
+//
+// The runs of a stage are summed, so a stage can run many times (e.g. once per
+// page) and on several threads at the same time.
+
+#ifndef CPU_INSTRUCTIONS_UTIL_STAGE_PROFILER_H_
+#define CPU_INSTRUCTIONS_UTIL_STAGE_PROFILER_H_
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "strings/string.h"
+
+#include "cpu_instructions/proto/stage_profile.pb.h"
+
+namespace cpu_instructions {
+
+// Collects the measurements of all the stages of the process. The class is
+// thread-safe.
+class StageProfiler {
+ public:
+  // Returns the profiler of the process.
+  static StageProfiler* Get();
+
+  StageProfiler() = default;
+  StageProfiler(const StageProfiler&) = delete;
+  StageProfiler& operator=(const StageProfiler&) = delete;
+
+  // Adds the measurements of a run of the stage 'run.name()' to the stage.
+  void AddRun(const StageProfile& run);
+
+  // Returns the measurements of all the stages so far.
+  StageProfileReport GetReport() const;
+
+  // Forgets all the stages.
+  void Reset();
+
+ private:
+  mutable std::mutex mutex_;
+  StageProfileReport report_;
+  // The index of each stage in report_.stages().
+  std::unordered_map<string, int> stage_indices_;
+};
+
+// Measures a run of a stage, from construction to destruction, and adds it to
+// StageProfiler::Get().
+class ScopedStageTimer {
+ public:
+  explicit ScopedStageTimer(const string& name);
+
+  ScopedStageTimer(const ScopedStageTimer&) = delete;
+  ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+
+  ~ScopedStageTimer();
+
+  // Adds 'count' to the number of items called 'item' processed by the run.
+  void AddItems(const string& item, int64_t count);
+
+ private:
+  const string name_;
+  const std::chrono::steady_clock::time_point start_wall_time_;
+  const double start_cpu_time_seconds_;
+  const int64_t start_peak_rss_kb_;
+  std::vector<std::pair<string, int64_t>> item_counts_;
+};
+
+// Returns the CPU time consumed by the calling thread, in seconds.
+double GetThreadCpuTimeSeconds();
+
+// Returns the peak resident set size of the process, in kilobytes.
+int64_t GetPeakRssKb();
+
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_UTIL_STAGE_PROFILER_H_
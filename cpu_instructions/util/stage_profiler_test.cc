@@ -0,0 +1,107 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/stage_profiler.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "cpu_instructions/util/thread_pool.h"
+#include "gtest/gtest.h"
+
+namespace cpu_instructions {
+namespace {
+
+class StageProfilerTest : public ::testing::Test {
+ protected:
+  void SetUp() override { StageProfiler::Get()->Reset(); }
+};
+
+TEST_F(StageProfilerTest, SumsRuns) {
+  for (int i = 0; i < 3; ++i) {
+    ScopedStageTimer timer("first");
+    timer.AddItems("glyphs", 10);
+    timer.AddItems("rows", 1);
+    timer.AddItems("glyphs", 5);
+  }
+  {
+    ScopedStageTimer timer("second");
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  {
+    ScopedStageTimer timer("first");
+    timer.AddItems("segments", 2);
+  }
+  const StageProfileReport report = StageProfiler::Get()->GetReport();
+  ASSERT_EQ(report.stages_size(), 2);
+  EXPECT_GT(report.peak_rss_kb(), 0);
+
+  const StageProfile& first = report.stages(0);
+  EXPECT_EQ(first.name(), "first");
+  EXPECT_EQ(first.num_runs(), 4);
+  ASSERT_EQ(first.item_counts_size(), 3);
+  EXPECT_EQ(first.item_counts(0).name(), "glyphs");
+  EXPECT_EQ(first.item_counts(0).count(), 45);
+  EXPECT_EQ(first.item_counts(1).name(), "rows");
+  EXPECT_EQ(first.item_counts(1).count(), 3);
+  EXPECT_EQ(first.item_counts(2).name(), "segments");
+  EXPECT_EQ(first.item_counts(2).count(), 2);
+
+  const StageProfile& second = report.stages(1);
+  EXPECT_EQ(second.name(), "second");
+  EXPECT_EQ(second.num_runs(), 1);
+  EXPECT_GE(second.wall_time_seconds(), 0.01);
+  // Sleeping does not use the CPU.
+  EXPECT_LT(second.cpu_time_seconds(), second.wall_time_seconds());
+  EXPECT_EQ(second.item_counts_size(), 0);
+}
+
+TEST_F(StageProfilerTest, MeasuresCpuTimeAndMemory) {
+  constexpr int kNumBytes = 64 << 20;
+  {
+    ScopedStageTimer timer("allocate");
+    std::vector<char> buffer(kNumBytes, 1);
+    volatile int sum = 0;
+    for (const char c : buffer) sum += c;
+    EXPECT_EQ(sum, kNumBytes);
+  }
+  const StageProfileReport report = StageProfiler::Get()->GetReport();
+  ASSERT_EQ(report.stages_size(), 1);
+  EXPECT_GT(report.stages(0).cpu_time_seconds(), 0);
+  EXPECT_GT(report.stages(0).peak_rss_delta_kb(), 0);
+  EXPECT_GE(report.peak_rss_kb(), kNumBytes / 1024);
+}
+
+TEST_F(StageProfilerTest, Threads) {
+  constexpr int kNumRuns = 1000;
+  ParallelFor(4, kNumRuns, [](size_t i) {
+    ScopedStageTimer timer("parallel");
+    timer.AddItems("runs", 1);
+  });
+  const StageProfileReport report = StageProfiler::Get()->GetReport();
+  ASSERT_EQ(report.stages_size(), 1);
+  EXPECT_EQ(report.stages(0).num_runs(), kNumRuns);
+  ASSERT_EQ(report.stages(0).item_counts_size(), 1);
+  EXPECT_EQ(report.stages(0).item_counts(0).count(), kNumRuns);
+}
+
+TEST_F(StageProfilerTest, Reset) {
+  { ScopedStageTimer timer("stage"); }
+  StageProfiler::Get()->Reset();
+  EXPECT_EQ(StageProfiler::Get()->GetReport().stages_size(), 0);
+}
+
+}  // namespace
+}  // namespace cpu_instructions
@@ -0,0 +1,96 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include "glog/logging.h"
+
+namespace cpu_instructions {
+
+ThreadPool::ThreadPool(int num_threads) : num_threads_(num_threads) {
+  CHECK_GT(num_threads, 0);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  queue_not_empty_.notify_all();
+  for (std::thread& worker : workers_) worker.join();
+  // Closures scheduled on a pool whose workers were never started are run on
+  // the destroying thread so that the "all closures are done" contract holds.
+  for (const auto& closure : queue_) closure();
+}
+
+void ThreadPool::StartWorkers() {
+  CHECK(workers_.empty()) << "StartWorkers() was already called";
+  workers_.reserve(num_threads_);
+  for (int i = 0; i < num_threads_; ++i) {
+    workers_.emplace_back(&ThreadPool::RunWorker, this);
+  }
+}
+
+void ThreadPool::Schedule(std::function<void()> closure) {
+  CHECK(closure != nullptr);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CHECK(!stopping_) << "Schedule() called on a stopping ThreadPool";
+    queue_.push_back(std::move(closure));
+  }
+  queue_not_empty_.notify_one();
+}
+
+void ThreadPool::RunWorker() {
+  while (true) {
+    std::function<void()> closure;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queue_not_empty_.wait(lock,
+                            [this]() { return stopping_ || !queue_.empty(); });
+      // The queue is drained before the workers exit.
+      if (queue_.empty()) return;
+      closure = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    closure();
+  }
+}
+
+void ParallelFor(int num_threads, size_t num_items,
+                 const std::function<void(size_t)>& function) {
+  if (num_threads <= 1 || num_items <= 1) {
+    for (size_t i = 0; i < num_items; ++i) function(i);
+    return;
+  }
+  // Items are handed out one at a time so that a few expensive items do not
+  // leave the other threads idle.
+  std::atomic<size_t> next_item(0);
+  const int num_workers =
+      static_cast<int>(std::min<size_t>(num_threads, num_items));
+  ThreadPool pool(num_workers);
+  pool.StartWorkers();
+  for (int worker = 0; worker < num_workers; ++worker) {
+    pool.Schedule([&next_item, num_items, &function]() {
+      for (size_t i = next_item++; i < num_items; i = next_item++) {
+        function(i);
+      }
+    });
+  }
+}
+
+}  // namespace cpu_instructions
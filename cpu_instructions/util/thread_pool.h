@@ -0,0 +1,79 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A minimal fixed-size thread pool.
+
+#ifndef CPU_INSTRUCTIONS_UTIL_THREAD_POOL_H_
+#define CPU_INSTRUCTIONS_UTIL_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cpu_instructions {
+
+// A pool of worker threads executing closures in the order they were
+// scheduled. The destructor blocks until all the scheduled closures have run.
+//
+// Usage:
+//   ThreadPool pool(num_threads);
+//   pool.StartWorkers();
+//   for (...) pool.Schedule([...]() { ... });
+//   // All closures are done when 'pool' goes out of scope.
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads);
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool();
+
+  // Starts the worker threads. Closures scheduled before this call are queued
+  // and run once the workers are started.
+  void StartWorkers();
+
+  // Adds a closure to the queue of work.
+  void Schedule(std::function<void()> closure);
+
+  int num_threads() const { return num_threads_; }
+
+ private:
+  // The main loop of the worker threads.
+  void RunWorker();
+
+  const int num_threads_;
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable queue_not_empty_;
+  // The closures waiting to be executed. Guarded by mutex_.
+  std::deque<std::function<void()>> queue_;
+  // Set to true by the destructor to stop the workers. Guarded by mutex_.
+  bool stopping_ = false;
+};
+
+// Calls 'function(i)' for all i in [0, num_items) using up to 'num_threads'
+// threads, and returns when all calls have completed. The calls are made on the
+// calling thread, in increasing order of i, when num_threads <= 1.
+void ParallelFor(int num_threads, size_t num_items,
+                 const std::function<void(size_t)>& function);
+
+}  // namespace cpu_instructions
+
+#endif  // CPU_INSTRUCTIONS_UTIL_THREAD_POOL_H_
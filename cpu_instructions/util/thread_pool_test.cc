@@ -0,0 +1,68 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/util/thread_pool.h"
+
+#include <atomic>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace cpu_instructions {
+namespace {
+
+using ::testing::Each;
+using ::testing::ElementsAre;
+
+TEST(ThreadPoolTest, RunsAllClosures) {
+  std::atomic<int> counter(0);
+  {
+    ThreadPool pool(4);
+    pool.StartWorkers();
+    for (int i = 0; i < 1000; ++i) {
+      pool.Schedule([&counter]() { ++counter; });
+    }
+  }
+  EXPECT_EQ(counter, 1000);
+}
+
+TEST(ThreadPoolTest, RunsClosuresScheduledBeforeStart) {
+  std::atomic<int> counter(0);
+  {
+    ThreadPool pool(2);
+    pool.Schedule([&counter]() { ++counter; });
+    pool.Schedule([&counter]() { ++counter; });
+    pool.StartWorkers();
+  }
+  EXPECT_EQ(counter, 2);
+}
+
+TEST(ParallelForTest, VisitsEachItemOnce) {
+  constexpr size_t kNumItems = 1234;
+  for (const int num_threads : {1, 2, 8}) {
+    std::vector<int> visits(kNumItems, 0);
+    ParallelFor(num_threads, kNumItems, [&visits](size_t i) { ++visits[i]; });
+    EXPECT_THAT(visits, Each(1)) << "num_threads = " << num_threads;
+  }
+}
+
+TEST(ParallelForTest, SerialWhenSingleThreaded) {
+  std::vector<size_t> order;
+  ParallelFor(1, 4, [&order](size_t i) { order.push_back(i); });
+  EXPECT_THAT(order, ElementsAre(0, 1, 2, 3));
+}
+
+}  // namespace
+}  // namespace cpu_instructions
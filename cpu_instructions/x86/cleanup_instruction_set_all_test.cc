@@ -0,0 +1,135 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Tests the default pipeline with all the x86 cleanup transforms.
+
+#include <vector>
+
+#include "cpu_instructions/base/cleanup_instruction_set.h"
+#include "cpu_instructions/proto/instructions.pb.h"
+#include "cpu_instructions/testing/test_util.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "src/google/protobuf/text_format.h"
+#include "util/task/status.h"
+
+DECLARE_bool(cpu_instructions_fuse_per_instruction_transforms);
+DECLARE_int32(cpu_instructions_transform_num_threads);
+
+namespace cpu_instructions {
+namespace x86 {
+namespace {
+
+using ::cpu_instructions::testing::EqualsProto;
+using ::google::protobuf::TextFormat;
+using ::cpu_instructions::util::Status;
+
+// Instructions in the format of the SDM parser, covering the transforms that
+// can run in parallel.
+constexpr char kInstructionSetProto[] = R"(
+    instructions {
+      vendor_syntax { mnemonic: 'ADD' operands { name: 'r/m8' }
+                      operands { name: 'imm8' }}
+      feature_name: '' encoding_scheme: 'MI'
+      raw_encoding_specification: '80 /0 imm8' }
+    instructions {
+      vendor_syntax { mnemonic: 'CLFLUSH' operands { name: 'm8' }}
+      encoding_scheme: 'M' raw_encoding_specification: '0F AE /7' }
+    instructions {
+      vendor_syntax { mnemonic: 'CMPS' operands { name: 'm8' }
+                      operands { name: 'm8' }}
+      encoding_scheme: 'NP' raw_encoding_specification: 'A6' }
+    instructions {
+      vendor_syntax { mnemonic: 'FADD' operands { name: 'ST(0)' }
+                      operands { name: 'ST(i)' }}
+      encoding_scheme: 'ZO' raw_encoding_specification: 'D8 C0+i' }
+    instructions {
+      vendor_syntax { mnemonic: 'HLT' }
+      encoding_scheme: 'ZO' raw_encoding_specification: 'F4' }
+    instructions {
+      vendor_syntax { mnemonic: 'INS' operands { name: 'm8' }
+                      operands { name: 'DX' }}
+      encoding_scheme: 'NP' raw_encoding_specification: '6C' }
+    instructions {
+      vendor_syntax { mnemonic: 'LODS' operands { name: 'm16' }}
+      encoding_scheme: 'NP' raw_encoding_specification: 'AD' }
+    instructions {
+      vendor_syntax { mnemonic: 'MOVS' operands { name: 'm32' }
+                      operands { name: 'm32' }}
+      encoding_scheme: 'NP' raw_encoding_specification: 'A5' }
+    instructions {
+      vendor_syntax { mnemonic: 'OUTS' operands { name: 'DX' }
+                      operands { name: 'm8' }}
+      encoding_scheme: 'NP' raw_encoding_specification: '6E' }
+    instructions {
+      vendor_syntax { mnemonic: 'STOS' operands { name: 'm64' }}
+      encoding_scheme: 'NP' raw_encoding_specification: 'REX.W + AB' }
+    instructions {
+      vendor_syntax { mnemonic: 'VADDPD'
+                      operands { name: 'xmm1' tags { name: 'k1' }
+                                 tags { name: 'z' } usage: USAGE_WRITE }
+                      operands { name: 'xmm2' usage: USAGE_READ }
+                      operands { name: 'xmm3/m128/m64bcst'
+                                 usage: USAGE_READ }}
+      feature_name: 'AVX512VL AVX512F' encoding_scheme: 'FV'
+      raw_encoding_specification: 'EVEX.NDS.128.66.0F.W1 58 /r' }
+    instructions {
+      vendor_syntax { mnemonic: 'VMOVD' operands { name: 'xmm1' }
+                      operands { name: 'r32/m32' }}
+      feature_name: 'AVX' encoding_scheme: 'RM'
+      raw_encoding_specification: 'VEX.128.66.0F.W0 6E' }
+    instructions {
+      vendor_syntax { mnemonic: 'VMOVQ' operands { name: 'xmm1' }
+                      operands { name: 'xmm2' }}
+      feature_name: 'AVX' encoding_scheme: 'RM'
+      raw_encoding_specification: 'VEX.128.F3.0F.WIG 7E /r' }
+    instructions {
+      vendor_syntax { mnemonic: 'XBEGIN' operands { name: 'rel32' }}
+      feature_name: 'RTM' encoding_scheme: 'A'
+      raw_encoding_specification: 'C7 F8' })";
+
+InstructionSetProto RunDefaultPipeline(int num_threads, bool fuse_transforms) {
+  ::gflags::FlagSaver flag_saver;
+  FLAGS_cpu_instructions_transform_num_threads = num_threads;
+  FLAGS_cpu_instructions_fuse_per_instruction_transforms = fuse_transforms;
+  InstructionSetProto instruction_set;
+  CHECK(TextFormat::ParseFromString(kInstructionSetProto, &instruction_set));
+  const Status status =
+      RunTransformPipeline(GetDefaultTransformPipeline(), &instruction_set);
+  EXPECT_TRUE(status.ok()) << status;
+  return instruction_set;
+}
+
+TEST(DefaultTransformPipelineTest, ParallelPipelineMatchesSerial) {
+  const InstructionSetProto serial = RunDefaultPipeline(1, false);
+  EXPECT_GT(serial.instructions_size(), 0);
+  for (const int num_threads : {2, 8}) {
+    EXPECT_THAT(RunDefaultPipeline(num_threads, false), EqualsProto(serial))
+        << "num_threads = " << num_threads;
+  }
+}
+
+TEST(DefaultTransformPipelineTest, FusedPipelineMatchesUnfused) {
+  const InstructionSetProto unfused = RunDefaultPipeline(1, false);
+  for (const int num_threads : {1, 8}) {
+    EXPECT_THAT(RunDefaultPipeline(num_threads, true), EqualsProto(unfused))
+        << "num_threads = " << num_threads;
+  }
+}
+
+}  // namespace
+}  // namespace x86
+}  // namespace cpu_instructions
@@ -0,0 +1,104 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks the default pipeline of x86 cleanup transforms, with and without
+// the fusion of per-instruction transforms.
+
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "cpu_instructions/base/cleanup_instruction_set.h"
+#include "cpu_instructions/proto/instructions.pb.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "strings/str_cat.h"
+#include "util/task/status.h"
+
+DEFINE_string(cpu_instructions_transform_benchmark_instructions, "",
+              "An InstructionSetProto in text format, as produced by the SDM "
+              "parser, on which the default pipeline is run.");
+DEFINE_int32(cpu_instructions_transform_benchmark_copies, 100,
+             "The number of copies of the instructions from "
+             "--cpu_instructions_transform_benchmark_instructions, so that "
+             "the benchmark runs on an instruction set of a realistic size. "
+             "The copies are made distinct so that RemoveDuplicateInstructions "
+             "does not remove them.");
+
+DECLARE_bool(cpu_instructions_fuse_per_instruction_transforms);
+DECLARE_bool(cpu_instructions_print_transform_names_to_log);
+
+namespace cpu_instructions {
+namespace x86 {
+namespace {
+
+const InstructionSetProto& GetInstructionSet() {
+  static const InstructionSetProto* const instruction_set = []() {
+    CHECK(!FLAGS_cpu_instructions_transform_benchmark_instructions.empty())
+        << "missing --cpu_instructions_transform_benchmark_instructions";
+    const auto instructions = ReadTextProtoOrDie<InstructionSetProto>(
+        FLAGS_cpu_instructions_transform_benchmark_instructions);
+    CHECK_GT(instructions.instructions_size(), 0);
+    auto* const result = new InstructionSetProto();
+    for (int copy = 0; copy < FLAGS_cpu_instructions_transform_benchmark_copies;
+         ++copy) {
+      for (const InstructionProto& instruction : instructions.instructions()) {
+        InstructionProto* const instruction_copy = result->add_instructions();
+        *instruction_copy = instruction;
+        // None of the transforms uses the group id, so changing it keeps the
+        // copies distinct without changing what the transforms do with them.
+        if (copy > 0) {
+          StrAppend(instruction_copy->mutable_group_id(), " (copy ", copy, ")");
+        }
+      }
+    }
+    return result;
+  }();
+  return *instruction_set;
+}
+
+// Runs the default pipeline; state.range(0) is non-zero if the per-instruction
+// transforms are fused.
+void BM_DefaultTransformPipeline(benchmark::State& state) {
+  FLAGS_cpu_instructions_print_transform_names_to_log = false;
+  FLAGS_cpu_instructions_fuse_per_instruction_transforms = state.range(0) != 0;
+  const std::vector<InstructionSetTransform> pipeline =
+      GetDefaultTransformPipeline();
+  const InstructionSetProto& input = GetInstructionSet();
+  // The pipeline stops at the first failing transform; make sure that it runs
+  // to the end, so that the fused and unfused pipelines do the same work.
+  {
+    InstructionSetProto instruction_set = input;
+    CHECK_OK(RunTransformPipeline(pipeline, &instruction_set));
+  }
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    InstructionSetProto instruction_set = input;
+    state.ResumeTiming();
+    CHECK_OK(RunTransformPipeline(pipeline, &instruction_set));
+  }
+  state.SetItemsProcessed(state.iterations() * input.instructions_size());
+}
+BENCHMARK(BM_DefaultTransformPipeline)->Arg(0)->Arg(1);
+
+}  // namespace
+}  // namespace x86
+}  // namespace cpu_instructions
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -242,7 +242,11 @@ Status FixEncodingSpecificationOfXBegin(InstructionSetProto* instruction_set) {
   }
   return status;
 }
-REGISTER_INSTRUCTION_SET_TRANSFORM(FixEncodingSpecificationOfXBegin, 1000);
+REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(
+    FixEncodingSpecificationOfXBegin, 1000,
+    InstructionSetTransformAccess()
+        .Reads({"vendor_syntax.operands"})
+        .Writes({"raw_encoding_specification"}));
 
 Status FixEncodingSpecifications(InstructionSetProto* instruction_set) {
   const RE2 fix_w0_regexp("^(VEX[^ ]*\\.)0 ");
@@ -258,7 +262,9 @@ Status FixEncodingSpecifications(InstructionSetProto* instruction_set) {
   }
   return OkStatus();
 }
-REGISTER_INSTRUCTION_SET_TRANSFORM(FixEncodingSpecifications, 1000);
+REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(
+    FixEncodingSpecifications, 1000,
+    InstructionSetTransformAccess().Writes({"raw_encoding_specification"}));
 
 Status AddMissingModRmAndImmediateSpecification(
     InstructionSetProto* instruction_set) {
@@ -313,30 +319,26 @@ Status AddMissingModRmAndImmediateSpecification(
   }
   return OkStatus();
 }
-REGISTER_INSTRUCTION_SET_TRANSFORM(AddMissingModRmAndImmediateSpecification,
-                                   1000);
+REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(
+    AddMissingModRmAndImmediateSpecification, 1000,
+    InstructionSetTransformAccess().Writes({"raw_encoding_specification"}));
 
-Status ParseEncodingSpecifications(InstructionSetProto* instruction_set) {
-  CHECK(instruction_set != nullptr);
-  Status status = OkStatus();
-  for (InstructionProto& instruction :
-       *instruction_set->mutable_instructions()) {
-    const StatusOr<EncodingSpecification> encoding_specification_or_status =
-        ParseEncodingSpecification(instruction.raw_encoding_specification());
-    if (encoding_specification_or_status.ok()) {
-      *instruction.mutable_x86_encoding_specification() =
-          encoding_specification_or_status.ValueOrDie();
-    } else {
-      UpdateStatus(&status, encoding_specification_or_status.status());
-      LOG(WARNING) << "Could not parse encoding specification: "
-                   << instruction.raw_encoding_specification();
-    }
+Status ParseEncodingSpecifications(InstructionProto* instruction) {
+  CHECK(instruction != nullptr);
+  const StatusOr<EncodingSpecification> encoding_specification_or_status =
+      ParseEncodingSpecification(instruction->raw_encoding_specification());
+  if (!encoding_specification_or_status.ok()) {
+    LOG(WARNING) << "Could not parse encoding specification: "
+                 << instruction->raw_encoding_specification();
+    return encoding_specification_or_status.status();
   }
-  return status;
+  *instruction->mutable_x86_encoding_specification() =
+      encoding_specification_or_status.ValueOrDie();
+  return OkStatus();
 }
 // We must parse the encoding specifications after running all other encoding
 // specification cleanups, but before running any other transform.
-REGISTER_INSTRUCTION_SET_TRANSFORM(ParseEncodingSpecifications, 1010);
+REGISTER_PER_INSTRUCTION_TRANSFORM(ParseEncodingSpecifications, 1010);
 
 }  // namespace x86
 }  // namespace cpu_instructions
@@ -481,7 +481,8 @@ TEST(ParseEncodingSpecificationsTest, ParseErrors) {
   InstructionSetProto instruction_set;
   ASSERT_TRUE(
       TextFormat::ParseFromString(kInstructionSetProto, &instruction_set));
-  const Status status = ParseEncodingSpecifications(&instruction_set);
+  const Status status =
+      RunPerInstructionTransform(ParseEncodingSpecifications, &instruction_set);
   EXPECT_EQ(status.error_code(), INVALID_ARGUMENT);
 }
 
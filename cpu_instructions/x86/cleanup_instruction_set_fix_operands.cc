@@ -52,11 +52,22 @@ const char* kRSIIndexes[] = {"BYTE PTR [RSI]", "WORD PTR [RSI]",
 const char* kRDIIndexes[] = {"BYTE PTR [RDI]", "WORD PTR [RDI]",
                              "DWORD PTR [RDI]", "QWORD PTR [RDI]"};
 
+// Mnemonics of the string instructions whose operands are fixed below. Note
+// that we're matching only the versions with operands. These versions use the
+// mnemonics without the size suffix.
+constexpr char kCmps[] = "CMPS";
+constexpr char kIns[] = "INS";
+constexpr char kLods[] = "LODS";
+constexpr char kMovs[] = "MOVS";
+constexpr char kOuts[] = "OUTS";
+constexpr char kScas[] = "SCAS";
+constexpr char kStos[] = "STOS";
+
 }  // namespace
 
 Status FixOperandsOfCmpsAndMovs(InstructionSetProto* instruction_set) {
   CHECK(instruction_set != nullptr);
-  const std::unordered_set<string> kMnemonics = {"CMPS", "MOVS"};
+  const std::unordered_set<string> kMnemonics = {kCmps, kMovs};
   const std::unordered_set<string> kSourceOperands(std::begin(kRSIIndexes),
                                                    std::begin(kRSIIndexes));
   const std::unordered_set<string> kDestinationOperands(
@@ -66,11 +77,11 @@ Status FixOperandsOfCmpsAndMovs(InstructionSetProto* instruction_set) {
   Status status = OkStatus();
   for (InstructionProto& instruction :
        *instruction_set->mutable_instructions()) {
-    InstructionFormat* const vendor_syntax =
-        instruction.mutable_vendor_syntax();
-    if (!ContainsKey(kMnemonics, vendor_syntax->mnemonic())) {
+    if (!ContainsKey(kMnemonics, instruction.vendor_syntax().mnemonic())) {
       continue;
     }
+    InstructionFormat* const vendor_syntax =
+        instruction.mutable_vendor_syntax();
 
     if (vendor_syntax->operands_size() != 2) {
       status = InvalidArgumentError(
@@ -95,7 +106,7 @@ Status FixOperandsOfCmpsAndMovs(InstructionSetProto* instruction_set) {
     // while for CMPS LLVM only supports CMPSB BYTE PTR [RSI],BYTE PTR [RDI].
     // The following handles this.
     constexpr const char* const kIndexings[] = {"[RDI]", "[RSI]"};
-    const int dest = vendor_syntax->mnemonic() == "MOVS" ? 0 : 1;
+    const int dest = vendor_syntax->mnemonic() == kMovs ? 0 : 1;
     const int src = 1 - dest;
     vendor_syntax->mutable_operands(0)->set_name(
         StrCat(pointer_size, " PTR ", kIndexings[dest]));
@@ -109,23 +120,24 @@ Status FixOperandsOfCmpsAndMovs(InstructionSetProto* instruction_set) {
   }
   return status;
 }
-REGISTER_INSTRUCTION_SET_TRANSFORM(FixOperandsOfCmpsAndMovs, 2000);
+REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(
+    FixOperandsOfCmpsAndMovs, 2000, InstructionSetTransformAccess()
+                                        .Writes({"vendor_syntax.operands"})
+                                        .OnlyMnemonics({kCmps, kMovs}));
 
 Status FixOperandsOfInsAndOuts(InstructionSetProto* instruction_set) {
-  constexpr char kIns[] = "INS";
-  constexpr char kOuts[] = "OUTS";
   const std::unordered_map<string, string> operand_to_pointer_size(
       std::begin(kOperandToPointerSize), std::end(kOperandToPointerSize));
   Status status = OkStatus();
   for (InstructionProto& instruction :
        *instruction_set->mutable_instructions()) {
-    InstructionFormat* const vendor_syntax =
-        instruction.mutable_vendor_syntax();
-    const bool is_ins = vendor_syntax->mnemonic() == kIns;
-    const bool is_outs = vendor_syntax->mnemonic() == kOuts;
+    const bool is_ins = instruction.vendor_syntax().mnemonic() == kIns;
+    const bool is_outs = instruction.vendor_syntax().mnemonic() == kOuts;
     if (!is_ins && !is_outs) {
       continue;
     }
+    InstructionFormat* const vendor_syntax =
+        instruction.mutable_vendor_syntax();
 
     if (vendor_syntax->operands_size() != 2) {
       status = InvalidArgumentError(
@@ -167,15 +179,14 @@ Status FixOperandsOfInsAndOuts(InstructionSetProto* instruction_set) {
   }
   return status;
 }
-REGISTER_INSTRUCTION_SET_TRANSFORM(FixOperandsOfInsAndOuts, 2000);
+REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(
+    FixOperandsOfInsAndOuts, 2000, InstructionSetTransformAccess()
+                                       .Writes({"vendor_syntax.operands"})
+                                       .OnlyMnemonics({kIns, kOuts}));
 
 Status FixOperandsOfLodsScasAndStos(InstructionSetProto* instruction_set) {
-  // Note that we're matching only the versions with operands. These versions
-  // use the mnemonics without the size suffix. By matching exactly these names,
-  // we can easily avoid the operand-less versions.
-  constexpr char kLods[] = "LODS";
-  constexpr char kScas[] = "SCAS";
-  constexpr char kStos[] = "STOS";
+  // By matching exactly the mnemonics without the size suffix, we can easily
+  // avoid the operand-less versions.
   const std::unordered_map<string, string> operand_to_pointer_size(
       std::begin(kOperandToPointerSize), std::end(kOperandToPointerSize));
   const std::unordered_map<string, string> kOperandToRegister = {
@@ -183,14 +194,15 @@ Status FixOperandsOfLodsScasAndStos(InstructionSetProto* instruction_set) {
   Status status = OkStatus();
   for (InstructionProto& instruction :
        *instruction_set->mutable_instructions()) {
-    InstructionFormat* const vendor_syntax =
-        instruction.mutable_vendor_syntax();
-    const bool is_lods = vendor_syntax->mnemonic() == kLods;
-    const bool is_stos = vendor_syntax->mnemonic() == kStos;
-    const bool is_scas = vendor_syntax->mnemonic() == kScas;
+    const string& mnemonic = instruction.vendor_syntax().mnemonic();
+    const bool is_lods = mnemonic == kLods;
+    const bool is_stos = mnemonic == kStos;
+    const bool is_scas = mnemonic == kScas;
     if (!is_lods && !is_stos && !is_scas) {
       continue;
     }
+    InstructionFormat* const vendor_syntax =
+        instruction.mutable_vendor_syntax();
 
     if (vendor_syntax->operands_size() != 1) {
       status = InvalidArgumentError(
@@ -236,7 +248,11 @@ Status FixOperandsOfLodsScasAndStos(InstructionSetProto* instruction_set) {
   }
   return status;
 }
-REGISTER_INSTRUCTION_SET_TRANSFORM(FixOperandsOfLodsScasAndStos, 2000);
+REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(
+    FixOperandsOfLodsScasAndStos, 2000,
+    InstructionSetTransformAccess()
+        .Writes({"vendor_syntax.operands"})
+        .OnlyMnemonics({kLods, kScas, kStos}));
 
 Status FixOperandsOfVMovq(InstructionSetProto* instruction_set) {
   CHECK(instruction_set != nullptr);
@@ -258,7 +274,10 @@ Status FixOperandsOfVMovq(InstructionSetProto* instruction_set) {
   }
   return OkStatus();
 }
-REGISTER_INSTRUCTION_SET_TRANSFORM(FixOperandsOfVMovq, 2000);
+REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(
+    FixOperandsOfVMovq, 2000, InstructionSetTransformAccess()
+                                  .Reads({"raw_encoding_specification"})
+                                  .Writes({"vendor_syntax.operands"}));
 
 Status FixRegOperands(InstructionSetProto* instruction_set) {
   CHECK(instruction_set != nullptr);
@@ -351,7 +370,9 @@ Status RenameOperands(InstructionSetProto* instruction_set) {
   }
   return OkStatus();
 }
-REGISTER_INSTRUCTION_SET_TRANSFORM(RenameOperands, 2000);
+REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(
+    RenameOperands, 2000,
+    InstructionSetTransformAccess().Writes({"vendor_syntax.operands"}));
 
 Status RemoveImplicitST0Operand(InstructionSetProto* instruction_set) {
   CHECK(instruction_set != nullptr);
@@ -378,7 +399,10 @@ Status RemoveImplicitST0Operand(InstructionSetProto* instruction_set) {
   }
   return OkStatus();
 }
-REGISTER_INSTRUCTION_SET_TRANSFORM(RemoveImplicitST0Operand, 2000);
+REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(
+    RemoveImplicitST0Operand, 2000, InstructionSetTransformAccess()
+                                        .Reads({"raw_encoding_specification"})
+                                        .Writes({"vendor_syntax.operands"}));
 
 Status RemoveImplicitXmm0Operand(InstructionSetProto* instruction_set) {
   CHECK(instruction_set != nullptr);
@@ -396,7 +420,9 @@ Status RemoveImplicitXmm0Operand(InstructionSetProto* instruction_set) {
   }
   return OkStatus();
 }
-REGISTER_INSTRUCTION_SET_TRANSFORM(RemoveImplicitXmm0Operand, 2000);
+REGISTER_INSTRUCTION_SET_TRANSFORM_WITH_ACCESS(
+    RemoveImplicitXmm0Operand, 2000,
+    InstructionSetTransformAccess().Writes({"vendor_syntax.operands"}));
 
 }  // namespace x86
 }  // namespace cpu_instructions
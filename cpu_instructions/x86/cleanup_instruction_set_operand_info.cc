@@ -912,83 +912,89 @@ Status AssignEncodingRandomlyFromAvailableEncodings(
   return OkStatus();
 }
 
+// The lookup tables used by AddOperandInfo. They are built only once, because
+// the transform is called separately for each instruction.
+const AddressingModeMap& GetAddressingModeMap() {
+  static const AddressingModeMap* const kMap = new AddressingModeMap(
+      std::begin(kAddressingModeMap), std::end(kAddressingModeMap));
+  return *kMap;
+}
+
+const EncodingMap& GetEncodingMap() {
+  static const EncodingMap* const kMap =
+      new EncodingMap(std::begin(kEncodingMap), std::end(kEncodingMap));
+  return *kMap;
+}
+
+const ValueSizeMap& GetValueSizeMap() {
+  static const ValueSizeMap* const kMap = new ValueSizeMap(
+      std::begin(kOperandValueSizeBitsMap), std::end(kOperandValueSizeBitsMap));
+  return *kMap;
+}
+
 }  // namespace
 
-Status AddOperandInfo(InstructionSetProto* instruction_set) {
-  CHECK(instruction_set != nullptr);
-  const AddressingModeMap addressing_mode_map(std::begin(kAddressingModeMap),
-                                              std::end(kAddressingModeMap));
-  const EncodingMap encoding_map(std::begin(kEncodingMap),
-                                 std::end(kEncodingMap));
-  const ValueSizeMap value_size_map(std::begin(kOperandValueSizeBitsMap),
-                                    std::end(kOperandValueSizeBitsMap));
-  Status status = OkStatus();
-  for (InstructionProto& instruction :
-       *instruction_set->mutable_instructions()) {
-    InstructionFormat* const vendor_syntax =
-        instruction.mutable_vendor_syntax();
-    if (!instruction.has_x86_encoding_specification()) {
-      return FailedPreconditionError(
-          StrCat("Instruction does not have a parsed encoding specification: ",
-                 instruction.DebugString()));
-    }
-    InstructionOperandEncodingMultiset available_encodings =
-        GetAvailableEncodings(instruction.x86_encoding_specification());
+Status AddOperandInfo(InstructionProto* instruction) {
+  CHECK(instruction != nullptr);
+  InstructionFormat* const vendor_syntax = instruction->mutable_vendor_syntax();
+  if (!instruction->has_x86_encoding_specification()) {
+    return FailedPreconditionError(
+        StrCat("Instruction does not have a parsed encoding specification: ",
+               instruction->DebugString()));
+  }
+  InstructionOperandEncodingMultiset available_encodings =
+      GetAvailableEncodings(instruction->x86_encoding_specification());
 
-    // First assign the addressing modes and the encodings that can be
-    // determined from the operand itself.
-    std::vector<int> operands_with_no_encoding;
-    RETURN_IF_ERROR(AssignOperandPropertiesWhereUniquelyDetermined(
-        addressing_mode_map, encoding_map, value_size_map, &instruction,
-        &available_encodings, &operands_with_no_encoding));
+  // First assign the addressing modes and the encodings that can be determined
+  // from the operand itself.
+  std::vector<int> operands_with_no_encoding;
+  RETURN_IF_ERROR(AssignOperandPropertiesWhereUniquelyDetermined(
+      GetAddressingModeMap(), GetEncodingMap(), GetValueSizeMap(), instruction,
+      &available_encodings, &operands_with_no_encoding));
 
-    if (!operands_with_no_encoding.empty()) {
-      // There are some operands that were not assigned the encoding just from
-      // the name of the operand. We need to use a more sophisticated process.
-      if (operands_with_no_encoding.size() == 1 &&
-          available_encodings.size() == 1) {
-        // There is just one operand where we need to assign the encoding, and
-        // only one available encoding, so we simply match them. In theory, the
-        // following branch should catch this case, but it doesn't work
-        // correctly because some instructions of this type do not use the usual
-        // encoding_scheme conventions, but we can correctly handle them using
-        // this heuristic.
-        InstructionOperand* const operand =
-            vendor_syntax->mutable_operands(operands_with_no_encoding.front());
-        operand->set_encoding(*available_encodings.begin());
-      } else if (operands_with_no_encoding.size() <=
-                 available_encodings.size()) {
-        // We have enough available encodings to assign to the remaining
-        // operands. First try to use the encoding scheme as a guide, and if
-        // that fails, we just assign the remaining available encodings to the
-        // remaining operands randomly.
-        RETURN_IF_ERROR(AssignEncodingByEncodingScheme(
-            &instruction, operands_with_no_encoding, &available_encodings));
-        RETURN_IF_ERROR(AssignEncodingRandomlyFromAvailableEncodings(
-            &instruction, &available_encodings));
-      } else {
-        VLOG(1) << "operands_with_no_encoding:";
-        for (const int index : operands_with_no_encoding) {
-          VLOG(1) << "  " << index;
-        }
-        VLOG(1) << "available_encodings:";
-        for (const InstructionOperand::Encoding available_encoding :
-             available_encodings) {
-          VLOG(1) << "  "
-                  << InstructionOperand::Encoding_Name(available_encoding);
-        }
-        // We don't have enough available encodings to encode all the operands.
-        status = InvalidArgumentError(StrCat(
-            "There are more operands remaining than available encodings: ",
-            instruction.DebugString()));
-        LOG(ERROR) << status;
-        continue;
-      }
+  if (operands_with_no_encoding.empty()) return OkStatus();
+  // There are some operands that were not assigned the encoding just from the
+  // name of the operand. We need to use a more sophisticated process.
+  if (operands_with_no_encoding.size() == 1 &&
+      available_encodings.size() == 1) {
+    // There is just one operand where we need to assign the encoding, and only
+    // one available encoding, so we simply match them. In theory, the
+    // following branch should catch this case, but it doesn't work correctly
+    // because some instructions of this type do not use the usual
+    // encoding_scheme conventions, but we can correctly handle them using this
+    // heuristic.
+    InstructionOperand* const operand =
+        vendor_syntax->mutable_operands(operands_with_no_encoding.front());
+    operand->set_encoding(*available_encodings.begin());
+  } else if (operands_with_no_encoding.size() <= available_encodings.size()) {
+    // We have enough available encodings to assign to the remaining operands.
+    // First try to use the encoding scheme as a guide, and if that fails, we
+    // just assign the remaining available encodings to the remaining operands
+    // randomly.
+    RETURN_IF_ERROR(AssignEncodingByEncodingScheme(
+        instruction, operands_with_no_encoding, &available_encodings));
+    RETURN_IF_ERROR(AssignEncodingRandomlyFromAvailableEncodings(
+        instruction, &available_encodings));
+  } else {
+    VLOG(1) << "operands_with_no_encoding:";
+    for (const int index : operands_with_no_encoding) {
+      VLOG(1) << "  " << index;
     }
+    VLOG(1) << "available_encodings:";
+    for (const InstructionOperand::Encoding available_encoding :
+         available_encodings) {
+      VLOG(1) << "  " << InstructionOperand::Encoding_Name(available_encoding);
+    }
+    // We don't have enough available encodings to encode all the operands.
+    const Status status = InvalidArgumentError(
+        StrCat("There are more operands remaining than available encodings: ",
+               instruction->DebugString()));
+    LOG(ERROR) << status;
+    return status;
   }
-  return status;
+  return OkStatus();
 }
-REGISTER_INSTRUCTION_SET_TRANSFORM(AddOperandInfo, 4000);
+REGISTER_PER_INSTRUCTION_TRANSFORM(AddOperandInfo, 4000);
 
 Status AddMissingOperandUsage(InstructionSetProto* instruction_set) {
   CHECK(instruction_set != nullptr);
@@ -32,8 +32,9 @@ using ::cpu_instructions::util::Status;
 // function replaces any existing operand information in the vendor syntax so
 // that the i-th operand structure corresponds to the i-th operand of the
 // instruction in the vendor syntax specification.
-// Note that this instruction depends on the output of RenameOperands.
-Status AddOperandInfo(InstructionSetProto* instruction_set);
+// Note that this instruction depends on the output of RenameOperands. This is a
+// per-instruction transform.
+Status AddOperandInfo(InstructionProto* instruction);
 
 // Applies heuristics to determine the usage patterns of operands with unknown
 // usage patterns. For example, VEX.vvvv are implicitly read from except when
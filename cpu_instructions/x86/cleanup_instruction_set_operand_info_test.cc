@@ -141,7 +141,8 @@ TEST(AddOperandInfoTest, DetectsInconsistentEncodings) {
     InstructionSetProto instruction_set;
     ASSERT_TRUE(::google::protobuf::TextFormat::ParseFromString(
         instruction_set_proto, &instruction_set));
-    const Status transform_status = AddOperandInfo(&instruction_set);
+    const Status transform_status =
+        RunPerInstructionTransform(AddOperandInfo, &instruction_set);
     EXPECT_EQ(transform_status.error_code(), INVALID_ARGUMENT);
   }
 }
@@ -38,22 +38,21 @@ const std::unordered_map<string, string>& GetMissingCpuFlags() {
 
 }  // namespace
 
-Status AddMissingCpuFlags(InstructionSetProto* instruction_set) {
-  CHECK(instruction_set != nullptr);
-  for (auto& instruction : *instruction_set->mutable_instructions()) {
-    const string* const feature_name = FindOrNull(
-        GetMissingCpuFlags(), instruction.vendor_syntax().mnemonic());
-    if (feature_name) {
-      // Be warned if they fix it someday. If this triggers, just remove the
-      // rule.
-      CHECK_NE(*feature_name, instruction.feature_name())
-          << instruction.vendor_syntax().mnemonic();
-      instruction.set_feature_name(*feature_name);
-    }
+Status AddMissingCpuFlags(InstructionProto* instruction) {
+  CHECK(instruction != nullptr);
+  const string* const feature_name =
+      FindOrNull(GetMissingCpuFlags(), instruction->vendor_syntax().mnemonic());
+  if (feature_name) {
+    // Be warned if they fix it someday. If this triggers, just remove the rule.
+    CHECK_NE(*feature_name, instruction->feature_name())
+        << instruction->vendor_syntax().mnemonic();
+    instruction->set_feature_name(*feature_name);
   }
   return OkStatus();
 }
-REGISTER_INSTRUCTION_SET_TRANSFORM(AddMissingCpuFlags, 1000);
+REGISTER_PER_INSTRUCTION_TRANSFORM_WITH_ACCESS(
+    AddMissingCpuFlags, 1000,
+    InstructionSetTransformAccess().Writes({"feature_name"}));
 
 namespace {
 
@@ -114,18 +113,18 @@ const std::unordered_map<string, int>& GetProtectionModes() {
 
 }  // namespace
 
-Status AddProtectionModes(InstructionSetProto* instruction_set) {
-  CHECK(instruction_set != nullptr);
-  for (auto& instruction : *instruction_set->mutable_instructions()) {
-    const int* mode = FindOrNull(GetProtectionModes(),
-                                 instruction.vendor_syntax().mnemonic());
-    if (mode) {
-      instruction.set_protection_mode(*mode);
-    }
+Status AddProtectionModes(InstructionProto* instruction) {
+  CHECK(instruction != nullptr);
+  const int* mode =
+      FindOrNull(GetProtectionModes(), instruction->vendor_syntax().mnemonic());
+  if (mode) {
+    instruction->set_protection_mode(*mode);
   }
   return OkStatus();
 }
-REGISTER_INSTRUCTION_SET_TRANSFORM(AddProtectionModes, 1000);
+REGISTER_PER_INSTRUCTION_TRANSFORM_WITH_ACCESS(
+    AddProtectionModes, 1000,
+    InstructionSetTransformAccess().Writes({"protection_mode"}));
 
 }  // namespace x86
 }  // namespace cpu_instructions
@@ -27,13 +27,14 @@ namespace x86 {
 using ::cpu_instructions::util::Status;
 
 // Adds the missing feature flags for some cases where they are missing in the
-// SDM.
-Status AddMissingCpuFlags(InstructionSetProto* instruction_set);
+// SDM. This is a per-instruction transform.
+Status AddMissingCpuFlags(InstructionProto* instruction);
 
 // Adds the minimum required protection mode for instructions that require it.
 // TODO(courbet): Ideally this would be parsed from the SDM, but the information
 // is not stored in a consistent format (and sometimes not at given all).
-Status AddProtectionModes(InstructionSetProto* instruction_set);
+// This is a per-instruction transform.
+Status AddProtectionModes(InstructionProto* instruction);
 
 }  // namespace x86
 }  // namespace cpu_instructions
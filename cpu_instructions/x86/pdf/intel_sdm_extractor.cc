@@ -16,16 +16,23 @@
 
 #include <algorithm>
 #include <map>
+#include <memory>
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
+#include "cpu_instructions/util/fingerprint.h"
 #include "cpu_instructions/util/pdf/pdf_document_utils.h"
+#include "cpu_instructions/util/proto_fingerprint.h"
+#include "cpu_instructions/util/stage_profiler.h"
+#include "cpu_instructions/util/thread_pool.h"
 #include "cpu_instructions/x86/pdf/vendor_syntax.h"
+#include "gflags/gflags.h"
 #include "glog/logging.h"
 #include "re2/re2.h"
+#include "re2/set.h"
 #include "strings/case.h"
 #include "strings/str_cat.h"
 #include "strings/str_join.h"
@@ -36,6 +43,11 @@
 #include "util/gtl/map_util.h"
 #include "util/gtl/ptr_util.h"
 
+DEFINE_int32(cpu_instructions_sdm_num_threads, 1,
+             "The number of threads extracting the instruction sections of an "
+             "SDM. Sections are independent and their results are merged in "
+             "section order, so the output does not depend on this value.");
+
 namespace cpu_instructions {
 namespace x86 {
 namespace pdf {
@@ -43,7 +55,9 @@ namespace pdf {
 namespace {
 
 using cpu_instructions::pdf::PdfDocument;
+using cpu_instructions::pdf::PdfOutlineEntry;
 using cpu_instructions::pdf::PdfPage;
+using cpu_instructions::pdf::PdfPageRange;
 using cpu_instructions::pdf::PdfTextTableRow;
 using cpu_instructions::pdf::PdfTextBlock;
 
@@ -52,36 +66,66 @@ using re2::StringPiece;
 // The top/bottom page margin, in pixels.
 constexpr const float kPageMargin = 50.0f;
 
+// An ordered list of values with the regexp that matches their text. All the
+// regexps are compiled into a single anchored RE2::Set, so that a text is
+// matched against all of them in one pass instead of one RE2::FullMatch per
+// regexp.
+template <typename ValueType>
+class MatcherTable {
+ public:
+  using Matcher = std::pair<ValueType, const RE2*>;
+
+  // The value type of the container must be std::pair<value, matcher> or other
+  // type that behaves the same way. Note that the following two containers
+  // satisfy the requirements: std::map<ValueType, RE2*> and
+  // std::vector<std::pair<ValueType, RE2*>>. The matchers keep the order of the
+  // container.
+  template <typename Container>
+  explicit MatcherTable(const Container& matchers)
+      : set_(RE2::Options(), RE2::ANCHOR_BOTH) {
+    for (const auto& pair : matchers) {
+      string error;
+      CHECK_EQ(set_.Add(pair.second->pattern(), &error), matchers_.size())
+          << error;
+      matchers_.emplace_back(pair.first, pair.second);
+    }
+    CHECK(set_.Compile()) << "Could not compile the matchers";
+  }
+
+  // Returns the first matcher whose regexp fully matches 'text', or nullptr if
+  // there is none.
+  const Matcher* FindFirstMatch(const string& text) const {
+    std::vector<int> matches;
+    if (!set_.Match(text, &matches)) return nullptr;
+    return &matchers_[*std::min_element(matches.begin(), matches.end())];
+  }
+
+ private:
+  std::vector<Matcher> matchers_;
+  RE2::Set set_;
+};
+
 // Returns the value associated to the first matching regexp. If there is a
 // match, the function returns the first matching RE2 object from 'matchers';
 // otherwise, it returns nullptr.
-//
-// The value type of the container must be std::pair<value, matcher> or other
-// type that behaves the same way. Note that the following two containers
-// satisfy the requirements: std::map<ValueType, RE2*> and
-// std::vector<std::pair<ValueType, RE2*>>.
-template <typename ValueType, typename Container>
-const RE2* TryParse(const Container& matchers, const string& text,
+template <typename ValueType>
+const RE2* TryParse(const MatcherTable<ValueType>& matchers, const string& text,
                     ValueType* output) {
   CHECK(output != nullptr) << "must not be nullptr";
-  for (const auto& pair : matchers) {
-    if (RE2::FullMatch(text, *pair.second)) {
-      *output = pair.first;
-      return pair.second;
-    }
-  }
-  return nullptr;
+  const auto* const match = matchers.FindFirstMatch(text);
+  if (match == nullptr) return nullptr;
+  *output = match->first;
+  return match->second;
 }
 
-// Returns the value associated to the first matching regexp in the map or the
-// provided default value.
-template <typename ValueType, typename Container>
-ValueType ParseWithDefault(const Container& matchers, const string& text,
+// Returns the value associated to the first matching regexp in the table or
+// the provided default value.
+template <typename ValueType>
+ValueType ParseWithDefault(const MatcherTable<ValueType>& matchers,
+                           const string& text,
                            const ValueType& default_value) {
-  for (const auto& pair : matchers) {
-    if (RE2::FullMatch(text, *pair.second)) return pair.first;
-  }
-  return default_value;
+  const auto* const match = matchers.FindFirstMatch(text);
+  return match == nullptr ? default_value : match->first;
 }
 
 typedef std::vector<const PdfPage*> Pages;
@@ -160,78 +204,83 @@ string GetSubSectionTitle(const PdfTextTableRow& row) {
   return text;
 }
 
-const std::map<SubSection::Type, const RE2*>& GetSubSectionMatchers() {
-  static const auto* kSubSection = new std::map<SubSection::Type, const RE2*>{
-      {SubSection::CPP_COMPILER_INTRISIC,
-       new RE2(".*C/C\\+\\+ Compiler Intrinsic Equivalent.*")},
-      {SubSection::DESCRIPTION, new RE2("Description")},
-      {SubSection::EFFECTIVE_OPERAND_SIZE, new RE2("Effective Operand Size")},
-      {SubSection::EXCEPTIONS, new RE2("Exceptions \\(All .*")},
-      {SubSection::EXCEPTIONS_64BITS_MODE,
-       new RE2("64-[Bb]it Mode Exceptions")},
-      {SubSection::EXCEPTIONS_COMPATIBILITY_MODE,
-       new RE2("Compatibility Mode Exceptions")},
-      {SubSection::EXCEPTIONS_FLOATING_POINT,
-       new RE2("Floating-Point Exceptions")},
-      {SubSection::EXCEPTIONS_NUMERIC, new RE2("Numeric Exceptions")},
-      {SubSection::EXCEPTIONS_OTHER, new RE2("Other Exceptions")},
-      {SubSection::EXCEPTIONS_PROTECTED_MODE,
-       new RE2("Protected Mode Exceptions")},
-      {SubSection::EXCEPTIONS_REAL_ADDRESS_MODE,
-       new RE2("Real[- ]Address Mode Exceptions")},
-      {SubSection::EXCEPTIONS_VIRTUAL_8086_MODE,
-       new RE2("Virtual[- ]8086 Mode Exceptions")},
-      {SubSection::FLAGS_AFFECTED, new RE2("A?Flags Affected")},
-      {SubSection::FLAGS_AFFECTED_FPU, new RE2("FPU Flags Affected")},
-      {SubSection::FLAGS_AFFECTED_INTEGER, new RE2("Integer Flags Affected")},
-      {SubSection::IA32_ARCHITECTURE_COMPATIBILITY,
-       new RE2("IA-32 Architecture Compatibility")},
-      {SubSection::IA32_ARCHITECTURE_LEGACY_COMPATIBILITY,
-       new RE2("IA-32 Architecture Legacy Compatibility")},
-      {SubSection::IMPLEMENTATION_NOTES, new RE2("Implementation Notes?")},
-      {SubSection::INSTRUCTION_OPERAND_ENCODING,
-       new RE2("Instruction Operand Encoding1?")},
-      {SubSection::NOTES, new RE2("Notes:")},
-      {SubSection::OPERATION, new RE2("Operation")},
-      {SubSection::OPERATION_IA32_MODE, new RE2("IA-32e Mode Operation")},
-      {SubSection::OPERATION_NON_64BITS_MODE,
-       new RE2("Non-64-Bit Mode Operation")},
-  };
+const MatcherTable<SubSection::Type>& GetSubSectionMatchers() {
+  static const auto* kSubSection = new MatcherTable<SubSection::Type>(
+      std::map<SubSection::Type, const RE2*>{
+          {SubSection::CPP_COMPILER_INTRISIC,
+           new RE2(".*C/C\\+\\+ Compiler Intrinsic Equivalent.*")},
+          {SubSection::DESCRIPTION, new RE2("Description")},
+          {SubSection::EFFECTIVE_OPERAND_SIZE,
+           new RE2("Effective Operand Size")},
+          {SubSection::EXCEPTIONS, new RE2("Exceptions \\(All .*")},
+          {SubSection::EXCEPTIONS_64BITS_MODE,
+           new RE2("64-[Bb]it Mode Exceptions")},
+          {SubSection::EXCEPTIONS_COMPATIBILITY_MODE,
+           new RE2("Compatibility Mode Exceptions")},
+          {SubSection::EXCEPTIONS_FLOATING_POINT,
+           new RE2("Floating-Point Exceptions")},
+          {SubSection::EXCEPTIONS_NUMERIC, new RE2("Numeric Exceptions")},
+          {SubSection::EXCEPTIONS_OTHER, new RE2("Other Exceptions")},
+          {SubSection::EXCEPTIONS_PROTECTED_MODE,
+           new RE2("Protected Mode Exceptions")},
+          {SubSection::EXCEPTIONS_REAL_ADDRESS_MODE,
+           new RE2("Real[- ]Address Mode Exceptions")},
+          {SubSection::EXCEPTIONS_VIRTUAL_8086_MODE,
+           new RE2("Virtual[- ]8086 Mode Exceptions")},
+          {SubSection::FLAGS_AFFECTED, new RE2("A?Flags Affected")},
+          {SubSection::FLAGS_AFFECTED_FPU, new RE2("FPU Flags Affected")},
+          {SubSection::FLAGS_AFFECTED_INTEGER,
+           new RE2("Integer Flags Affected")},
+          {SubSection::IA32_ARCHITECTURE_COMPATIBILITY,
+           new RE2("IA-32 Architecture Compatibility")},
+          {SubSection::IA32_ARCHITECTURE_LEGACY_COMPATIBILITY,
+           new RE2("IA-32 Architecture Legacy Compatibility")},
+          {SubSection::IMPLEMENTATION_NOTES, new RE2("Implementation Notes?")},
+          {SubSection::INSTRUCTION_OPERAND_ENCODING,
+           new RE2("Instruction Operand Encoding1?")},
+          {SubSection::NOTES, new RE2("Notes:")},
+          {SubSection::OPERATION, new RE2("Operation")},
+          {SubSection::OPERATION_IA32_MODE, new RE2("IA-32e Mode Operation")},
+          {SubSection::OPERATION_NON_64BITS_MODE,
+           new RE2("Non-64-Bit Mode Operation")},
+      });
   return *kSubSection;
 }
 
-const std::map<InstructionTable::Column, const RE2*>&
-GetInstructionColumnMatchers() {
+const MatcherTable<InstructionTable::Column>& GetInstructionColumnMatchers() {
   static const auto* kInstructionColumns =
-      new std::map<InstructionTable::Column, const RE2*>{
-          {InstructionTable::IT_OPCODE, new RE2(R"(Opcode\*{0,3})")},
-          {InstructionTable::IT_OPCODE_INSTRUCTION,
-           new RE2(R"(Opcode\*?/?\n?Instruction)")},
-          {InstructionTable::IT_INSTRUCTION, new RE2(R"(Instruction)")},
-          {InstructionTable::IT_MODE_SUPPORT_64_32BIT,
-           new RE2(R"(64/3\n?2\n?[- ]?\n?bit \n?Mode( \n?Support)?)")},
-          {InstructionTable::IT_MODE_SUPPORT_64BIT,
-           new RE2(R"(64-[Bb]it \n?Mode)")},
-          {InstructionTable::IT_MODE_COMPAT_LEG,
-           new RE2(R"(Compat/\n?Leg Mode\*?)")},
-          {InstructionTable::IT_FEATURE_FLAG,
-           new RE2(R"(CPUID(\ ?\n?Fea\-?\n?ture \n?Flag)?)")},
-          {InstructionTable::IT_DESCRIPTION, new RE2(R"(Description)")},
-          {InstructionTable::IT_OP_EN, new RE2(R"(Op\ ?\n?/?\ ?\n?E\n?[nN])")},
-      };
+      new MatcherTable<InstructionTable::Column>(
+          std::map<InstructionTable::Column, const RE2*>{
+              {InstructionTable::IT_OPCODE, new RE2(R"(Opcode\*{0,3})")},
+              {InstructionTable::IT_OPCODE_INSTRUCTION,
+               new RE2(R"(Opcode\*?/?\n?Instruction)")},
+              {InstructionTable::IT_INSTRUCTION, new RE2(R"(Instruction)")},
+              {InstructionTable::IT_MODE_SUPPORT_64_32BIT,
+               new RE2(R"(64/3\n?2\n?[- ]?\n?bit \n?Mode( \n?Support)?)")},
+              {InstructionTable::IT_MODE_SUPPORT_64BIT,
+               new RE2(R"(64-[Bb]it \n?Mode)")},
+              {InstructionTable::IT_MODE_COMPAT_LEG,
+               new RE2(R"(Compat/\n?Leg Mode\*?)")},
+              {InstructionTable::IT_FEATURE_FLAG,
+               new RE2(R"(CPUID(\ ?\n?Fea\-?\n?ture \n?Flag)?)")},
+              {InstructionTable::IT_DESCRIPTION, new RE2(R"(Description)")},
+              {InstructionTable::IT_OP_EN,
+               new RE2(R"(Op\ ?\n?/?\ ?\n?E\n?[nN])")},
+          });
   return *kInstructionColumns;
 }
 
-const std::map<InstructionTable::Mode, const RE2*>&
-GetInstructionModeMatchers() {
-  static const auto* kModes = new std::map<InstructionTable::Mode, const RE2*>{
-      {InstructionTable::MODE_V, new RE2(R"([Vv](?:alid)?[1-9*]*)")},
-      {InstructionTable::MODE_I, new RE2(R"(Inv\.|[Ii](?:nvalid)?[1-9*]*)")},
-      {InstructionTable::MODE_NE, new RE2(R"(NA|NE|N\. ?E1?\.[1-9*]*)")},
-      {InstructionTable::MODE_NP, new RE2(R"(NP)")},
-      {InstructionTable::MODE_NI, new RE2(R"(NI)")},
-      {InstructionTable::MODE_NS, new RE2(R"(N\.?S\.?)")},
-  };
+const MatcherTable<InstructionTable::Mode>& GetInstructionModeMatchers() {
+  static const auto* kModes = new MatcherTable<InstructionTable::Mode>(
+      std::map<InstructionTable::Mode, const RE2*>{
+          {InstructionTable::MODE_V, new RE2(R"([Vv](?:alid)?[1-9*]*)")},
+          {InstructionTable::MODE_I,
+           new RE2(R"(Inv\.|[Ii](?:nvalid)?[1-9*]*)")},
+          {InstructionTable::MODE_NE, new RE2(R"(NA|NE|N\. ?E1?\.[1-9*]*)")},
+          {InstructionTable::MODE_NP, new RE2(R"(NP)")},
+          {InstructionTable::MODE_NI, new RE2(R"(NI)")},
+          {InstructionTable::MODE_NS, new RE2(R"(N\.?S\.?)")},
+      });
   return *kModes;
 }
 
@@ -254,38 +303,43 @@ using OperandEncoding =
 using OperandEncodingMatchers =
     std::vector<std::pair<OperandEncoding::OperandEncodingSpec, RE2*>>;
 
-const OperandEncodingMatchers& GetOperandEncodingSpecMatchers() {
+const MatcherTable<OperandEncoding::OperandEncodingSpec>&
+GetOperandEncodingSpecMatchers() {
   // See unit tests for examples.
-  static const auto* kOperandEncodingSpec = new OperandEncodingMatchers{{
-      {OperandEncoding::OE_NA, new RE2("NA")},
-      {OperandEncoding::OE_VEX_SUFFIX, new RE2(R"(imm8\[7:4\])")},
-      {OperandEncoding::OE_IMMEDIATE,
-       new RE2(
-           R"((?:(?:[iI]mm(?:\/?(?:8|16|26|32|64)){1,4})(?:\[[0-9]:[0-9]\])?|Offset|Moffs|iw)(?:\s+\(([wW, rR]+)\))?)")},
-      {OperandEncoding::OE_MOD_REG, new RE2(R"(ModRM:reg\s+\(([rR, wW]+)\))")},
-      {OperandEncoding::OE_MOD_RM,
-       new RE2(
-           R"(ModRM:r/?m\s+\(([rR, wW]+)(?:ModRM:\[[0-9]+:[0-9]+\] must (?:not )?be [01]+b)?\))")},
-      {OperandEncoding::OE_VEX,
-       new RE2(R"(VEX\.(?:[1v]{4})(?:\s+\(([rR, wW]+)\))?)")},
-      {OperandEncoding::OE_EVEX_V,
-       new RE2(R"((?:EVEX\.)?(?:v{4})(?:\s+\(([rR, wW]+)\))?)")},
-      {OperandEncoding::OE_OPCODE,
-       new RE2(R"(opcode\s*\+\s*rd\s+\(([rR, wW]+)\))")},
-      {OperandEncoding::OE_IMPLICIT,
-       new RE2(R"([Ii]mplicit XMM0(?:\s+\(([rR, wW]+)\))?)")},
-      {OperandEncoding::OE_REGISTERS,
-       new RE2(
-           R"(<?[A-Z][A-Z0-9]+>?(?:/<?[A-Z][A-Z0-9]+>?)*(?:\s+\(([rR, wW]+)\))?)")},
-      {OperandEncoding::OE_REGISTERS2,
-       new RE2(R"(RDX/EDX is implied 64/32 bits \nsource)")},
-      {OperandEncoding::OE_CONSTANT, new RE2(R"([0-9])")},
-      {OperandEncoding::OE_SIB,
-       new RE2(
-           R"(SIB\.base\s+\(r\):\s+Address of pointer\nSIB\.index\(r\))")},
-      {OperandEncoding::OE_VSIB,
-       new RE2(R"(BaseReg \(R\): VSIB:base,\nVectorReg\(R\): VSIB:index)")},
-  }};
+  static const auto* kOperandEncodingSpec =
+      new MatcherTable<OperandEncoding::OperandEncodingSpec>(
+          OperandEncodingMatchers{{
+              {OperandEncoding::OE_NA, new RE2("NA")},
+              {OperandEncoding::OE_VEX_SUFFIX, new RE2(R"(imm8\[7:4\])")},
+              {OperandEncoding::OE_IMMEDIATE,
+               new RE2(
+                   R"((?:(?:[iI]mm(?:\/?(?:8|16|26|32|64)){1,4})(?:\[[0-9]:[0-9]\])?|Offset|Moffs|iw)(?:\s+\(([wW, rR]+)\))?)")},
+              {OperandEncoding::OE_MOD_REG,
+               new RE2(R"(ModRM:reg\s+\(([rR, wW]+)\))")},
+              {OperandEncoding::OE_MOD_RM,
+               new RE2(
+                   R"(ModRM:r/?m\s+\(([rR, wW]+)(?:ModRM:\[[0-9]+:[0-9]+\] must (?:not )?be [01]+b)?\))")},
+              {OperandEncoding::OE_VEX,
+               new RE2(R"(VEX\.(?:[1v]{4})(?:\s+\(([rR, wW]+)\))?)")},
+              {OperandEncoding::OE_EVEX_V,
+               new RE2(R"((?:EVEX\.)?(?:v{4})(?:\s+\(([rR, wW]+)\))?)")},
+              {OperandEncoding::OE_OPCODE,
+               new RE2(R"(opcode\s*\+\s*rd\s+\(([rR, wW]+)\))")},
+              {OperandEncoding::OE_IMPLICIT,
+               new RE2(R"([Ii]mplicit XMM0(?:\s+\(([rR, wW]+)\))?)")},
+              {OperandEncoding::OE_REGISTERS,
+               new RE2(
+                   R"(<?[A-Z][A-Z0-9]+>?(?:/<?[A-Z][A-Z0-9]+>?)*(?:\s+\(([rR, wW]+)\))?)")},
+              {OperandEncoding::OE_REGISTERS2,
+               new RE2(R"(RDX/EDX is implied 64/32 bits \nsource)")},
+              {OperandEncoding::OE_CONSTANT, new RE2(R"([0-9])")},
+              {OperandEncoding::OE_SIB,
+               new RE2(
+                   R"(SIB\.base\s+\(r\):\s+Address of pointer\nSIB\.index\(r\))")},
+              {OperandEncoding::OE_VSIB,
+               new RE2(
+                   R"(BaseReg \(R\): VSIB:base,\nVectorReg\(R\): VSIB:index)")},
+          }});
   return *kOperandEncodingSpec;
 }
 
@@ -749,8 +803,92 @@ void ProcessSubSections(std::vector<SubSection> sub_sections,
   PairOperandEncodings(section);
 }
 
+// Returns the fingerprint of a section with id 'group_id' and 'sub_sections'.
+// Empty sub-sections are skipped, as they are discarded by ProcessSubSections.
+template <typename Container>
+uint64_t GetSubSectionsFingerprint(const string& group_id,
+                                   const Container& sub_sections) {
+  uint64_t fingerprint = Fingerprint(group_id);
+  for (const SubSection& sub_section : sub_sections) {
+    if (sub_section.rows().empty()) continue;
+    fingerprint = FingerprintCat(fingerprint, FingerprintProto(sub_section));
+  }
+  return fingerprint;
+}
+
+// Extracts the instruction section spanning 'pages'. The section is copied from
+// 'previous_sections' if it has the same text there.
+InstructionSection ProcessInstructionPages(
+    const string& group_id, const Pages& pages,
+    const SdmSectionIndex* previous_sections) {
+  ScopedStageTimer timer("ExtractInstructionSection");
+  timer.AddItems("pages", pages.size());
+  std::vector<SubSection> sub_sections = ExtractSubSectionRows(pages);
+  if (previous_sections != nullptr) {
+    const InstructionSection* const previous_section =
+        previous_sections->FindOrNull(
+            GetSubSectionsFingerprint(group_id, sub_sections));
+    if (previous_section != nullptr) {
+      LOG(INFO) << "Reusing unchanged section id " << group_id;
+      timer.AddItems("reused_sections", 1);
+      return *previous_section;
+    }
+  }
+  InstructionSection section;
+  LOG(INFO) << "Processing section id " << group_id << " pages "
+            << pages.front()->number() << "-" << pages.back()->number();
+  section.set_id(group_id);
+  ProcessSubSections(std::move(sub_sections), &section);
+  timer.AddItems("instructions",
+                 section.instruction_table().instructions_size());
+  return section;
+}
+
+// The pages of an instruction section.
+struct SectionPages {
+  string group_id;
+  Pages pages;
+};
+
+// The number of sections of an SDM extracted by each thread between two
+// merges, when the pages are read from a PdfDocumentReader.
+constexpr const int kSectionsPerThread = 4;
+
+// Extracts the instruction sections spanning 'sections' on
+// --cpu_instructions_sdm_num_threads threads. The extracted sections are
+// returned in the order of 'sections'.
+std::vector<InstructionSection> ProcessInstructionSections(
+    const std::vector<SectionPages>& sections,
+    const SdmSectionIndex* previous_sections) {
+  std::vector<InstructionSection> output(sections.size());
+  ParallelFor(FLAGS_cpu_instructions_sdm_num_threads, sections.size(),
+              [&sections, previous_sections, &output](size_t i) {
+                output[i] = ProcessInstructionPages(
+                    sections[i].group_id, sections[i].pages, previous_sections);
+              });
+  return output;
+}
+
 }  // namespace
 
+uint64_t GetInstructionSectionFingerprint(const InstructionSection& section) {
+  return GetSubSectionsFingerprint(section.id(), section.sub_sections());
+}
+
+SdmSectionIndex::SdmSectionIndex(SdmDocument previous)
+    : previous_(std::move(previous)) {
+  for (const InstructionSection& section : previous_.instruction_sections()) {
+    // As in ConvertPdfDocumentToSdmDocument, the last section wins.
+    sections_[GetInstructionSectionFingerprint(section)] = &section;
+    section_ids_.insert(section.id());
+  }
+}
+
+const InstructionSection* SdmSectionIndex::FindOrNull(
+    uint64_t fingerprint) const {
+  return FindWithDefault(sections_, fingerprint, nullptr);
+}
+
 OperandEncoding ParseOperandEncodingTableCell(const string& content) {
   OperandEncoding::OperandEncodingSpec spec = OperandEncoding::OE_NA;
   const RE2* const regexp =
@@ -806,6 +944,19 @@ OperandEncoding ParseOperandEncodingTableCell(const string& content) {
 
 SdmDocument ConvertPdfDocumentToSdmDocument(
     const cpu_instructions::pdf::PdfDocument& pdf) {
+  return ConvertPdfDocumentToSdmDocument(pdf, nullptr);
+}
+
+SdmDocument ConvertPdfDocumentToSdmDocument(
+    cpu_instructions::pdf::PdfDocumentReader* reader) {
+  return ConvertPdfDocumentToSdmDocument(reader, nullptr);
+}
+
+SdmDocument ConvertPdfDocumentToSdmDocument(
+    const cpu_instructions::pdf::PdfDocument& pdf,
+    const SdmSectionIndex* previous_sections) {
+  ScopedStageTimer timer("ConvertPdfDocumentToSdmDocument");
+  timer.AddItems("pages", pdf.pages_size());
   // Find all instruction pages.
   SdmDocument sdm_document;
   std::map<string, Pages> instruction_group_id_to_pages;
@@ -816,29 +967,180 @@ SdmDocument ConvertPdfDocumentToSdmDocument(
         GetInstructionsPages(pdf, i, instruction_group_id);
   }
   // Now processing instruction pages
-  for (const auto& id_pages_pair : instruction_group_id_to_pages) {
-    InstructionSection section;
-    const auto& group_id = id_pages_pair.first;
-    const auto& pages = id_pages_pair.second;
-    LOG(INFO) << "Processing section id " << group_id << " pages "
-              << pages.front()->number() << "-" << pages.back()->number();
-    section.set_id(group_id);
-    ProcessSubSections(ExtractSubSectionRows(pages), &section);
+  std::vector<SectionPages> sections;
+  sections.reserve(instruction_group_id_to_pages.size());
+  for (auto& id_pages_pair : instruction_group_id_to_pages) {
+    sections.push_back(
+        {id_pages_pair.first, std::move(id_pages_pair.second)});
+  }
+  for (InstructionSection& section :
+       ProcessInstructionSections(sections, previous_sections)) {
     section.Swap(sdm_document.add_instruction_sections());
   }
+  timer.AddItems("sections", sdm_document.instruction_sections_size());
   return sdm_document;
 }
 
+SdmDocument ConvertPdfDocumentToSdmDocument(
+    cpu_instructions::pdf::PdfDocumentReader* reader,
+    const SdmSectionIndex* previous_sections) {
+  CHECK(reader != nullptr);
+  ScopedStageTimer timer("ConvertPdfDocumentToSdmDocument");
+  // An instruction spans the pages following its first page whose footer is
+  // the instruction name. All the instructions whose pages are being read share
+  // the same normalized name, so only the pages of the current run need to be
+  // kept in memory. See GetInstructionsPages. The sections of consecutive
+  // runs are extracted in batches, so that there is enough work for all the
+  // threads while the number of pages in memory stays bounded.
+  struct OpenSection {
+    string group_id;
+    size_t first_page_index;
+  };
+  std::vector<OpenSection> open_sections;
+  std::vector<std::unique_ptr<PdfPage>> run_pages;
+  const size_t max_batch_size =
+      std::max(1, FLAGS_cpu_instructions_sdm_num_threads * kSectionsPerThread);
+  std::vector<SectionPages> batch;
+  std::vector<std::unique_ptr<PdfPage>> batch_pages;
+  std::map<string, InstructionSection> sections;
+  const auto process_batch = [&batch, &batch_pages, &sections,
+                              previous_sections]() {
+    std::vector<InstructionSection> batch_sections =
+        ProcessInstructionSections(batch, previous_sections);
+    for (size_t i = 0; i < batch.size(); ++i) {
+      // As in ConvertPdfDocumentToSdmDocument(const PdfDocument&), the last
+      // section with a given id wins.
+      sections[batch[i].group_id] = std::move(batch_sections[i]);
+    }
+    batch.clear();
+    batch_pages.clear();
+  };
+  const auto close_run = [&open_sections, &run_pages, max_batch_size, &batch,
+                          &batch_pages, &process_batch]() {
+    for (const OpenSection& open_section : open_sections) {
+      Pages pages;
+      for (size_t i = open_section.first_page_index; i < run_pages.size();
+           ++i) {
+        pages.push_back(run_pages[i].get());
+      }
+      batch.push_back({open_section.group_id, std::move(pages)});
+    }
+    open_sections.clear();
+    for (auto& page : run_pages) batch_pages.push_back(std::move(page));
+    run_pages.clear();
+    if (batch.size() >= max_batch_size) process_batch();
+  };
+  auto page = gtl::MakeUnique<PdfPage>();
+  while (reader->ReadNextPage(page.get())) {
+    timer.AddItems("pages", 1);
+    if (!open_sections.empty() &&
+        !IsPageInstruction(*page, open_sections.front().group_id)) {
+      close_run();
+    }
+    string instruction_group_id = GetInstructionGroupId(*page);
+    if (!instruction_group_id.empty()) {
+      open_sections.push_back({std::move(instruction_group_id),
+                               run_pages.size()});
+    }
+    if (!open_sections.empty()) {
+      run_pages.push_back(std::move(page));
+      page = gtl::MakeUnique<PdfPage>();
+    }
+  }
+  close_run();
+  process_batch();
+
+  SdmDocument sdm_document;
+  for (auto& id_section_pair : sections) {
+    id_section_pair.second.Swap(sdm_document.add_instruction_sections());
+  }
+  timer.AddItems("sections", sdm_document.instruction_sections_size());
+  return sdm_document;
+}
+
+SdmSectionChanges GetSdmSectionChanges(
+    const SdmDocument& sdm_document, const SdmSectionIndex& previous_sections) {
+  SdmSectionChanges changes;
+  std::set<string> section_ids;
+  for (const InstructionSection& section :
+       sdm_document.instruction_sections()) {
+    section_ids.insert(section.id());
+    if (!ContainsKey(previous_sections.section_ids(), section.id())) {
+      changes.add_added_section_ids(section.id());
+    } else if (previous_sections.FindOrNull(
+                   GetInstructionSectionFingerprint(section)) == nullptr) {
+      changes.add_modified_section_ids(section.id());
+    } else {
+      changes.add_unchanged_section_ids(section.id());
+    }
+  }
+  for (const string& id : previous_sections.section_ids()) {
+    if (!ContainsKey(section_ids, id)) changes.add_removed_section_ids(id);
+  }
+  return changes;
+}
+
+std::vector<PdfPageRange> GetInstructionSetReferencePageRanges(
+    const std::vector<PdfOutlineEntry>& outline) {
+  string instruction_set_ref = kInstructionSetRef;
+  LowerString(&instruction_set_ref);
+  std::vector<PdfPageRange> ranges;
+  for (size_t i = 0; i < outline.size(); ++i) {
+    const PdfOutlineEntry& entry = outline[i];
+    if (entry.page_number() <= 0) continue;
+    string title = entry.title();
+    LowerString(&title);
+    if (title.find(instruction_set_ref) == string::npos) continue;
+    PdfPageRange range;
+    range.set_first_page(entry.page_number());
+    // 0 means that the chapter extends to the last page of the document.
+    for (size_t j = i + 1; j < outline.size(); ++j) {
+      const PdfOutlineEntry& next = outline[j];
+      if (next.level() > entry.level() || next.page_number() <= 0) continue;
+      range.set_last_page(
+          std::max(entry.page_number(), next.page_number() - 1));
+      break;
+    }
+    ranges.push_back(range);
+  }
+  return ranges;
+}
+
 InstructionSetProto ProcessIntelSdmDocument(const SdmDocument& sdm_document) {
+  // The instructions of each section are copied to a contiguous range of
+  // instruction_set.instructions() that is allocated upfront, so that the
+  // sections can be copied in parallel and the output does not depend on the
+  // number of threads.
+  ScopedStageTimer timer("ProcessIntelSdmDocument");
   InstructionSetProto instruction_set;
-  for (const auto& section : sdm_document.instruction_sections()) {
-    for (const auto& instruction : section.instruction_table().instructions()) {
-      InstructionProto* const new_instruction =
-          instruction_set.add_instructions();
-      *new_instruction = instruction;
-      new_instruction->set_group_id(section.id());
-    }
+  const int num_sections = sdm_document.instruction_sections_size();
+  std::vector<int> first_instruction_index(num_sections);
+  int num_instructions = 0;
+  for (int i = 0; i < num_sections; ++i) {
+    first_instruction_index[i] = num_instructions;
+    num_instructions += sdm_document.instruction_sections(i)
+                            .instruction_table()
+                            .instructions_size();
   }
+  auto* const instructions = instruction_set.mutable_instructions();
+  instructions->Reserve(num_instructions);
+  for (int i = 0; i < num_instructions; ++i) instructions->Add();
+  ParallelFor(
+      FLAGS_cpu_instructions_sdm_num_threads, num_sections,
+      [&sdm_document, &first_instruction_index, instructions](size_t i) {
+        const InstructionSection& section =
+            sdm_document.instruction_sections(i);
+        int index = first_instruction_index[i];
+        for (const auto& instruction :
+             section.instruction_table().instructions()) {
+          InstructionProto* const new_instruction =
+              instructions->Mutable(index++);
+          *new_instruction = instruction;
+          new_instruction->set_group_id(section.id());
+        }
+      });
+  timer.AddItems("sections", num_sections);
+  timer.AddItems("instructions", num_instructions);
   return instruction_set;
 }
 
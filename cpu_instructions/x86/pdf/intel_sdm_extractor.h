@@ -15,21 +15,84 @@
 #ifndef CPU_INSTRUCTIONS_X86_PDF_INTEL_SDM_EXTRACTOR_H_
 #define CPU_INSTRUCTIONS_X86_PDF_INTEL_SDM_EXTRACTOR_H_
 
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <vector>
 #include "strings/string.h"
 
 #include "cpu_instructions/proto/instructions.pb.h"
 #include "cpu_instructions/proto/pdf/pdf_document.pb.h"
 #include "cpu_instructions/proto/pdf/x86/intel_sdm.pb.h"
+#include "cpu_instructions/util/pdf/pdf_document_stream.h"
 
 namespace cpu_instructions {
 namespace x86 {
 namespace pdf {
 
+// Returns a fingerprint of the id of 'section' and of the text of its
+// sub-sections, i.e. of everything its instructions are extracted from.
+uint64_t GetInstructionSectionFingerprint(const InstructionSection& section);
+
+// The instruction sections of a previous extraction of the SDM, e.g. of the
+// previous edition, indexed by fingerprint. The fingerprints only cover the
+// text of the sections, so the previous extraction must have been done by the
+// same version of the extractor.
+class SdmSectionIndex {
+ public:
+  explicit SdmSectionIndex(SdmDocument previous);
+
+  SdmSectionIndex(const SdmSectionIndex&) = delete;
+  SdmSectionIndex& operator=(const SdmSectionIndex&) = delete;
+
+  // Returns the previous section with the given fingerprint (see
+  // GetInstructionSectionFingerprint), or nullptr if there is none.
+  const InstructionSection* FindOrNull(uint64_t fingerprint) const;
+
+  // The ids of all the previous sections.
+  const std::set<string>& section_ids() const { return section_ids_; }
+
+ private:
+  const SdmDocument previous_;
+  std::unordered_map<uint64_t, const InstructionSection*> sections_;
+  std::set<string> section_ids_;
+};
+
+// Extracts the instruction sections of an SDM. The sections are independent
+// and are extracted on --cpu_instructions_sdm_num_threads threads.
 SdmDocument ConvertPdfDocumentToSdmDocument(
     const cpu_instructions::pdf::PdfDocument& document);
 
+// Same as above, but reads the pages one at a time from 'reader'. Only the
+// pages of the instruction being extracted are kept in memory.
+SdmDocument ConvertPdfDocumentToSdmDocument(
+    cpu_instructions::pdf::PdfDocumentReader* reader);
+
+// Same as above, but the sections whose text is the same as in
+// 'previous_sections' are copied from there instead of being interpreted
+// again. 'previous_sections' can be nullptr.
+SdmDocument ConvertPdfDocumentToSdmDocument(
+    const cpu_instructions::pdf::PdfDocument& document,
+    const SdmSectionIndex* previous_sections);
+SdmDocument ConvertPdfDocumentToSdmDocument(
+    cpu_instructions::pdf::PdfDocumentReader* reader,
+    const SdmSectionIndex* previous_sections);
+
+// Returns the sections of 'sdm_document' that were added, modified or left
+// unchanged, and the sections of 'previous_sections' that were removed.
+SdmSectionChanges GetSdmSectionChanges(
+    const SdmDocument& sdm_document, const SdmSectionIndex& previous_sections);
+
 InstructionSetProto ProcessIntelSdmDocument(const SdmDocument& sdm_document);
 
+// Returns the page ranges of the "Instruction Set Reference" chapters of an SDM
+// given its outline, so that only these pages need to be parsed. A chapter ends
+// before the next outline entry of the same or a higher level. Returns an empty
+// vector if there is no such chapter, e.g. when the document has no outline.
+std::vector<cpu_instructions::pdf::PdfPageRange>
+GetInstructionSetReferencePageRanges(
+    const std::vector<cpu_instructions::pdf::PdfOutlineEntry>& outline);
+
 // Parses the contents of an operand encoding cell.
 InstructionTable::OperandEncodingCrossref::OperandEncoding
 ParseOperandEncodingTableCell(const string& content);
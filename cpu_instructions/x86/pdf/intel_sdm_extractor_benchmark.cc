@@ -0,0 +1,70 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks the conversion of a PdfDocument to an SdmDocument.
+
+#include "benchmark/benchmark.h"
+#include "cpu_instructions/proto/pdf/pdf_document.pb.h"
+#include "cpu_instructions/util/pdf/pdf_document_parser.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "cpu_instructions/x86/pdf/intel_sdm_extractor.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_string(cpu_instructions_sdm_benchmark_document, "",
+              "A PdfDocument in text format from which the benchmarks "
+              "extract instructions. Its pages are clustered once.");
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+namespace {
+
+using cpu_instructions::pdf::PdfDocument;
+using cpu_instructions::pdf::PdfPage;
+
+const PdfDocument& GetDocument() {
+  static const PdfDocument* const document = []() {
+    CHECK(!FLAGS_cpu_instructions_sdm_benchmark_document.empty())
+        << "missing --cpu_instructions_sdm_benchmark_document";
+    auto* const result = new PdfDocument(ReadTextProtoOrDie<PdfDocument>(
+        FLAGS_cpu_instructions_sdm_benchmark_document));
+    for (PdfPage& page : *result->mutable_pages()) {
+      cpu_instructions::pdf::Cluster(&page);
+    }
+    return result;
+  }();
+  return *document;
+}
+
+void BM_ConvertPdfDocumentToSdmDocument(benchmark::State& state) {
+  const PdfDocument& document = GetDocument();
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(ConvertPdfDocumentToSdmDocument(document));
+  }
+  state.SetItemsProcessed(state.iterations() * document.pages_size());
+}
+BENCHMARK(BM_ConvertPdfDocumentToSdmDocument);
+
+}  // namespace
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
@@ -17,17 +17,22 @@
 #include "cpu_instructions/testing/test_util.h"
 #include "cpu_instructions/util/pdf/pdf_document_parser.h"
 #include "cpu_instructions/util/proto_util.h"
+#include "gflags/gflags.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "strings/str_cat.h"
 
+DECLARE_int32(cpu_instructions_sdm_num_threads);
+
 namespace cpu_instructions {
 namespace x86 {
 namespace pdf {
 namespace {
 
 using cpu_instructions::pdf::PdfDocument;
+using cpu_instructions::pdf::PdfOutlineEntry;
 using cpu_instructions::testing::EqualsProto;
+using ::testing::ElementsAre;
 
 const char kTestDataPath[] = "/__main__/cpu_instructions/x86/pdf/testdata/";
 
@@ -54,6 +59,137 @@ TEST(IntelSdmExtractorTest, BitSetPage) {
                                    "253666_p170_p171_instructionset")));
 }
 
+TEST(IntelSdmExtractorTest, BitSetPageFromStream) {
+  PdfDocument pdf_document = GetProto<PdfDocument>("253666_p170_p171_pdfdoc");
+  for (auto& page : *pdf_document.mutable_pages()) {
+    Cluster(&page);
+  }
+  // Surrounds the instruction with pages that do not belong to any
+  // instruction.
+  PdfDocument streamed_document;
+  streamed_document.add_pages()->set_number(169);
+  streamed_document.MergeFrom(pdf_document);
+  streamed_document.add_pages()->set_number(172);
+  const string filename =
+      StrCat(getenv("TEST_TMPDIR"), "/253666_p170_p171.pdf.pb");
+  WriteBinaryProtoOrDie(filename, streamed_document);
+
+  cpu_instructions::pdf::PdfDocumentReader reader(filename);
+  EXPECT_THAT(ConvertPdfDocumentToSdmDocument(&reader),
+              EqualsProto(GetProto<SdmDocument>("253666_p170_p171_sdmdoc")));
+}
+
+TEST(IntelSdmExtractorTest, MultipleThreads) {
+  PdfDocument pdf_document = GetProto<PdfDocument>("253666_p170_p171_pdfdoc");
+  for (auto& page : *pdf_document.mutable_pages()) {
+    Cluster(&page);
+  }
+  const int old_num_threads = FLAGS_cpu_instructions_sdm_num_threads;
+  FLAGS_cpu_instructions_sdm_num_threads = 4;
+  const SdmDocument sdm_document =
+      ConvertPdfDocumentToSdmDocument(pdf_document);
+  EXPECT_THAT(sdm_document,
+              EqualsProto(GetProto<SdmDocument>("253666_p170_p171_sdmdoc")));
+
+  // Instructions are output in section order.
+  SdmDocument many_sections;
+  for (const char* const id : {"E", "A", "D", "B", "C"}) {
+    InstructionSection* const section =
+        many_sections.add_instruction_sections();
+    *section = sdm_document.instruction_sections(0);
+    section->set_id(id);
+  }
+  const InstructionSetProto parallel_instruction_set =
+      ProcessIntelSdmDocument(many_sections);
+  FLAGS_cpu_instructions_sdm_num_threads = 1;
+  EXPECT_THAT(parallel_instruction_set,
+              EqualsProto(ProcessIntelSdmDocument(many_sections)));
+  FLAGS_cpu_instructions_sdm_num_threads = old_num_threads;
+}
+
+TEST(IntelSdmExtractorTest, ReusesUnchangedSections) {
+  PdfDocument pdf_document = GetProto<PdfDocument>("253666_p170_p171_pdfdoc");
+  for (auto& page : *pdf_document.mutable_pages()) {
+    Cluster(&page);
+  }
+  const SdmDocument expected = GetProto<SdmDocument>("253666_p170_p171_sdmdoc");
+  const string id = expected.instruction_sections(0).id();
+
+  // The instructions of a section with the same text are copied, even if they
+  // differ from what the extractor would return.
+  SdmDocument previous = expected;
+  previous.mutable_instruction_sections(0)
+      ->mutable_instruction_table()
+      ->clear_instructions();
+  InstructionSection* const removed = previous.add_instruction_sections();
+  removed->set_id("REMOVED");
+  {
+    const SdmSectionIndex previous_sections(previous);
+    const SdmDocument sdm_document =
+        ConvertPdfDocumentToSdmDocument(pdf_document, &previous_sections);
+    EXPECT_EQ(sdm_document.instruction_sections(0)
+                  .instruction_table()
+                  .instructions_size(),
+              0);
+    EXPECT_THAT(GetSdmSectionChanges(sdm_document, previous_sections),
+                EqualsProto(StrCat("removed_section_ids: 'REMOVED' ",
+                                   "unchanged_section_ids: '", id, "'")));
+  }
+
+  // A section whose text changed is extracted again.
+  previous.mutable_instruction_sections(0)
+      ->mutable_sub_sections(0)
+      ->mutable_rows(0)
+      ->mutable_blocks(0)
+      ->set_text("Changed");
+  {
+    const SdmSectionIndex previous_sections(previous);
+    const SdmDocument sdm_document =
+        ConvertPdfDocumentToSdmDocument(pdf_document, &previous_sections);
+    EXPECT_THAT(sdm_document, EqualsProto(expected));
+    EXPECT_THAT(GetSdmSectionChanges(sdm_document, previous_sections),
+                EqualsProto(StrCat("modified_section_ids: '", id, "' ",
+                                   "removed_section_ids: 'REMOVED'")));
+  }
+
+  // All the sections are new.
+  const SdmSectionIndex no_sections((SdmDocument()));
+  EXPECT_THAT(
+      GetSdmSectionChanges(
+          ConvertPdfDocumentToSdmDocument(pdf_document, &no_sections),
+          no_sections),
+      EqualsProto(StrCat("added_section_ids: '", id, "'")));
+}
+
+PdfOutlineEntry MakeOutlineEntry(const string& title, int level,
+                                 int page_number) {
+  PdfOutlineEntry entry;
+  entry.set_title(title);
+  entry.set_level(level);
+  entry.set_page_number(page_number);
+  return entry;
+}
+
+TEST(IntelSdmExtractorTest, GetInstructionSetReferencePageRanges) {
+  const std::vector<PdfOutlineEntry> outline = {
+      MakeOutlineEntry("CHAPTER 1 ABOUT THIS MANUAL", 0, 5),
+      MakeOutlineEntry("CHAPTER 3 INSTRUCTION SET REFERENCE, A-L", 0, 100),
+      MakeOutlineEntry("3.1 Interpreting the Instruction Reference Pages", 1,
+                       100),
+      MakeOutlineEntry("3.2 Instructions (A-L)", 1, 110),
+      MakeOutlineEntry("Chapter 4 Instruction Set Reference, M-U", 0, 300),
+      MakeOutlineEntry("Entry without a page", 0, 0),
+      MakeOutlineEntry("CHAPTER 6 SAFER MODE EXTENSIONS REFERENCE", 0, 500),
+      MakeOutlineEntry("CHAPTER 5 INSTRUCTION SET REFERENCE, V-Z", 0, 600),
+      MakeOutlineEntry("5.1 Ternary Bit Vector Logic Table", 1, 700),
+  };
+  EXPECT_THAT(GetInstructionSetReferencePageRanges(outline),
+              ElementsAre(EqualsProto("first_page: 100 last_page: 299"),
+                          EqualsProto("first_page: 300 last_page: 499"),
+                          EqualsProto("first_page: 600")));
+  EXPECT_THAT(GetInstructionSetReferencePageRanges({}), ElementsAre());
+}
+
 TEST(IntelSdmExtractorTest, ParseOperandEncodingTableCell) {
   EXPECT_THAT(ParseOperandEncodingTableCell("NA"), EqualsProto("spec: OE_NA"));
 
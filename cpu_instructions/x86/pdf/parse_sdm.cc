@@ -19,12 +19,18 @@
 #include <fstream>
 #include <functional>
 #include <memory>
+#include <set>
+#include <vector>
 #include "strings/string.h"
 
-#include "cpu_instructions/util/pdf/pdf_document_utils.h"
+#include "cpu_instructions/util/pdf/pdf_document_stream.h"
+#include "cpu_instructions/util/pdf/pdf_patch_bundle.h"
 #include "cpu_instructions/util/pdf/xpdf_util.h"
 #include "cpu_instructions/util/proto_util.h"
+#include "cpu_instructions/util/stage_profiler.h"
+#include "cpu_instructions/util/thread_pool.h"
 #include "cpu_instructions/x86/pdf/intel_sdm_extractor.h"
+#include "gflags/gflags.h"
 #include "glog/logging.h"
 #include "re2/re2.h"
 #include "strings/str_cat.h"
@@ -32,16 +38,37 @@
 #include "util/gtl/map_util.h"
 #include "util/gtl/ptr_util.h"
 
+DEFINE_bool(cpu_instructions_sdm_use_outline, true,
+            "Whether to only parse the 'Instruction Set Reference' chapters "
+            "of the SDM, as found in the outline of the PDF file. All the "
+            "pages are parsed when the outline has no such chapter.");
+
+DEFINE_int32(cpu_instructions_sdm_num_parallel_requests, 1,
+             "The number of input files of --cpu_instructions_input_spec "
+             "that are parsed concurrently. The instructions are merged in "
+             "the order of the input files, so the output does not depend on "
+             "this value.");
+
+DEFINE_string(cpu_instructions_sdm_previous_documents, "",
+              "A comma-separated list of .sdm.pb files written by a previous "
+              "run of the parser, e.g. on the previous edition of the SDM. "
+              "The instruction sections whose text did not change since then "
+              "are copied from these files instead of being extracted again, "
+              "and the changes are written to <output_base>.changes.pbtxt. "
+              "The files must have been written by the same version of the "
+              "parser.");
+
 namespace cpu_instructions {
 namespace x86 {
 namespace pdf {
 namespace {
 
-using cpu_instructions::pdf::LoadConfigurations;
 using cpu_instructions::pdf::PdfDocument;
-using cpu_instructions::pdf::PdfDocumentsChanges;
+using cpu_instructions::pdf::PdfDocumentReader;
 using cpu_instructions::pdf::PdfPage;
+using cpu_instructions::pdf::PdfPageRange;
 using cpu_instructions::pdf::PdfParseRequest;
+using cpu_instructions::pdf::PdfPatchBundle;
 using cpu_instructions::pdf::PdfTextTableRow;
 
 constexpr const char kSourceName[] = "IntelSDMParser V2";
@@ -71,44 +98,158 @@ std::vector<PdfParseRequest> ParseRequestsOrDie(const string& input_spec) {
   return parsed_specs;
 }
 
+// Returns the sections of the files of
+// --cpu_instructions_sdm_previous_documents, or nullptr if there are none.
+std::unique_ptr<SdmSectionIndex> LoadPreviousSectionsOrDie() {
+  const std::vector<string> filenames =
+      strings::Split(FLAGS_cpu_instructions_sdm_previous_documents, ",",
+                     strings::SkipEmpty());  // NOLINT
+  if (filenames.empty()) return nullptr;
+  SdmDocument previous;
+  for (const string& filename : filenames) {
+    LOG(INFO) << "Reading previous sections from " << filename;
+    previous.MergeFrom(ReadBinaryProtoOrDie<SdmDocument>(filename));
+  }
+  return gtl::MakeUnique<SdmSectionIndex>(std::move(previous));
+}
+
+// Parses the SDM file of 'spec' and extracts its instructions. The debug protos
+// are written to <output_base>_<request_id>.{pdf,sdm}.pb, the latter on
+// 'writer_pool'. When 'previous_sections' is not nullptr, the unchanged
+// sections are copied from there and the changes are returned in 'changes'.
+InstructionSetProto ProcessRequestOrDie(
+    int request_id, PdfParseRequest spec, const PdfPatchBundle& patch_sets,
+    const SdmSectionIndex* previous_sections, const string& output_base,
+    ThreadPool* writer_pool, SdmSectionChanges* changes) {
+  if (FLAGS_cpu_instructions_sdm_use_outline) {
+    const std::vector<PdfPageRange> ranges =
+        GetInstructionSetReferencePageRanges(
+            cpu_instructions::pdf::ReadOutlineOrDie(spec.filename()));
+    if (ranges.empty()) {
+      LOG(WARNING) << "No instruction set reference in the outline of '"
+                   << spec.filename() << "', parsing all the pages";
+    }
+    for (const PdfPageRange& range : ranges) {
+      LOG(INFO) << "Instruction set reference: pages " << range.first_page()
+                << "-" << range.last_page();
+      *spec.add_page_ranges() = range;
+    }
+  }
+  const string pb_filename = StrCat(output_base, "_", request_id, ".pdf.pb");
+  // The pages are streamed to the file as they are parsed and read back one
+  // at a time so that the whole document is never held in memory.
+  LOG(INFO) << "Saving pdf as proto file : " << pb_filename;
+  const PdfDocument pdf_document =
+      ParseToFileOrDie(spec, patch_sets, pb_filename);
+
+  LOG(INFO) << "Extracting instruction set";
+  PdfDocumentReader pdf_document_reader(pb_filename);
+  const auto sdm_document = std::make_shared<const SdmDocument>(
+      ConvertPdfDocumentToSdmDocument(&pdf_document_reader, previous_sections));
+  if (previous_sections != nullptr) {
+    *changes = GetSdmSectionChanges(*sdm_document, *previous_sections);
+  }
+  // The SdmDocument is written while the instructions are extracted from it.
+  const string sdm_pb_filename =
+      StrCat(output_base, "_", request_id, ".sdm.pb");
+  LOG(INFO) << "Saving pdf as proto file : " << sdm_pb_filename;
+  writer_pool->Schedule([sdm_pb_filename, sdm_document]() {
+    WriteBinaryProtoOrDie(sdm_pb_filename, *sdm_document);
+  });
+  InstructionSetProto instruction_set = ProcessIntelSdmDocument(*sdm_document);
+  *instruction_set.add_source_infos() =
+      CreateInstructionSetSourceInfo(pdf_document.metadata());
+  return instruction_set;
+}
+
 }  // namespace
 
 InstructionSetProto ParseSdmOrDie(const string& input_spec,
                                   const string& patches_folder,
                                   const string& output_base) {
-  const PdfDocumentsChanges patch_sets = LoadConfigurations(patches_folder);
+  const std::unique_ptr<PdfPatchBundle> patch_sets =
+      PdfPatchBundle::LoadOrDie(patches_folder);
+
+  const std::unique_ptr<SdmSectionIndex> previous_sections =
+      LoadPreviousSectionsOrDie();
 
   const auto requests = ParseRequestsOrDie(input_spec);
 
+  // Writing the debug protos of a request overlaps with the remaining work on
+  // all the requests.
+  std::vector<SdmSectionChanges> changes(requests.size());
   InstructionSetProto full_instruction_set;
-  for (int request_id = 0; request_id < requests.size(); ++request_id) {
-    const PdfParseRequest& spec = requests[request_id];
-    const PdfDocument pdf_document = ParseOrDie(spec, patch_sets);
-    const string pb_filename = StrCat(output_base, "_", request_id, ".pdf.pb");
-    LOG(INFO) << "Saving pdf as proto file : " << pb_filename;
-    WriteBinaryProtoOrDie(pb_filename, pdf_document);
-
-    LOG(INFO) << "Extracting instruction set";
-    const SdmDocument sdm_document =
-        ConvertPdfDocumentToSdmDocument(pdf_document);
-    const string sdm_pb_filename =
-        StrCat(output_base, "_", request_id, ".sdm.pb");
-    LOG(INFO) << "Saving pdf as proto file : " << sdm_pb_filename;
-    WriteBinaryProtoOrDie(sdm_pb_filename, sdm_document);
-    InstructionSetProto instruction_set = ProcessIntelSdmDocument(sdm_document);
-    *instruction_set.add_source_infos() =
-        CreateInstructionSetSourceInfo(pdf_document.metadata());
-    full_instruction_set.MergeFrom(instruction_set);
+  {
+    ThreadPool writer_pool(1);
+    writer_pool.StartWorkers();
+    full_instruction_set = internal::ProcessRequestsInOrder(
+        requests.size(), [&](size_t request_id) {
+          return ProcessRequestOrDie(request_id, requests[request_id],
+                                     *patch_sets, previous_sections.get(),
+                                     output_base, &writer_pool,
+                                     &changes[request_id]);
+        });
+  }
+  if (previous_sections != nullptr) {
+    // A section is only removed if it is not in any of the input files.
+    SdmSectionChanges all_changes;
+    std::set<string> section_ids;
+    for (SdmSectionChanges& request_changes : changes) {
+      request_changes.clear_removed_section_ids();
+      for (const auto* ids : {&request_changes.added_section_ids(),
+                              &request_changes.modified_section_ids(),
+                              &request_changes.unchanged_section_ids()}) {
+        section_ids.insert(ids->begin(), ids->end());
+      }
+      all_changes.MergeFrom(request_changes);
+    }
+    for (const string& id : previous_sections->section_ids()) {
+      if (!ContainsKey(section_ids, id)) {
+        all_changes.add_removed_section_ids(id);
+      }
+    }
+    LOG(INFO) << "Sections: " << all_changes.added_section_ids_size()
+              << " added, " << all_changes.modified_section_ids_size()
+              << " modified, " << all_changes.removed_section_ids_size()
+              << " removed, " << all_changes.unchanged_section_ids_size()
+              << " unchanged";
+    const string changes_filename = StrCat(output_base, ".changes.pbtxt");
+    LOG(INFO) << "Saving section changes as: " << changes_filename;
+    WriteTextProtoOrDie(changes_filename, all_changes);
   }
-
   // Outputs the instructions.
   const string instructions_filename = StrCat(output_base, ".pbtxt");
   LOG(INFO) << "Saving instruction database as: " << instructions_filename;
-  WriteTextProtoOrDie(instructions_filename, full_instruction_set);
+  {
+    ScopedStageTimer timer("WriteTextProtoOrDie");
+    WriteTextProtoOrDie(instructions_filename, full_instruction_set);
+    timer.AddItems("instructions", full_instruction_set.instructions_size());
+  }
+
+  return full_instruction_set;
+}
 
+namespace internal {
+
+InstructionSetProto ProcessRequestsInOrder(
+    size_t num_requests,
+    const std::function<InstructionSetProto(size_t)>& process_request) {
+  // Requests are independent, and each one writes its result to its own slot
+  // so that the merge below does not depend on the order in which they finish.
+  std::vector<InstructionSetProto> instruction_sets(num_requests);
+  ParallelFor(FLAGS_cpu_instructions_sdm_num_parallel_requests, num_requests,
+              [&](size_t request_id) {
+                instruction_sets[request_id] = process_request(request_id);
+              });
+  InstructionSetProto full_instruction_set;
+  for (const InstructionSetProto& instruction_set : instruction_sets) {
+    full_instruction_set.MergeFrom(instruction_set);
+  }
   return full_instruction_set;
 }
 
+}  // namespace internal
+
 }  // namespace pdf
 }  // namespace x86
 }  // namespace cpu_instructions
@@ -15,6 +15,8 @@
 #ifndef CPU_INSTRUCTIONS_X86_PDF_PARSE_SDM_H_
 #define CPU_INSTRUCTIONS_X86_PDF_PARSE_SDM_H_
 
+#include <cstddef>
+#include <functional>
 #include "strings/string.h"
 
 #include "cpu_instructions/proto/instructions.pb.h"
@@ -29,10 +31,28 @@ namespace pdf {
 //     of the PDF (raw parsed input) and SDM (interpreted input) respectively,
 //     as <output_base>_<input_id>.{pdf,sdm}.pb
 // The files in patches_folder are applied before interpreting the SDM.
+// patches_folder can also be a bundle compiled by compile_pdf_patches.
+// Input files are parsed concurrently when
+// --cpu_instructions_sdm_num_parallel_requests is greater than 1.
+// When --cpu_instructions_sdm_previous_documents is set, only the instruction
+// sections that changed since these documents are extracted again, and the
+// changes are written to <output_base>.changes.pbtxt.
 InstructionSetProto ParseSdmOrDie(const string& input_spec,
                                   const string& patches_folder,
                                   const string& output_base);
 
+namespace internal {
+
+// Calls 'process_request' for each request id in [0, num_requests) on up to
+// --cpu_instructions_sdm_num_parallel_requests threads, and returns the merge
+// of the instruction sets it returned, in the order of the request ids.
+// Exposed for testing.
+InstructionSetProto ProcessRequestsInOrder(
+    size_t num_requests,
+    const std::function<InstructionSetProto(size_t)>& process_request);
+
+}  // namespace internal
+
 }  // namespace pdf
 }  // namespace x86
 }  // namespace cpu_instructions
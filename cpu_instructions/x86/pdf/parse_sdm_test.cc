@@ -0,0 +1,105 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cpu_instructions/x86/pdf/parse_sdm.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "strings/string.h"
+
+#include "cpu_instructions/proto/instructions.pb.h"
+#include "cpu_instructions/testing/test_util.h"
+#include "gflags/gflags.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "strings/str_cat.h"
+
+DECLARE_int32(cpu_instructions_sdm_num_parallel_requests);
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+namespace {
+
+using ::cpu_instructions::testing::EqualsProto;
+using ::testing::ElementsAre;
+
+constexpr size_t kNumRequests = 6;
+
+// Returns the instruction set extracted by the fake request 'request_id': two
+// instructions and a source info that identify the request.
+InstructionSetProto MakeRequestInstructionSet(size_t request_id) {
+  InstructionSetProto instruction_set;
+  for (const char* const suffix : {"A", "B"}) {
+    instruction_set.add_instructions()->mutable_vendor_syntax()->set_mnemonic(
+        StrCat("R", request_id, suffix));
+  }
+  instruction_set.add_source_infos()->set_source_name(
+      StrCat("request ", request_id));
+  return instruction_set;
+}
+
+TEST(ProcessRequestsInOrderTest, SingleRequest) {
+  ::gflags::FlagSaver flag_saver;
+  FLAGS_cpu_instructions_sdm_num_parallel_requests = 4;
+  EXPECT_THAT(internal::ProcessRequestsInOrder(1, MakeRequestInstructionSet),
+              EqualsProto(MakeRequestInstructionSet(0)));
+}
+
+TEST(ProcessRequestsInOrderTest, MergesInRequestOrder) {
+  ::gflags::FlagSaver flag_saver;
+  FLAGS_cpu_instructions_sdm_num_parallel_requests = 1;
+  const InstructionSetProto serial_instruction_set =
+      internal::ProcessRequestsInOrder(kNumRequests,
+                                       MakeRequestInstructionSet);
+  std::vector<string> mnemonics;
+  for (const InstructionProto& instruction :
+       serial_instruction_set.instructions()) {
+    mnemonics.push_back(instruction.vendor_syntax().mnemonic());
+  }
+  EXPECT_THAT(mnemonics, ElementsAre("R0A", "R0B", "R1A", "R1B", "R2A", "R2B",
+                                     "R3A", "R3B", "R4A", "R4B", "R5A", "R5B"));
+  ASSERT_EQ(serial_instruction_set.source_infos_size(), kNumRequests);
+  for (size_t i = 0; i < kNumRequests; ++i) {
+    EXPECT_EQ(serial_instruction_set.source_infos(i).source_name(),
+              StrCat("request ", i));
+  }
+
+  for (const int num_parallel_requests : {2, 3, 6}) {
+    SCOPED_TRACE(StrCat("num_parallel_requests = ", num_parallel_requests));
+    FLAGS_cpu_instructions_sdm_num_parallel_requests = num_parallel_requests;
+    // The later requests finish first, so the merge order can not come from
+    // the completion order.
+    std::vector<std::atomic<int>> num_calls(kNumRequests);
+    for (auto& calls : num_calls) calls = 0;
+    const InstructionSetProto parallel_instruction_set =
+        internal::ProcessRequestsInOrder(kNumRequests, [&](size_t request_id) {
+          ++num_calls[request_id];
+          std::this_thread::sleep_for(
+              std::chrono::milliseconds(10 * (kNumRequests - request_id)));
+          return MakeRequestInstructionSet(request_id);
+        });
+    EXPECT_THAT(parallel_instruction_set, EqualsProto(serial_instruction_set));
+    for (size_t i = 0; i < kNumRequests; ++i) {
+      EXPECT_EQ(num_calls[i], 1) << "request " << i;
+    }
+  }
+}
+
+}  // namespace
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
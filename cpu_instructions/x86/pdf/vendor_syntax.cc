@@ -14,14 +14,13 @@
 
 #include "cpu_instructions/x86/pdf/vendor_syntax.h"
 
+#include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
-#include <vector>
 
+#include "cpu_instructions/util/fingerprint.h"
+#include "cpu_instructions/util/instruction_syntax.h"
 #include "glog/logging.h"
-#include "re2/re2.h"
-#include "strings/str_split.h"
-#include "strings/strip.h"
 #include "util/gtl/map_util.h"
 
 namespace cpu_instructions {
@@ -30,8 +29,6 @@ namespace pdf {
 
 namespace {
 
-using re2::StringPiece;
-
 // The list of operand names from the Intel encoding specification that are
 // accepted by the converter.
 // TODO(courbet): Generate these automatically.
@@ -132,12 +129,18 @@ const char* const kValidOperandTypes[] = {
     "k2/m8", "k2/m16", "k2/m32", "k2/m64",
 };
 
-string FixOperandName(const string& operand_name) {
+// Hashes the operand names without copying them.
+struct StringPieceHash {
+  size_t operator()(StringPiece text) const { return Fingerprint(text); }
+};
+
+// Returns the operand name to use for 'operand_name'.
+StringPiece FixOperandName(StringPiece operand_name) {
   // List of substitutions in operand names. Note that these substitutions are
   // only used to fix obvious typos and formatting errors in the manual.
   // Systematic inconsistencies are fixed by the transforms library.
   static const auto* const kOperandNameSubstitutions =
-      new std::unordered_map<string, string>({
+      new std::unordered_map<StringPiece, StringPiece, StringPieceHash>({
           {"imm8/r", "imm8"},
           {"r32/m161", "r32/m16"},
           {"r32/m32", "r/m32"},
@@ -153,57 +156,108 @@ string FixOperandName(const string& operand_name) {
 }
 
 // The vendor syntax has always the format [prefix] mnemonic op1, op2[, op3].
-// An operand can optionally be followed by up to two tags (e.g. "{k1}").
-const LazyRE2 kMnemonicRegexp = {
-    R"(\s*((?:REPN?[EZ]?\s+)?[A-Z0-9x]+)\s*)"};
-const LazyRE2 kOperandRegexp = {
-    R"(([^,{]+)(?:{([a-z0-9]+)})?\s*(?:{([a-z0-9]+)})?\s*,?\s*)"};
+// A mnemonic is made of upper case letters, digits and 'x', and the prefix is
+// one of the REP prefixes. An operand can optionally be followed by up to two
+// tags (e.g. "{k1}").
+bool IsMnemonicChar(char c) {
+  return (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == 'x';
+}
+
+bool IsTagChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9');
+}
+
+// Consumes the mnemonic and its REP prefix if any. Returns an empty string if
+// the input does not start with a mnemonic.
+StringPiece ConsumeMnemonic(InstructionSyntaxLexer* lexer) {
+  const InstructionSyntaxLexer start = *lexer;
+  const StringPiece word = lexer->ConsumeWhile(IsMnemonicChar);
+  for (const char* const prefix :
+       {"REP", "REPE", "REPZ", "REPN", "REPNE", "REPNZ"}) {
+    if (word != prefix) continue;
+    InstructionSyntaxLexer lookahead = *lexer;
+    const StringPiece space =
+        lookahead.ConsumeWhile(InstructionSyntaxLexer::IsWhitespace);
+    if (!space.empty() && !lookahead.ConsumeWhile(IsMnemonicChar).empty()) {
+      *lexer = lookahead;
+      return lexer->ConsumedSince(start);
+    }
+  }
+  return word;
+}
+
+// Consumes a tag, i.e. "{" [a-z0-9]+ "}". Returns an empty string and consumes
+// nothing if the input does not start with a tag.
+StringPiece ConsumeTag(InstructionSyntaxLexer* lexer) {
+  InstructionSyntaxLexer lookahead = *lexer;
+  if (!lookahead.ConsumeChar('{')) return StringPiece();
+  const StringPiece tag = lookahead.ConsumeWhile(IsTagChar);
+  if (tag.empty() || !lookahead.ConsumeChar('}')) return StringPiece();
+  *lexer = lookahead;
+  return tag;
+}
 
 }  // namespace
 
-bool ParseVendorSyntax(string content, InstructionFormat* instruction_format) {
+bool ParseVendorSyntax(StringPiece content,
+                       InstructionFormat* instruction_format) {
+  // The valid operand names, looked up without copying the operand names.
   static const auto* const kValidIntelOperandTypes =
-      new std::unordered_set<string>(std::begin(kValidOperandTypes),
-                                     std::end(kValidOperandTypes));
-  // Remove any asterisks (typically artifacts from notes).
-  content.erase(std::remove(content.begin(), content.end(), '*'),
-                content.end());
+      new std::unordered_set<StringPiece, StringPieceHash>(
+          std::begin(kValidOperandTypes), std::end(kValidOperandTypes));
+  // Remove any asterisks (typically artifacts from notes). The input is only
+  // copied when it has some.
+  string content_without_asterisks;
+  if (content.find('*') != StringPiece::npos) {
+    content_without_asterisks = content.ToString();
+    content_without_asterisks.erase(
+        std::remove(content_without_asterisks.begin(),
+                    content_without_asterisks.end(), '*'),
+        content_without_asterisks.end());
+    content = content_without_asterisks;
+  }
   instruction_format->Clear();
-  StringPiece input(content);
+  InstructionSyntaxLexer lexer(content);
 
-  if (!RE2::Consume(&input, *kMnemonicRegexp,
-                    instruction_format->mutable_mnemonic())) {
+  lexer.SkipWhitespace();
+  const StringPiece mnemonic = ConsumeMnemonic(&lexer);
+  if (mnemonic.empty()) {
     LOG(ERROR) << "Cannot parse instruction in vendor syntax '" << content
                << "'";
     return false;
   }
+  instruction_format->set_mnemonic(mnemonic.data(), mnemonic.size());
+  lexer.SkipWhitespace();
 
-  string operand_name;
-  string tag1;
-  string tag2;
-  while (RE2::Consume(&input, *kOperandRegexp, &operand_name, &tag1, &tag2)) {
-    StripWhitespace(&operand_name);
-    StripWhitespace(&tag1);
-    StripWhitespace(&tag2);
-    operand_name = FixOperandName(operand_name);
+  while (true) {
+    StringPiece operand_name = lexer.ConsumeUntil(",{", false);
+    if (operand_name.empty()) break;
+    const StringPiece tag1 = ConsumeTag(&lexer);
+    lexer.SkipWhitespace();
+    const StringPiece tag2 = ConsumeTag(&lexer);
+    lexer.SkipWhitespace();
+    lexer.ConsumeChar(',');
+    lexer.SkipWhitespace();
+    operand_name =
+        FixOperandName(InstructionSyntaxLexer::StripWhitespace(operand_name));
     if (!ContainsKey(*kValidIntelOperandTypes, operand_name)) {
       LOG(ERROR) << "Unknown operand '" << operand_name << "' while parsing '"
                  << content << "'";
       operand_name = kUnknown;
     }
     auto* const operand = instruction_format->add_operands();
-    operand->set_name(operand_name);
+    operand->set_name(operand_name.data(), operand_name.size());
     if (!tag1.empty()) {
-      operand->add_tags()->set_name(tag1);
+      operand->add_tags()->set_name(tag1.data(), tag1.size());
     }
     if (!tag2.empty()) {
-      operand->add_tags()->set_name(tag2);
+      operand->add_tags()->set_name(tag2.data(), tag2.size());
     }
   }
 
-  if (!input.empty()) {
+  if (!lexer.AtEnd()) {
     LOG(ERROR) << "Did not consume all input in vendor syntax '" << content
-               << "' remains '" << input << "'";
+               << "' remains '" << lexer.remaining() << "'";
     return false;
   }
   return true;
@@ -18,6 +18,7 @@
 #include "strings/string.h"
 
 #include "cpu_instructions/proto/instructions.pb.h"
+#include "strings/string_view.h"
 
 namespace cpu_instructions {
 namespace x86 {
@@ -26,7 +27,8 @@ namespace pdf {
 constexpr const char kUnknown[] = "<UNKNOWN>";
 
 // Parses the vendor syntax (e.g. "ADC r/m16, imm8").
-bool ParseVendorSyntax(string content, InstructionFormat* instruction_format);
+bool ParseVendorSyntax(StringPiece content,
+                       InstructionFormat* instruction_format);
 
 }  // namespace pdf
 }  // namespace x86
@@ -0,0 +1,88 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks the parsers of the vendor and assembly syntaxes.
+
+#include <vector>
+#include "strings/string.h"
+
+#include "benchmark/benchmark.h"
+#include "cpu_instructions/proto/instructions.pb.h"
+#include "cpu_instructions/util/instruction_syntax.h"
+#include "cpu_instructions/util/proto_util.h"
+#include "cpu_instructions/x86/pdf/vendor_syntax.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_string(cpu_instructions_syntax_benchmark_instructions, "",
+              "An InstructionSetProto in text format whose vendor syntaxes "
+              "are parsed by the benchmarks.");
+
+namespace cpu_instructions {
+namespace x86 {
+namespace pdf {
+namespace {
+
+// Returns the vendor syntaxes of the instructions of
+// --cpu_instructions_syntax_benchmark_instructions as strings.
+const std::vector<string>& GetSyntaxes() {
+  static const std::vector<string>* const syntaxes = []() {
+    CHECK(!FLAGS_cpu_instructions_syntax_benchmark_instructions.empty())
+        << "missing --cpu_instructions_syntax_benchmark_instructions";
+    const auto instruction_set = ReadTextProtoOrDie<InstructionSetProto>(
+        FLAGS_cpu_instructions_syntax_benchmark_instructions);
+    auto* const result = new std::vector<string>();
+    for (const InstructionProto& instruction : instruction_set.instructions()) {
+      result->push_back(ConvertToCodeString(instruction.vendor_syntax()));
+    }
+    CHECK(!result->empty());
+    return result;
+  }();
+  return *syntaxes;
+}
+
+void BM_ParseVendorSyntax(benchmark::State& state) {
+  const std::vector<string>& syntaxes = GetSyntaxes();
+  InstructionFormat instruction_format;
+  while (state.KeepRunning()) {
+    for (const string& syntax : syntaxes) {
+      benchmark::DoNotOptimize(ParseVendorSyntax(syntax, &instruction_format));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * syntaxes.size());
+}
+BENCHMARK(BM_ParseVendorSyntax);
+
+void BM_ParseAssemblyString(benchmark::State& state) {
+  const std::vector<string>& syntaxes = GetSyntaxes();
+  while (state.KeepRunning()) {
+    for (const string& syntax : syntaxes) {
+      benchmark::DoNotOptimize(ParseAssemblyStringOrDie(syntax));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * syntaxes.size());
+}
+BENCHMARK(BM_ParseAssemblyString);
+
+}  // namespace
+}  // namespace pdf
+}  // namespace x86
+}  // namespace cpu_instructions
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
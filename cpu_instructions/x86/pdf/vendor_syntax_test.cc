@@ -15,8 +15,11 @@
 #include "cpu_instructions/x86/pdf/vendor_syntax.h"
 
 #include "cpu_instructions/testing/test_util.h"
+#include "cpu_instructions/util/instruction_syntax.h"
+#include "cpu_instructions/util/proto_util.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "strings/str_cat.h"
 
 namespace cpu_instructions {
 namespace x86 {
@@ -111,6 +114,29 @@ TEST(ParseVendorSyntaxTest, Invalid) {
   EXPECT_FALSE(ParseVendorSyntax("  , xmm0", &vendor_syntax));
 }
 
+// The vendor and assembly parsers share their lexer; both must return the
+// vendor syntax of all the instructions of a parsed database from its string
+// representation.
+TEST(ParseVendorSyntaxTest, AgreesWithAssemblySyntax) {
+  const InstructionSetProto instruction_set =
+      ReadTextProtoOrDie<InstructionSetProto>(
+          StrCat(getenv("TEST_SRCDIR"), "/__main__/cpu_instructions/x86/pdf/",
+                 "testdata/253666_p170_p171_instructionset.pbtxt"));
+  ASSERT_GT(instruction_set.instructions_size(), 0);
+  for (const InstructionProto& instruction : instruction_set.instructions()) {
+    InstructionFormat expected;
+    expected.set_mnemonic(instruction.vendor_syntax().mnemonic());
+    for (const auto& operand : instruction.vendor_syntax().operands()) {
+      expected.add_operands()->set_name(operand.name());
+    }
+    const string code = ConvertToCodeString(expected);
+    InstructionFormat vendor_syntax;
+    EXPECT_TRUE(ParseVendorSyntax(code, &vendor_syntax)) << code;
+    EXPECT_THAT(vendor_syntax, EqualsProto(expected));
+    EXPECT_THAT(ParseAssemblyStringOrDie(code), EqualsProto(expected));
+  }
+}
+
 }  // namespace
 }  // namespace pdf
 }  // namespace x86